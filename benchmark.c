@@ -0,0 +1,542 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "benchmark.h"
+
+/* Must be bigger than the last level cache, so walking it evicts the lookup structures */
+#define BENCH_EVICT_BYTES (64 * 1024 * 1024)
+
+static const char *apszDistNames[BENCHDIST_MAX] = { "uniform", "prefix", "zipf", "trace", "host_neighbourhood" };
+static const char *apszPmuNames[BENCHPMU_MAX]   = { "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses" };
+
+static double      dTscGhz;
+static char       *pchEvictBuffer;
+
+/* splitmix64, so runs are reproducible and cover all 32 bits (glibc rand() only gives 31) */
+uint64_t BenchRandom(uint64_t *pu64State)
+{
+  uint64_t u64Z = (*pu64State += 0x9E3779B97F4A7C15ULL);
+
+  u64Z = (u64Z ^ (u64Z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  u64Z = (u64Z ^ (u64Z >> 27)) * 0x94D049BB133111EBULL;
+
+  return u64Z ^ (u64Z >> 31);
+}
+
+uint64_t BenchTicks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int uAux = 0;
+
+  _mm_lfence();
+  return __rdtscp(&uAux);
+#else
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+/* Milliseconds of CLOCK_MONOTONIC since pSooner */
+double BenchElapsedMs(struct timespec *pSooner)
+{
+  struct timespec later;
+  struct timespec diff;
+
+  clock_gettime(CLOCK_MONOTONIC, &later);
+  timediff(pSooner, &later, &diff);
+
+  return diff.tv_sec * 1000.0 + diff.tv_nsec / 1000000.0;
+}
+
+/* Calibrate the tick counter against the monotonic clock once */
+double BenchTscGhz(void)
+{
+  struct timespec sooner;
+  struct timespec later;
+  struct timespec diff;
+  uint64_t        u64Start = 0;
+  uint64_t        u64End   = 0;
+
+  if (dTscGhz > 0)
+  {
+    return dTscGhz;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  u64Start = BenchTicks();
+  do
+  {
+    clock_gettime(CLOCK_MONOTONIC, &later);
+    timediff(&sooner, &later, &diff);
+  } while (diff.tv_sec == 0 && diff.tv_nsec < 50000000);
+  u64End = BenchTicks();
+
+  dTscGhz = (double)(u64End - u64Start) / (double)(diff.tv_sec * 1000000000LL + diff.tv_nsec);
+
+  return dTscGhz;
+}
+
+const char *BenchDistName(BENCHDIST eDist)
+{
+  return eDist < BENCHDIST_MAX ? apszDistNames[eDist] : "unknown";
+}
+
+int BenchDistFromName(const char *pszName)
+{
+  int iIndex = 0;
+
+  for (iIndex = 0; iIndex < BENCHDIST_MAX; iIndex++)
+  {
+    if (!strcmp(pszName, apszDistNames[iIndex]))
+    {
+      return iIndex;
+    }
+  }
+
+  return -1;
+}
+
+static uint32_t RandomPrefixAddress(uint64_t *pu64State, PROUTEENTRY pRoutes, unsigned int uNumRoutes)
+{
+  PROUTEENTRY pRoute = NULL;
+
+  if (!uNumRoutes)
+  {
+    return (uint32_t)BenchRandom(pu64State);
+  }
+
+  pRoute = &pRoutes[BenchRandom(pu64State) % uNumRoutes];
+
+  return pRoute->u32Start + (uint32_t)(BenchRandom(pu64State) % pRoute->u32Size);
+}
+
+static uint32_t *ReadTraceFile(const char *pszTraceFile, unsigned int *puCount)
+{
+  FILE           *pFile     = NULL;
+  uint32_t       *pu32IPs   = NULL;
+  unsigned int    uCapacity = 0;
+  unsigned int    uCount    = 0;
+  char            achLine[256];
+  char            achAddress[64];
+  struct in_addr  ipAddr;
+
+  pFile = fopen(pszTraceFile, "r");
+  if (!pFile)
+  {
+    printf("Could not open trace file %s\n", pszTraceFile);
+    exit(1);
+  }
+
+  /* One address per line in dotted quad notation, anything after the address is ignored */
+  while (fgets(achLine, sizeof(achLine), pFile))
+  {
+    if (achLine[0] == '#' || sscanf(achLine, "%63s", achAddress) != 1 || !inet_aton(achAddress, &ipAddr))
+    {
+      continue;
+    }
+
+    if (uCount == uCapacity)
+    {
+      uCapacity = uCapacity ? uCapacity * 2 : 4096;
+      pu32IPs   = realloc(pu32IPs, uCapacity * sizeof(*pu32IPs));
+      if (!pu32IPs)
+      {
+        printf("Can't allocate trace address list\n");
+        exit(1);
+      }
+    }
+    pu32IPs[uCount++] = ntohl(ipAddr.s_addr);
+  }
+  fclose(pFile);
+
+  if (!uCount)
+  {
+    printf("No addresses in trace file %s\n", pszTraceFile);
+    exit(1);
+  }
+
+  *puCount = uCount;
+  return pu32IPs;
+}
+
+/* Addresses in the /24s around host routes, where a trie with its /32s needs level 3 chunks.
+   Returns 0 if the table has no /32s. */
+static unsigned int HostNeighbourhoodAddresses(uint64_t *pu64State, uint32_t *pu32IPs, unsigned int uCount,
+                                               PROUTEENTRY pRoutes, unsigned int uNumRoutes)
+{
+  uint32_t     *pu32Hosts = NULL;
+  unsigned int  uHosts    = 0;
+  unsigned int  uIndex    = 0;
+
+  pu32Hosts = malloc((uNumRoutes ? uNumRoutes : 1) * sizeof(*pu32Hosts));
+  if (!pu32Hosts)
+  {
+    printf("Can't allocate host route list\n");
+    exit(1);
+  }
+  for (uIndex = 0; uIndex < uNumRoutes; uIndex++)
+  {
+    if (pRoutes[uIndex].u32Size == 1)
+    {
+      pu32Hosts[uHosts++] = pRoutes[uIndex].u32Start;
+    }
+  }
+
+  for (uIndex = 0; uHosts && uIndex < uCount; uIndex++)
+  {
+    uint64_t u64Random = BenchRandom(pu64State);
+
+    pu32IPs[uIndex] = (pu32Hosts[(u64Random >> 8) % uHosts] & 0xFFFFFF00) | (u64Random & 0xFF);
+  }
+
+  free(pu32Hosts);
+  return uHosts;
+}
+
+/* Returns an allocated array of *puCount addresses. For traces *puCount is set to the trace length. */
+uint32_t *BenchGenerateAddresses(BENCHDIST eDist, unsigned int *puCount, PROUTEENTRY pRoutes, unsigned int uNumRoutes,
+                                 double dZipfSkew, const char *pszTraceFile)
+{
+  uint32_t    *pu32IPs     = NULL;
+  uint32_t    *pu32HotSet  = NULL;
+  double      *pdCumulative = NULL;
+  uint64_t     u64State    = 100; /* Always use the same seed so that benchmark is reproducible. */
+  unsigned int uIndex      = 0;
+
+  if (eDist == BENCHDIST_TRACE)
+  {
+    return ReadTraceFile(pszTraceFile, puCount);
+  }
+
+  pu32IPs = calloc(*puCount, sizeof(*pu32IPs));
+  if (!pu32IPs)
+  {
+    printf("Can't allocate benchmark IP list\n");
+    exit(1);
+  }
+
+  switch (eDist)
+  {
+    case BENCHDIST_HOSTS:
+      if (HostNeighbourhoodAddresses(&u64State, pu32IPs, *puCount, pRoutes, uNumRoutes))
+      {
+        break;
+      }
+      /* Fall through */
+    case BENCHDIST_PREFIX:
+      for (uIndex = 0; uIndex < *puCount; uIndex++)
+      {
+        pu32IPs[uIndex] = RandomPrefixAddress(&u64State, pRoutes, uNumRoutes);
+      }
+      break;
+
+    case BENCHDIST_ZIPF:
+    {
+      double dTotal = 0;
+
+      pu32HotSet   = calloc(BENCH_ZIPF_HOTSET, sizeof(*pu32HotSet));
+      pdCumulative = calloc(BENCH_ZIPF_HOTSET, sizeof(*pdCumulative));
+      if (!pu32HotSet || !pdCumulative)
+      {
+        printf("Can't allocate zipf hot set\n");
+        exit(1);
+      }
+
+      /* Rank k gets weight 1/k^s */
+      for (uIndex = 0; uIndex < BENCH_ZIPF_HOTSET; uIndex++)
+      {
+        pu32HotSet[uIndex]   = RandomPrefixAddress(&u64State, pRoutes, uNumRoutes);
+        dTotal              += 1.0 / pow(uIndex + 1, dZipfSkew);
+        pdCumulative[uIndex] = dTotal;
+      }
+
+      for (uIndex = 0; uIndex < *puCount; uIndex++)
+      {
+        double       dDraw = (double)(BenchRandom(&u64State) >> 11) / (double)(1ULL << 53) * dTotal;
+        unsigned int uLow  = 0;
+        unsigned int uHigh = BENCH_ZIPF_HOTSET - 1;
+
+        while (uLow < uHigh)
+        {
+          unsigned int uMid = (uLow + uHigh) / 2;
+
+          if (pdCumulative[uMid] < dDraw)
+          {
+            uLow = uMid + 1;
+          }
+          else
+          {
+            uHigh = uMid;
+          }
+        }
+        pu32IPs[uIndex] = pu32HotSet[uLow];
+      }
+
+      free(pu32HotSet);
+      free(pdCumulative);
+      break;
+    }
+
+    case BENCHDIST_UNIFORM:
+    default:
+      for (uIndex = 0; uIndex < *puCount; uIndex++)
+      {
+        pu32IPs[uIndex] = (uint32_t)BenchRandom(&u64State);
+      }
+      break;
+  }
+
+  return pu32IPs;
+}
+
+static int OpenPmuCounter(BENCHPMU eCounter)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.disabled       = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+
+  switch (eCounter)
+  {
+    case BENCHPMU_CYCLES:
+      attr.type   = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case BENCHPMU_INSTRUCTIONS:
+      attr.type   = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case BENCHPMU_L1D_MISSES:
+      attr.type   = PERF_TYPE_HW_CACHE;
+      attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+    case BENCHPMU_LLC_MISSES:
+      attr.type   = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_CACHE_MISSES;
+      break;
+    case BENCHPMU_BRANCH_MISSES:
+    default:
+      attr.type   = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+      break;
+  }
+
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void EnablePmu(int *piFds, int bEnable)
+{
+  int iIndex = 0;
+
+  for (iIndex = 0; iIndex < BENCHPMU_MAX; iIndex++)
+  {
+    if (piFds[iIndex] >= 0)
+    {
+      ioctl(piFds[iIndex], bEnable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+}
+
+static void EvictCaches(void)
+{
+  volatile char *pchEvict = NULL;
+  unsigned int   uIndex   = 0;
+  char           chSum    = 0;
+
+  if (!pchEvictBuffer)
+  {
+    pchEvictBuffer = malloc(BENCH_EVICT_BYTES);
+    if (!pchEvictBuffer)
+    {
+      printf("Can't allocate cache eviction buffer\n");
+      exit(1);
+    }
+    memset(pchEvictBuffer, 1, BENCH_EVICT_BYTES);
+  }
+
+  pchEvict = pchEvictBuffer;
+  for (uIndex = 0; uIndex < BENCH_EVICT_BYTES; uIndex += 64)
+  {
+    chSum += pchEvict[uIndex];
+  }
+  pchEvict[0] = chSum;
+}
+
+static int CompareDouble(const void *pA, const void *pB)
+{
+  double dA = *(const double *)pA;
+  double dB = *(const double *)pB;
+
+  return (dA > dB) - (dA < dB);
+}
+
+static double Percentile(double *pdSorted, unsigned int uCount, double dPercentile)
+{
+  unsigned int uIndex = (unsigned int)(dPercentile / 100.0 * (uCount - 1) + 0.5);
+
+  return pdSorted[uIndex];
+}
+
+void BenchRun(const char *pszEngine, BENCHLOOKUP fpLookup, const uint32_t *pu32IPs, unsigned int uCount,
+              BENCHDIST eDist, int bCold, PBENCHRESULT pResult)
+{
+  uint32_t     au32Results[BENCH_BATCH];
+  int          aiFds[BENCHPMU_MAX];
+  uint64_t     u64Value     = 0;
+  uint64_t     u64Start     = 0;
+  double      *pdSamples    = NULL;
+  double       dTotalNs     = 0;
+  double       dGhz         = BenchTscGhz();
+  unsigned int uNumBatches  = uCount / BENCH_BATCH;
+  unsigned int uIndex       = 0;
+
+  if (bCold && uNumBatches > BENCH_COLD_BATCHES)
+  {
+    uNumBatches = BENCH_COLD_BATCHES;
+  }
+  if (!uNumBatches)
+  {
+    printf("Need at least %d addresses to benchmark\n", BENCH_BATCH);
+    exit(1);
+  }
+
+  pdSamples = calloc(uNumBatches, sizeof(*pdSamples));
+  if (!pdSamples)
+  {
+    printf("Can't allocate benchmark samples\n");
+    exit(1);
+  }
+
+  memset(pResult, 0, sizeof(*pResult));
+  pResult->pszEngine = pszEngine;
+  pResult->eDist     = eDist;
+  pResult->bCold     = bCold;
+  pResult->uLookups  = uNumBatches * BENCH_BATCH;
+
+  for (uIndex = 0; uIndex < BENCHPMU_MAX; uIndex++)
+  {
+    aiFds[uIndex] = OpenPmuCounter(uIndex);
+  }
+
+  if (!bCold)
+  {
+    /* Warm up caches and branch predictors with one untimed pass */
+    for (uIndex = 0; uIndex < uNumBatches; uIndex++)
+    {
+      fpLookup(pu32IPs + uIndex * BENCH_BATCH, au32Results, BENCH_BATCH);
+    }
+    EnablePmu(aiFds, 1);
+  }
+
+  for (uIndex = 0; uIndex < uNumBatches; uIndex++)
+  {
+    if (bCold)
+    {
+      EvictCaches();
+      EnablePmu(aiFds, 1);
+    }
+
+    u64Start = BenchTicks();
+    fpLookup(pu32IPs + uIndex * BENCH_BATCH, au32Results, BENCH_BATCH);
+    pdSamples[uIndex] = (double)(BenchTicks() - u64Start) / dGhz / BENCH_BATCH;
+
+    if (bCold)
+    {
+      EnablePmu(aiFds, 0);
+    }
+    dTotalNs += pdSamples[uIndex] * BENCH_BATCH;
+  }
+  EnablePmu(aiFds, 0);
+
+  for (uIndex = 0; uIndex < BENCHPMU_MAX; uIndex++)
+  {
+    pResult->adPmuPerLookup[uIndex] = -1;
+    if (aiFds[uIndex] >= 0)
+    {
+      if (read(aiFds[uIndex], &u64Value, sizeof(u64Value)) == sizeof(u64Value))
+      {
+        pResult->adPmuPerLookup[uIndex] = (double)u64Value / pResult->uLookups;
+      }
+      close(aiFds[uIndex]);
+    }
+  }
+
+  qsort(pdSamples, uNumBatches, sizeof(*pdSamples), CompareDouble);
+  pResult->dMeanNs         = dTotalNs / pResult->uLookups;
+  pResult->dMinNs          = pdSamples[0];
+  pResult->dP50Ns          = Percentile(pdSamples, uNumBatches, 50);
+  pResult->dP90Ns          = Percentile(pdSamples, uNumBatches, 90);
+  pResult->dP99Ns          = Percentile(pdSamples, uNumBatches, 99);
+  pResult->dP999Ns         = Percentile(pdSamples, uNumBatches, 99.9);
+  pResult->dMaxNs          = pdSamples[uNumBatches - 1];
+  pResult->dMLookupsPerSec = dTotalNs > 0 ? pResult->uLookups / dTotalNs * 1000.0 : 0;
+
+  free(pdSamples);
+}
+
+void BenchPrintJsonResult(FILE *pFile, PBENCHRESULT pResult, int bLast)
+{
+  int iIndex = 0;
+
+  fprintf(pFile, "    {\n");
+  fprintf(pFile, "      \"engine\": \"%s\",\n", pResult->pszEngine);
+  fprintf(pFile, "      \"distribution\": \"%s\",\n", BenchDistName(pResult->eDist));
+  fprintf(pFile, "      \"cache\": \"%s\",\n", pResult->bCold ? "cold" : "warm");
+  fprintf(pFile, "      \"lookups\": %u,\n", pResult->uLookups);
+  fprintf(pFile, "      \"mlookups_per_sec\": %.3f,\n", pResult->dMLookupsPerSec);
+  fprintf(pFile, "      \"ns_per_lookup\": { \"mean\": %.3f, \"min\": %.3f, \"p50\": %.3f, \"p90\": %.3f, "
+                 "\"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f },\n",
+          pResult->dMeanNs, pResult->dMinNs, pResult->dP50Ns, pResult->dP90Ns,
+          pResult->dP99Ns, pResult->dP999Ns, pResult->dMaxNs);
+  fprintf(pFile, "      \"pmu_per_lookup\": {");
+  for (iIndex = 0; iIndex < BENCHPMU_MAX; iIndex++)
+  {
+    if (pResult->adPmuPerLookup[iIndex] < 0)
+    {
+      fprintf(pFile, " \"%s\": null", apszPmuNames[iIndex]);
+    }
+    else
+    {
+      fprintf(pFile, " \"%s\": %.4f", apszPmuNames[iIndex], pResult->adPmuPerLookup[iIndex]);
+    }
+    fprintf(pFile, "%s", iIndex + 1 < BENCHPMU_MAX ? "," : " }\n");
+  }
+  fprintf(pFile, "    }%s\n", bLast ? "" : ",");
+}
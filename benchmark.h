@@ -0,0 +1,91 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "routing_table_split.h"
+
+typedef enum tagBENCHDIST
+{
+  BENCHDIST_UNIFORM = 0, /* Uniform over the whole 32 bit address space */
+  BENCHDIST_PREFIX,      /* Random address inside a randomly picked announced prefix */
+  BENCHDIST_ZIPF,        /* Zipf skewed draws from a hot set of announced addresses */
+  BENCHDIST_TRACE,       /* Replay of a recorded address trace file */
+  BENCHDIST_HOSTS,       /* Random address in the /24 of a random /32, prefix if there are none */
+  BENCHDIST_MAX
+} BENCHDIST;
+
+typedef enum tagBENCHPMU
+{
+  BENCHPMU_CYCLES = 0,
+  BENCHPMU_INSTRUCTIONS,
+  BENCHPMU_L1D_MISSES,
+  BENCHPMU_LLC_MISSES,
+  BENCHPMU_BRANCH_MISSES,
+  BENCHPMU_MAX
+} BENCHPMU;
+
+/* Number of lookups timed together in one rdtsc sample */
+#define BENCH_BATCH        (64)
+/* Cold runs evict the caches before every batch, so only sample this many */
+#define BENCH_COLD_BATCHES (512)
+#define BENCH_ZIPF_HOTSET  (65536)
+
+/* Looks up uCount addresses. Results are stored so the lookups can't be optimized away. */
+typedef void (*BENCHLOOKUP)(const uint32_t *pu32IPs, uint32_t *pu32Results, unsigned int uCount);
+
+typedef struct tagBENCHRESULT
+{
+  const char  *pszEngine;
+  BENCHDIST    eDist;
+  int          bCold;
+  unsigned int uLookups;
+
+  /* Nanoseconds per lookup, from the per batch samples */
+  double       dMeanNs;
+  double       dMinNs;
+  double       dP50Ns;
+  double       dP90Ns;
+  double       dP99Ns;
+  double       dP999Ns;
+  double       dMaxNs;
+  double       dMLookupsPerSec;
+
+  /* Counter value per lookup, or negative if the counter could not be opened */
+  double       adPmuPerLookup[BENCHPMU_MAX];
+} BENCHRESULT, *PBENCHRESULT;
+
+uint64_t    BenchRandom(uint64_t *pu64State);
+double      BenchTscGhz(void);
+uint64_t    BenchTicks(void);
+double      BenchElapsedMs(struct timespec *pSooner);
+const char *BenchDistName(BENCHDIST eDist);
+int         BenchDistFromName(const char *pszName);
+
+uint32_t   *BenchGenerateAddresses(BENCHDIST eDist, unsigned int *puCount, PROUTEENTRY pRoutes, unsigned int uNumRoutes,
+                                   double dZipfSkew, const char *pszTraceFile);
+
+void        BenchRun(const char *pszEngine, BENCHLOOKUP fpLookup, const uint32_t *pu32IPs, unsigned int uCount,
+                     BENCHDIST eDist, int bCold, PBENCHRESULT pResult);
+
+void        BenchPrintJsonResult(FILE *pFile, PBENCHRESULT pResult, int bLast);
+
+#endif /* __BENCHMARK_H__ */
@@ -0,0 +1,599 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bgp_rib.h"
+#include "nexthop.h"
+
+#define RIB_WIDE_LENGTH (12)   /* Prefixes shorter than this cover more than one bucket group */
+
+static void *GrowArray(void *pArray, unsigned int uCount, size_t uSize)
+{
+  void *pGrown = realloc(pArray, uCount * uSize);
+
+  if (!pGrown)
+  {
+    printf("Can't grow routing information base\n");
+    exit(1);
+  }
+
+  return pGrown;
+}
+
+static uint32_t SlotHash(uint32_t u32Start, unsigned int uLength, uint32_t u32Mask)
+{
+  return ((u32Start ^ (uLength * 0x01000193U)) * 0x9E3779B1U) & u32Mask;
+}
+
+/* Slot of the prefix, or of the empty slot it would go in */
+static uint32_t FindSlot(PRIB pRib, uint32_t u32Start, unsigned int uLength)
+{
+  uint32_t u32Slot = SlotHash(u32Start, uLength, pRib->u32SlotMask);
+
+  while (pRib->pu32Slots[u32Slot] != RIB_NO_INDEX)
+  {
+    uint32_t u32Index = pRib->pu32Slots[u32Slot];
+
+    if (pRib->pNextHops[u32Index].u32Start == u32Start && pRib->pPrefixes[u32Index].u8Length == uLength)
+    {
+      break;
+    }
+    u32Slot = (u32Slot + 1) & pRib->u32SlotMask;
+  }
+
+  return u32Slot;
+}
+
+static void Rehash(PRIB pRib, uint32_t u32NumSlots)
+{
+  uint32_t     *pu32Old     = pRib->pu32Slots;
+  uint32_t      u32OldMask  = pRib->u32SlotMask;
+  uint32_t      u32Slot     = 0;
+
+  pRib->pu32Slots   = malloc(u32NumSlots * sizeof(*pRib->pu32Slots));
+  pRib->u32SlotMask = u32NumSlots - 1;
+  if (!pRib->pu32Slots)
+  {
+    printf("Can't allocate prefix hash table\n");
+    exit(1);
+  }
+  memset(pRib->pu32Slots, 0xFF, u32NumSlots * sizeof(*pRib->pu32Slots));
+
+  for (u32Slot = 0; pu32Old && u32Slot <= u32OldMask; u32Slot++)
+  {
+    uint32_t u32Index = pu32Old[u32Slot];
+
+    if (u32Index != RIB_NO_INDEX)
+    {
+      pRib->pu32Slots[FindSlot(pRib, pRib->pNextHops[u32Index].u32Start, pRib->pPrefixes[u32Index].u8Length)] = u32Index;
+    }
+  }
+  free(pu32Old);
+}
+
+/* Linear probing without tombstones: close the gap by moving later entries of the cluster back */
+static void RemoveSlot(PRIB pRib, uint32_t u32Slot)
+{
+  uint32_t u32Next = (u32Slot + 1) & pRib->u32SlotMask;
+
+  pRib->pu32Slots[u32Slot] = RIB_NO_INDEX;
+  while (pRib->pu32Slots[u32Next] != RIB_NO_INDEX)
+  {
+    uint32_t u32Index = pRib->pu32Slots[u32Next];
+    uint32_t u32Home  = SlotHash(pRib->pNextHops[u32Index].u32Start, pRib->pPrefixes[u32Index].u8Length, pRib->u32SlotMask);
+
+    /* Move it if its home is not in the cyclic range (u32Slot, u32Next] */
+    if (((u32Next - u32Home) & pRib->u32SlotMask) >= ((u32Next - u32Slot) & pRib->u32SlotMask))
+    {
+      pRib->pu32Slots[u32Slot] = u32Index;
+      pRib->pu32Slots[u32Next] = RIB_NO_INDEX;
+      u32Slot = u32Next;
+    }
+    u32Next = (u32Next + 1) & pRib->u32SlotMask;
+  }
+}
+
+void RibInit(PRIB pRib)
+{
+  memset(pRib, 0, sizeof(*pRib));
+  memset(pRib->au32GroupHeads, 0xFF, sizeof(pRib->au32GroupHeads));
+  Rehash(pRib, 65536);
+}
+
+void RibFree(PRIB pRib)
+{
+  free(pRib->pNextHops);
+  free(pRib->pPrefixes);
+  free(pRib->pu32Slots);
+  free(pRib->pu32Free);
+  free(pRib->pu32Retired);
+  free(pRib->pu32GroupNext);
+  free(pRib->pu32GroupPrev);
+  free(pRib->pu32Wide);
+  memset(pRib, 0, sizeof(*pRib));
+}
+
+static void MarkDirty(PRIB pRib, uint32_t u32Start, uint32_t u32Size)
+{
+  uint32_t u32Group = u32Start >> 20;
+  uint32_t u32Last  = (u32Start + (u32Size - 1)) >> 20;
+
+  for (; u32Group <= u32Last; u32Group++)
+  {
+    pRib->au64DirtyGroups[u32Group / 64] |= 1ULL << (u32Group % 64);
+  }
+}
+
+static uint32_t AddPrefix(PRIB pRib, uint32_t u32Slot, uint32_t u32Start, uint32_t u32Size, unsigned int uLength)
+{
+  uint32_t u32Index = 0;
+
+  if (pRib->uNumFree)
+  {
+    u32Index = pRib->pu32Free[--pRib->uNumFree];
+  }
+  else
+  {
+    if (pRib->uNumIndexes == pRib->uCapacity)
+    {
+      pRib->uCapacity     = pRib->uCapacity ? pRib->uCapacity * 2 : 65536;
+      pRib->pNextHops     = GrowArray(pRib->pNextHops, pRib->uCapacity, sizeof(*pRib->pNextHops));
+      pRib->pPrefixes     = GrowArray(pRib->pPrefixes, pRib->uCapacity, sizeof(*pRib->pPrefixes));
+      pRib->pu32GroupNext = GrowArray(pRib->pu32GroupNext, pRib->uCapacity, sizeof(*pRib->pu32GroupNext));
+      pRib->pu32GroupPrev = GrowArray(pRib->pu32GroupPrev, pRib->uCapacity, sizeof(*pRib->pu32GroupPrev));
+      /* Every index can be free or retired at once */
+      pRib->pu32Free      = GrowArray(pRib->pu32Free, pRib->uCapacity, sizeof(*pRib->pu32Free));
+      pRib->pu32Retired   = GrowArray(pRib->pu32Retired, pRib->uCapacity, sizeof(*pRib->pu32Retired));
+    }
+    u32Index = pRib->uNumIndexes++;
+  }
+
+  memset(&pRib->pNextHops[u32Index], 0, sizeof(pRib->pNextHops[u32Index]));
+  memset(&pRib->pPrefixes[u32Index], 0, sizeof(pRib->pPrefixes[u32Index]));
+  pRib->pNextHops[u32Index].u32Start        = u32Start;
+  pRib->pNextHops[u32Index].u32Size         = u32Size;
+  pRib->pNextHops[u32Index].u32NextHopIndex = u32Index;
+  pRib->pNextHops[u32Index].u32PathList     = NO_PATH_LIST;
+  pRib->pPrefixes[u32Index].u8Length        = uLength;
+
+  pRib->pu32Slots[u32Slot] = u32Index;
+  pRib->uNumLive++;
+
+  if (uLength >= RIB_WIDE_LENGTH)
+  {
+    uint32_t u32Group = u32Start >> 20;
+
+    pRib->pu32GroupPrev[u32Index] = RIB_NO_INDEX;
+    pRib->pu32GroupNext[u32Index] = pRib->au32GroupHeads[u32Group];
+    if (pRib->au32GroupHeads[u32Group] != RIB_NO_INDEX)
+    {
+      pRib->pu32GroupPrev[pRib->au32GroupHeads[u32Group]] = u32Index;
+    }
+    pRib->au32GroupHeads[u32Group] = u32Index;
+  }
+  else
+  {
+    if (pRib->uNumWide == pRib->uWideCapacity)
+    {
+      pRib->uWideCapacity = pRib->uWideCapacity ? pRib->uWideCapacity * 2 : 256;
+      pRib->pu32Wide      = GrowArray(pRib->pu32Wide, pRib->uWideCapacity, sizeof(*pRib->pu32Wide));
+    }
+    pRib->pu32Wide[pRib->uNumWide++] = u32Index;
+  }
+
+  MarkDirty(pRib, u32Start, u32Size);
+  pRib->u64PrefixesAdded++;
+
+  return u32Index;
+}
+
+/* The slot keeps its path list until the index is reused, lookups on the current image still
+   forward with it */
+static void RemovePrefix(PRIB pRib, uint32_t u32Slot)
+{
+  uint32_t     u32Index = pRib->pu32Slots[u32Slot];
+  PROUTEENTRY  pRoute   = &pRib->pNextHops[u32Index];
+  unsigned int uWide    = 0;
+
+  RemoveSlot(pRib, u32Slot);
+  MarkDirty(pRib, pRoute->u32Start, pRoute->u32Size);
+
+  if (pRib->pPrefixes[u32Index].u8Length >= RIB_WIDE_LENGTH)
+  {
+    uint32_t u32Prev = pRib->pu32GroupPrev[u32Index];
+    uint32_t u32Next = pRib->pu32GroupNext[u32Index];
+
+    if (u32Prev != RIB_NO_INDEX)
+    {
+      pRib->pu32GroupNext[u32Prev] = u32Next;
+    }
+    else
+    {
+      pRib->au32GroupHeads[pRoute->u32Start >> 20] = u32Next;
+    }
+    if (u32Next != RIB_NO_INDEX)
+    {
+      pRib->pu32GroupPrev[u32Next] = u32Prev;
+    }
+  }
+  else
+  {
+    for (uWide = 0; pRib->pu32Wide[uWide] != u32Index; uWide++)
+    {
+    }
+    pRib->pu32Wide[uWide] = pRib->pu32Wide[--pRib->uNumWide];
+  }
+
+  pRoute->u32Size = 0;
+  pRib->pu32Retired[pRib->uNumRetired++] = u32Index;
+  pRib->uNumLive--;
+  pRib->u64PrefixesRemoved++;
+}
+
+/* Path list of the best paths, and the ECMP group of the ones tied for the shortest AS path,
+   the same selection ReadFromBgpDump() makes */
+static void SelectPaths(PRIB pRib, uint32_t u32Index)
+{
+  PRIBPREFIX   pPrefix = &pRib->pPrefixes[u32Index];
+  uint32_t     au32Paths[NEXTHOP_MAX_PATHS];
+  uint32_t     au32Members[ECMP_MAX_MEMBERS];
+  unsigned int uNumPaths   = 0;
+  unsigned int uNumMembers = 0;
+  unsigned int uPath       = 0;
+  unsigned int uOther      = 0;
+  uint32_t     u32PathList = 0;
+  uint32_t     u32Group    = 0;
+
+  for (uPath = 0; uPath < pPrefix->u8NumPaths; uPath++)
+  {
+    uint32_t u32Adjacency = pPrefix->aPaths[uPath].u32Adjacency;
+
+    for (uOther = 0; uOther < uNumPaths && au32Paths[uOther] != u32Adjacency; uOther++)
+    {
+    }
+    if (uOther == uNumPaths && uNumPaths < NEXTHOP_MAX_PATHS)
+    {
+      au32Paths[uNumPaths++] = u32Adjacency;
+    }
+
+    if (pPrefix->aPaths[uPath].u16PathLength != pPrefix->aPaths[0].u16PathLength)
+    {
+      continue;
+    }
+    for (uOther = 0; uOther < uNumMembers && au32Members[uOther] != u32Adjacency; uOther++)
+    {
+    }
+    if (uOther == uNumMembers && uNumMembers < ECMP_MAX_MEMBERS)
+    {
+      au32Members[uNumMembers++] = u32Adjacency;
+    }
+  }
+
+  u32PathList = NextHopAddPathList(au32Paths, uNumPaths);
+  u32Group    = NextHopAddGroup(au32Members, uNumMembers);
+  if (pRib->pNextHops[u32Index].u32PathList != NO_PATH_LIST &&
+      (pRib->pNextHops[u32Index].u32PathList != u32PathList || pRib->pNextHops[u32Index].u32Group != u32Group))
+  {
+    pRib->u64PathChanges++;
+  }
+
+  /* Forwarding through the result index picks the new paths up right away, no rebuild needed */
+  __atomic_store_n(&pRib->pNextHops[u32Index].u32PathList, u32PathList, __ATOMIC_RELAXED);
+  __atomic_store_n(&pRib->pNextHops[u32Index].u32Group, u32Group, __ATOMIC_RELAXED);
+}
+
+static int RemovePath(PRIBPREFIX pPrefix, uint32_t u32Peer)
+{
+  unsigned int uPath = 0;
+
+  for (uPath = 0; uPath < pPrefix->u8NumPaths; uPath++)
+  {
+    if (pPrefix->aPaths[uPath].u16Peer == u32Peer)
+    {
+      memmove(&pPrefix->aPaths[uPath], &pPrefix->aPaths[uPath + 1], (pPrefix->u8NumPaths - uPath - 1) * sizeof(RIBPATH));
+      pPrefix->u8NumPaths--;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static int InsertPath(PRIBPREFIX pPrefix, const RIBPATH *pPath)
+{
+  unsigned int uInsert = pPrefix->u8NumPaths;
+
+  while (uInsert > 0)
+  {
+    const RIBPATH *pOther = &pPrefix->aPaths[uInsert - 1];
+
+    if (pOther->u16PathLength < pPath->u16PathLength ||
+        (pOther->u16PathLength == pPath->u16PathLength && pOther->u16Peer <= pPath->u16Peer))
+    {
+      break;
+    }
+    uInsert--;
+  }
+
+  if (uInsert == RIB_MAX_PATHS)
+  {
+    return 0;
+  }
+
+  memmove(&pPrefix->aPaths[uInsert + 1], &pPrefix->aPaths[uInsert],
+          ((pPrefix->u8NumPaths < RIB_MAX_PATHS ? pPrefix->u8NumPaths : RIB_MAX_PATHS - 1) - uInsert) * sizeof(RIBPATH));
+  pPrefix->aPaths[uInsert] = *pPath;
+  if (pPrefix->u8NumPaths < RIB_MAX_PATHS)
+  {
+    pPrefix->u8NumPaths++;
+  }
+
+  return 1;
+}
+
+static int ApplyToPrefix(PRIB pRib, const BGPEVENT *pEvent, uint32_t u32Start, uint32_t u32Size)
+{
+  uint32_t   u32Slot  = 0;
+  uint32_t   u32Index = 0;
+  PRIBPREFIX pPrefix  = NULL;
+  RIBPATH    path     = { 0 };
+  int        bChanged = 0;
+
+  /* Keep the hash table at most half full */
+  if ((pRib->uNumLive + 1) * 2 > pRib->u32SlotMask + 1)
+  {
+    Rehash(pRib, (pRib->u32SlotMask + 1) * 2);
+  }
+
+  u32Slot  = FindSlot(pRib, u32Start, pEvent->uLength);
+  u32Index = pRib->pu32Slots[u32Slot];
+
+  if (pEvent->bWithdraw)
+  {
+    if (u32Index == RIB_NO_INDEX || !RemovePath(&pRib->pPrefixes[u32Index], pEvent->u32Peer))
+    {
+      pRib->u64Ignored++;
+      return 0;
+    }
+    if (!pRib->pPrefixes[u32Index].u8NumPaths)
+    {
+      RemovePrefix(pRib, u32Slot);
+      return 1;
+    }
+    SelectPaths(pRib, u32Index);
+    return 0;
+  }
+
+  if (u32Index == RIB_NO_INDEX)
+  {
+    u32Index = AddPrefix(pRib, u32Slot, u32Start, u32Size, pEvent->uLength);
+    bChanged = 1;
+  }
+  pPrefix = &pRib->pPrefixes[u32Index];
+
+  /* An announcement replaces what the peer announced before */
+  RemovePath(pPrefix, pEvent->u32Peer);
+  path.u32Adjacency  = NextHopAddAdjacency(pEvent->u32Peer, pEvent->u32Gateway);
+  path.u16Peer       = pEvent->u32Peer;
+  path.u16PathLength = pEvent->uPathLength < UINT16_MAX ? pEvent->uPathLength : UINT16_MAX;
+  if (!InsertPath(pPrefix, &path))
+  {
+    pRib->u64PathsDropped++;
+  }
+
+  if (!pPrefix->u8NumPaths)
+  {
+    /* Only when a new prefix's only path didn't fit, which can't happen, but keep it consistent */
+    RemovePrefix(pRib, u32Slot);
+    return bChanged;
+  }
+  SelectPaths(pRib, u32Index);
+
+  return bChanged;
+}
+
+/* Implicit withdraw of every path of the peer. Runs over all prefixes, but sessions go down
+   rarely next to the updates. */
+static int PeerDown(PRIB pRib, uint32_t u32Peer)
+{
+  uint32_t u32Index = 0;
+  int      bChanged = 0;
+
+  pRib->u64PeerDowns++;
+  for (u32Index = 0; u32Index < pRib->uNumIndexes; u32Index++)
+  {
+    if (!pRib->pNextHops[u32Index].u32Size || !RemovePath(&pRib->pPrefixes[u32Index], u32Peer))
+    {
+      continue;
+    }
+    pRib->u64PeerPaths++;
+    if (!pRib->pPrefixes[u32Index].u8NumPaths)
+    {
+      RemovePrefix(pRib, FindSlot(pRib, pRib->pNextHops[u32Index].u32Start, pRib->pPrefixes[u32Index].u8Length));
+      bChanged = 1;
+      continue;
+    }
+    SelectPaths(pRib, u32Index);
+  }
+
+  return bChanged;
+}
+
+int RibApply(PRIB pRib, const BGPEVENT *pEvent)
+{
+  uint32_t u32Start = 0;
+  int      bChanged = 0;
+
+  if (pEvent->bPeerDown)
+  {
+    return pEvent->u32Peer <= UINT16_MAX ? PeerDown(pRib, pEvent->u32Peer) : 0;
+  }
+
+  if (pEvent->uLength > 32 || pEvent->u32Peer > UINT16_MAX)
+  {
+    pRib->u64Ignored++;
+    return 0;
+  }
+
+  if (pEvent->bWithdraw)
+  {
+    pRib->u64Withdrawals++;
+  }
+  else
+  {
+    pRib->u64Announcements++;
+  }
+
+  if (pEvent->uLength == 0)
+  {
+    /* The default route is kept as its two halves, both with length 0 */
+    bChanged  = ApplyToPrefix(pRib, pEvent, 0, 0x80000000U);
+    bChanged |= ApplyToPrefix(pRib, pEvent, 0x80000000U, 0x80000000U);
+    return bChanged;
+  }
+
+  u32Start = pEvent->u32Prefix & (0xFFFFFFFFU << (32 - pEvent->uLength));
+
+  return ApplyToPrefix(pRib, pEvent, u32Start, (uint32_t)(1ULL << (32 - pEvent->uLength)));
+}
+
+/* Length buckets so routes go in narrowest first, the default route halves last */
+typedef struct tagRIBTREEORDER
+{
+  uint32_t    *apu32Indexes[33];
+  unsigned int auCounts[33];
+  unsigned int auCapacities[33];
+} RIBTREEORDER;
+
+static void OrderAdd(RIBTREEORDER *pOrder, unsigned int uLength, uint32_t u32Index)
+{
+  if (pOrder->auCounts[uLength] == pOrder->auCapacities[uLength])
+  {
+    pOrder->auCapacities[uLength] = pOrder->auCapacities[uLength] ? pOrder->auCapacities[uLength] * 2 : 256;
+    pOrder->apu32Indexes[uLength] = GrowArray(pOrder->apu32Indexes[uLength], pOrder->auCapacities[uLength], sizeof(uint32_t));
+  }
+  pOrder->apu32Indexes[uLength][pOrder->auCounts[uLength]++] = u32Index;
+}
+
+void RibBuildTree(PRIB pRib, PTREENODE pTreeRoot, const uint64_t *pu64Groups)
+{
+  RIBTREEORDER order;
+  unsigned int uLength = 0;
+  unsigned int uIndex  = 0;
+  uint32_t     u32Group = 0;
+
+  memset(&order, 0, sizeof(order));
+
+  if (!pu64Groups)
+  {
+    for (uIndex = 0; uIndex < pRib->uNumIndexes; uIndex++)
+    {
+      if (pRib->pNextHops[uIndex].u32Size)
+      {
+        OrderAdd(&order, pRib->pPrefixes[uIndex].u8Length, uIndex);
+      }
+    }
+  }
+  else
+  {
+    for (u32Group = 0; u32Group < RIB_GROUPS; u32Group++)
+    {
+      uint32_t u32Index = 0;
+
+      if (!(pu64Groups[u32Group / 64] & (1ULL << (u32Group % 64))))
+      {
+        continue;
+      }
+      for (u32Index = pRib->au32GroupHeads[u32Group]; u32Index != RIB_NO_INDEX; u32Index = pRib->pu32GroupNext[u32Index])
+      {
+        OrderAdd(&order, pRib->pPrefixes[u32Index].u8Length, u32Index);
+      }
+    }
+    for (uIndex = 0; uIndex < pRib->uNumWide; uIndex++)
+    {
+      OrderAdd(&order, pRib->pPrefixes[pRib->pu32Wide[uIndex]].u8Length, pRib->pu32Wide[uIndex]);
+    }
+  }
+
+  for (uLength = 32; uLength != UINT32_MAX; uLength--)
+  {
+    for (uIndex = 0; uIndex < order.auCounts[uLength]; uIndex++)
+    {
+      ROUTEENTRY route = pRib->pNextHops[order.apu32Indexes[uLength][uIndex]];
+
+      route.u32NextHopIndex = order.apu32Indexes[uLength][uIndex];
+      if (!pu64Groups || uLength >= RIB_WIDE_LENGTH)
+      {
+        InsertIntoPrefixTreeAt(pTreeRoot, &route);
+        continue;
+      }
+
+      /* One /12 piece per group asked for, so each group has a route starting in it */
+      route.u32Size = 1U << 20;
+      for (u32Group = pRib->pNextHops[route.u32NextHopIndex].u32Start >> 20;
+           u32Group <= (pRib->pNextHops[route.u32NextHopIndex].u32Start + (pRib->pNextHops[route.u32NextHopIndex].u32Size - 1)) >> 20;
+           u32Group++)
+      {
+        if (pu64Groups[u32Group / 64] & (1ULL << (u32Group % 64)))
+        {
+          route.u32Start = u32Group << 20;
+          InsertIntoPrefixTreeAt(pTreeRoot, &route);
+        }
+      }
+    }
+    free(order.apu32Indexes[uLength]);
+  }
+}
+
+unsigned int RibTakeDirtyGroups(PRIB pRib, uint64_t *pu64Groups)
+{
+  unsigned int uWord   = 0;
+  unsigned int uGroups = 0;
+
+  for (uWord = 0; uWord < RIB_GROUPS / 64; uWord++)
+  {
+    pu64Groups[uWord] = pRib->au64DirtyGroups[uWord];
+    uGroups += __builtin_popcountll(pRib->au64DirtyGroups[uWord]);
+    pRib->au64DirtyGroups[uWord] = 0;
+  }
+
+  return uGroups;
+}
+
+void RibResetCounters(PRIB pRib)
+{
+  pRib->u64Announcements   = 0;
+  pRib->u64Withdrawals     = 0;
+  pRib->u64PrefixesAdded   = 0;
+  pRib->u64PrefixesRemoved = 0;
+  pRib->u64PathChanges     = 0;
+  pRib->u64PathsDropped    = 0;
+  pRib->u64Ignored         = 0;
+  pRib->u64PeerDowns       = 0;
+  pRib->u64PeerPaths       = 0;
+}
+
+void RibPublished(PRIB pRib)
+{
+  memcpy(&pRib->pu32Free[pRib->uNumFree], pRib->pu32Retired, pRib->uNumRetired * sizeof(*pRib->pu32Retired));
+  pRib->uNumFree   += pRib->uNumRetired;
+  pRib->uNumRetired = 0;
+}
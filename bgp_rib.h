@@ -0,0 +1,105 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BGP_RIB_H__
+#define __BGP_RIB_H__
+
+#include <stdint.h>
+#include "routing_table_split.h"
+#include "read_bgp.h"
+
+/* Routes kept for UPDATE replay. Every prefix holds the best paths of its peers and a result
+   index, stable while the prefix exists, which is also its slot in pNextHops. The default
+   route takes two slots like everywhere else, one per /1 half. */
+#define RIB_MAX_PATHS   (8)
+#define RIB_GROUPS      (4096)   /* Level 1 bucket groups of the luleå trie, one per /12 */
+#define RIB_NO_INDEX    (UINT32_MAX)
+
+typedef struct tagRIBPATH
+{
+  uint32_t u32Adjacency;
+  uint16_t u16Peer;
+  uint16_t u16PathLength;
+} RIBPATH, *PRIBPATH;
+
+typedef struct tagRIBPREFIX
+{
+  uint8_t  u8Length;
+  uint8_t  u8NumPaths;
+  RIBPATH  aPaths[RIB_MAX_PATHS];  /* Shortest AS path first, then lowest peer */
+} RIBPREFIX, *PRIBPREFIX;
+
+typedef struct tagRIB
+{
+  PROUTEENTRY  pNextHops;        /* What the trie is built from, u32Size 0 for unused slots */
+  PRIBPREFIX   pPrefixes;        /* Same index */
+  unsigned int uNumIndexes;      /* Slots handed out so far, unused ones included */
+  unsigned int uCapacity;
+  unsigned int uNumLive;
+
+  uint32_t    *pu32Slots;        /* Open addressing over the indexes, keyed by start and length */
+  uint32_t     u32SlotMask;
+
+  uint32_t    *pu32Free;         /* Indexes free to reuse */
+  unsigned int uNumFree;
+  uint32_t    *pu32Retired;      /* Freed since the last publish, the current image may still use them */
+  unsigned int uNumRetired;
+
+  /* Prefixes of /12 and longer are listed under their bucket group, wider ones on their own */
+  uint32_t     au32GroupHeads[RIB_GROUPS];
+  uint32_t    *pu32GroupNext;
+  uint32_t    *pu32GroupPrev;
+  uint32_t    *pu32Wide;
+  unsigned int uNumWide;
+  unsigned int uWideCapacity;
+
+  uint64_t     au64DirtyGroups[RIB_GROUPS / 64];  /* Groups whose prefixes came or went */
+
+  uint64_t     u64Announcements;
+  uint64_t     u64Withdrawals;
+  uint64_t     u64PrefixesAdded;
+  uint64_t     u64PrefixesRemoved;
+  uint64_t     u64PathChanges;   /* Best paths that changed without the prefix coming or going */
+  uint64_t     u64PathsDropped;  /* Announcements worse than RIB_MAX_PATHS paths already held */
+  uint64_t     u64Ignored;       /* Withdrawals of unknown paths and invalid prefixes */
+  uint64_t     u64PeerDowns;     /* Sessions that went down */
+  uint64_t     u64PeerPaths;     /* Paths those took with them */
+} RIB, *PRIB;
+
+void         RibInit(PRIB pRib);
+void         RibFree(PRIB pRib);
+
+/* Returns 1 if the prefix came or went, or for a peer going down any of its prefixes went,
+   so the trie has to change */
+int          RibApply(PRIB pRib, const BGPEVENT *pEvent);
+
+/* Inserts the routes into pTreeRoot, narrowest first. With pu64Groups only the routes of those
+   groups, and routes wider than /12 cut down to the groups they cover, which is what
+   LuleaTrieRebuildGroups() needs. */
+void         RibBuildTree(PRIB pRib, PTREENODE pTreeRoot, const uint64_t *pu64Groups);
+
+/* Copies the dirty groups to pu64Groups, clears them and returns how many there were */
+unsigned int RibTakeDirtyGroups(PRIB pRib, uint64_t *pu64Groups);
+
+/* Zeroes the event counters, leaving the routes as they are */
+void         RibResetCounters(PRIB pRib);
+
+/* Call once lookups can no longer reach the image the last rebuild replaced, the indexes of
+   prefixes removed before it can then be reused */
+void         RibPublished(PRIB pRib);
+
+#endif /* __BGP_RIB_H__ */
@@ -0,0 +1,170 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "routing_table_split.h"
+#include "dir24.h"
+
+static uint32_t     *pu32Tbl24    = NULL;
+static uint32_t     *pu32TblLong  = NULL;
+static unsigned int  uNumBlocks   = 0;
+static unsigned int  uMaxBlocks   = 0;
+
+/* Returns the extension block for the /24 u32Index, creating it from the /24 entry if needed */
+static uint32_t *Dir24Block(uint32_t u32Index)
+{
+  uint32_t     u32Entry = pu32Tbl24[u32Index];
+  unsigned int uEntry   = 0;
+
+  if (u32Entry & DIR24_EXTENDED)
+  {
+    return &pu32TblLong[(u32Entry & ~DIR24_EXTENDED) * DIR24_BLOCK_ENTRIES];
+  }
+
+  if (uNumBlocks == uMaxBlocks)
+  {
+    uMaxBlocks  = uMaxBlocks ? uMaxBlocks * 2 : 4096;
+    pu32TblLong = realloc(pu32TblLong, (size_t)uMaxBlocks * DIR24_BLOCK_ENTRIES * sizeof(*pu32TblLong));
+    if (!pu32TblLong)
+    {
+      printf("Can't allocate DIR-24-8 extension blocks\n");
+      exit(1);
+    }
+  }
+
+  for (uEntry = 0; uEntry < DIR24_BLOCK_ENTRIES; uEntry++)
+  {
+    pu32TblLong[uNumBlocks * DIR24_BLOCK_ENTRIES + uEntry] = u32Entry;
+  }
+  pu32Tbl24[u32Index] = DIR24_EXTENDED | uNumBlocks;
+
+  return &pu32TblLong[uNumBlocks++ * DIR24_BLOCK_ENTRIES];
+}
+
+static int Dir24AddRange(uint32_t u32Start, uint32_t u32Size, uint32_t u32NextHopIndex, void *pContext)
+{
+  uint64_t u64IP  = u32Start;
+  uint64_t u64End = (uint64_t)u32Start + u32Size;
+
+  while (u64IP < u64End)
+  {
+    if ((u64IP & 0xFF) == 0 && u64End - u64IP >= DIR24_BLOCK_ENTRIES)
+    {
+      pu32Tbl24[u64IP >> 8] = u32NextHopIndex;
+      u64IP += DIR24_BLOCK_ENTRIES;
+    }
+    else
+    {
+      uint32_t *pu32Block = Dir24Block(u64IP >> 8);
+      uint64_t  u64Stop   = (u64IP | 0xFF) + 1;
+
+      if (u64Stop > u64End)
+      {
+        u64Stop = u64End;
+      }
+      for (; u64IP < u64Stop; u64IP++)
+      {
+        pu32Block[u64IP & 0xFF] = u32NextHopIndex;
+      }
+    }
+  }
+
+  return 1;
+}
+
+int BuildDir24(PTREENODE pTreeRoot, PROUTEENTRY pNextHops, unsigned int uNumPrefixes)
+{
+  unsigned int uIndex = 0;
+
+  if (uNumPrefixes >= DIR24_NO_ROUTE)
+  {
+    printf("Too many prefixes for DIR-24-8\n");
+    return 0;
+  }
+
+  FreeDir24();
+
+  pu32Tbl24 = malloc(DIR24_TBL24_ENTRIES * sizeof(*pu32Tbl24));
+  if (!pu32Tbl24)
+  {
+    printf("Can't allocate DIR-24-8 table\n");
+    exit(1);
+  }
+  for (uIndex = 0; uIndex < DIR24_TBL24_ENTRIES; uIndex++)
+  {
+    pu32Tbl24[uIndex] = DIR24_NO_ROUTE;
+  }
+
+  /* The ranges are disjoint, so every entry is written at most once */
+  WalkPrefixTree(pTreeRoot, Dir24AddRange, NULL);
+
+  return 1;
+}
+
+uint32_t Dir24Lookup(uint32_t u32IP)
+{
+  uint32_t u32Entry = pu32Tbl24[u32IP >> 8];
+
+  if (u32Entry & DIR24_EXTENDED)
+  {
+    u32Entry = pu32TblLong[((u32Entry & ~DIR24_EXTENDED) << 8) | (u32IP & 0xFF)];
+  }
+
+  return u32Entry == DIR24_NO_ROUTE ? NO_NEXT_HOP : u32Entry;
+}
+
+/* How many lookups ahead to prefetch the /24 entry, same as the luleå batch lookup */
+#define DIR24_PREFETCH_DISTANCE (8)
+
+void Dir24LookupBatch(const uint32_t *pu32IPs, uint32_t *pu32Results, unsigned int uCount)
+{
+  unsigned int uIndex = 0;
+
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    if (uIndex + DIR24_PREFETCH_DISTANCE < uCount)
+    {
+      __builtin_prefetch(&pu32Tbl24[pu32IPs[uIndex + DIR24_PREFETCH_DISTANCE] >> 8]);
+    }
+
+    pu32Results[uIndex] = Dir24Lookup(pu32IPs[uIndex]);
+  }
+}
+
+size_t Dir24Bytes(void)
+{
+  if (!pu32Tbl24)
+  {
+    return 0;
+  }
+
+  /* Only count blocks in use, the realloc slack is not part of the structure */
+  return DIR24_TBL24_ENTRIES * sizeof(*pu32Tbl24) + (size_t)uNumBlocks * DIR24_BLOCK_ENTRIES * sizeof(*pu32TblLong);
+}
+
+void FreeDir24(void)
+{
+  free(pu32Tbl24);
+  free(pu32TblLong);
+  pu32Tbl24   = NULL;
+  pu32TblLong = NULL;
+  uNumBlocks  = 0;
+  uMaxBlocks  = 0;
+}
@@ -0,0 +1,38 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DIR24_H__
+#define __DIR24_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "routing_table_split.h"
+
+/* DIR-24-8: one entry per /24, addresses in partially covered /24s continue in a 256 entry block.
+   Entries are next hop indexes, or a block index with DIR24_EXTENDED set. */
+#define DIR24_TBL24_ENTRIES  (1U << 24)
+#define DIR24_BLOCK_ENTRIES  (256)
+#define DIR24_EXTENDED       (1U << 31)
+#define DIR24_NO_ROUTE       (DIR24_EXTENDED - 1)
+
+int         BuildDir24(PTREENODE pTreeRoot, PROUTEENTRY pNextHops, unsigned int uNumPrefixes);
+uint32_t    Dir24Lookup(uint32_t u32IP);
+void        Dir24LookupBatch(const uint32_t *pu32IPs, uint32_t *pu32Results, unsigned int uCount);
+size_t      Dir24Bytes(void);
+void        FreeDir24(void);
+
+#endif /* __DIR24_H__ */
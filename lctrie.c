@@ -0,0 +1,523 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "routing_table_split.h"
+#include "lctrie.h"
+
+/* Deepest path: one node per stride from the root down to a /32 */
+#define LCTRIE_MAX_DEPTH (32 / LCTRIE_STRIDE + 1)
+
+LCTRIE lcTrie;
+
+/* Internal bits of the prefixes that cover each value of the stride, longest has the highest bit */
+static const uint16_t au16Covering[1 << LCTRIE_STRIDE] =
+{
+  0x008B, 0x008B, 0x010B, 0x010B, 0x0213, 0x0213, 0x0413, 0x0413,
+  0x0825, 0x0825, 0x1025, 0x1025, 0x2045, 0x2045, 0x4045, 0x4045
+};
+
+static inline uint32_t Mask(unsigned int uPos)
+{
+  return uPos ? ~0U << (32 - uPos) : 0;
+}
+
+static inline unsigned int Stride(uint32_t u32IP, unsigned int uPos)
+{
+  return (u32IP >> (32 - LCTRIE_STRIDE - uPos)) & ((1 << LCTRIE_STRIDE) - 1);
+}
+
+/* Elements of the array before bit uBit */
+static inline unsigned int Rank(uint16_t u16Bitmap, unsigned int uBit)
+{
+  return __builtin_popcount(u16Bitmap & ((1U << uBit) - 1));
+}
+
+void LcTrieInit(PLCTRIE pTrie)
+{
+  unsigned int uIndex = 0;
+
+  memset(pTrie, 0, sizeof(*pTrie));
+  pTrie->u32FreeNodes = LCTRIE_NONE;
+  for (uIndex = 0; uIndex <= (1 << LCTRIE_STRIDE); uIndex++)
+  {
+    pTrie->au32FreeWords[uIndex] = LCTRIE_NONE;
+  }
+
+  pTrie->u32NodeCapacity = 1024;
+  pTrie->pNodes          = calloc(pTrie->u32NodeCapacity, sizeof(*pTrie->pNodes));
+  pTrie->u32WordCapacity = 4096;
+  pTrie->pu32Words       = malloc(pTrie->u32WordCapacity * sizeof(*pTrie->pu32Words));
+  if (!pTrie->pNodes || !pTrie->pu32Words)
+  {
+    printf("Can't allocate LC-trie pools\n");
+    exit(1);
+  }
+
+  /* The root is always there, and covers the whole address space */
+  pTrie->u32NumNodes = 1;
+}
+
+void LcTrieFree(PLCTRIE pTrie)
+{
+  free(pTrie->pNodes);
+  free(pTrie->pu32Words);
+  memset(pTrie, 0, sizeof(*pTrie));
+}
+
+/* Node pointers are only good until the next AllocNode(), the pool can move */
+static uint32_t AllocNode(PLCTRIE pTrie, uint32_t u32Key, unsigned int uPos)
+{
+  uint32_t    u32Node = pTrie->u32FreeNodes;
+  PLCTRIENODE pNode   = NULL;
+
+  if (u32Node != LCTRIE_NONE)
+  {
+    pTrie->u32FreeNodes = pTrie->pNodes[u32Node].u32Children;
+  }
+  else
+  {
+    if (pTrie->u32NumNodes == pTrie->u32NodeCapacity)
+    {
+      pTrie->u32NodeCapacity *= 2;
+      pTrie->pNodes = realloc(pTrie->pNodes, pTrie->u32NodeCapacity * sizeof(*pTrie->pNodes));
+      if (!pTrie->pNodes)
+      {
+        printf("Can't grow LC-trie node pool\n");
+        exit(1);
+      }
+    }
+    u32Node = pTrie->u32NumNodes++;
+  }
+
+  pNode = &pTrie->pNodes[u32Node];
+  memset(pNode, 0, sizeof(*pNode));
+  pNode->u32Key      = u32Key & Mask(uPos);
+  pNode->u8Pos       = uPos;
+  pNode->u32Values   = LCTRIE_NONE;
+  pNode->u32Children = LCTRIE_NONE;
+
+  return u32Node;
+}
+
+static void FreeNode(PLCTRIE pTrie, uint32_t u32Node)
+{
+  pTrie->pNodes[u32Node].u32Children = pTrie->u32FreeNodes;
+  pTrie->u32FreeNodes                = u32Node;
+}
+
+static uint32_t AllocWords(PLCTRIE pTrie, unsigned int uCount)
+{
+  uint32_t u32Offset = pTrie->au32FreeWords[uCount];
+
+  if (u32Offset != LCTRIE_NONE)
+  {
+    pTrie->au32FreeWords[uCount] = pTrie->pu32Words[u32Offset];
+    return u32Offset;
+  }
+
+  while (pTrie->u32NumWords + uCount > pTrie->u32WordCapacity)
+  {
+    pTrie->u32WordCapacity *= 2;
+    pTrie->pu32Words = realloc(pTrie->pu32Words, pTrie->u32WordCapacity * sizeof(*pTrie->pu32Words));
+    if (!pTrie->pu32Words)
+    {
+      printf("Can't grow LC-trie word pool\n");
+      exit(1);
+    }
+  }
+  u32Offset = pTrie->u32NumWords;
+  pTrie->u32NumWords += uCount;
+
+  return u32Offset;
+}
+
+static void FreeWords(PLCTRIE pTrie, uint32_t u32Offset, unsigned int uCount)
+{
+  if (uCount)
+  {
+    pTrie->pu32Words[u32Offset]  = pTrie->au32FreeWords[uCount];
+    pTrie->au32FreeWords[uCount] = u32Offset;
+  }
+}
+
+/* Returns the offset of a copy of the uCount word array at u32Offset with u32Word inserted
+   at uAt, the old array goes back to the pool */
+static uint32_t InsertWord(PLCTRIE pTrie, uint32_t u32Offset, unsigned int uCount, unsigned int uAt, uint32_t u32Word)
+{
+  uint32_t u32New = AllocWords(pTrie, uCount + 1);
+
+  if (uCount)
+  {
+    memcpy(&pTrie->pu32Words[u32New], &pTrie->pu32Words[u32Offset], uAt * sizeof(uint32_t));
+    memcpy(&pTrie->pu32Words[u32New + uAt + 1], &pTrie->pu32Words[u32Offset + uAt], (uCount - uAt) * sizeof(uint32_t));
+    FreeWords(pTrie, u32Offset, uCount);
+  }
+  pTrie->pu32Words[u32New + uAt] = u32Word;
+
+  return u32New;
+}
+
+static uint32_t RemoveWord(PLCTRIE pTrie, uint32_t u32Offset, unsigned int uCount, unsigned int uAt)
+{
+  uint32_t u32New = LCTRIE_NONE;
+
+  if (uCount > 1)
+  {
+    u32New = AllocWords(pTrie, uCount - 1);
+    memcpy(&pTrie->pu32Words[u32New], &pTrie->pu32Words[u32Offset], uAt * sizeof(uint32_t));
+    memcpy(&pTrie->pu32Words[u32New + uAt], &pTrie->pu32Words[u32Offset + uAt + 1], (uCount - uAt - 1) * sizeof(uint32_t));
+  }
+  FreeWords(pTrie, u32Offset, uCount);
+
+  return u32New;
+}
+
+/* Internal bit of a prefix of uLength that ends in a node starting at uPos */
+static inline unsigned int InternalBit(uint32_t u32Start, unsigned int uLength, unsigned int uPos)
+{
+  unsigned int uRelative = uLength - uPos;
+
+  return uRelative ? (1U << uRelative) - 1 + ((u32Start << uPos) >> (32 - uRelative)) : 0;
+}
+
+/* Adds or replaces a prefix. Returns 1 if it is new, 0 if it replaced the value of one already there. */
+int LcTrieInsert(PLCTRIE pTrie, uint32_t u32Start, unsigned int uLength, uint32_t u32Value)
+{
+  uint32_t u32Node = 0;
+
+  u32Start &= Mask(uLength);
+
+  while (1)
+  {
+    PLCTRIENODE  pNode    = &pTrie->pNodes[u32Node];
+    unsigned int uPos     = pNode->u8Pos;
+    unsigned int uBit     = 0;
+    unsigned int uSlot    = 0;
+    uint32_t     u32Child = 0;
+    PLCTRIENODE  pChild   = NULL;
+    unsigned int uCommon  = 0;
+
+    if (uLength < uPos + LCTRIE_STRIDE || uPos == 32)
+    {
+      uBit  = InternalBit(u32Start, uLength, uPos);
+      uSlot = Rank(pNode->u16Internal, uBit);
+      if (pNode->u16Internal & (1U << uBit))
+      {
+        pTrie->pu32Words[pNode->u32Values + uSlot] = u32Value;
+        return 0;
+      }
+
+      pNode->u32Values = InsertWord(pTrie, pNode->u32Values, __builtin_popcount(pNode->u16Internal), uSlot, u32Value);
+      pNode->u16Internal |= 1U << uBit;
+      pTrie->u32NumPrefixes++;
+      return 1;
+    }
+
+    uBit  = Stride(u32Start, uPos);
+    uSlot = Rank(pNode->u16External, uBit);
+    if (!(pNode->u16External & (1U << uBit)))
+    {
+      /* Nothing below yet, the new node goes straight to the stride the prefix ends in */
+      u32Child = AllocNode(pTrie, u32Start, uLength & ~(LCTRIE_STRIDE - 1));
+      pNode    = &pTrie->pNodes[u32Node];
+      pNode->u32Children = InsertWord(pTrie, pNode->u32Children, __builtin_popcount(pNode->u16External), uSlot, u32Child);
+      pNode->u16External |= 1U << uBit;
+      u32Node = u32Child;
+      continue;
+    }
+
+    u32Child = pTrie->pu32Words[pNode->u32Children + uSlot];
+    pChild   = &pTrie->pNodes[u32Child];
+    uCommon  = (u32Start ^ pChild->u32Key) ? __builtin_clz(u32Start ^ pChild->u32Key) : 32;
+    uCommon  = uCommon < uLength ? uCommon : uLength;
+    if (uCommon >= pChild->u8Pos)
+    {
+      u32Node = u32Child;
+      continue;
+    }
+
+    /* The child skipped strides the prefix leaves, or branches off in. Put a node where they
+       part, at most one stride above the child. */
+    {
+      unsigned int uSplit  = uCommon & ~(LCTRIE_STRIDE - 1);
+      uint32_t     u32Fork = AllocNode(pTrie, u32Start, uSplit);
+      PLCTRIENODE  pFork   = &pTrie->pNodes[u32Fork];
+
+      pChild = &pTrie->pNodes[u32Child];
+      pFork->u32Children = InsertWord(pTrie, LCTRIE_NONE, 0, 0, u32Child);
+      pFork->u16External = 1U << Stride(pChild->u32Key, uSplit);
+      pTrie->pu32Words[pTrie->pNodes[u32Node].u32Children + uSlot] = u32Fork;
+      u32Node = u32Fork;
+    }
+  }
+}
+
+/* Removes a prefix, and the nodes it leaves without prefixes and with fewer than two children.
+   Returns 0 if it isn't there. */
+int LcTrieDelete(PLCTRIE pTrie, uint32_t u32Start, unsigned int uLength)
+{
+  uint32_t     au32Path[LCTRIE_MAX_DEPTH];
+  unsigned int auSlot[LCTRIE_MAX_DEPTH];   /* Where au32Path[n] is in the children of au32Path[n - 1] */
+  unsigned int uDepth  = 0;
+  uint32_t     u32Node = 0;
+  PLCTRIENODE  pNode   = NULL;
+  unsigned int uBit    = 0;
+
+  u32Start &= Mask(uLength);
+
+  while (1)
+  {
+    pNode = &pTrie->pNodes[u32Node];
+    if ((u32Start ^ pNode->u32Key) & Mask(pNode->u8Pos) || uLength < pNode->u8Pos)
+    {
+      return 0;
+    }
+    au32Path[uDepth++] = u32Node;
+
+    if (uLength < pNode->u8Pos + LCTRIE_STRIDE || pNode->u8Pos == 32)
+    {
+      break;
+    }
+
+    uBit = Stride(u32Start, pNode->u8Pos);
+    if (!(pNode->u16External & (1U << uBit)))
+    {
+      return 0;
+    }
+    auSlot[uDepth] = Rank(pNode->u16External, uBit);
+    u32Node        = pTrie->pu32Words[pNode->u32Children + auSlot[uDepth]];
+  }
+
+  uBit = InternalBit(u32Start, uLength, pNode->u8Pos);
+  if (!(pNode->u16Internal & (1U << uBit)))
+  {
+    return 0;
+  }
+  pNode->u32Values = RemoveWord(pTrie, pNode->u32Values, __builtin_popcount(pNode->u16Internal), Rank(pNode->u16Internal, uBit));
+  pNode->u16Internal &= ~(1U << uBit);
+  pTrie->u32NumPrefixes--;
+
+  /* Walk back up while nodes are left without a reason to exist. The root always stays. */
+  while (--uDepth)
+  {
+    PLCTRIENODE pParent = &pTrie->pNodes[au32Path[uDepth - 1]];
+
+    pNode = &pTrie->pNodes[au32Path[uDepth]];
+    if (pNode->u16Internal || __builtin_popcount(pNode->u16External) > 1)
+    {
+      break;
+    }
+
+    if (pNode->u16External)
+    {
+      /* Only one child, the parent can point at it directly */
+      pTrie->pu32Words[pParent->u32Children + auSlot[uDepth]] = pTrie->pu32Words[pNode->u32Children];
+      FreeWords(pTrie, pNode->u32Children, 1);
+      FreeNode(pTrie, au32Path[uDepth]);
+      break;
+    }
+
+    pParent->u32Children = RemoveWord(pTrie, pParent->u32Children, __builtin_popcount(pParent->u16External), auSlot[uDepth]);
+    pParent->u16External &= ~(1U << Stride(pNode->u32Key, pParent->u8Pos));
+    FreeNode(pTrie, au32Path[uDepth]);
+  }
+
+  return 1;
+}
+
+/* Returns the value of the longest prefix matching u32IP, LCTRIE_NONE if there is none */
+uint32_t LcTrieLookup(const LCTRIE *pTrie, uint32_t u32IP)
+{
+  const LCTRIENODE *pNode    = pTrie->pNodes;
+  uint32_t          u32Best  = LCTRIE_NONE;
+  unsigned int      uStride  = 0;
+  unsigned int      uCovered = 0;
+
+  while (!((u32IP ^ pNode->u32Key) & Mask(pNode->u8Pos)))
+  {
+    if (pNode->u8Pos == 32)
+    {
+      if (pNode->u16Internal)
+      {
+        u32Best = pTrie->pu32Words[pNode->u32Values];
+      }
+      break;
+    }
+
+    uStride  = Stride(u32IP, pNode->u8Pos);
+    uCovered = pNode->u16Internal & au16Covering[uStride];
+    if (uCovered)
+    {
+      u32Best = pTrie->pu32Words[pNode->u32Values + Rank(pNode->u16Internal, 31 - __builtin_clz(uCovered))];
+    }
+
+    if (!(pNode->u16External & (1U << uStride)))
+    {
+      break;
+    }
+    pNode = &pTrie->pNodes[pTrie->pu32Words[pNode->u32Children + Rank(pNode->u16External, uStride)]];
+  }
+
+  return u32Best;
+}
+
+typedef struct tagLCTRIEWALK
+{
+  RANGECALLBACK  fpCallback;
+  void          *pContext;
+  uint64_t       u64Start;    /* Range not reported yet, grows while neighbours have the same value */
+  uint64_t       u64End;
+  uint32_t       u32Value;
+  int            bStopped;
+} LCTRIEWALK, *PLCTRIEWALK;
+
+/* Reports the pending range as the largest aligned blocks it splits into, the same pieces the
+   radix tree splits a prefix into around the narrower prefixes inside it */
+static void FlushRange(PLCTRIEWALK pWalk)
+{
+  uint64_t u64Start = pWalk->u64Start;
+
+  while (u64Start < pWalk->u64End && !pWalk->bStopped)
+  {
+    uint64_t u64Size = u64Start ? u64Start & -u64Start : 1ULL << 31;
+
+    if (u64Size > 1ULL << 31)
+    {
+      u64Size = 1ULL << 31;
+    }
+    while (u64Start + u64Size > pWalk->u64End)
+    {
+      u64Size >>= 1;
+    }
+
+    pWalk->bStopped = !pWalk->fpCallback((uint32_t)u64Start, (uint32_t)u64Size, pWalk->u32Value, pWalk->pContext);
+    u64Start += u64Size;
+  }
+  pWalk->u64Start = pWalk->u64End;
+}
+
+static void AddRange(PLCTRIEWALK pWalk, uint64_t u64Start, uint64_t u64End, uint32_t u32Value)
+{
+  if (u64Start == u64End)
+  {
+    return;
+  }
+
+  if (u32Value != pWalk->u32Value || u64Start != pWalk->u64End)
+  {
+    if (pWalk->u32Value != LCTRIE_NONE)
+    {
+      FlushRange(pWalk);
+    }
+    pWalk->u64Start = u64Start;
+    pWalk->u32Value = u32Value;
+  }
+  pWalk->u64End = u64End;
+}
+
+static void WalkNode(const LCTRIE *pTrie, PLCTRIEWALK pWalk, const LCTRIENODE *pNode, uint32_t u32Inherited)
+{
+  uint64_t     u64Start = pNode->u32Key;
+  uint64_t     u64Size  = 0;
+  unsigned int uStride  = 0;
+
+  if (pNode->u8Pos == 32)
+  {
+    AddRange(pWalk, u64Start, u64Start + 1, pNode->u16Internal ? pTrie->pu32Words[pNode->u32Values] : u32Inherited);
+    return;
+  }
+
+  u64Size = 1ULL << (32 - LCTRIE_STRIDE - pNode->u8Pos);
+  for (uStride = 0; uStride < (1 << LCTRIE_STRIDE) && !pWalk->bStopped; uStride++, u64Start += u64Size)
+  {
+    unsigned int uCovered = pNode->u16Internal & au16Covering[uStride];
+    uint32_t     u32Value = u32Inherited;
+
+    if (uCovered)
+    {
+      u32Value = pTrie->pu32Words[pNode->u32Values + Rank(pNode->u16Internal, 31 - __builtin_clz(uCovered))];
+    }
+
+    if (pNode->u16External & (1U << uStride))
+    {
+      const LCTRIENODE *pChild = &pTrie->pNodes[pTrie->pu32Words[pNode->u32Children + Rank(pNode->u16External, uStride)]];
+      uint64_t          u64End = pChild->u32Key + (1ULL << (32 - pChild->u8Pos));
+
+      /* The child may skip strides, so it can cover only part of this one */
+      AddRange(pWalk, u64Start, pChild->u32Key, u32Value);
+      WalkNode(pTrie, pWalk, pChild, u32Value);
+      AddRange(pWalk, u64End, u64Start + u64Size, u32Value);
+    }
+    else
+    {
+      AddRange(pWalk, u64Start, u64Start + u64Size, u32Value);
+    }
+  }
+}
+
+/* Calls fpCallback for every disjoint range with a route, in address order, split into
+   aligned blocks like WalkPrefixTree() does. Returns 0 if the callback stopped the walk. */
+int LcTrieWalk(const LCTRIE *pTrie, RANGECALLBACK fpCallback, void *pContext)
+{
+  LCTRIEWALK walk;
+
+  walk.fpCallback = fpCallback;
+  walk.pContext   = pContext;
+  walk.u64Start   = 0;
+  walk.u64End     = 0;
+  walk.u32Value   = LCTRIE_NONE;
+  walk.bStopped   = 0;
+
+  WalkNode(pTrie, &walk, pTrie->pNodes, LCTRIE_NONE);
+  if (walk.u32Value != LCTRIE_NONE)
+  {
+    FlushRange(&walk);
+  }
+
+  return !walk.bStopped;
+}
+
+/* Pool space handed out, freed nodes and arrays waiting for reuse included */
+size_t LcTrieBytes(const LCTRIE *pTrie)
+{
+  return (size_t)pTrie->u32NumNodes * sizeof(*pTrie->pNodes) + (size_t)pTrie->u32NumWords * sizeof(*pTrie->pu32Words);
+}
+
+/* Builds lcTrie from the prefixes, values are their indexes. Inserted widest first, so a
+   duplicate prefix keeps the first index the same way the radix tree does. */
+int BuildLcTrie(PTREENODE pTreeRoot, PROUTEENTRY pNextHops, unsigned int uNumPrefixes)
+{
+  unsigned int uIndex = uNumPrefixes;
+
+  (void)pTreeRoot;
+  LcTrieFree(&lcTrie);
+  LcTrieInit(&lcTrie);
+
+  while (uIndex--)
+  {
+    unsigned int uLength = pNextHops[uIndex].u32Size ? 32 - __builtin_ctz(pNextHops[uIndex].u32Size) : 0;
+
+    LcTrieInsert(&lcTrie, pNextHops[uIndex].u32Start, uLength, uIndex);
+  }
+
+  return 1;
+}
@@ -0,0 +1,70 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LCTRIE_H__
+#define __LCTRIE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "routing_table_split.h"
+
+/* Mutable control plane trie. Every node consumes LCTRIE_STRIDE address bits, with a bitmap
+   of the prefixes ending inside it and a bitmap of its children, indexed by popcount the way
+   tree bitmap does. Nodes only exist where prefixes end or paths branch: a child pointer can
+   skip any number of strides, and the child's key tells which address bits it skipped. */
+#define LCTRIE_STRIDE (4)
+#define LCTRIE_NONE   (UINT32_MAX)
+
+typedef struct tagLCTRIENODE
+{
+  uint32_t u32Key;       /* Address bits above u8Pos, the rest zero */
+  uint8_t  u8Pos;        /* Prefix length the node starts at, a multiple of LCTRIE_STRIDE up to 32 */
+  uint8_t  u8Reserved;
+  uint16_t u16Internal;  /* Prefix of relative length l and value v ends here: bit (1 << l) - 1 + v */
+  uint16_t u16External;  /* Child for each value of the next LCTRIE_STRIDE bits */
+  uint16_t u16Reserved;
+  uint32_t u32Values;    /* Word offset of the prefix values, in internal bit order */
+  uint32_t u32Children;  /* Word offset of the child node indexes, in external bit order */
+} LCTRIENODE, *PLCTRIENODE;
+
+/* Nodes and the value and child arrays come from two pools, so the trie is a handful of
+   allocations whatever its size. Freed arrays are kept on a free list per length. */
+typedef struct tagLCTRIE
+{
+  PLCTRIENODE  pNodes;
+  uint32_t     u32NumNodes;       /* Handed out so far, node 0 is the root */
+  uint32_t     u32NodeCapacity;
+  uint32_t     u32FreeNodes;      /* Free list, linked through u32Children */
+  uint32_t    *pu32Words;
+  uint32_t     u32NumWords;
+  uint32_t     u32WordCapacity;
+  uint32_t     au32FreeWords[(1 << LCTRIE_STRIDE) + 1];  /* Free arrays by length, linked through their first word */
+  uint32_t     u32NumPrefixes;
+} LCTRIE, *PLCTRIE;
+
+extern LCTRIE lcTrie;
+
+void     LcTrieInit(PLCTRIE pTrie);
+void     LcTrieFree(PLCTRIE pTrie);
+int      LcTrieInsert(PLCTRIE pTrie, uint32_t u32Start, unsigned int uLength, uint32_t u32Value);
+int      LcTrieDelete(PLCTRIE pTrie, uint32_t u32Start, unsigned int uLength);
+uint32_t LcTrieLookup(const LCTRIE *pTrie, uint32_t u32IP);
+int      LcTrieWalk(const LCTRIE *pTrie, RANGECALLBACK fpCallback, void *pContext);
+size_t   LcTrieBytes(const LCTRIE *pTrie);
+int      BuildLcTrie(PTREENODE pTreeRoot, PROUTEENTRY pNextHops, unsigned int uNumPrefixes);
+
+#endif /* __LCTRIE_H__ */
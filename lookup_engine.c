@@ -0,0 +1,91 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "routing_table_split.h"
+#include "lulea_trie.h"
+#include "dir24.h"
+#include "poptrie.h"
+#include "lctrie.h"
+#include "lookup_engine.h"
+
+static void RadixLookupBatch(const uint32_t *pu32IPs, uint32_t *pu32Results, unsigned int uCount)
+{
+  unsigned int uIndex = 0;
+
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    pu32Results[uIndex] = LookupInTreeIndex(pu32IPs[uIndex]);
+  }
+}
+
+static size_t LuleaTrieBytes(void)
+{
+  size_t uSize = 0;
+
+  LuleaTrieImage(&uSize);
+  return uSize;
+}
+
+static uint32_t LcLookup(uint32_t u32IP)
+{
+  return LcTrieLookup(&lcTrie, u32IP);
+}
+
+static void LcLookupBatch(const uint32_t *pu32IPs, uint32_t *pu32Results, unsigned int uCount)
+{
+  unsigned int uIndex = 0;
+
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    pu32Results[uIndex] = LcTrieLookup(&lcTrie, pu32IPs[uIndex]);
+  }
+}
+
+static size_t LcBytes(void)
+{
+  return LcTrieBytes(&lcTrie);
+}
+
+const LOOKUPENGINE aLookupEngines[] =
+{
+  { "radix",   NULL,           LookupInTreeIndex, RadixLookupBatch,     PrefixTreeBytes },
+  { "lulea",   BuildLuleaTrie, LuleaTrieLookup,   LuleaTrieLookupBatch, LuleaTrieBytes  },
+  { "dir24",   BuildDir24,     Dir24Lookup,       Dir24LookupBatch,     Dir24Bytes      },
+  { "poptrie", BuildPoptrie,   PoptrieLookup,     PoptrieLookupBatch,   PoptrieBytes    },
+  { "lctrie",  BuildLcTrie,    LcLookup,          LcLookupBatch,        LcBytes         },
+};
+
+const unsigned int uNumLookupEngines = sizeof(aLookupEngines) / sizeof(aLookupEngines[0]);
+
+const LOOKUPENGINE *LookupEngineFind(const char *pszName)
+{
+  unsigned int uIndex = 0;
+
+  for (uIndex = 0; uIndex < uNumLookupEngines; uIndex++)
+  {
+    if (!strcmp(aLookupEngines[uIndex].pszName, pszName))
+    {
+      return &aLookupEngines[uIndex];
+    }
+  }
+
+  return NULL;
+}
@@ -0,0 +1,44 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LOOKUP_ENGINE_H__
+#define __LOOKUP_ENGINE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "routing_table_split.h"
+
+/* Common interface for the lookup structures, so they can be built, verified and benchmarked
+   from the same radix tree. Every engine returns the result index of the matching prefix (its
+   index in pNextHops and the result table), or NO_NEXT_HOP. */
+typedef struct tagLOOKUPENGINE
+{
+  const char  *pszName;
+
+  /* NULL for the radix tree itself, which BuildPrefixTree() has already built */
+  int         (*fpBuild)(PTREENODE pTreeRoot, PROUTEENTRY pNextHops, unsigned int uNumPrefixes);
+  uint32_t    (*fpLookup)(uint32_t u32IP);
+  void        (*fpLookupBatch)(const uint32_t *pu32IPs, uint32_t *pu32Results, unsigned int uCount);
+  size_t      (*fpBytes)(void);
+} LOOKUPENGINE, *PLOOKUPENGINE;
+
+extern const LOOKUPENGINE aLookupEngines[];
+extern const unsigned int uNumLookupEngines;
+
+const LOOKUPENGINE *LookupEngineFind(const char *pszName);
+
+#endif /* __LOOKUP_ENGINE_H__ */
@@ -0,0 +1,1019 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "routing_table_split.h"
+#include "read_bgp.h"
+#include "lulea_trie.h"
+#include "lookup_engine.h"
+#include "verify.h"
+#include "benchmark.h"
+#include "lulea_stats.h"
+#include "nexthop.h"
+#include "lulea_cache.h"
+#include "lulea_trace.h"
+#include "lulea_numa.h"
+#include "lctrie.h"
+#include "result_table.h"
+
+#define BENCH_DEFAULT_LOOKUPS (1000000)
+#define BENCH_DEFAULT_TRACE_RATE (16)
+
+static PROUTEENTRY pNextHops;
+
+static const LOOKUPENGINE *pCurrentEngine;
+
+/* BenchRun() hands over one batch at a time, so the engine dispatch is paid once per batch */
+static void LookupEngine(const uint32_t *pu32IPs, uint32_t *pu32Results, unsigned int uCount)
+{
+  pCurrentEngine->fpLookupBatch(pu32IPs, pu32Results, uCount);
+}
+
+typedef struct tagENGINEBUILD
+{
+  double dBuildMs;
+  size_t uBytes;
+} ENGINEBUILD;
+
+/* Forwarding lookup through a trie built with path list leaves, the result is the adjacency */
+static void LookupForward(const uint32_t *pu32IPs, uint32_t *pu32Results, unsigned int uCount)
+{
+  unsigned int uIndex = 0;
+
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    pu32Results[uIndex] = NextHopResolve(LuleaTrieLookup(pu32IPs[uIndex]));
+  }
+}
+
+/* Counts addresses where the forwarding trie disagrees with the radix tree's prefix */
+static unsigned int CheckForwarding(const uint32_t *pu32IPs, unsigned int uCount)
+{
+  unsigned int uIndex      = 0;
+  unsigned int uMismatches = 0;
+
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    PROUTEENTRY pRoute    = LookupInTree(pu32IPs[uIndex]);
+    uint32_t    u32Expect = pRoute ? NextHopResolve(pRoute->u32PathList) : NO_ADJACENCY;
+
+    uMismatches += NextHopResolve(LuleaTrieLookup(pu32IPs[uIndex])) != u32Expect;
+  }
+
+  return uMismatches;
+}
+
+/* Fails the peer that is primary for the most prefixes, once through the adjacency table and
+   once the way it had to be done before: rebuilding the trie. */
+static void BenchFailover(FILE *pOutput, unsigned int uNumRoutes, const uint32_t *pu32IPs, unsigned int uCount)
+{
+  uint32_t        *pu32PerPeer  = calloc(65536, sizeof(*pu32PerPeer));
+  uint32_t        *pu32Before   = malloc(uNumRoutes * sizeof(*pu32Before));
+  uint32_t         u32Peer      = 0;
+  unsigned int     uIndex       = 0;
+  unsigned int     uMismatches  = 0;
+  unsigned int     uMoved       = 0;
+  unsigned int     uUnreachable = 0;
+  unsigned int     uChanged     = 0;
+  uint64_t         u64Ticks     = 0;
+  double           dRebuildMs   = 0;
+  double           dFailoverNs  = 0;
+  double           dRestoreNs   = 0;
+  struct timespec  sooner;
+  BENCHRESULT      result;
+
+  if (!pu32PerPeer || !pu32Before)
+  {
+    printf("Can't allocate failover counters\n");
+    exit(1);
+  }
+
+  for (uIndex = 0; uIndex < uNumRoutes; uIndex++)
+  {
+    PPATHLIST pPathList = NextHopPathList(pNextHops[uIndex].u32PathList);
+
+    pu32Before[uIndex] = NextHopResolve(pNextHops[uIndex].u32PathList);
+    if (pPathList && pPathList->u32NumPaths)
+    {
+      uint32_t u32Primary = NextHopAdjacency(pPathList->au32Adjacencies[0])->u32Peer;
+
+      pu32PerPeer[u32Primary]++;
+      if (pu32PerPeer[u32Primary] > pu32PerPeer[u32Peer])
+      {
+        u32Peer = u32Primary;
+      }
+    }
+  }
+
+  fprintf(stderr, "Building luleå trie with path list leaves\n");
+  LuleaTrieSetLeafType(LULEALEAF_PATHLIST);
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  BuildLuleaTrie(&root, pNextHops, uNumRoutes);
+  dRebuildMs = BenchElapsedMs(&sooner);
+  LuleaTrieSetLeafType(LULEALEAF_PREFIX);
+
+  uMismatches = CheckForwarding(pu32IPs, uCount);
+
+  fprintf(stderr, "Running lulea_pathlist prefix warm\n");
+  BenchRun("lulea_pathlist", LookupForward, pu32IPs, uCount, BENCHDIST_PREFIX, 0, &result);
+
+  u64Ticks    = BenchTicks();
+  uChanged    = NextHopSetPeerState(u32Peer, 0);
+  dFailoverNs = (BenchTicks() - u64Ticks) / BenchTscGhz();
+
+  uMismatches += CheckForwarding(pu32IPs, uCount);
+  for (uIndex = 0; uIndex < uNumRoutes; uIndex++)
+  {
+    uint32_t u32After = NextHopResolve(pNextHops[uIndex].u32PathList);
+
+    uMoved       += u32After != pu32Before[uIndex];
+    uUnreachable += u32After == NO_ADJACENCY && pu32Before[uIndex] != NO_ADJACENCY;
+  }
+
+  u64Ticks   = BenchTicks();
+  NextHopSetPeerState(u32Peer, 1);
+  dRestoreNs = (BenchTicks() - u64Ticks) / BenchTscGhz();
+
+  fprintf(pOutput, "  \"failover\": {\n");
+  fprintf(pOutput, "    \"adjacencies\": %u,\n", NextHopNumAdjacencies());
+  fprintf(pOutput, "    \"path_lists\": %u,\n", NextHopNumPathLists());
+  fprintf(pOutput, "    \"peer\": %u,\n", u32Peer);
+  fprintf(pOutput, "    \"peer_primary_prefixes\": %u,\n", pu32PerPeer[u32Peer]);
+  fprintf(pOutput, "    \"adjacency_stores\": %u,\n", uChanged);
+  fprintf(pOutput, "    \"prefixes_moved\": %u,\n", uMoved);
+  fprintf(pOutput, "    \"prefixes_unreachable\": %u,\n", uUnreachable);
+  fprintf(pOutput, "    \"failover_ns\": %.1f,\n", dFailoverNs);
+  fprintf(pOutput, "    \"restore_ns\": %.1f,\n", dRestoreNs);
+  fprintf(pOutput, "    \"rebuild_ms\": %.3f,\n", dRebuildMs);
+  fprintf(pOutput, "    \"forwarding_ns_per_lookup\": %.3f,\n", result.dMeanNs);
+  fprintf(pOutput, "    \"forwarding_mlookups_per_sec\": %.3f,\n", result.dMLookupsPerSec);
+  fprintf(pOutput, "    \"forwarding_mismatches\": %u\n", uMismatches);
+  fprintf(pOutput, "  },\n");
+
+  free(pu32PerPeer);
+  free(pu32Before);
+}
+
+/* Stand in for the RSS hash a NIC hands over with every packet */
+#define BENCH_FLOW_HASH(u32IP) ((u32IP) * 0x9E3779B1U)
+
+static void LookupFlow(const uint32_t *pu32IPs, uint32_t *pu32Results, unsigned int uCount)
+{
+  uint32_t     au32FlowHashes[BENCH_BATCH];
+  unsigned int uIndex = 0;
+
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    au32FlowHashes[uIndex] = BENCH_FLOW_HASH(pu32IPs[uIndex]);
+  }
+  LuleaTrieLookupFlowBatch(pu32IPs, au32FlowHashes, pu32Results, uCount);
+}
+
+/* Flow lookups through a trie with ECMP group leaves, checked against the radix tree */
+static void BenchEcmp(FILE *pOutput, unsigned int uNumRoutes, const uint32_t *pu32IPs, unsigned int uCount)
+{
+  unsigned int auMembers[ECMP_MAX_MEMBERS + 1] = { 0 };
+  unsigned int uIndex      = 0;
+  unsigned int uMismatches = 0;
+  BENCHRESULT  result;
+
+  for (uIndex = 0; uIndex < uNumRoutes; uIndex++)
+  {
+    auMembers[pEcmpGroups[pNextHops[uIndex].u32Group].u16NumMembers]++;
+  }
+
+  fprintf(stderr, "Building luleå trie with ECMP group leaves\n");
+  LuleaTrieSetLeafType(LULEALEAF_GROUP);
+  BuildLuleaTrie(&root, pNextHops, uNumRoutes);
+  LuleaTrieSetLeafType(LULEALEAF_PREFIX);
+
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    PROUTEENTRY pRoute    = LookupInTree(pu32IPs[uIndex]);
+    uint32_t    u32Flow   = BENCH_FLOW_HASH(pu32IPs[uIndex]);
+    uint32_t    u32Expect = pRoute ? NextHopGroupMember(pRoute->u32Group, u32Flow) : NO_ADJACENCY;
+
+    uMismatches += LuleaTrieLookupFlow(pu32IPs[uIndex], u32Flow) != u32Expect;
+  }
+
+  fprintf(stderr, "Running lulea_flow prefix warm\n");
+  BenchRun("lulea_flow", LookupFlow, pu32IPs, uCount, BENCHDIST_PREFIX, 0, &result);
+
+  fprintf(pOutput, "  \"ecmp\": {\n");
+  fprintf(pOutput, "    \"groups\": %u,\n", NextHopNumGroups());
+  fprintf(pOutput, "    \"prefixes_by_members\": [");
+  for (uIndex = 0; uIndex <= ECMP_MAX_MEMBERS; uIndex++)
+  {
+    fprintf(pOutput, "%u%s", auMembers[uIndex], uIndex < ECMP_MAX_MEMBERS ? ", " : "");
+  }
+  fprintf(pOutput, "],\n");
+  fprintf(pOutput, "    \"flow_ns_per_lookup\": %.3f,\n", result.dMeanNs);
+  fprintf(pOutput, "    \"flow_mlookups_per_sec\": %.3f,\n", result.dMLookupsPerSec);
+  fprintf(pOutput, "    \"flow_mismatches\": %u\n", uMismatches);
+  fprintf(pOutput, "  }\n");
+}
+
+/* Zipf skews the destination cache is swept over, uniform traffic is run first as skew 0 of
+   the whole address space */
+static const double adCacheSkews[] = { 0.0, 0.4, 0.6, 0.8, 0.9, 1.0, 1.1, 1.2, 1.4 };
+#define BENCH_CACHE_SKEWS (sizeof(adCacheSkews) / sizeof(adCacheSkews[0]))
+
+/* Plain against cached luleå lookups from uniform to heavily skewed traffic, to find the
+   skew where the cache starts paying for its probe */
+static void BenchCache(FILE *pOutput, unsigned int uNumRoutes, unsigned int uLookups)
+{
+  double       dCrossover  = -1;
+  unsigned int uRun        = 0;
+  unsigned int uMismatches = 0;
+
+  fprintf(pOutput, "  \"cache\": {\n");
+  fprintf(pOutput, "    \"sets\": %u,\n", LULEA_CACHE_SETS);
+  fprintf(pOutput, "    \"ways\": %d,\n", LULEA_CACHE_WAYS);
+  fprintf(pOutput, "    \"bytes_per_thread\": %zu,\n", sizeof(LULEACACHE));
+  fprintf(pOutput, "    \"sweep\": [\n");
+
+  for (uRun = 0; uRun <= BENCH_CACHE_SKEWS; uRun++)
+  {
+    BENCHDIST     eDist         = uRun ? BENCHDIST_ZIPF : BENCHDIST_UNIFORM;
+    double        dSkew         = uRun ? adCacheSkews[uRun - 1] : 0;
+    unsigned int  uCount        = uLookups;
+    uint32_t     *pu32IPs       = BenchGenerateAddresses(eDist, &uCount, pNextHops, uNumRoutes, dSkew, NULL);
+    uint64_t      u64Lookups    = 0;
+    uint64_t      u64Hits       = 0;
+    uint64_t      u64Before     = 0;
+    uint64_t      u64HitsBefore = 0;
+    unsigned int  uIndex        = 0;
+    BENCHRESULT   plain;
+    BENCHRESULT   cached;
+
+    fprintf(stderr, "Running lulea and lulea_cached %s skew %.2f warm\n", BenchDistName(eDist), dSkew);
+    BenchRun("lulea", LuleaTrieLookupBatch, pu32IPs, uCount, eDist, 0, &plain);
+    /* Every skew starts from an empty cache, BenchRun() warms it with its own pass */
+    if (pLuleaThreadCache)
+    {
+      LuleaCacheFlush(pLuleaThreadCache, pLuleaThreadCache->u32Generation);
+    }
+    LuleaCacheGetStats(&u64Before, &u64HitsBefore);
+    BenchRun("lulea_cached", LuleaTrieLookupCachedBatch, pu32IPs, uCount, eDist, 0, &cached);
+    LuleaCacheGetStats(&u64Lookups, &u64Hits);
+    u64Lookups -= u64Before;
+    u64Hits    -= u64HitsBefore;
+
+    /* The crossover is the first skew where the cached lookup beats the plain one on the same
+       addresses. Uniform traffic is only there for reference. */
+    if (uRun && dCrossover < 0 && cached.dMeanNs < plain.dMeanNs)
+    {
+      dCrossover = dSkew;
+    }
+
+    /* Checked after timing, so the timed runs don't start with a cache this loop warmed */
+    for (uIndex = 0; uIndex < uCount; uIndex++)
+    {
+      uMismatches += LuleaTrieLookupCached(pu32IPs[uIndex]) != LuleaTrieLookup(pu32IPs[uIndex]);
+    }
+
+    fprintf(pOutput, "      { \"distribution\": \"%s\", \"skew\": %.2f, \"hit_rate\": %.4f, "
+            "\"lulea_ns_per_lookup\": %.3f, \"cached_ns_per_lookup\": %.3f }%s\n",
+            BenchDistName(eDist), dSkew, u64Lookups ? (double)u64Hits / u64Lookups : 0.0,
+            plain.dMeanNs, cached.dMeanNs, uRun < BENCH_CACHE_SKEWS ? "," : "");
+    free(pu32IPs);
+  }
+
+  fprintf(pOutput, "    ],\n");
+  if (dCrossover < 0)
+  {
+    fprintf(pOutput, "    \"crossover_skew\": null,\n");
+  }
+  else
+  {
+    fprintf(pOutput, "    \"crossover_skew\": %.2f,\n", dCrossover);
+  }
+  fprintf(pOutput, "    \"mismatches\": %u\n", uMismatches);
+  fprintf(pOutput, "  },\n");
+}
+
+/* One thread per CPU node, pinned to it, times lookups on the replica of every memory node */
+typedef struct tagNUMARUN
+{
+  unsigned int    uCpuNode;
+  const uint32_t *pu32IPs;
+  unsigned int    uCount;
+  int             bPinned;
+  double          dLocalNs;                     /* LuleaTrieLookupBatch(), which picks the replica itself */
+  double          adNs[LULEA_NUMA_MAX_NODES];   /* By memory node */
+} NUMARUN, *PNUMARUN;
+
+static __thread unsigned int uBenchMemoryNode;
+
+static void LookupOnNode(const uint32_t *pu32IPs, uint32_t *pu32Results, unsigned int uCount)
+{
+  unsigned int uIndex = 0;
+
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    pu32Results[uIndex] = LuleaTrieLookupOnNode(uBenchMemoryNode, pu32IPs[uIndex]);
+  }
+}
+
+static void *NumaThread(void *pArg)
+{
+  PNUMARUN     pRun   = pArg;
+  unsigned int uNode  = 0;
+  BENCHRESULT  result;
+
+  pRun->bPinned = LuleaNumaPinToNode(pRun->uCpuNode);
+
+  for (uNode = 0; uNode < LuleaNumaNodes(); uNode++)
+  {
+    fprintf(stderr, "Running lulea on node %u memory from node %u cpus\n", uNode, pRun->uCpuNode);
+    uBenchMemoryNode = uNode;
+    BenchRun("lulea_numa", LookupOnNode, pRun->pu32IPs, pRun->uCount, BENCHDIST_UNIFORM, 0, &result);
+    pRun->adNs[uNode] = result.dMeanNs;
+  }
+
+  BenchRun("lulea_numa", LuleaTrieLookupBatch, pRun->pu32IPs, pRun->uCount, BENCHDIST_UNIFORM, 0, &result);
+  pRun->dLocalNs = result.dMeanNs;
+
+  return NULL;
+}
+
+/* Luleå lookups with the image replicated to every NUMA node, from the CPUs of each node
+   against the replica of each node. The diagonal is local memory. */
+static void BenchNuma(FILE *pOutput, unsigned int uNumRoutes, unsigned int uLookups)
+{
+  unsigned int     uNodes      = 0;
+  unsigned int     uCpuNode    = 0;
+  unsigned int     uNode       = 0;
+  unsigned int     uIndex      = 0;
+  unsigned int     uMismatches = 0;
+  unsigned int     uCount      = uLookups;
+  unsigned int     uLocal      = 0;
+  unsigned int     uRemote     = 0;
+  double           dLocalNs    = 0;
+  double           dRemoteNs   = 0;
+  uint32_t        *pu32IPs     = BenchGenerateAddresses(BENCHDIST_UNIFORM, &uCount, pNextHops, uNumRoutes, 0, NULL);
+  PNUMARUN         pRuns       = NULL;
+  LULEABUILDSTATS  stats;
+
+  uNodes = LuleaTrieSetReplication(1);
+  LuleaTrieGetBuildStats(&stats);
+  pRuns = calloc(uNodes, sizeof(*pRuns));
+  if (!pRuns)
+  {
+    printf("Can't allocate NUMA runs\n");
+    exit(1);
+  }
+
+  for (uNode = 0; uNode < uNodes; uNode++)
+  {
+    for (uIndex = 0; uIndex < uCount; uIndex++)
+    {
+      uMismatches += LuleaTrieLookupOnNode(uNode, pu32IPs[uIndex]) != LookupInTreeIndex(pu32IPs[uIndex]);
+    }
+  }
+
+  /* One node at a time, so runs don't compete for memory bandwidth */
+  for (uCpuNode = 0; uCpuNode < uNodes; uCpuNode++)
+  {
+    pthread_t thread;
+
+    pRuns[uCpuNode].uCpuNode = uCpuNode;
+    pRuns[uCpuNode].pu32IPs  = pu32IPs;
+    pRuns[uCpuNode].uCount   = uCount;
+    if (pthread_create(&thread, NULL, NumaThread, &pRuns[uCpuNode]))
+    {
+      printf("Can't start NUMA benchmark thread\n");
+      exit(1);
+    }
+    pthread_join(thread, NULL);
+
+    for (uNode = 0; uNode < uNodes; uNode++)
+    {
+      if (uNode == uCpuNode)
+      {
+        dLocalNs += pRuns[uCpuNode].adNs[uNode];
+        uLocal++;
+      }
+      else
+      {
+        dRemoteNs += pRuns[uCpuNode].adNs[uNode];
+        uRemote++;
+      }
+    }
+  }
+  LuleaTrieSetReplication(0);
+
+  fprintf(pOutput, "  \"numa\": {\n");
+  fprintf(pOutput, "    \"nodes\": %u,\n", uNodes);
+  fprintf(pOutput, "    \"replica_bytes\": %llu,\n", (unsigned long long)stats.u64ReplicaBytes);
+  fprintf(pOutput, "    \"ns_per_lookup\": [");
+  for (uCpuNode = 0; uCpuNode < uNodes; uCpuNode++)
+  {
+    fprintf(pOutput, "%s{ \"cpu_node\": %u, \"pinned\": %s, \"dispatched\": %.3f, \"by_memory_node\": [",
+            uCpuNode ? ", " : " ", uCpuNode, pRuns[uCpuNode].bPinned ? "true" : "false", pRuns[uCpuNode].dLocalNs);
+    for (uNode = 0; uNode < uNodes; uNode++)
+    {
+      fprintf(pOutput, "%s%.3f", uNode ? ", " : "", pRuns[uCpuNode].adNs[uNode]);
+    }
+    fprintf(pOutput, "] }");
+  }
+  fprintf(pOutput, " ],\n");
+  fprintf(pOutput, "    \"local_ns_per_lookup\": %.3f,\n", uLocal ? dLocalNs / uLocal : 0.0);
+  if (uRemote)
+  {
+    fprintf(pOutput, "    \"remote_ns_per_lookup\": %.3f,\n", dRemoteNs / uRemote);
+  }
+  else
+  {
+    fprintf(pOutput, "    \"remote_ns_per_lookup\": null,\n");
+  }
+  fprintf(pOutput, "    \"mismatches\": %u\n", uMismatches);
+  fprintf(pOutput, "  },\n");
+
+  free(pRuns);
+  free(pu32IPs);
+}
+
+typedef struct tagRANGELIST
+{
+  uint32_t    *pu32Ranges;   /* Start, size and next hop index of each range */
+  unsigned int uNumRanges;
+  unsigned int uMaxRanges;
+} RANGELIST, *PRANGELIST;
+
+static int CollectRange(uint32_t u32Start, uint32_t u32Size, uint32_t u32NextHopIndex, void *pContext)
+{
+  PRANGELIST pList = pContext;
+
+  if (pList->uNumRanges == pList->uMaxRanges)
+  {
+    pList->uMaxRanges = pList->uMaxRanges ? pList->uMaxRanges * 2 : 65536;
+    pList->pu32Ranges = realloc(pList->pu32Ranges, pList->uMaxRanges * 3 * sizeof(uint32_t));
+    if (!pList->pu32Ranges)
+    {
+      printf("Can't allocate range list\n");
+      exit(1);
+    }
+  }
+  pList->pu32Ranges[pList->uNumRanges * 3]     = u32Start;
+  pList->pu32Ranges[pList->uNumRanges * 3 + 1] = u32Size;
+  pList->pu32Ranges[pList->uNumRanges * 3 + 2] = u32NextHopIndex;
+  pList->uNumRanges++;
+
+  return 1;
+}
+
+static unsigned int PrefixLength(const ROUTEENTRY *pRoute)
+{
+  return pRoute->u32Size ? 32 - __builtin_ctz(pRoute->u32Size) : 0;
+}
+
+/* Control plane work on the radix tree and the LC-trie: building from the prefixes, longest
+   match queries, the range walk a luleå build starts from, and withdrawing and re-adding every
+   tenth prefix in place. The radix tree can't delete, it is rebuilt instead. */
+static void BenchControlPlane(FILE *pOutput, unsigned int uNumRoutes, unsigned int uLookups)
+{
+  TREENODE         tree        = { 0 };
+  LCTRIE           trie;
+  RANGELIST        radixRanges = { 0 };
+  RANGELIST        lcRanges    = { 0 };
+  unsigned int     uCount      = uLookups;
+  uint32_t        *pu32IPs     = BenchGenerateAddresses(BENCHDIST_PREFIX, &uCount, pNextHops, uNumRoutes, 0, NULL);
+  unsigned int     uIndex      = 0;
+  unsigned int     uChurn      = 0;
+  unsigned int     uMismatches = 0;
+  unsigned int     uWalkMismatches = 0;
+  size_t           uTreeBytes  = PrefixTreeBytes();
+  uint32_t         u32Sum      = 0;
+  double           adBuildMs[2];
+  double           adQueryNs[2];
+  double           adWalkMs[2];
+  double           dDeleteMs   = 0;
+  double           dInsertMs   = 0;
+  struct timespec  sooner;
+
+  fprintf(stderr, "Running control plane radix and lctrie\n");
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  BuildPrefixTreeFrom(&tree, pNextHops, uNumRoutes, 0);
+  adBuildMs[0] = BenchElapsedMs(&sooner);
+  uTreeBytes   = PrefixTreeBytes() - uTreeBytes;
+
+  /* Widest first, so duplicates keep the first index like the radix tree */
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  LcTrieInit(&trie);
+  for (uIndex = uNumRoutes; uIndex--; )
+  {
+    LcTrieInsert(&trie, pNextHops[uIndex].u32Start, PrefixLength(&pNextHops[uIndex]), uIndex);
+  }
+  adBuildMs[1] = BenchElapsedMs(&sooner);
+
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    u32Sum += LookupInTreeIndexAt(&tree, pu32IPs[uIndex]);
+  }
+  adQueryNs[0] = BenchElapsedMs(&sooner) * 1000000.0 / uCount;
+
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    u32Sum += LcTrieLookup(&trie, pu32IPs[uIndex]);
+  }
+  adQueryNs[1] = BenchElapsedMs(&sooner) * 1000000.0 / uCount;
+
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  WalkPrefixTree(&tree, CollectRange, &radixRanges);
+  adWalkMs[0] = BenchElapsedMs(&sooner);
+
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  LcTrieWalk(&trie, CollectRange, &lcRanges);
+  adWalkMs[1] = BenchElapsedMs(&sooner);
+
+  /* The compiler has to get the same ranges from either */
+  uWalkMismatches = radixRanges.uNumRanges != lcRanges.uNumRanges;
+  for (uIndex = 0; uIndex < radixRanges.uNumRanges && uIndex < lcRanges.uNumRanges; uIndex++)
+  {
+    uWalkMismatches += memcmp(&radixRanges.pu32Ranges[uIndex * 3], &lcRanges.pu32Ranges[uIndex * 3], 3 * sizeof(uint32_t)) != 0;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  for (uIndex = 0; uIndex < uNumRoutes; uIndex += 10)
+  {
+    uChurn += LcTrieDelete(&trie, pNextHops[uIndex].u32Start, PrefixLength(&pNextHops[uIndex]));
+  }
+  dDeleteMs = BenchElapsedMs(&sooner);
+
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  for (uIndex = 0; uIndex < uNumRoutes; uIndex += 10)
+  {
+    LcTrieInsert(&trie, pNextHops[uIndex].u32Start, PrefixLength(&pNextHops[uIndex]), uIndex);
+  }
+  dInsertMs = BenchElapsedMs(&sooner);
+
+  /* Duplicates re-added above may now hold a later index than the tree, so compare prefixes */
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    uint32_t u32Radix = LookupInTreeIndexAt(&tree, pu32IPs[uIndex]);
+    uint32_t u32Lc    = LcTrieLookup(&trie, pu32IPs[uIndex]);
+
+    if (u32Radix != u32Lc &&
+        (u32Radix == NO_NEXT_HOP || u32Lc == NO_NEXT_HOP ||
+         pNextHops[u32Radix].u32Start != pNextHops[u32Lc].u32Start || pNextHops[u32Radix].u32Size != pNextHops[u32Lc].u32Size))
+    {
+      uMismatches++;
+    }
+  }
+
+  fprintf(pOutput, "  \"control_plane\": {\n");
+  fprintf(pOutput, "    \"engines\": [\"radix\", \"lctrie\"],\n");
+  fprintf(pOutput, "    \"prefixes\": %u,\n", trie.u32NumPrefixes);
+  fprintf(pOutput, "    \"lctrie_nodes\": %u,\n", trie.u32NumNodes);
+  fprintf(pOutput, "    \"bytes\": [%zu, %zu],\n", uTreeBytes, LcTrieBytes(&trie));
+  fprintf(pOutput, "    \"build_ms\": [%.3f, %.3f],\n", adBuildMs[0], adBuildMs[1]);
+  fprintf(pOutput, "    \"query_ns\": [%.3f, %.3f],\n", adQueryNs[0], adQueryNs[1]);
+  fprintf(pOutput, "    \"range_walk_ms\": [%.3f, %.3f],\n", adWalkMs[0], adWalkMs[1]);
+  fprintf(pOutput, "    \"ranges\": [%u, %u],\n", radixRanges.uNumRanges, lcRanges.uNumRanges);
+  fprintf(pOutput, "    \"lctrie_delete_ns\": %.3f,\n", uChurn ? dDeleteMs * 1000000.0 / uChurn : 0.0);
+  fprintf(pOutput, "    \"lctrie_insert_ns\": %.3f,\n", uChurn ? dInsertMs * 1000000.0 / uChurn : 0.0);
+  fprintf(pOutput, "    \"checksum\": %u,\n", u32Sum);
+  fprintf(pOutput, "    \"range_mismatches\": %u,\n", uWalkMismatches);
+  fprintf(pOutput, "    \"mismatches\": %u\n", uMismatches);
+  fprintf(pOutput, "  },\n");
+
+  FreePrefixTreeAt(&tree);
+  LcTrieFree(&trie);
+  free(radixRanges.pu32Ranges);
+  free(lcRanges.pu32Ranges);
+  free(pu32IPs);
+}
+
+/* The luleå trie walked with 16, 24 and 32 bit pointers, where the table fits them */
+static void BenchPointerWidth(FILE *pOutput, unsigned int uNumRoutes, unsigned int uLookups)
+{
+  static const unsigned int auWidths[] = { 16, 24, 32 };
+  unsigned int     uWidth      = 0;
+  unsigned int     uMismatches = 0;
+  unsigned int     auCounts[2] = { uLookups, uLookups };
+  uint32_t        *apu32IPs[2];
+  LULEABUILDSTATS  stats;
+  BENCHRESULT      uniform;
+  BENCHRESULT      prefix;
+
+  apu32IPs[0] = BenchGenerateAddresses(BENCHDIST_UNIFORM, &auCounts[0], pNextHops, uNumRoutes, 0, NULL);
+  apu32IPs[1] = BenchGenerateAddresses(BENCHDIST_PREFIX, &auCounts[1], pNextHops, uNumRoutes, 0, NULL);
+
+  fprintf(pOutput, "  \"pointer_width\": {\n");
+  fprintf(pOutput, "    \"runs\": [\n");
+  for (uWidth = 0; uWidth < 3; uWidth++)
+  {
+    unsigned int uBits = LuleaTrieSetPointerWidth(auWidths[uWidth]);
+
+    LuleaTrieGetBuildStats(&stats);
+    uMismatches += VerifyRanges(LookupEngineFind("lulea"), stderr, &root, pNextHops, VERIFY_DEFAULT_REPORT);
+
+    /* A width the table doesn't fit falls back to a wider one, which its own run measures */
+    if (uBits != auWidths[uWidth])
+    {
+      fprintf(pOutput, "      { \"requested_bits\": %u, \"bits\": %u, \"image_bytes\": null, "
+              "\"uniform_ns_per_lookup\": null, \"prefix_ns_per_lookup\": null }%s\n",
+              auWidths[uWidth], uBits, uWidth < 2 ? "," : "");
+      continue;
+    }
+
+    fprintf(stderr, "Running lulea with %u bit pointers\n", uBits);
+    BenchRun("lulea", LuleaTrieLookupBatch, apu32IPs[0], auCounts[0], BENCHDIST_UNIFORM, 0, &uniform);
+    BenchRun("lulea", LuleaTrieLookupBatch, apu32IPs[1], auCounts[1], BENCHDIST_PREFIX, 0, &prefix);
+
+    fprintf(pOutput, "      { \"requested_bits\": %u, \"bits\": %u, \"image_bytes\": %llu, "
+            "\"uniform_ns_per_lookup\": %.3f, \"prefix_ns_per_lookup\": %.3f }%s\n",
+            auWidths[uWidth], uBits, (unsigned long long)(uBits < 32 ? stats.au64PackedBytes[uBits / 8 - 2] : stats.u64ImageBytes),
+            uniform.dMeanNs, prefix.dMeanNs, uWidth < 2 ? "," : "");
+  }
+  fprintf(pOutput, "    ],\n");
+
+  /* Sized by the 16 bit run, which sizes every width */
+  LuleaTrieSetPointerWidth(16);
+  LuleaTrieGetBuildStats(&stats);
+  LuleaTrieSetPointerWidth(32);
+  fprintf(pOutput, "    \"image_bytes_by_width\": {");
+  for (uWidth = 0; uWidth < 3; uWidth++)
+  {
+    if (stats.abPackedFits[uWidth])
+    {
+      fprintf(pOutput, " \"%u\": %llu", auWidths[uWidth], (unsigned long long)stats.au64PackedBytes[uWidth]);
+    }
+    else
+    {
+      fprintf(pOutput, " \"%u\": null", auWidths[uWidth]);
+    }
+    fprintf(pOutput, "%s", uWidth < 2 ? "," : " },\n");
+  }
+  fprintf(pOutput, "    \"mismatches\": %u\n", uMismatches);
+  fprintf(pOutput, "  },\n");
+
+  free(apu32IPs[0]);
+  free(apu32IPs[1]);
+}
+
+/* The luleå trie with and without its /32s split out into the host route table */
+static void BenchHostRoutes(FILE *pOutput, unsigned int uNumRoutes, unsigned int uLookups)
+{
+  static const BENCHDIST aeSets[] = { BENCHDIST_UNIFORM, BENCHDIST_PREFIX, BENCHDIST_HOSTS };
+  LULEABUILDSTATS     aStats[2];
+  double              adBuildMs[2];
+  double              adNs[2][3];
+  unsigned int        uSplit      = 0;
+  unsigned int        uSet        = 0;
+  unsigned int        uMismatches = 0;
+  uint32_t           *apu32IPs[3];
+  unsigned int        auCounts[3] = { uLookups, uLookups, uLookups };
+  struct timespec     sooner;
+  BENCHRESULT         result;
+
+  for (uSet = 0; uSet < 3; uSet++)
+  {
+    apu32IPs[uSet] = BenchGenerateAddresses(aeSets[uSet], &auCounts[uSet], pNextHops, uNumRoutes, 0, NULL);
+  }
+
+  for (uSplit = 0; uSplit < 2; uSplit++)
+  {
+    fprintf(stderr, "Building luleå trie %s host routes\n", uSplit ? "without" : "with");
+    LuleaTrieSetHostRoutes(uSplit);
+    clock_gettime(CLOCK_MONOTONIC, &sooner);
+    BuildLuleaTrie(&root, pNextHops, uNumRoutes);
+    adBuildMs[uSplit] = BenchElapsedMs(&sooner);
+    LuleaTrieGetBuildStats(&aStats[uSplit]);
+
+    uMismatches += VerifyRanges(LookupEngineFind("lulea"), stderr, &root, pNextHops, VERIFY_DEFAULT_REPORT);
+
+    for (uSet = 0; uSet < 3; uSet++)
+    {
+      fprintf(stderr, "Running lulea%s %s warm\n", uSplit ? "_hosts" : "", BenchDistName(aeSets[uSet]));
+      BenchRun(uSplit ? "lulea_hosts" : "lulea", LuleaTrieLookupBatch, apu32IPs[uSet], auCounts[uSet], aeSets[uSet], 0,
+               &result);
+      adNs[uSplit][uSet] = result.dMeanNs;
+    }
+  }
+  LuleaTrieSetHostRoutes(0);
+
+  fprintf(pOutput, "  \"host_routes\": {\n");
+  fprintf(pOutput, "    \"host_routes\": %u,\n", aStats[1].u32HostRoutes);
+  fprintf(pOutput, "    \"host_table_bytes\": %llu,\n", (unsigned long long)aStats[1].u64HostTableBytes);
+  fprintf(pOutput, "    \"trie_bytes\": [%llu, %llu],\n", (unsigned long long)aStats[0].u64ImageBytes,
+          (unsigned long long)aStats[1].u64ImageBytes);
+  fprintf(pOutput, "    \"level2_chunks\": [%u, %u],\n", aStats[0].au32Chunks[1], aStats[1].au32Chunks[1]);
+  fprintf(pOutput, "    \"level3_chunks\": [%u, %u],\n", aStats[0].au32Chunks[2], aStats[1].au32Chunks[2]);
+  fprintf(pOutput, "    \"build_ms\": [%.3f, %.3f],\n", adBuildMs[0], adBuildMs[1]);
+  fprintf(pOutput, "    \"ns_per_lookup\": {");
+  for (uSet = 0; uSet < 3; uSet++)
+  {
+    fprintf(pOutput, " \"%s\": [%.3f, %.3f]%s", BenchDistName(aeSets[uSet]), adNs[0][uSet], adNs[1][uSet], uSet < 2 ? "," : " },\n");
+  }
+  fprintf(pOutput, "    \"mismatches\": %u\n", uMismatches);
+  fprintf(pOutput, "  },\n");
+
+  for (uSet = 0; uSet < 3; uSet++)
+  {
+    free(apu32IPs[uSet]);
+  }
+}
+
+static void Usage(char *pszProgram)
+{
+  printf("Usage: %s [options] <bgp dump file>\n", pszProgram);
+  printf("  -d <dist>   uniform, prefix, zipf, trace, host_neighbourhood or all, which leaves host_neighbourhood out (default all)\n");
+  printf("  -c <cache>  warm, cold or both (default both)\n");
+  printf("  -n <count>  number of lookups per run (default %d)\n", BENCH_DEFAULT_LOOKUPS);
+  printf("  -s <skew>   zipf skew (default 1.0)\n");
+  printf("  -t <file>   address trace to replay, one dotted quad per line\n");
+  printf("  -o <file>   write JSON results to file instead of stdout\n");
+  printf("  -H <file>   write lookup termination counters and level 1 heat map (needs a STATS=yes build)\n");
+  printf("  -T <file>   record what a sample of luleå lookups touch for lulea_cachesim (needs a TRACE=yes build)\n");
+  printf("  -R <n>      record every n:th lookup (default %d)\n", BENCH_DEFAULT_TRACE_RATE);
+  exit(1);
+}
+
+/* Lookups of the -d distribution, prefix unless given, through the luleå trie as built above */
+static void RecordTrace(const char *pszFile, int iDist, unsigned int uNumRoutes, unsigned int uLookups,
+                        unsigned int uSampleRate, double dZipfSkew, const char *pszTrace)
+{
+#ifdef LULEA_TRACE
+  unsigned int  uCount      = uLookups;
+  uint32_t     *pu32IPs     = BenchGenerateAddresses(iDist < 0 ? BENCHDIST_PREFIX : iDist, &uCount, pNextHops, uNumRoutes,
+                                                     dZipfSkew, pszTrace);
+  uint32_t     *pu32Results = malloc(uCount * sizeof(*pu32Results));
+  size_t        uImageBytes = 0;
+
+  if (!pu32Results)
+  {
+    printf("Can't allocate lookup results\n");
+    exit(1);
+  }
+
+  LuleaTrieImage(&uImageBytes);
+  LuleaTraceStart(uSampleRate, uCount / uSampleRate + 1);
+  LuleaTrieLookupBatch(pu32IPs, pu32Results, uCount);
+  fprintf(stderr, "Recorded %u of %u lookups to %s\n", LuleaTraceStop(), uCount, pszFile);
+
+  if (!LuleaTraceSave(pszFile, uImageBytes, RESULT_TABLE_NEXT_HOP_BYTES))
+  {
+    exit(1);
+  }
+
+  free(pu32IPs);
+  free(pu32Results);
+#else
+  fprintf(stderr, "Lookup tracing is not compiled in, rebuild with TRACE=yes\n");
+#endif
+}
+
+int main(int argc, char **argv)
+{
+  PPREFIXES    pPrefixes   = NULL;
+  FILE        *pOutput     = stdout;
+  const char  *pszTrace    = NULL;
+  const char  *pszDump     = NULL;
+  const char  *pszStats    = NULL;
+  const char  *pszRecord   = NULL;
+  unsigned int uSampleRate = BENCH_DEFAULT_TRACE_RATE;
+  double       dZipfSkew   = 1.0;
+  unsigned int uLookups    = BENCH_DEFAULT_LOOKUPS;
+  unsigned int uNumRoutes  = 0;
+  int          iDist       = -1;
+  int          bWarm       = 1;
+  int          bCold       = 1;
+  int          iOption     = 0;
+  int          iDistIndex  = 0;
+  int          iCold       = 0;
+  unsigned int uEngine     = 0;
+  unsigned int uNumRuns    = 0;
+  unsigned int uRun        = 0;
+  BENCHRESULT  result;
+  ENGINEBUILD *pBuilds     = NULL;
+  double       dTreeMs     = 0;
+  struct       timespec sooner;
+
+  while ((iOption = getopt(argc, argv, "d:c:n:s:t:o:H:T:R:")) != -1)
+  {
+    switch (iOption)
+    {
+      case 'd':
+        if (strcmp(optarg, "all"))
+        {
+          iDist = BenchDistFromName(optarg);
+          if (iDist < 0)
+          {
+            Usage(argv[0]);
+          }
+        }
+        break;
+      case 'c':
+        bWarm = strcmp(optarg, "cold") != 0;
+        bCold = strcmp(optarg, "warm") != 0;
+        break;
+      case 'n':
+        uLookups = strtoul(optarg, NULL, 0);
+        break;
+      case 's':
+        dZipfSkew = strtod(optarg, NULL);
+        break;
+      case 't':
+        pszTrace = optarg;
+        break;
+      case 'H':
+        pszStats = optarg;
+        break;
+      case 'T':
+        pszRecord = optarg;
+        break;
+      case 'R':
+        uSampleRate = strtoul(optarg, NULL, 0);
+        break;
+      case 'o':
+        pOutput = fopen(optarg, "w");
+        if (!pOutput)
+        {
+          printf("Could not open %s for writing\n", optarg);
+          exit(1);
+        }
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+
+  if (optind >= argc || (iDist == BENCHDIST_TRACE && !pszTrace) || !uSampleRate)
+  {
+    Usage(argv[0]);
+  }
+  pszDump = argv[optind];
+
+  /* Progress goes to stderr so stdout can be piped straight into a JSON tool */
+  fprintf(stderr, "Reading BGP from file\n");
+  pPrefixes  = ReadFromBgpDump((char *)pszDump);
+  uNumRoutes = pPrefixes->uTotalPrefixes;
+  pBuilds = calloc(uNumLookupEngines, sizeof(*pBuilds));
+  if (!pBuilds)
+  {
+    printf("Can't allocate engine build results\n");
+    exit(1);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  pNextHops  = BuildPrefixTree(pPrefixes);
+  dTreeMs    = BenchElapsedMs(&sooner);
+
+  for (uEngine = 0; uEngine < uNumLookupEngines; uEngine++)
+  {
+    const LOOKUPENGINE *pEngine = &aLookupEngines[uEngine];
+
+    /* The radix tree is the input to the other engines, its build time is the tree's */
+    pBuilds[uEngine].dBuildMs = dTreeMs;
+    if (pEngine->fpBuild)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &sooner);
+      if (!pEngine->fpBuild(&root, pNextHops, uNumRoutes))
+      {
+        fprintf(stderr, "Building %s failed\n", pEngine->pszName);
+        exit(1);
+      }
+      pBuilds[uEngine].dBuildMs = BenchElapsedMs(&sooner);
+    }
+    pBuilds[uEngine].uBytes = pEngine->fpBytes();
+
+    /* Only compare engines that give the same answers */
+    if (VerifyRanges(pEngine, stderr, &root, pNextHops, VERIFY_DEFAULT_REPORT))
+    {
+      fprintf(stderr, "%s does not match the radix tree\n", pEngine->pszName);
+      exit(1);
+    }
+  }
+  fprintf(stderr, "Built tables for %u prefixes, tsc at %.3f GHz\n", uNumRoutes, BenchTscGhz());
+
+  for (iDistIndex = 0; iDistIndex < BENCHDIST_MAX; iDistIndex++)
+  {
+    if ((iDist < 0 && (iDistIndex != BENCHDIST_TRACE || pszTrace) && iDistIndex != BENCHDIST_HOSTS) || iDist == iDistIndex)
+    {
+      uNumRuns += (bWarm + bCold) * uNumLookupEngines;
+    }
+  }
+
+  fprintf(pOutput, "{\n");
+  fprintf(pOutput, "  \"dump\": \"%s\",\n", pszDump);
+  fprintf(pOutput, "  \"prefixes\": %u,\n", uNumRoutes);
+  fprintf(pOutput, "  \"tsc_ghz\": %.4f,\n", BenchTscGhz());
+  fprintf(pOutput, "  \"batch\": %d,\n", BENCH_BATCH);
+  fprintf(pOutput, "  \"zipf_skew\": %.3f,\n", dZipfSkew);
+  fprintf(pOutput, "  \"engines\": [\n");
+  for (uEngine = 0; uEngine < uNumLookupEngines; uEngine++)
+  {
+    fprintf(pOutput, "    { \"engine\": \"%s\", \"build_ms\": %.3f, \"memory_bytes\": %zu, \"bytes_per_prefix\": %.2f }%s\n",
+            aLookupEngines[uEngine].pszName, pBuilds[uEngine].dBuildMs, pBuilds[uEngine].uBytes,
+            uNumRoutes ? (double)pBuilds[uEngine].uBytes / uNumRoutes : 0, uEngine + 1 < uNumLookupEngines ? "," : "");
+  }
+  fprintf(pOutput, "  ],\n");
+  fprintf(pOutput, "  \"results\": [\n");
+
+  for (iDistIndex = 0; iDistIndex < BENCHDIST_MAX; iDistIndex++)
+  {
+    uint32_t     *pu32IPs = NULL;
+    unsigned int  uCount  = uLookups;
+
+    if (!((iDist < 0 && (iDistIndex != BENCHDIST_TRACE || pszTrace) && iDistIndex != BENCHDIST_HOSTS) || iDist == iDistIndex))
+    {
+      continue;
+    }
+
+    pu32IPs = BenchGenerateAddresses(iDistIndex, &uCount, pNextHops, uNumRoutes, dZipfSkew, pszTrace);
+
+    for (iCold = 0; iCold < 2; iCold++)
+    {
+      if ((iCold && !bCold) || (!iCold && !bWarm))
+      {
+        continue;
+      }
+
+      for (uEngine = 0; uEngine < uNumLookupEngines; uEngine++)
+      {
+        pCurrentEngine = &aLookupEngines[uEngine];
+        fprintf(stderr, "Running %s %s %s\n", pCurrentEngine->pszName, BenchDistName(iDistIndex), iCold ? "cold" : "warm");
+        BenchRun(pCurrentEngine->pszName, LookupEngine, pu32IPs, uCount, iDistIndex, iCold, &result);
+        BenchPrintJsonResult(pOutput, &result, ++uRun == uNumRuns);
+      }
+    }
+
+    free(pu32IPs);
+  }
+
+  fprintf(pOutput, "  ],\n");
+
+  if (pszRecord)
+  {
+    RecordTrace(pszRecord, iDist, uNumRoutes, uLookups, uSampleRate, dZipfSkew, pszTrace);
+  }
+
+  BenchCache(pOutput, uNumRoutes, uLookups);
+  BenchNuma(pOutput, uNumRoutes, uLookups);
+  BenchControlPlane(pOutput, uNumRoutes, uLookups);
+  BenchPointerWidth(pOutput, uNumRoutes, uLookups);
+  BenchHostRoutes(pOutput, uNumRoutes, uLookups);
+
+  /* Last, as they replace the luleå trie with ones holding path list and group leaves */
+  {
+    unsigned int  uCount  = uLookups;
+    uint32_t     *pu32IPs = BenchGenerateAddresses(BENCHDIST_PREFIX, &uCount, pNextHops, uNumRoutes, dZipfSkew, NULL);
+
+    BenchFailover(pOutput, uNumRoutes, pu32IPs, uCount);
+    BenchEcmp(pOutput, uNumRoutes, pu32IPs, uCount);
+    free(pu32IPs);
+  }
+  fprintf(pOutput, "}\n");
+  if (pOutput != stdout)
+  {
+    fclose(pOutput);
+  }
+
+  if (pszStats)
+  {
+#ifdef LULEA_STATS
+    LULEASTATS  stats;
+    FILE       *pFile = fopen(pszStats, "w");
+
+    if (!pFile)
+    {
+      printf("Could not open %s for writing\n", pszStats);
+      exit(1);
+    }
+    /* Covers every Luleå run above, including warm up passes */
+    LuleaStatsSnapshot(&stats);
+    LuleaStatsWriteJson(pFile, &stats);
+    LuleaStatsDumpHeatMap(pFile, &stats);
+    fclose(pFile);
+#else
+    fprintf(stderr, "Lookup counters are not compiled in, rebuild with STATS=yes\n");
+#endif
+  }
+
+  return 0;
+}
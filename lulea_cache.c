@@ -0,0 +1,84 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lulea_cache.h"
+
+__thread PLULEACACHE pLuleaThreadCache;
+
+/* Every thread that ever did a cached lookup, never freed, same as the lookup statistics */
+static PLULEACACHE pThreadCacheList;
+
+PLULEACACHE LuleaCacheRegisterThread(void)
+{
+  PLULEACACHE pCache = NULL;
+
+  pCache = aligned_alloc(64, sizeof(*pCache));
+  if (!pCache)
+  {
+    printf("Can't allocate destination cache\n");
+    exit(1);
+  }
+  /* Generation 0 is never a trie generation, so the first lookup flushes the cache */
+  memset(pCache, 0, sizeof(*pCache));
+
+  pCache->pNext = __atomic_load_n(&pThreadCacheList, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&pThreadCacheList, &pCache->pNext, pCache, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+  {
+  }
+
+  pLuleaThreadCache = pCache;
+
+  return pCache;
+}
+
+/* Called by the owning thread on its first lookup after the trie was rebuilt or swapped */
+void LuleaCacheFlush(PLULEACACHE pCache, uint32_t u32Generation)
+{
+  unsigned int uSet = 0;
+  unsigned int uWay = 0;
+
+  for (uSet = 0; uSet < LULEA_CACHE_SETS; uSet++)
+  {
+    for (uWay = 0; uWay < LULEA_CACHE_WAYS; uWay++)
+    {
+      pCache->aSets[uSet].au32Keys[uWay]    = 0;
+      pCache->aSets[uSet].au32Results[uWay] = LULEA_CACHE_EMPTY;
+    }
+  }
+
+  pCache->u32Generation = u32Generation;
+}
+
+/* Summed over all threads, counters of threads doing lookups meanwhile may be off by a few */
+void LuleaCacheGetStats(uint64_t *pu64Lookups, uint64_t *pu64Hits)
+{
+  PLULEACACHE pCache = __atomic_load_n(&pThreadCacheList, __ATOMIC_ACQUIRE);
+
+  *pu64Lookups = 0;
+  *pu64Hits    = 0;
+
+  for (; pCache; pCache = pCache->pNext)
+  {
+    *pu64Lookups += __atomic_load_n(&pCache->u64Lookups, __ATOMIC_RELAXED);
+    *pu64Hits    += __atomic_load_n(&pCache->u64Hits, __ATOMIC_RELAXED);
+  }
+}
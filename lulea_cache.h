@@ -0,0 +1,60 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LULEA_CACHE_H__
+#define __LULEA_CACHE_H__
+
+#include <stdint.h>
+
+/* Per thread destination cache in front of the luleå trie, see LuleaTrieLookupCached().
+   2 way set associative, keyed by the full /32, so it is right whatever prefix lengths the
+   table holds. 16 kB per thread, to stay in L1 next to the level 1 codewords it saves. */
+#define LULEA_CACHE_SET_BITS (10)
+#define LULEA_CACHE_SETS     (1U << LULEA_CACHE_SET_BITS)
+#define LULEA_CACHE_WAYS     (2)
+
+/* Trie values never have the next level pointer bit set, except NO_NEXT_HOP, so it marks empty ways */
+#define LULEA_CACHE_EMPTY    (1U << 31)
+
+/* Multiplicative hash, so addresses that only differ in the low bits spread over the sets */
+#define LULEA_CACHE_SET(u32IP) (((u32IP) * 0x9E3779B1U) >> (32 - LULEA_CACHE_SET_BITS))
+
+/* Way 0 is the most recently used */
+typedef struct tagLULEACACHESET
+{
+  uint32_t au32Keys[LULEA_CACHE_WAYS];
+  uint32_t au32Results[LULEA_CACHE_WAYS];
+} LULEACACHESET, *PLULEACACHESET;
+
+typedef struct tagLULEACACHE
+{
+  uint32_t u32Generation; /* Trie generation the entries were looked up in */
+  uint64_t u64Lookups;
+  uint64_t u64Hits;
+
+  struct tagLULEACACHE *pNext;
+
+  LULEACACHESET aSets[LULEA_CACHE_SETS] __attribute__((aligned(64)));
+} LULEACACHE, *PLULEACACHE;
+
+extern __thread PLULEACACHE pLuleaThreadCache;
+
+PLULEACACHE LuleaCacheRegisterThread(void);
+void        LuleaCacheFlush(PLULEACACHE pCache, uint32_t u32Generation);
+void        LuleaCacheGetStats(uint64_t *pu64Lookups, uint64_t *pu64Hits);
+
+#endif /* __LULEA_CACHE_H__ */
@@ -0,0 +1,421 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lulea_trace.h"
+#include "result_table.h"
+
+/* Replays a lookup trace recorded with lulea_bench -T through set associative caches and a
+   TLB, so the effect of a layout change can be predicted from a trace instead of measured on
+   the target box. Every level is filled on a miss, LRU within a set. The image, the host
+   route table and the next hop array are placed in separate page aligned regions. */
+
+#define CACHESIM_LEVELS       (3)
+#define CACHESIM_REGION_SHIFT (40)
+
+typedef struct tagCACHELEVEL
+{
+  const char  *pszName;
+  uint64_t     u64Bytes;        /* Capacity, or entries for a TLB */
+  unsigned int uWays;
+  unsigned int uSets;
+  unsigned int uBlockShift;     /* Line or page size */
+  uint64_t    *pu64Tags;        /* Block number + 1, 0 is an empty way */
+  uint64_t    *pu64LastUse;
+  uint64_t     u64Clock;
+  uint64_t     u64Accesses;
+  uint64_t     u64Misses;
+  uint64_t     au64Misses[LULEATRACE_MAX];
+} CACHELEVEL, *PCACHELEVEL;
+
+/* Distinct blocks touched, open addressing over block number + 1 */
+typedef struct tagBLOCKSET
+{
+  uint64_t    *pu64Blocks;
+  uint64_t     u64Mask;
+  uint64_t     u64Count;
+} BLOCKSET, *PBLOCKSET;
+
+static unsigned int Log2(uint64_t u64Value)
+{
+  return 63 - __builtin_clzll(u64Value);
+}
+
+/* Accepts k, m and g suffixes */
+static uint64_t ParseSize(const char *pszValue, char **ppszEnd)
+{
+  uint64_t u64Value = strtoull(pszValue, ppszEnd, 0);
+
+  switch (**ppszEnd)
+  {
+    case 'k': case 'K': u64Value <<= 10; (*ppszEnd)++; break;
+    case 'm': case 'M': u64Value <<= 20; (*ppszEnd)++; break;
+    case 'g': case 'G': u64Value <<= 30; (*ppszEnd)++; break;
+  }
+
+  return u64Value;
+}
+
+/* "size,ways" */
+static int ParseGeometry(const char *pszValue, uint64_t *pu64Bytes, unsigned int *puWays)
+{
+  char *pszEnd = NULL;
+
+  *pu64Bytes = ParseSize(pszValue, &pszEnd);
+  if (*pszEnd != ',')
+  {
+    return 0;
+  }
+  *puWays = strtoul(pszEnd + 1, &pszEnd, 0);
+
+  return !*pszEnd && *pu64Bytes && *puWays;
+}
+
+static void InitLevel(PCACHELEVEL pLevel, const char *pszName, uint64_t u64Blocks, unsigned int uWays, unsigned int uBlockBytes)
+{
+  pLevel->pszName     = pszName;
+  pLevel->uWays       = uWays;
+  pLevel->uSets       = u64Blocks / uWays;
+  pLevel->uBlockShift = Log2(uBlockBytes);
+
+  if (!pLevel->uSets || pLevel->uSets & (pLevel->uSets - 1))
+  {
+    printf("%s: %llu blocks over %u ways doesn't give a power of two number of sets\n", pszName,
+           (unsigned long long)u64Blocks, uWays);
+    exit(1);
+  }
+
+  pLevel->pu64Tags    = calloc((size_t)pLevel->uSets * uWays, sizeof(uint64_t));
+  pLevel->pu64LastUse = calloc((size_t)pLevel->uSets * uWays, sizeof(uint64_t));
+  if (!pLevel->pu64Tags || !pLevel->pu64LastUse)
+  {
+    printf("Can't allocate %s model\n", pszName);
+    exit(1);
+  }
+}
+
+/* Returns 1 on a hit. Misses replace the least recently used way. */
+static int AccessLevel(PCACHELEVEL pLevel, uint64_t u64Address, unsigned int uKind, int bCount)
+{
+  uint64_t     u64Block  = (u64Address >> pLevel->uBlockShift) + 1;
+  uint64_t    *pu64Tags  = &pLevel->pu64Tags[(size_t)(u64Block & (pLevel->uSets - 1)) * pLevel->uWays];
+  uint64_t    *pu64Uses  = &pLevel->pu64LastUse[pu64Tags - pLevel->pu64Tags];
+  unsigned int uWay      = 0;
+  unsigned int uVictim   = 0;
+
+  pLevel->u64Clock++;
+  pLevel->u64Accesses += bCount;
+
+  for (uWay = 0; uWay < pLevel->uWays; uWay++)
+  {
+    if (pu64Tags[uWay] == u64Block)
+    {
+      pu64Uses[uWay] = pLevel->u64Clock;
+      return 1;
+    }
+    if (pu64Uses[uWay] < pu64Uses[uVictim])
+    {
+      uVictim = uWay;
+    }
+  }
+
+  pu64Tags[uVictim] = u64Block;
+  pu64Uses[uVictim] = pLevel->u64Clock;
+  if (bCount)
+  {
+    pLevel->u64Misses++;
+    pLevel->au64Misses[uKind]++;
+  }
+
+  return 0;
+}
+
+static void AddBlock(PBLOCKSET pSet, uint64_t u64Block)
+{
+  uint64_t u64Slot = 0;
+
+  if ((pSet->u64Count + 1) * 2 > pSet->u64Mask + 1)
+  {
+    BLOCKSET grown;
+    uint64_t u64Old = 0;
+
+    grown.u64Mask    = pSet->u64Mask ? pSet->u64Mask * 2 + 1 : 4095;
+    grown.u64Count   = 0;
+    grown.pu64Blocks = calloc(grown.u64Mask + 1, sizeof(uint64_t));
+    if (!grown.pu64Blocks)
+    {
+      printf("Can't allocate working set\n");
+      exit(1);
+    }
+    for (u64Old = 0; pSet->pu64Blocks && u64Old <= pSet->u64Mask; u64Old++)
+    {
+      if (pSet->pu64Blocks[u64Old])
+      {
+        AddBlock(&grown, pSet->pu64Blocks[u64Old] - 1);
+      }
+    }
+    free(pSet->pu64Blocks);
+    *pSet = grown;
+  }
+
+  u64Slot = (u64Block * 0x9E3779B97F4A7C15ULL) & pSet->u64Mask;
+  while (pSet->pu64Blocks[u64Slot] && pSet->pu64Blocks[u64Slot] != u64Block + 1)
+  {
+    u64Slot = (u64Slot + 1) & pSet->u64Mask;
+  }
+  if (!pSet->pu64Blocks[u64Slot])
+  {
+    pSet->pu64Blocks[u64Slot] = u64Block + 1;
+    pSet->u64Count++;
+  }
+}
+
+static uint64_t AccessAddress(const LULEATRACEACCESS *pAccess, uint32_t u32NextHopBytes)
+{
+  switch (pAccess->u8Kind)
+  {
+    case LULEATRACE_NEXT_HOP:
+      return (2ULL << CACHESIM_REGION_SHIFT) + (uint64_t)pAccess->u32Offset * u32NextHopBytes;
+    case LULEATRACE_HOST_ROUTE:
+      return (1ULL << CACHESIM_REGION_SHIFT) + pAccess->u32Offset;
+    default:
+      return pAccess->u32Offset;
+  }
+}
+
+static void Usage(char *pszProgram)
+{
+  printf("Usage: %s [options] <trace>\n", pszProgram);
+  printf("  -1 <size,ways>  L1 data cache (default 32k,8)\n");
+  printf("  -2 <size,ways>  L2 cache (default 1m,16)\n");
+  printf("  -3 <size,ways>  last level cache (default 32m,16)\n");
+  printf("  -t <entries,ways>  data TLB (default 64,4)\n");
+  printf("  -l <bytes>      cache line size (default 64)\n");
+  printf("  -p <bytes>      page size, 2m for huge pages (default 4k)\n");
+  printf("  -e <bytes>      size of a next hop entry, to try other layouts (default from the trace, or %zu)\n",
+         RESULT_TABLE_NEXT_HOP_BYTES);
+  printf("  -w <count>      lookups that only warm the caches up (default 0)\n");
+  printf("  -o <file>       write JSON results to file instead of stdout\n");
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  LULEATRACEHEADER   header;
+  PLULEATRACERECORD  pRecords     = NULL;
+  CACHELEVEL         aLevels[CACHESIM_LEVELS];
+  CACHELEVEL         tlb;
+  BLOCKSET           aLines[3];   /* Image, host routes, next hops */
+  BLOCKSET           pages;
+  FILE              *pOutput      = stdout;
+  const char        *apszNames[CACHESIM_LEVELS] = { "l1", "l2", "llc" };
+  uint64_t           au64Bytes[CACHESIM_LEVELS] = { 32 << 10, 1 << 20, 32 << 20 };
+  unsigned int       auWays[CACHESIM_LEVELS]    = { 8, 16, 16 };
+  uint64_t           u64TlbEntries = 64;
+  unsigned int       uTlbWays     = 4;
+  uint64_t           u64LineBytes = 64;
+  uint64_t           u64PageBytes = 4096;
+  uint32_t           u32NextHopBytes = 0;
+  uint64_t           u64Warmup    = 0;
+  uint64_t           u64Record    = 0;
+  uint64_t           u64Counted   = 0;
+  uint64_t           u64Accesses  = 0;
+  unsigned int       uLevel       = 0;
+  unsigned int       uKind        = 0;
+  int                iOption      = 0;
+  char              *pszEnd       = NULL;
+
+  memset(aLevels, 0, sizeof(aLevels));
+  memset(&tlb, 0, sizeof(tlb));
+  memset(aLines, 0, sizeof(aLines));
+  memset(&pages, 0, sizeof(pages));
+
+  while ((iOption = getopt(argc, argv, "1:2:3:t:l:p:e:w:o:")) != -1)
+  {
+    switch (iOption)
+    {
+      case '1':
+      case '2':
+      case '3':
+        if (!ParseGeometry(optarg, &au64Bytes[iOption - '1'], &auWays[iOption - '1']))
+        {
+          Usage(argv[0]);
+        }
+        break;
+      case 't':
+        if (!ParseGeometry(optarg, &u64TlbEntries, &uTlbWays))
+        {
+          Usage(argv[0]);
+        }
+        break;
+      case 'l':
+        u64LineBytes = ParseSize(optarg, &pszEnd);
+        break;
+      case 'p':
+        u64PageBytes = ParseSize(optarg, &pszEnd);
+        break;
+      case 'e':
+        u32NextHopBytes = strtoul(optarg, NULL, 0);
+        break;
+      case 'w':
+        u64Warmup = strtoull(optarg, NULL, 0);
+        break;
+      case 'o':
+        pOutput = fopen(optarg, "w");
+        if (!pOutput)
+        {
+          printf("Could not open %s for writing\n", optarg);
+          exit(1);
+        }
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+
+  if (optind >= argc || !u64LineBytes || (u64LineBytes & (u64LineBytes - 1)) || !u64PageBytes ||
+      (u64PageBytes & (u64PageBytes - 1)))
+  {
+    Usage(argv[0]);
+  }
+
+  pRecords = LuleaTraceLoad(argv[optind], &header);
+  if (!pRecords)
+  {
+    exit(1);
+  }
+  if (!u32NextHopBytes)
+  {
+    u32NextHopBytes = header.u32NextHopBytes ? header.u32NextHopBytes : RESULT_TABLE_NEXT_HOP_BYTES;
+  }
+
+  for (uLevel = 0; uLevel < CACHESIM_LEVELS; uLevel++)
+  {
+    InitLevel(&aLevels[uLevel], apszNames[uLevel], au64Bytes[uLevel] / u64LineBytes, auWays[uLevel], u64LineBytes);
+  }
+  InitLevel(&tlb, "tlb", u64TlbEntries, uTlbWays, u64PageBytes);
+
+  for (u64Record = 0; u64Record < header.u64NumRecords; u64Record++)
+  {
+    PLULEATRACERECORD pRecord = &pRecords[u64Record];
+    int               bCount  = u64Record >= u64Warmup;
+    unsigned int      uAccess = 0;
+
+    u64Counted += bCount;
+    for (uAccess = 0; uAccess < pRecord->u32NumAccesses && uAccess < LULEA_TRACE_MAX_ACCESSES; uAccess++)
+    {
+      const LULEATRACEACCESS *pAccess   = &pRecord->aAccesses[uAccess];
+      uint64_t                u64First  = AccessAddress(pAccess, u32NextHopBytes);
+      uint64_t                u64Last   = u64First + (pAccess->u8Kind == LULEATRACE_NEXT_HOP ? u32NextHopBytes : pAccess->u8Bytes) - 1;
+      uint64_t                u64Line   = 0;
+
+      if (pAccess->u8Kind >= LULEATRACE_MAX)
+      {
+        continue;
+      }
+      u64Accesses += bCount;
+
+      /* An access that straddles a line or page boundary touches both */
+      for (u64Line = u64First / u64LineBytes; u64Line <= u64Last / u64LineBytes; u64Line++)
+      {
+        for (uLevel = 0; uLevel < CACHESIM_LEVELS; uLevel++)
+        {
+          if (AccessLevel(&aLevels[uLevel], u64Line * u64LineBytes, pAccess->u8Kind, bCount))
+          {
+            break;
+          }
+        }
+        if (bCount)
+        {
+          AddBlock(&aLines[u64First >> CACHESIM_REGION_SHIFT], u64Line);
+        }
+      }
+      for (u64Line = u64First / u64PageBytes; u64Line <= u64Last / u64PageBytes; u64Line++)
+      {
+        AccessLevel(&tlb, u64Line * u64PageBytes, pAccess->u8Kind, bCount);
+        if (bCount)
+        {
+          AddBlock(&pages, u64Line);
+        }
+      }
+    }
+  }
+
+  fprintf(pOutput, "{\n");
+  fprintf(pOutput, "  \"trace\": \"%s\",\n", argv[optind]);
+  fprintf(pOutput, "  \"sample_rate\": %u,\n", header.u32SampleRate);
+  fprintf(pOutput, "  \"image_bytes\": %llu,\n", (unsigned long long)header.u64ImageBytes);
+  fprintf(pOutput, "  \"next_hop_bytes\": %u,\n", u32NextHopBytes);
+  fprintf(pOutput, "  \"lookups\": %llu,\n", (unsigned long long)u64Counted);
+  fprintf(pOutput, "  \"warmup_lookups\": %llu,\n", (unsigned long long)(header.u64NumRecords - u64Counted));
+  fprintf(pOutput, "  \"accesses_per_lookup\": %.3f,\n", u64Counted ? (double)u64Accesses / u64Counted : 0);
+  fprintf(pOutput, "  \"line_bytes\": %llu,\n", (unsigned long long)u64LineBytes);
+  fprintf(pOutput, "  \"page_bytes\": %llu,\n", (unsigned long long)u64PageBytes);
+  fprintf(pOutput, "  \"working_set\": { \"lines\": %llu, \"bytes\": %llu, \"image_lines\": %llu, \"host_route_lines\": %llu,"
+          " \"next_hop_lines\": %llu, \"pages\": %llu },\n",
+          (unsigned long long)(aLines[0].u64Count + aLines[1].u64Count + aLines[2].u64Count),
+          (unsigned long long)((aLines[0].u64Count + aLines[1].u64Count + aLines[2].u64Count) * u64LineBytes),
+          (unsigned long long)aLines[0].u64Count, (unsigned long long)aLines[1].u64Count,
+          (unsigned long long)aLines[2].u64Count, (unsigned long long)pages.u64Count);
+  fprintf(pOutput, "  \"levels\": [\n");
+  for (uLevel = 0; uLevel <= CACHESIM_LEVELS; uLevel++)
+  {
+    PCACHELEVEL pLevel = uLevel < CACHESIM_LEVELS ? &aLevels[uLevel] : &tlb;
+
+    fprintf(pOutput, "    { \"level\": \"%s\", \"%s\": %llu, \"ways\": %u, \"accesses\": %llu, \"misses\": %llu,"
+            " \"miss_rate\": %.4f, \"misses_per_lookup\": %.4f, \"misses_per_lookup_by_access\": {",
+            pLevel->pszName, uLevel < CACHESIM_LEVELS ? "bytes" : "entries",
+            (unsigned long long)(uLevel < CACHESIM_LEVELS ? au64Bytes[uLevel] : u64TlbEntries), pLevel->uWays,
+            (unsigned long long)pLevel->u64Accesses, (unsigned long long)pLevel->u64Misses,
+            pLevel->u64Accesses ? (double)pLevel->u64Misses / pLevel->u64Accesses : 0,
+            u64Counted ? (double)pLevel->u64Misses / u64Counted : 0);
+    for (uKind = 0; uKind < LULEATRACE_MAX; uKind++)
+    {
+      fprintf(pOutput, " \"%s\": %.4f%s", LuleaTraceKindName(uKind),
+              u64Counted ? (double)pLevel->au64Misses[uKind] / u64Counted : 0, uKind + 1 < LULEATRACE_MAX ? "," : "");
+    }
+    fprintf(pOutput, " } }%s\n", uLevel < CACHESIM_LEVELS ? "," : "");
+  }
+  fprintf(pOutput, "  ]\n");
+  fprintf(pOutput, "}\n");
+
+  if (pOutput != stdout)
+  {
+    fclose(pOutput);
+  }
+
+  for (uLevel = 0; uLevel < CACHESIM_LEVELS; uLevel++)
+  {
+    free(aLevels[uLevel].pu64Tags);
+    free(aLevels[uLevel].pu64LastUse);
+  }
+  free(tlb.pu64Tags);
+  free(tlb.pu64LastUse);
+  for (uLevel = 0; uLevel < 3; uLevel++)
+  {
+    free(aLines[uLevel].pu64Blocks);
+  }
+  free(pages.pu64Blocks);
+  free(pRecords);
+
+  return 0;
+}
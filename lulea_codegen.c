@@ -0,0 +1,270 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include "routing_table_split.h"
+#include "lulea_trie.h"
+#include "result_table.h"
+#include "lulea_snapshot.h"
+#include "lulea_report.h"
+
+/* Compiles a luleå trie snapshot into C: the image and result table as aligned static const
+   arrays, which end up in .rodata and are shared between processes like any other text, and a
+   lookup function with the image address and chunk layout as constants. Levels the image does
+   not use are left out of the lookup. */
+
+static void WriteWords64(FILE *pFile, const char *pchData, size_t uBytes)
+{
+  size_t uIndex = 0;
+
+  for (uIndex = 0; uIndex < uBytes; uIndex += sizeof(uint64_t))
+  {
+    uint64_t u64Word = 0;
+
+    memcpy(&u64Word, pchData + uIndex, uBytes - uIndex < sizeof(u64Word) ? uBytes - uIndex : sizeof(u64Word));
+    fprintf(pFile, "%s0x%016lxULL,", uIndex % 32 ? " " : "\n  ", u64Word);
+  }
+  fprintf(pFile, "\n};\n\n");
+}
+
+static void WriteWords32(FILE *pFile, const uint32_t *pu32Data, unsigned int uCount)
+{
+  unsigned int uIndex = 0;
+
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    fprintf(pFile, "%s0x%08x,", uIndex % 8 ? " " : "\n  ", pu32Data[uIndex]);
+  }
+  fprintf(pFile, "\n};\n\n");
+}
+
+static void WriteBytes(FILE *pFile, const uint8_t *pu8Data, unsigned int uCount)
+{
+  unsigned int uIndex = 0;
+
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    fprintf(pFile, "%s%u,", uIndex % 16 ? " " : "\n  ", pu8Data[uIndex]);
+  }
+  fprintf(pFile, "\n};\n\n");
+}
+
+static void WriteHeader(FILE *pFile, const char *pszPrefix, const char *pszSnapshot)
+{
+  fprintf(pFile, "/* Generated by lulea_codegen from %s, do not edit */\n\n", pszSnapshot);
+  fprintf(pFile, "#ifndef __%s_H__\n#define __%s_H__\n\n", pszPrefix, pszPrefix);
+  fprintf(pFile, "#include <stdint.h>\n\n");
+  fprintf(pFile, "#define %s_NO_NEXT_HOP (UINT32_MAX)\n\n", pszPrefix);
+  fprintf(pFile, "/* Result index of the longest matching prefix, %s_NO_NEXT_HOP if there is none */\n", pszPrefix);
+  fprintf(pFile, "uint32_t %sLookup(uint32_t u32IP);\n\n", pszPrefix);
+  fprintf(pFile, "/* Result table, indexed by what %sLookup() returns */\n", pszPrefix);
+  fprintf(pFile, "extern const unsigned int u%sNumResults;\n", pszPrefix);
+  fprintf(pFile, "extern const uint32_t     au32%sStart[];\n", pszPrefix);
+  fprintf(pFile, "extern const uint8_t      au8%sLength[];\n", pszPrefix);
+  fprintf(pFile, "extern const uint32_t     au32%sNextHop[];\n\n", pszPrefix);
+  fprintf(pFile, "#endif\n");
+}
+
+/* One level of the walk: direct codeword or pointer, then follow it or return it */
+static void WriteLevel(FILE *pFile, const char *pszCodewords, const char *pszPointers, unsigned int uIndexShift,
+                       unsigned int uLowShift, int bLast)
+{
+  fprintf(pFile, "  u64Codeword = ((const LULEAU64 *)(%s))[(u32IP >> %u) & 0x%x];\n", pszCodewords, uIndexShift,
+          uIndexShift == 20 ? 0xFFF : 0xF);
+  fprintf(pFile, "  if (u64Codeword & 0x%016llxULL)\n  {\n    return (uint32_t)u64Codeword;\n  }\n", CODEWORD_NEXTHOP);
+  fprintf(pFile, "  u32Pointer = LuleaPointer(%s, u64Codeword, (u32IP >> %u) & 0xF);\n", pszPointers, uLowShift);
+  if (bLast)
+  {
+    fprintf(pFile, "  return u32Pointer & 0x%08xU ? NO_NEXT_HOP : u32Pointer;\n", POINTERTYPE_NEXTLEVEL);
+  }
+  else
+  {
+    fprintf(pFile, "  if (!(u32Pointer & 0x%08xU))\n  {\n    return u32Pointer;\n  }\n", POINTERTYPE_NEXTLEVEL);
+    fprintf(pFile, "  pchChunk = pchImage + (u32Pointer & 0x%08xU);\n\n", ~POINTERTYPE_NEXTLEVEL);
+  }
+}
+
+static void WriteSource(FILE *pFile, const char *pszPrefix, const char *pszHeader, const char *pszSnapshot,
+                        const char *pchImage, size_t uImageBytes, PRESULTTABLE pResults, PLULEAREPORT pReport)
+{
+  unsigned int uLevels = pReport->au32Chunks[2] ? 3 : (pReport->au32Chunks[1] ? 2 : 1);
+  char         achLevel1[64];
+  char         achLevel23[64];
+
+  fprintf(pFile, "/* Generated by lulea_codegen from %s, do not edit.\n", pszSnapshot);
+  fprintf(pFile, "   %zu byte image, %u prefixes, %u level 2 and %u level 3 chunks */\n\n", uImageBytes,
+          pResults->uNumResults, pReport->au32Chunks[1], pReport->au32Chunks[2]);
+  fprintf(pFile, "#include <stdint.h>\n#include \"%s\"\n\n", pszHeader);
+  fprintf(pFile, "#if __BYTE_ORDER__ != %d\n#error \"The image was generated on a machine with different byte order\"\n#endif\n\n",
+          __BYTE_ORDER__);
+  fprintf(pFile, "#define NO_NEXT_HOP %s_NO_NEXT_HOP\n\n", pszPrefix);
+  fprintf(pFile, "/* The image mixes 64 bit codewords and 32 bit pointers */\n");
+  fprintf(pFile, "typedef uint64_t __attribute__((may_alias)) LULEAU64;\n");
+  fprintf(pFile, "typedef uint32_t __attribute__((may_alias)) LULEAU32;\n\n");
+
+  fprintf(pFile, "static const uint64_t au64Image[%zu] __attribute__((aligned(64))) =\n{", (uImageBytes + 7) / 8);
+  WriteWords64(pFile, pchImage, uImageBytes);
+
+  fprintf(pFile, "const unsigned int u%sNumResults = %u;\n\n", pszPrefix, pResults->uNumResults);
+  fprintf(pFile, "const uint32_t au32%sStart[%u] __attribute__((aligned(64))) =\n{", pszPrefix, pResults->uNumResults);
+  WriteWords32(pFile, pResults->pu32Start, pResults->uNumResults);
+  fprintf(pFile, "const uint8_t au8%sLength[%u] __attribute__((aligned(64))) =\n{", pszPrefix, pResults->uNumResults);
+  WriteBytes(pFile, pResults->pu8Length, pResults->uNumResults);
+  fprintf(pFile, "const uint32_t au32%sNextHop[%u] __attribute__((aligned(64))) =\n{", pszPrefix, pResults->uNumResults);
+  WriteWords32(pFile, pResults->pu32NextHop, pResults->uNumResults);
+
+  fprintf(pFile, "static inline uint32_t LuleaPointer(const char *pchPointers, uint64_t u64Codeword, unsigned int uLow)\n{\n");
+  fprintf(pFile, "  unsigned int uPopcount = __builtin_popcount((uint32_t)(u64Codeword >> (32 + (16 - (uLow + 1)))));\n\n");
+  fprintf(pFile, "  uPopcount -= (uPopcount > 0);\n");
+  fprintf(pFile, "  return ((const LULEAU32 *)pchPointers)[uPopcount + (uint32_t)u64Codeword];\n}\n\n");
+
+  fprintf(pFile, "uint32_t %sLookup(uint32_t u32IP)\n{\n", pszPrefix);
+  fprintf(pFile, "  const char *pchImage    = (const char *)au64Image;\n");
+  if (uLevels > 1)
+  {
+    fprintf(pFile, "  const char *pchChunk    = 0;\n");
+  }
+  fprintf(pFile, "  uint64_t    u64Codeword = 0;\n");
+  fprintf(pFile, "  uint32_t    u32Pointer  = 0;\n\n");
+
+  snprintf(achLevel23, sizeof(achLevel23), "pchChunk + %zu", offsetof(LEVEL23, au32Pointers));
+  fprintf(pFile, "  /* Level 1 */\n");
+  snprintf(achLevel1, sizeof(achLevel1), "pchImage + %zu", offsetof(LEVEL1, au32Pointers));
+  WriteLevel(pFile, "pchImage", achLevel1, 20, 16, uLevels == 1);
+  if (uLevels > 1)
+  {
+    fprintf(pFile, "  /* Level 2 */\n");
+    WriteLevel(pFile, "pchChunk", achLevel23, 12, 8, uLevels == 2);
+  }
+  if (uLevels > 2)
+  {
+    fprintf(pFile, "  /* Level 3 */\n");
+    WriteLevel(pFile, "pchChunk", achLevel23, 4, 0, 1);
+  }
+  fprintf(pFile, "}\n\n");
+
+  /* Small driver, so a generated table can be tried without writing one */
+  fprintf(pFile, "#ifdef LULEA_CODEGEN_MAIN\n");
+  fprintf(pFile, "#include <stdio.h>\n#include <arpa/inet.h>\n\n");
+  fprintf(pFile, "int main(void)\n{\n");
+  fprintf(pFile, "  char           achBuffer[256];\n  struct in_addr ipAddr;\n\n");
+  fprintf(pFile, "  while (fgets(achBuffer, sizeof(achBuffer), stdin))\n  {\n");
+  fprintf(pFile, "    uint32_t u32Result = 0;\n\n");
+  fprintf(pFile, "    if (!inet_aton(achBuffer, &ipAddr))\n    {\n      continue;\n    }\n");
+  fprintf(pFile, "    u32Result = %sLookup(ntohl(ipAddr.s_addr));\n", pszPrefix);
+  fprintf(pFile, "    if (u32Result == NO_NEXT_HOP)\n    {\n      printf(\"%%s\", \"no route\\n\");\n      continue;\n    }\n");
+  fprintf(pFile, "    printf(\"%%u.%%u.%%u.%%u/%%u next hop %%u\\n\", au32%sStart[u32Result] >> 24, (au32%sStart[u32Result] >> 16) & 0xFF,\n",
+          pszPrefix, pszPrefix);
+  fprintf(pFile, "           (au32%sStart[u32Result] >> 8) & 0xFF, au32%sStart[u32Result] & 0xFF, au8%sLength[u32Result],\n",
+          pszPrefix, pszPrefix, pszPrefix);
+  fprintf(pFile, "           au32%sNextHop[u32Result]);\n  }\n\n  return 0;\n}\n#endif\n", pszPrefix);
+}
+
+int main(int argc, char **argv)
+{
+  RESULTTABLE  results;
+  LULEAREPORT  report;
+  const char  *pszPrefix   = "LuleaTable";
+  const char  *pszOutput   = "lulea_table";
+  const char  *pszHeader   = NULL;
+  char        *pchImage    = NULL;
+  char        *pszFile     = NULL;
+  size_t       uImageBytes = 0;
+  int          iOption     = 0;
+  FILE        *pFile       = NULL;
+
+  while ((iOption = getopt(argc, argv, "o:p:")) != -1)
+  {
+    switch (iOption)
+    {
+      case 'o':
+        pszOutput = optarg;
+        break;
+      case 'p':
+        pszPrefix = optarg;
+        break;
+      default:
+        optind = argc;
+        break;
+    }
+  }
+
+  if (optind >= argc)
+  {
+    printf("Usage: %s [-o <output>] [-p <prefix>] <snapshot>\n", argv[0]);
+    printf("  -o <output>  writes <output>.c and <output>.h (default lulea_table)\n");
+    printf("  -p <prefix>  names the lookup <prefix>Lookup() and the result arrays after it (default LuleaTable)\n");
+    printf("Snapshots are written by lulea_trie_poc -S <file>. Compile the output with -DLULEA_CODEGEN_MAIN\n");
+    printf("for a program that looks up addresses read from stdin.\n");
+    exit(1);
+  }
+
+  if (!LuleaSnapshotLoad(argv[optind], &results))
+  {
+    exit(1);
+  }
+  pchImage = LuleaTrieImage(&uImageBytes);
+  LuleaTrieIntrospect(pchImage, uImageBytes, results.uNumResults, RESULT_TABLE_ENTRY_BYTES, &report);
+  if (report.u32Errors)
+  {
+    printf("%s is broken, run lulea_inspect on it\n", argv[optind]);
+    exit(2);
+  }
+
+  pszFile = malloc(strlen(pszOutput) + 3);
+  if (!pszFile)
+  {
+    printf("Can't allocate file name\n");
+    exit(1);
+  }
+
+  sprintf(pszFile, "%s.h", pszOutput);
+  pFile = fopen(pszFile, "w");
+  if (!pFile)
+  {
+    printf("Could not open %s for writing\n", pszFile);
+    exit(1);
+  }
+  WriteHeader(pFile, pszPrefix, argv[optind]);
+  fclose(pFile);
+
+  /* The source includes the header by its name without directories */
+  pszHeader = strrchr(pszFile, '/') ? strrchr(pszFile, '/') + 1 : pszFile;
+  pszHeader = strdup(pszHeader);
+
+  sprintf(pszFile, "%s.c", pszOutput);
+  pFile = fopen(pszFile, "w");
+  if (!pFile)
+  {
+    printf("Could not open %s for writing\n", pszFile);
+    exit(1);
+  }
+  WriteSource(pFile, pszPrefix, pszHeader, argv[optind], pchImage, uImageBytes, &results, &report);
+  if (fclose(pFile))
+  {
+    printf("Could not write %s\n", pszFile);
+    exit(1);
+  }
+
+  return 0;
+}
@@ -0,0 +1,563 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* For pthread_setaffinity_np() */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "routing_table_split.h"
+#include "read_bgp.h"
+#include "lulea_trie.h"
+#include "benchmark.h"
+#include "result_table.h"
+#include "nexthop.h"
+#include "pcap_file.h"
+
+/* Forwarding simulator: replays a pcap capture through the dataplane loop on pinned worker
+   threads. Packets are parsed straight out of the mapped file, looked up in batches and resolved
+   to an adjacency, and every stage is timed with the TSC. */
+
+#define FORWARD_DEFAULT_PASSES (10)
+#define FORWARD_RING_SLOTS     (256)   /* Batches per ring, a power of 2 */
+
+typedef enum tagFORWARDMODE
+{
+  FORWARDMODE_RTC = 0,   /* Run to completion, every worker parses, looks up and forwards its own batches */
+  FORWARDMODE_PIPELINE   /* Worker 0 parses and hands batches over SPSC rings to the lookup workers */
+} FORWARDMODE;
+
+typedef enum tagFORWARDSTAGE
+{
+  FORWARDSTAGE_PARSE = 0,
+  FORWARDSTAGE_LOOKUP,
+  FORWARDSTAGE_FORWARD,
+  FORWARDSTAGE_RING,     /* Waiting on a full ring (parser) or an empty one (lookup workers) */
+  FORWARDSTAGE_MAX
+} FORWARDSTAGE;
+
+static const char *apszStageNames[FORWARDSTAGE_MAX] = { "parse", "lookup", "forward", "ring_wait" };
+
+typedef struct tagFORWARDBATCH
+{
+  unsigned int uCount;
+  uint32_t     au32IPs[BENCH_BATCH];
+} FORWARDBATCH, *PFORWARDBATCH;
+
+/* Single producer, single consumer. Each side keeps a copy of the other side's index and only
+   rereads the shared one when the copy says the ring is full or empty. */
+typedef struct tagFORWARDRING
+{
+  uint32_t     u32Head __attribute__((aligned(64)));  /* Written by the producer */
+  uint32_t     u32CachedTail;
+  uint32_t     u32Tail __attribute__((aligned(64)));  /* Written by the consumer */
+  uint32_t     u32CachedHead;
+  int          bDone;
+  FORWARDBATCH aBatches[FORWARD_RING_SLOTS] __attribute__((aligned(64)));
+} FORWARDRING, *PFORWARDRING;
+
+typedef struct tagFORWARDWORKER
+{
+  pthread_t    thread;
+  unsigned int uIndex;
+  int          bPinned;
+  PFORWARDRING pRing;          /* Pipeline lookup workers only */
+
+  uint64_t     u64Packets;     /* Frames handled, IPv4 or not */
+  uint64_t     u64Lookups;
+  uint64_t     u64Skipped;     /* Not IPv4 */
+  uint64_t     u64NoRoute;
+  uint64_t     u64Forwarded;
+  uint64_t     u64AdjacencySum; /* Keeps the forward stage from being optimized away */
+  uint64_t     u64Ticks;       /* From the start barrier until the worker finished */
+  uint64_t     au64StageTicks[FORWARDSTAGE_MAX];
+} FORWARDWORKER, *PFORWARDWORKER;
+
+static PCAPFILE          capture;
+static RESULTTABLE       results;
+static FORWARDMODE       eMode      = FORWARDMODE_RTC;
+static unsigned int      uNumWorkers = 0;
+static unsigned int      uNumPasses  = FORWARD_DEFAULT_PASSES;
+static unsigned int      uReplicas   = 0;   /* NUMA nodes with a copy of the trie, 0 without -N */
+static pthread_barrier_t startBarrier;
+
+/* Spins on pause, but gives the core away now and then in case the thread on the other end of
+   the ring shares it */
+static inline void CpuRelax(unsigned int *puSpins)
+{
+  if (++*puSpins % 1024 == 0)
+  {
+    sched_yield();
+    return;
+  }
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+static int PinThread(unsigned int uIndex)
+{
+  cpu_set_t cpuSet;
+  long      lCores = sysconf(_SC_NPROCESSORS_ONLN);
+
+  CPU_ZERO(&cpuSet);
+  CPU_SET(uIndex % (lCores > 0 ? (unsigned int)lCores : 1), &cpuSet);
+
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+}
+
+/* Parses packets [uFirst, uFirst + uCount) of the capture into pBatch */
+static void ParseBatch(PFORWARDWORKER pWorker, unsigned int uFirst, unsigned int uCount, PFORWARDBATCH pBatch)
+{
+  unsigned int uIndex = 0;
+
+  pBatch->uCount = 0;
+  for (uIndex = uFirst; uIndex < uFirst + uCount; uIndex++)
+  {
+    const PCAPPACKET *pPacket = &capture.pPackets[uIndex];
+
+    pBatch->uCount += PcapFileDestination(capture.pu8Map + pPacket->u64Offset, pPacket->u32CapLen,
+                                          capture.u32LinkType, &pBatch->au32IPs[pBatch->uCount]);
+  }
+
+  pWorker->u64Packets += uCount;
+  pWorker->u64Skipped += uCount - pBatch->uCount;
+}
+
+/* Lookup and next hop resolution of one parsed batch */
+static void ForwardBatch(PFORWARDWORKER pWorker, PFORWARDBATCH pBatch)
+{
+  uint32_t        au32Results[BENCH_BATCH];
+  uint64_t        u64Ticks     = BenchTicks();
+  unsigned int    uIndex       = 0;
+  const uint32_t *pu32NextHops = LuleaTrieLocalNextHops();  /* This node's copy with -N */
+
+  LuleaTrieLookupBatch(pBatch->au32IPs, au32Results, pBatch->uCount);
+  pWorker->au64StageTicks[FORWARDSTAGE_LOOKUP] += BenchTicks() - u64Ticks;
+
+  u64Ticks = BenchTicks();
+  for (uIndex = 0; uIndex < pBatch->uCount; uIndex++)
+  {
+    uint32_t u32Adjacency = NO_ADJACENCY;
+
+    if (au32Results[uIndex] != NO_NEXT_HOP)
+    {
+      u32Adjacency = NextHopResolve(pu32NextHops[au32Results[uIndex]]);
+    }
+
+    if (u32Adjacency == NO_ADJACENCY)
+    {
+      pWorker->u64NoRoute++;
+    }
+    else
+    {
+      pWorker->u64Forwarded++;
+      pWorker->u64AdjacencySum += u32Adjacency;
+    }
+  }
+  pWorker->au64StageTicks[FORWARDSTAGE_FORWARD] += BenchTicks() - u64Ticks;
+  pWorker->u64Lookups += pBatch->uCount;
+}
+
+/* Worker uIndex takes batches uIndex, uIndex + uWorkers, ... of every pass */
+static void RunToCompletion(PFORWARDWORKER pWorker, unsigned int uFirstBatch, unsigned int uStride)
+{
+  FORWARDBATCH batch;
+  unsigned int uNumBatches = (capture.uNumPackets + BENCH_BATCH - 1) / BENCH_BATCH;
+  unsigned int uPass       = 0;
+  unsigned int uBatch      = 0;
+
+  for (uPass = 0; uPass < uNumPasses; uPass++)
+  {
+    for (uBatch = uFirstBatch; uBatch < uNumBatches; uBatch += uStride)
+    {
+      unsigned int uFirst   = uBatch * BENCH_BATCH;
+      unsigned int uCount   = capture.uNumPackets - uFirst < BENCH_BATCH ? capture.uNumPackets - uFirst : BENCH_BATCH;
+      uint64_t     u64Ticks = BenchTicks();
+
+      ParseBatch(pWorker, uFirst, uCount, &batch);
+      pWorker->au64StageTicks[FORWARDSTAGE_PARSE] += BenchTicks() - u64Ticks;
+      ForwardBatch(pWorker, &batch);
+    }
+  }
+}
+
+/* Pipeline parser: fills the ring slots in place, round robin over the lookup workers */
+static void PipelineParse(PFORWARDWORKER pWorker, PFORWARDWORKER pConsumers, unsigned int uNumConsumers)
+{
+  unsigned int uNumBatches = (capture.uNumPackets + BENCH_BATCH - 1) / BENCH_BATCH;
+  unsigned int uPass       = 0;
+  unsigned int uBatch      = 0;
+  unsigned int uConsumer   = 0;
+
+  for (uPass = 0; uPass < uNumPasses; uPass++)
+  {
+    for (uBatch = 0; uBatch < uNumBatches; uBatch++)
+    {
+      PFORWARDRING pRing    = pConsumers[uConsumer].pRing;
+      unsigned int uFirst   = uBatch * BENCH_BATCH;
+      unsigned int uCount   = capture.uNumPackets - uFirst < BENCH_BATCH ? capture.uNumPackets - uFirst : BENCH_BATCH;
+      uint64_t     u64Ticks = BenchTicks();
+
+      if (pRing->u32Head - pRing->u32CachedTail == FORWARD_RING_SLOTS)
+      {
+        unsigned int uSpins = 0;
+
+        while ((pRing->u32CachedTail = __atomic_load_n(&pRing->u32Tail, __ATOMIC_ACQUIRE)) + FORWARD_RING_SLOTS ==
+               pRing->u32Head)
+        {
+          CpuRelax(&uSpins);
+        }
+        pWorker->au64StageTicks[FORWARDSTAGE_RING] += BenchTicks() - u64Ticks;
+        u64Ticks = BenchTicks();
+      }
+
+      ParseBatch(pWorker, uFirst, uCount, &pRing->aBatches[pRing->u32Head & (FORWARD_RING_SLOTS - 1)]);
+      __atomic_store_n(&pRing->u32Head, pRing->u32Head + 1, __ATOMIC_RELEASE);
+      pWorker->au64StageTicks[FORWARDSTAGE_PARSE] += BenchTicks() - u64Ticks;
+
+      uConsumer = uConsumer + 1 < uNumConsumers ? uConsumer + 1 : 0;
+    }
+  }
+
+  for (uConsumer = 0; uConsumer < uNumConsumers; uConsumer++)
+  {
+    __atomic_store_n(&pConsumers[uConsumer].pRing->bDone, 1, __ATOMIC_RELEASE);
+  }
+}
+
+static void PipelineLookup(PFORWARDWORKER pWorker)
+{
+  PFORWARDRING pRing = pWorker->pRing;
+
+  while (1)
+  {
+    if (pRing->u32Tail == pRing->u32CachedHead)
+    {
+      uint64_t     u64Ticks = BenchTicks();
+      unsigned int uSpins   = 0;
+
+      while ((pRing->u32CachedHead = __atomic_load_n(&pRing->u32Head, __ATOMIC_ACQUIRE)) == pRing->u32Tail)
+      {
+        /* Done is set after the last head store, so check the head once more after seeing it */
+        if (__atomic_load_n(&pRing->bDone, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&pRing->u32Head, __ATOMIC_ACQUIRE) == pRing->u32Tail)
+        {
+          pWorker->au64StageTicks[FORWARDSTAGE_RING] += BenchTicks() - u64Ticks;
+          return;
+        }
+        CpuRelax(&uSpins);
+      }
+      pWorker->au64StageTicks[FORWARDSTAGE_RING] += BenchTicks() - u64Ticks;
+    }
+
+    ForwardBatch(pWorker, &pRing->aBatches[pRing->u32Tail & (FORWARD_RING_SLOTS - 1)]);
+    __atomic_store_n(&pRing->u32Tail, pRing->u32Tail + 1, __ATOMIC_RELEASE);
+  }
+}
+
+static PFORWARDWORKER pWorkers;
+
+static void *ForwardThread(void *pArg)
+{
+  PFORWARDWORKER pWorker  = pArg;
+  uint64_t       u64Start = 0;
+
+  pWorker->bPinned = PinThread(pWorker->uIndex);
+  pthread_barrier_wait(&startBarrier);
+  u64Start = BenchTicks();
+
+  if (eMode == FORWARDMODE_RTC)
+  {
+    RunToCompletion(pWorker, pWorker->uIndex, uNumWorkers);
+  }
+  else if (pWorker->uIndex == 0)
+  {
+    PipelineParse(pWorker, pWorkers + 1, uNumWorkers - 1);
+  }
+  else
+  {
+    PipelineLookup(pWorker);
+  }
+
+  pWorker->u64Ticks = BenchTicks() - u64Start;
+
+  return NULL;
+}
+
+static void WriteJson(FILE *pOutput, const char *pszCapture, double dSeconds, double dTscGhz)
+{
+  FORWARDWORKER total;
+  unsigned int  uIndex = 0;
+  unsigned int  uStage = 0;
+  int           bPinned = 1;
+
+  memset(&total, 0, sizeof(total));
+  for (uIndex = 0; uIndex < uNumWorkers; uIndex++)
+  {
+    total.u64Packets      += pWorkers[uIndex].u64Packets;
+    total.u64Lookups      += pWorkers[uIndex].u64Lookups;
+    total.u64Skipped      += pWorkers[uIndex].u64Skipped;
+    total.u64NoRoute      += pWorkers[uIndex].u64NoRoute;
+    total.u64Forwarded    += pWorkers[uIndex].u64Forwarded;
+    total.u64AdjacencySum += pWorkers[uIndex].u64AdjacencySum;
+    bPinned               &= pWorkers[uIndex].bPinned;
+    for (uStage = 0; uStage < FORWARDSTAGE_MAX; uStage++)
+    {
+      total.au64StageTicks[uStage] += pWorkers[uIndex].au64StageTicks[uStage];
+    }
+  }
+
+  fprintf(pOutput, "{\n");
+  fprintf(pOutput, "  \"capture\": \"%s\",\n", pszCapture);
+  fprintf(pOutput, "  \"link_type\": %u,\n", capture.u32LinkType);
+  fprintf(pOutput, "  \"capture_packets\": %u,\n", capture.uNumPackets);
+  fprintf(pOutput, "  \"mode\": \"%s\",\n", eMode == FORWARDMODE_RTC ? "rtc" : "pipeline");
+  fprintf(pOutput, "  \"numa_replicas\": %u,\n", uReplicas);
+  fprintf(pOutput, "  \"workers\": %u,\n", uNumWorkers);
+  fprintf(pOutput, "  \"pinned\": %s,\n", bPinned ? "true" : "false");
+  fprintf(pOutput, "  \"passes\": %u,\n", uNumPasses);
+  fprintf(pOutput, "  \"tsc_ghz\": %.3f,\n", dTscGhz);
+  fprintf(pOutput, "  \"packets\": %llu,\n", (unsigned long long)total.u64Packets);
+  fprintf(pOutput, "  \"ipv4_packets\": %llu,\n", (unsigned long long)total.u64Lookups);
+  fprintf(pOutput, "  \"skipped\": %llu,\n", (unsigned long long)total.u64Skipped);
+  fprintf(pOutput, "  \"no_route\": %llu,\n", (unsigned long long)total.u64NoRoute);
+  fprintf(pOutput, "  \"forwarded\": %llu,\n", (unsigned long long)total.u64Forwarded);
+  fprintf(pOutput, "  \"adjacency_checksum\": %llu,\n", (unsigned long long)total.u64AdjacencySum);
+  fprintf(pOutput, "  \"seconds\": %.6f,\n", dSeconds);
+  fprintf(pOutput, "  \"mpps\": %.3f,\n", dSeconds > 0 ? total.u64Packets / dSeconds / 1e6 : 0);
+
+  /* Parse cycles are per frame, lookup and forward cycles per IPv4 packet */
+  fprintf(pOutput, "  \"cycles_per_packet\": {\n");
+  for (uStage = 0; uStage < FORWARDSTAGE_MAX; uStage++)
+  {
+    uint64_t u64Count = uStage == FORWARDSTAGE_LOOKUP || uStage == FORWARDSTAGE_FORWARD ? total.u64Lookups : total.u64Packets;
+
+    fprintf(pOutput, "    \"%s\": %.2f%s\n", apszStageNames[uStage],
+            u64Count ? (double)total.au64StageTicks[uStage] / u64Count : 0, uStage + 1 < FORWARDSTAGE_MAX ? "," : "");
+  }
+  fprintf(pOutput, "  },\n");
+
+  fprintf(pOutput, "  \"per_worker\": [\n");
+  for (uIndex = 0; uIndex < uNumWorkers; uIndex++)
+  {
+    PFORWARDWORKER pWorker   = &pWorkers[uIndex];
+    double         dBusy     = pWorker->u64Ticks / (dTscGhz * 1e9);
+    uint64_t       u64Handled = eMode == FORWARDMODE_PIPELINE && uIndex ? pWorker->u64Lookups : pWorker->u64Packets;
+
+    fprintf(pOutput, "    { \"worker\": %u, \"packets\": %llu, \"mpps\": %.3f", uIndex, (unsigned long long)u64Handled,
+            dBusy > 0 ? u64Handled / dBusy / 1e6 : 0);
+    for (uStage = 0; uStage < FORWARDSTAGE_MAX; uStage++)
+    {
+      fprintf(pOutput, ", \"%s_cycles\": %llu", apszStageNames[uStage], (unsigned long long)pWorker->au64StageTicks[uStage]);
+    }
+    fprintf(pOutput, " }%s\n", uIndex + 1 < uNumWorkers ? "," : "");
+  }
+  fprintf(pOutput, "  ]\n");
+  fprintf(pOutput, "}\n");
+}
+
+static void Usage(char *pszProgram)
+{
+  printf("Usage: %s [options] <bgp dump file> <capture.pcap>\n", pszProgram);
+  printf("  -m <mode>   rtc (run to completion) or pipeline (default rtc)\n");
+  printf("  -w <count>  worker threads, one per core from core 0 (default all online cores)\n");
+  printf("  -r <count>  passes over the capture (default %d)\n", FORWARD_DEFAULT_PASSES);
+  printf("  -o <file>   write JSON results to file instead of stdout\n");
+  printf("  -g <count>  write a synthetic capture of <count> packets to prefixes of the table and exit\n");
+  printf("  -d <dist>   destinations of the synthetic capture: uniform or prefix (default prefix)\n");
+  printf("  -N          copy the trie to every NUMA node, workers look up in the copy of their node\n");
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  PPREFIXES        pPrefixes   = NULL;
+  PROUTEENTRY      pNextHops   = NULL;
+  FILE            *pOutput     = stdout;
+  unsigned int     uGenerate   = 0;
+  unsigned int     uIndex      = 0;
+  int              iDist       = BENCHDIST_PREFIX;
+  int              iOption     = 0;
+  int              bReplicate  = 0;
+  double           dSeconds    = 0;
+  long             lCores      = sysconf(_SC_NPROCESSORS_ONLN);
+  struct timespec  sooner;
+
+  while ((iOption = getopt(argc, argv, "m:w:r:o:g:d:N")) != -1)
+  {
+    switch (iOption)
+    {
+      case 'm':
+        if (!strcmp(optarg, "pipeline"))
+        {
+          eMode = FORWARDMODE_PIPELINE;
+        }
+        else if (strcmp(optarg, "rtc"))
+        {
+          Usage(argv[0]);
+        }
+        break;
+      case 'w':
+        uNumWorkers = strtoul(optarg, NULL, 0);
+        break;
+      case 'r':
+        uNumPasses = strtoul(optarg, NULL, 0);
+        break;
+      case 'g':
+        uGenerate = strtoul(optarg, NULL, 0);
+        break;
+      case 'd':
+        iDist = BenchDistFromName(optarg);
+        if (iDist != BENCHDIST_UNIFORM && iDist != BENCHDIST_PREFIX)
+        {
+          Usage(argv[0]);
+        }
+        break;
+      case 'N':
+        bReplicate = 1;
+        break;
+      case 'o':
+        pOutput = fopen(optarg, "w");
+        if (!pOutput)
+        {
+          printf("Could not open %s for writing\n", optarg);
+          exit(1);
+        }
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+
+  if (!uNumWorkers)
+  {
+    uNumWorkers = lCores > 0 ? (unsigned int)lCores : 1;
+  }
+  else if (lCores > 0 && uNumWorkers > (unsigned int)lCores)
+  {
+    fprintf(stderr, "%u workers share %ld cores, the numbers won't mean much\n", uNumWorkers, lCores);
+  }
+
+  if (optind + 2 != argc || !uNumPasses || (eMode == FORWARDMODE_PIPELINE && uNumWorkers < 2))
+  {
+    Usage(argv[0]);
+  }
+
+  /* Progress goes to stderr so stdout can be piped straight into a JSON tool */
+  fprintf(stderr, "Reading BGP from file\n");
+  pPrefixes = ReadFromBgpDump(argv[optind]);
+  pNextHops = BuildPrefixTree(pPrefixes);
+  ResultTableBuild(&results, pNextHops, pPrefixes->uTotalPrefixes);
+  LuleaTrieSetNextHops(results.pu32NextHop, results.uNumResults);
+
+  if (uGenerate)
+  {
+    uint32_t *pu32IPs = BenchGenerateAddresses(iDist, &uGenerate, pNextHops, pPrefixes->uTotalPrefixes, 0, NULL);
+
+    /* One frame in 64 is IPv6, which the forwarding loop skips */
+    if (!PcapFileWriteSynthetic(argv[optind + 1], pu32IPs, uGenerate, 64))
+    {
+      exit(1);
+    }
+    fprintf(stderr, "Wrote %u packets to %s\n", uGenerate, argv[optind + 1]);
+    free(pu32IPs);
+    return 0;
+  }
+
+  fprintf(stderr, "Building luleå trie\n");
+  if (!BuildLuleaTrie(&root, pNextHops, pPrefixes->uTotalPrefixes))
+  {
+    exit(1);
+  }
+  FreePrefixTree();
+
+  if (bReplicate)
+  {
+    uReplicas = LuleaTrieSetReplication(1);
+    fprintf(stderr, "Luleå trie replicated to %u NUMA nodes\n", uReplicas);
+  }
+
+  if (!PcapFileOpen(argv[optind + 1], &capture))
+  {
+    exit(1);
+  }
+
+  pWorkers = calloc(uNumWorkers, sizeof(*pWorkers));
+  if (!pWorkers || pthread_barrier_init(&startBarrier, NULL, uNumWorkers + 1))
+  {
+    printf("Can't allocate forwarding workers\n");
+    exit(1);
+  }
+
+  for (uIndex = 0; uIndex < uNumWorkers; uIndex++)
+  {
+    pWorkers[uIndex].uIndex = uIndex;
+    if (eMode == FORWARDMODE_PIPELINE && uIndex)
+    {
+      if (posix_memalign((void **)&pWorkers[uIndex].pRing, 64, sizeof(FORWARDRING)))
+      {
+        printf("Can't allocate forwarding ring\n");
+        exit(1);
+      }
+      memset(pWorkers[uIndex].pRing, 0, sizeof(FORWARDRING));
+    }
+  }
+
+  fprintf(stderr, "Forwarding %u packets %u times on %u workers\n", capture.uNumPackets, uNumPasses, uNumWorkers);
+  for (uIndex = 0; uIndex < uNumWorkers; uIndex++)
+  {
+    if (pthread_create(&pWorkers[uIndex].thread, NULL, ForwardThread, &pWorkers[uIndex]))
+    {
+      printf("Can't start forwarding thread\n");
+      exit(1);
+    }
+  }
+
+  pthread_barrier_wait(&startBarrier);
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  for (uIndex = 0; uIndex < uNumWorkers; uIndex++)
+  {
+    pthread_join(pWorkers[uIndex].thread, NULL);
+  }
+  dSeconds = BenchElapsedMs(&sooner) / 1000.0;
+
+  WriteJson(pOutput, argv[optind + 1], dSeconds, BenchTscGhz());
+
+  for (uIndex = 0; uIndex < uNumWorkers; uIndex++)
+  {
+    free(pWorkers[uIndex].pRing);
+  }
+  free(pWorkers);
+  pthread_barrier_destroy(&startBarrier);
+  PcapFileClose(&capture);
+  ResultTableFree(&results);
+  free(pNextHops);
+  if (pOutput != stdout)
+  {
+    fclose(pOutput);
+  }
+
+  return 0;
+}
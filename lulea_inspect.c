@@ -0,0 +1,91 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "routing_table_split.h"
+#include "lulea_trie.h"
+#include "result_table.h"
+#include "lulea_snapshot.h"
+#include "lulea_report.h"
+#include "lulea_shm.h"
+
+int main(int argc, char **argv)
+{
+  RESULTTABLE     results;
+  LULEASHMREADER  reader;
+  const char     *pszShm       = NULL;
+  FILE           *pOutput      = stdout;
+  char           *pchImage     = NULL;
+  size_t          uImageBytes  = 0;
+  int             iOption      = 0;
+  LULEAREPORT     report;
+
+  while ((iOption = getopt(argc, argv, "M:o:")) != -1)
+  {
+    switch (iOption)
+    {
+      case 'M':
+        pszShm = optarg;
+        break;
+      case 'o':
+        pOutput = fopen(optarg, "w");
+        if (!pOutput)
+        {
+          printf("Could not open %s for writing\n", optarg);
+          exit(1);
+        }
+        break;
+      default:
+        optind = argc;
+        break;
+    }
+  }
+
+  if (optind >= argc && !pszShm)
+  {
+    printf("Usage: %s [-o report.json] <snapshot> | -M <name>\n", argv[0]);
+    printf("Snapshots are written by lulea_trie_poc -S <file>, shared memory tables by lulea_trie_poc -M <name>\n");
+    exit(1);
+  }
+
+  if (pszShm)
+  {
+    if (!LuleaShmAttach(pszShm, &reader))
+    {
+      exit(1);
+    }
+    results = reader.results;
+  }
+  else if (!LuleaSnapshotLoad(argv[optind], &results))
+  {
+    exit(1);
+  }
+
+  pchImage = LuleaTrieImage(&uImageBytes);
+  LuleaTrieIntrospect(pchImage, uImageBytes, results.uNumResults, RESULT_TABLE_ENTRY_BYTES, &report);
+  LuleaReportWriteJson(pOutput, &report);
+
+  if (pOutput != stdout)
+  {
+    fclose(pOutput);
+  }
+
+  return report.u32Errors ? 2 : 0;
+}
@@ -0,0 +1,204 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* For sched_getcpu() and pthread_setaffinity_np() */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "lulea_numa.h"
+
+/* From <numaif.h>, which comes with libnuma */
+#define LULEA_MPOL_BIND (2)
+
+static pthread_once_t topologyOnce = PTHREAD_ONCE_INIT;
+static unsigned int   uNumNodes    = 1;
+static cpu_set_t      aNodeCpus[LULEA_NUMA_MAX_NODES];
+static uint8_t        au8CpuNode[CPU_SETSIZE];
+
+/* Parses a sysfs list like "0-15,32-47" into pCpus */
+static void ParseCpuList(const char *pszList, cpu_set_t *pCpus)
+{
+  char *pszEnd = NULL;
+
+  while (*pszList >= '0' && *pszList <= '9')
+  {
+    unsigned long ulFirst = strtoul(pszList, &pszEnd, 10);
+    unsigned long ulLast  = ulFirst;
+
+    if (*pszEnd == '-')
+    {
+      ulLast = strtoul(pszEnd + 1, &pszEnd, 10);
+    }
+    for (; ulFirst <= ulLast && ulFirst < CPU_SETSIZE; ulFirst++)
+    {
+      CPU_SET(ulFirst, pCpus);
+    }
+    pszList = *pszEnd == ',' ? pszEnd + 1 : pszEnd;
+  }
+}
+
+static void ReadTopology(void)
+{
+  char         achPath[128];
+  char         achList[4096];
+  unsigned int uNode = 0;
+  unsigned int uCpu  = 0;
+
+  for (uNode = 0; uNode < LULEA_NUMA_MAX_NODES; uNode++)
+  {
+    FILE *pFile = NULL;
+
+    snprintf(achPath, sizeof(achPath), "/sys/devices/system/node/node%u/cpulist", uNode);
+    pFile = fopen(achPath, "r");
+    if (!pFile)
+    {
+      break;
+    }
+    CPU_ZERO(&aNodeCpus[uNode]);
+    if (fgets(achList, sizeof(achList), pFile))
+    {
+      ParseCpuList(achList, &aNodeCpus[uNode]);
+    }
+    fclose(pFile);
+
+    for (uCpu = 0; uCpu < CPU_SETSIZE; uCpu++)
+    {
+      if (CPU_ISSET(uCpu, &aNodeCpus[uNode]))
+      {
+        au8CpuNode[uCpu] = uNode;
+      }
+    }
+  }
+
+  if (uNode)
+  {
+    uNumNodes = uNode;
+  }
+  else
+  {
+    /* No sysfs nodes, every CPU is on node 0 */
+    CPU_ZERO(&aNodeCpus[0]);
+    for (uCpu = 0; uCpu < CPU_SETSIZE; uCpu++)
+    {
+      CPU_SET(uCpu, &aNodeCpus[0]);
+    }
+  }
+}
+
+unsigned int LuleaNumaNodes(void)
+{
+  pthread_once(&topologyOnce, ReadTopology);
+
+  return uNumNodes;
+}
+
+unsigned int LuleaNumaNodeOfCpu(unsigned int uCpu)
+{
+  pthread_once(&topologyOnce, ReadTopology);
+
+  return uCpu < CPU_SETSIZE ? au8CpuNode[uCpu] : 0;
+}
+
+unsigned int LuleaNumaCurrentNode(void)
+{
+  int iCpu = sched_getcpu();
+
+  return LuleaNumaNodeOfCpu(iCpu < 0 ? 0 : (unsigned int)iCpu);
+}
+
+/* Lets the calling thread run on any CPU of uNode */
+int LuleaNumaPinToNode(unsigned int uNode)
+{
+  pthread_once(&topologyOnce, ReadTopology);
+  if (uNode >= uNumNodes)
+  {
+    return 0;
+  }
+
+  return pthread_setaffinity_np(pthread_self(), sizeof(aNodeCpus[uNode]), &aNodeCpus[uNode]) == 0;
+}
+
+typedef struct tagNUMACOPY
+{
+  void        *pDestination;
+  const void  *pSource;
+  size_t       uBytes;
+  unsigned int uNode;
+} NUMACOPY, *PNUMACOPY;
+
+/* Pages go to the node of the thread that touches them first, which is the fallback when
+   mbind() isn't allowed */
+static void *CopyThread(void *pArg)
+{
+  PNUMACOPY pCopy = pArg;
+
+  LuleaNumaPinToNode(pCopy->uNode);
+  memcpy(pCopy->pDestination, pCopy->pSource, pCopy->uBytes);
+
+  return NULL;
+}
+
+/* Returns a copy of pSource in memory of uNode, free it with LuleaNumaFree() */
+void *LuleaNumaCopyToNode(const void *pSource, size_t uBytes, unsigned int uNode)
+{
+  NUMACOPY       copy;
+  pthread_t      thread;
+  unsigned long  aulMask[LULEA_NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+  void          *pMemory = mmap(NULL, uBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (pMemory == MAP_FAILED)
+  {
+    printf("Can't allocate %zu bytes on node %u\n", uBytes, uNode);
+    exit(1);
+  }
+
+  memset(aulMask, 0, sizeof(aulMask));
+  aulMask[uNode / (8 * sizeof(unsigned long))] = 1UL << (uNode % (8 * sizeof(unsigned long)));
+  syscall(SYS_mbind, pMemory, uBytes, LULEA_MPOL_BIND, aulMask, LULEA_NUMA_MAX_NODES + 1, 0);
+
+  copy.pDestination = pMemory;
+  copy.pSource      = pSource;
+  copy.uBytes       = uBytes;
+  copy.uNode        = uNode;
+  if (pthread_create(&thread, NULL, CopyThread, &copy))
+  {
+    CopyThread(&copy);
+  }
+  else
+  {
+    pthread_join(thread, NULL);
+  }
+
+  return pMemory;
+}
+
+void LuleaNumaFree(void *pMemory, size_t uBytes)
+{
+  if (pMemory)
+  {
+    munmap(pMemory, uBytes);
+  }
+}
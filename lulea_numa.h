@@ -0,0 +1,34 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LULEA_NUMA_H__
+#define __LULEA_NUMA_H__
+
+#include <stddef.h>
+
+/* NUMA topology from /sys/devices/system/node and placement through the mbind() system
+   call, so there is no libnuma dependency. A box without the sysfs nodes is one node. */
+#define LULEA_NUMA_MAX_NODES (64)
+
+unsigned int LuleaNumaNodes(void);
+unsigned int LuleaNumaNodeOfCpu(unsigned int uCpu);
+unsigned int LuleaNumaCurrentNode(void);
+int          LuleaNumaPinToNode(unsigned int uNode);
+void        *LuleaNumaCopyToNode(const void *pSource, size_t uBytes, unsigned int uNode);
+void         LuleaNumaFree(void *pMemory, size_t uBytes);
+
+#endif /* __LULEA_NUMA_H__ */
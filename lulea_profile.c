@@ -0,0 +1,44 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "profile.h"
+
+int main(int argc, char **argv)
+{
+  double dThreshold   = 10.0;
+  int    iRegressions = 0;
+
+  if (argc < 3)
+  {
+    printf("Usage: %s <baseline profile.json> <candidate profile.json> [threshold percent, default 10]\n", argv[0]);
+    printf("Profiles are written by lulea_trie_poc -P <file>\n");
+    exit(1);
+  }
+
+  if (argc > 3)
+  {
+    dThreshold = strtod(argv[3], NULL);
+  }
+
+  iRegressions = ProfileCompare(argv[1], argv[2], dThreshold);
+  printf("%d metric(s) regressed more than %.1f%%\n", iRegressions, dThreshold);
+
+  return iRegressions ? 2 : 0;
+}
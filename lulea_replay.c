@@ -0,0 +1,432 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "routing_table_split.h"
+#include "read_bgp.h"
+#include "lulea_trie.h"
+#include "benchmark.h"
+#include "verify.h"
+#include "lookup_engine.h"
+#include "bgp_rib.h"
+
+/* Loads a RIB dump, then replays MRT UPDATE files against it. Updates are coalesced into
+   windows of stream time, and at the end of each window the bucket groups whose prefixes
+   came or went are rebuilt, or the whole trie if too many are dirty. Reports rebuild times,
+   how long after an update its prefix reached the forwarding image, and lookup throughput
+   between rebuilds. */
+
+#define REPLAY_DEFAULT_WINDOW_MS  (1000)
+#define REPLAY_DEFAULT_FULL       (1024)
+#define REPLAY_DEFAULT_LOOKUPS    (65536)
+
+typedef struct tagSAMPLES
+{
+  double      *pdValues;
+  unsigned int uCount;
+  unsigned int uCapacity;
+} SAMPLES, *PSAMPLES;
+
+typedef struct tagREPLAY
+{
+  RIB          rib;
+  unsigned int uFullThreshold;
+  unsigned int uVerifyEvery;
+  uint64_t     u64WindowMs;
+  uint64_t     u64WindowEnd;
+  int          bStarted;
+  double       dLastPublishMs;   /* Stream time the last rebuild finished, had it run inline */
+
+  uint64_t    *pu64Pending;      /* Stream time of updates in this window that added or removed a prefix */
+  unsigned int uNumPending;
+  unsigned int uPendingCapacity;
+
+  uint32_t    *pu32IPs;
+  uint32_t    *pu32Results;
+  unsigned int uNumIPs;
+
+  uint64_t     u64Events;
+  uint64_t     u64Windows;
+  uint64_t     u64Partial;
+  uint64_t     u64Full;
+  uint64_t     u64Skipped;
+  uint64_t     u64DirtyGroups;
+  uint64_t     u64GroupsRebuilt;
+  uint64_t     u64ChunksCopied;
+  uint64_t     u64Mismatches;
+
+  SAMPLES      rebuildMs;
+  SAMPLES      lagMs;
+  SAMPLES      lookupNs;
+} REPLAY, *PREPLAY;
+
+static void AddSample(PSAMPLES pSamples, double dValue)
+{
+  if (pSamples->uCount == pSamples->uCapacity)
+  {
+    pSamples->uCapacity = pSamples->uCapacity ? pSamples->uCapacity * 2 : 1024;
+    pSamples->pdValues  = realloc(pSamples->pdValues, pSamples->uCapacity * sizeof(*pSamples->pdValues));
+    if (!pSamples->pdValues)
+    {
+      printf("Can't allocate samples\n");
+      exit(1);
+    }
+  }
+  pSamples->pdValues[pSamples->uCount++] = dValue;
+}
+
+static int CompareDouble(const void *pA, const void *pB)
+{
+  double dA = *(const double *)pA;
+  double dB = *(const double *)pB;
+
+  return dA < dB ? -1 : dA > dB;
+}
+
+static double Percentile(PSAMPLES pSamples, double dPercentile)
+{
+  if (!pSamples->uCount)
+  {
+    return 0;
+  }
+
+  return pSamples->pdValues[(unsigned int)(dPercentile / 100.0 * (pSamples->uCount - 1) + 0.5)];
+}
+
+static void WriteSamplesJson(FILE *pFile, const char *pszName, PSAMPLES pSamples, int bLast)
+{
+  double       dSum   = 0;
+  unsigned int uIndex = 0;
+
+  qsort(pSamples->pdValues, pSamples->uCount, sizeof(*pSamples->pdValues), CompareDouble);
+  for (uIndex = 0; uIndex < pSamples->uCount; uIndex++)
+  {
+    dSum += pSamples->pdValues[uIndex];
+  }
+
+  fprintf(pFile, "  \"%s\": { \"count\": %u, \"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f }%s\n",
+          pszName, pSamples->uCount, pSamples->uCount ? dSum / pSamples->uCount : 0, Percentile(pSamples, 50),
+          Percentile(pSamples, 99), Percentile(pSamples, 100), bLast ? "" : ",");
+}
+
+static void LoadEvent(const BGPEVENT *pEvent, void *pContext)
+{
+  RibApply(pContext, pEvent);
+}
+
+static uint64_t Verify(PREPLAY pReplay)
+{
+  TREENODE tree;
+  uint64_t u64Mismatches = 0;
+
+  memset(&tree, 0, sizeof(tree));
+  RibBuildTree(&pReplay->rib, &tree, NULL);
+  u64Mismatches = VerifyRanges(LookupEngineFind("lulea"), stderr, &tree, pReplay->rib.pNextHops, VERIFY_DEFAULT_REPORT);
+  FreePrefixTreeAt(&tree);
+
+  return u64Mismatches;
+}
+
+static void CloseWindow(PREPLAY pReplay)
+{
+  LULEABUILDSTATS  stats;
+  TREENODE         tree;
+  uint64_t         au64Groups[RIB_GROUPS / 64];
+  unsigned int     uDirty     = RibTakeDirtyGroups(&pReplay->rib, au64Groups);
+  unsigned int     uIndex     = 0;
+  double           dRebuildMs = 0;
+  double           dPublishMs = 0;
+  int              bBuilt     = 0;
+  struct timespec  sooner;
+
+  pReplay->u64Windows++;
+
+  if (!uDirty)
+  {
+    pReplay->u64Skipped++;
+  }
+  else
+  {
+    memset(&tree, 0, sizeof(tree));
+    clock_gettime(CLOCK_MONOTONIC, &sooner);
+    if (uDirty >= pReplay->uFullThreshold)
+    {
+      RibBuildTree(&pReplay->rib, &tree, NULL);
+      bBuilt = BuildLuleaTrie(&tree, pReplay->rib.pNextHops, pReplay->rib.uNumIndexes);
+      pReplay->u64Full++;
+    }
+    else
+    {
+      RibBuildTree(&pReplay->rib, &tree, au64Groups);
+      bBuilt = LuleaTrieRebuildGroups(&tree, pReplay->rib.pNextHops, pReplay->rib.uNumIndexes, au64Groups);
+      pReplay->u64Partial++;
+    }
+    FreePrefixTreeAt(&tree);
+    dRebuildMs = BenchElapsedMs(&sooner);
+
+    if (!bBuilt)
+    {
+      printf("Could not rebuild the luleå trie\n");
+      exit(1);
+    }
+    /* Nothing looks up in the image the rebuild replaced any more */
+    RibPublished(&pReplay->rib);
+
+    LuleaTrieGetBuildStats(&stats);
+    pReplay->u64DirtyGroups   += uDirty;
+    pReplay->u64GroupsRebuilt += uDirty >= pReplay->uFullThreshold ? RIB_GROUPS : stats.u32GroupsRebuilt;
+    pReplay->u64ChunksCopied  += stats.u32ChunksCopied;
+    AddSample(&pReplay->rebuildMs, dRebuildMs);
+
+    /* Rebuilds run one after another, so a window that closes while the last one is still
+       running waits for it */
+    dPublishMs = pReplay->u64WindowEnd > pReplay->dLastPublishMs ? pReplay->u64WindowEnd : pReplay->dLastPublishMs;
+    dPublishMs += dRebuildMs;
+    pReplay->dLastPublishMs = dPublishMs;
+  }
+
+  for (uIndex = 0; uIndex < pReplay->uNumPending; uIndex++)
+  {
+    AddSample(&pReplay->lagMs, dPublishMs - pReplay->pu64Pending[uIndex]);
+  }
+  pReplay->uNumPending = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  LuleaTrieLookupBatch(pReplay->pu32IPs, pReplay->pu32Results, pReplay->uNumIPs);
+  AddSample(&pReplay->lookupNs, BenchElapsedMs(&sooner) * 1000000.0 / pReplay->uNumIPs);
+
+  if (pReplay->uVerifyEvery && pReplay->u64Windows % pReplay->uVerifyEvery == 0)
+  {
+    pReplay->u64Mismatches += Verify(pReplay);
+  }
+}
+
+static void ReplayEvent(const BGPEVENT *pEvent, void *pContext)
+{
+  PREPLAY pReplay = pContext;
+
+  if (!pReplay->bStarted)
+  {
+    pReplay->u64WindowEnd = pEvent->u64TimeMs - pEvent->u64TimeMs % pReplay->u64WindowMs + pReplay->u64WindowMs;
+    pReplay->bStarted     = 1;
+  }
+  else if (pEvent->u64TimeMs >= pReplay->u64WindowEnd)
+  {
+    CloseWindow(pReplay);
+    /* Quiet periods don't count as windows */
+    pReplay->u64WindowEnd += ((pEvent->u64TimeMs - pReplay->u64WindowEnd) / pReplay->u64WindowMs + 1) * pReplay->u64WindowMs;
+  }
+
+  pReplay->u64Events++;
+  if (!RibApply(&pReplay->rib, pEvent))
+  {
+    return;
+  }
+
+  if (pReplay->uNumPending == pReplay->uPendingCapacity)
+  {
+    pReplay->uPendingCapacity = pReplay->uPendingCapacity ? pReplay->uPendingCapacity * 2 : 1024;
+    pReplay->pu64Pending      = realloc(pReplay->pu64Pending, pReplay->uPendingCapacity * sizeof(*pReplay->pu64Pending));
+    if (!pReplay->pu64Pending)
+    {
+      printf("Can't allocate pending updates\n");
+      exit(1);
+    }
+  }
+  pReplay->pu64Pending[pReplay->uNumPending++] = pEvent->u64TimeMs;
+}
+
+static void Usage(char *pszProgram)
+{
+  printf("Usage: %s [options] <rib dump> <updates file> [<updates file> ...]\n", pszProgram);
+  printf("  -w <ms>     coalesce updates over windows of this much stream time (default %d)\n", REPLAY_DEFAULT_WINDOW_MS);
+  printf("  -f <count>  rebuild the whole trie when this many bucket groups are dirty (default %d)\n", REPLAY_DEFAULT_FULL);
+  printf("  -n <count>  lookups timed after every window (default %d)\n", REPLAY_DEFAULT_LOOKUPS);
+  printf("  -V <n>      verify the trie against the radix tree every n windows and at the end\n");
+  printf("  -o <file>   write JSON results to file instead of stdout\n");
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  REPLAY           replay;
+  FILE            *pOutput   = stdout;
+  uint64_t         au64Groups[RIB_GROUPS / 64];
+  unsigned long    ulRibEvents = 0;
+  double           dLoadMs   = 0;
+  double           dBuildMs  = 0;
+  double           dReplayMs = 0;
+  double           dMinMLookups = 0;
+  int              iOption   = 0;
+  int              iArg      = 0;
+  struct timespec  sooner;
+
+  memset(&replay, 0, sizeof(replay));
+  replay.u64WindowMs    = REPLAY_DEFAULT_WINDOW_MS;
+  replay.uFullThreshold = REPLAY_DEFAULT_FULL;
+  replay.uNumIPs        = REPLAY_DEFAULT_LOOKUPS;
+
+  while ((iOption = getopt(argc, argv, "w:f:n:V:o:")) != -1)
+  {
+    switch (iOption)
+    {
+      case 'w':
+        replay.u64WindowMs = strtoull(optarg, NULL, 0);
+        break;
+      case 'f':
+        replay.uFullThreshold = strtoul(optarg, NULL, 0);
+        break;
+      case 'n':
+        replay.uNumIPs = strtoul(optarg, NULL, 0);
+        break;
+      case 'V':
+        replay.uVerifyEvery = strtoul(optarg, NULL, 0);
+        break;
+      case 'o':
+        pOutput = fopen(optarg, "w");
+        if (!pOutput)
+        {
+          printf("Could not open %s for writing\n", optarg);
+          exit(1);
+        }
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+
+  if (optind + 2 > argc || !replay.u64WindowMs || !replay.uNumIPs)
+  {
+    Usage(argv[0]);
+  }
+
+  RibInit(&replay.rib);
+
+  fprintf(stderr, "Loading RIB from %s\n", argv[optind]);
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  ulRibEvents = ReadBgpEvents(argv[optind], LoadEvent, &replay.rib);
+  dLoadMs     = BenchElapsedMs(&sooner);
+  RibTakeDirtyGroups(&replay.rib, au64Groups);
+  /* Count only what the updates do */
+  RibResetCounters(&replay.rib);
+
+  fprintf(stderr, "Building luleå trie from %u prefixes\n", replay.rib.uNumLive);
+  {
+    TREENODE tree;
+
+    memset(&tree, 0, sizeof(tree));
+    clock_gettime(CLOCK_MONOTONIC, &sooner);
+    RibBuildTree(&replay.rib, &tree, NULL);
+    if (!BuildLuleaTrie(&tree, replay.rib.pNextHops, replay.rib.uNumIndexes))
+    {
+      printf("Could not build the luleå trie\n");
+      exit(1);
+    }
+    FreePrefixTreeAt(&tree);
+    dBuildMs = BenchElapsedMs(&sooner);
+  }
+
+  /* Addresses inside the prefixes of the initial table, the same set after every window */
+  replay.pu32IPs     = BenchGenerateAddresses(BENCHDIST_PREFIX, &replay.uNumIPs, replay.rib.pNextHops,
+                                              replay.rib.uNumIndexes, 0, NULL);
+  replay.pu32Results = malloc(replay.uNumIPs * sizeof(*replay.pu32Results));
+  if (!replay.pu32Results)
+  {
+    printf("Can't allocate lookup results\n");
+    exit(1);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  for (iArg = optind + 1; iArg < argc; iArg++)
+  {
+    fprintf(stderr, "Replaying %s\n", argv[iArg]);
+    ReadBgpEvents(argv[iArg], ReplayEvent, &replay);
+  }
+  if (replay.bStarted)
+  {
+    CloseWindow(&replay);
+  }
+  dReplayMs = BenchElapsedMs(&sooner);
+
+  if (replay.uVerifyEvery)
+  {
+    replay.u64Mismatches += Verify(&replay);
+  }
+
+  qsort(replay.lookupNs.pdValues, replay.lookupNs.uCount, sizeof(double), CompareDouble);
+  if (replay.lookupNs.uCount)
+  {
+    dMinMLookups = 1000.0 / Percentile(&replay.lookupNs, 100);
+  }
+
+  fprintf(pOutput, "{\n");
+  fprintf(pOutput, "  \"rib_paths\": %lu,\n", ulRibEvents);
+  fprintf(pOutput, "  \"rib_load_ms\": %.3f,\n", dLoadMs);
+  fprintf(pOutput, "  \"initial_build_ms\": %.3f,\n", dBuildMs);
+  fprintf(pOutput, "  \"prefixes\": %u,\n", replay.rib.uNumLive);
+  fprintf(pOutput, "  \"updates\": %llu,\n", (unsigned long long)replay.u64Events);
+  fprintf(pOutput, "  \"announcements\": %llu,\n", (unsigned long long)replay.rib.u64Announcements);
+  fprintf(pOutput, "  \"withdrawals\": %llu,\n", (unsigned long long)replay.rib.u64Withdrawals);
+  fprintf(pOutput, "  \"prefixes_added\": %llu,\n", (unsigned long long)replay.rib.u64PrefixesAdded);
+  fprintf(pOutput, "  \"prefixes_removed\": %llu,\n", (unsigned long long)replay.rib.u64PrefixesRemoved);
+  fprintf(pOutput, "  \"path_changes\": %llu,\n", (unsigned long long)replay.rib.u64PathChanges);
+  fprintf(pOutput, "  \"paths_dropped\": %llu,\n", (unsigned long long)replay.rib.u64PathsDropped);
+  fprintf(pOutput, "  \"ignored\": %llu,\n", (unsigned long long)replay.rib.u64Ignored);
+  fprintf(pOutput, "  \"peer_downs\": %llu,\n", (unsigned long long)replay.rib.u64PeerDowns);
+  fprintf(pOutput, "  \"peer_down_paths\": %llu,\n", (unsigned long long)replay.rib.u64PeerPaths);
+  fprintf(pOutput, "  \"replay_ms\": %.3f,\n", dReplayMs);
+  fprintf(pOutput, "  \"window_ms\": %llu,\n", (unsigned long long)replay.u64WindowMs);
+  fprintf(pOutput, "  \"full_threshold\": %u,\n", replay.uFullThreshold);
+  fprintf(pOutput, "  \"windows\": %llu,\n", (unsigned long long)replay.u64Windows);
+  fprintf(pOutput, "  \"partial_rebuilds\": %llu,\n", (unsigned long long)replay.u64Partial);
+  fprintf(pOutput, "  \"full_rebuilds\": %llu,\n", (unsigned long long)replay.u64Full);
+  fprintf(pOutput, "  \"skipped_rebuilds\": %llu,\n", (unsigned long long)replay.u64Skipped);
+  fprintf(pOutput, "  \"dirty_groups_per_rebuild\": %.3f,\n",
+          replay.rebuildMs.uCount ? (double)replay.u64DirtyGroups / replay.rebuildMs.uCount : 0);
+  fprintf(pOutput, "  \"groups_rebuilt_per_rebuild\": %.3f,\n",
+          replay.rebuildMs.uCount ? (double)replay.u64GroupsRebuilt / replay.rebuildMs.uCount : 0);
+  fprintf(pOutput, "  \"chunks_copied_per_rebuild\": %.3f,\n",
+          replay.rebuildMs.uCount ? (double)replay.u64ChunksCopied / replay.rebuildMs.uCount : 0);
+  WriteSamplesJson(pOutput, "rebuild_ms", &replay.rebuildMs, 0);
+  WriteSamplesJson(pOutput, "convergence_lag_ms", &replay.lagMs, 0);
+  WriteSamplesJson(pOutput, "lookup_ns", &replay.lookupNs, 0);
+  fprintf(pOutput, "  \"min_mlookups_per_sec\": %.3f,\n", dMinMLookups);
+  fprintf(pOutput, "  \"verified\": %s,\n", replay.uVerifyEvery ? "true" : "false");
+  fprintf(pOutput, "  \"mismatches\": %llu\n", (unsigned long long)replay.u64Mismatches);
+  fprintf(pOutput, "}\n");
+
+  if (pOutput != stdout)
+  {
+    fclose(pOutput);
+  }
+
+  free(replay.pu32IPs);
+  free(replay.pu32Results);
+  free(replay.pu64Pending);
+  free(replay.rebuildMs.pdValues);
+  free(replay.lagMs.pdValues);
+  free(replay.lookupNs.pdValues);
+  RibFree(&replay.rib);
+
+  return replay.u64Mismatches ? 2 : 0;
+}
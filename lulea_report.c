@@ -0,0 +1,198 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lulea_trie.h"
+#include "lulea_report.h"
+
+static unsigned int SizeBucket(unsigned int uPointers)
+{
+  unsigned int uBucket = 0;
+
+  while (uPointers && uBucket < LULEA_REPORT_SIZE_BUCKETS - 1)
+  {
+    uPointers >>= 1;
+    uBucket++;
+  }
+
+  return uBucket;
+}
+
+/* Counts codewords of one chunk, returns the number of pointers following them */
+static unsigned int WalkCodewords(PCODEWORD pCodewords, unsigned int uNumCodewords, unsigned int uLevel, PLULEAREPORT pReport)
+{
+  unsigned int uIndex    = 0;
+  unsigned int uPointers = 0;
+
+  pReport->au32Codewords[uLevel - 1] += uNumCodewords;
+
+  for (uIndex = 0; uIndex < uNumCodewords; uIndex++)
+  {
+    uint64_t     u64Codeword = pCodewords[uIndex].u64BitmaskOffset;
+    unsigned int uBits       = 0;
+
+    if (u64Codeword & CODEWORD_NEXTHOP)
+    {
+      pReport->au32DirectCodewords[uLevel - 1]++;
+      continue;
+    }
+
+    uBits = __builtin_popcount((uint32_t)(u64Codeword >> 32) & 0xFFFF);
+    pReport->aau32BitmaskPopcount[uLevel - 1][uBits]++;
+    uPointers += uBits;
+  }
+
+  return uPointers;
+}
+
+static void WalkPointers(const char *pchImage, size_t uImageBytes, uint32_t *pu32Pointers, unsigned int uNumPointers,
+                         unsigned int uLevel, PLULEAREPORT pReport)
+{
+  unsigned int uIndex = 0;
+
+  for (uIndex = 0; uIndex < uNumPointers; uIndex++)
+  {
+    uint32_t     u32Pointer = pu32Pointers[uIndex];
+    uint32_t     u32Offset  = u32Pointer & ~POINTERTYPE_NEXTLEVEL;
+    PLEVEL23     pChunk     = NULL;
+    unsigned int uChunkPointers = 0;
+
+    if (!(u32Pointer & POINTERTYPE_NEXTLEVEL))
+    {
+      pReport->au32NextHopPointers[uLevel - 1]++;
+      continue;
+    }
+
+    pReport->au32NextLevelPointers[uLevel - 1]++;
+    if (uLevel == 3 || u32Offset < sizeof(LEVEL1) || u32Offset + sizeof(LEVEL23) > uImageBytes)
+    {
+      pReport->u32Errors++;
+      continue;
+    }
+
+    pChunk         = (PLEVEL23)(pchImage + u32Offset);
+    uChunkPointers = WalkCodewords(pChunk->codewords, 16, uLevel + 1, pReport);
+    if (u32Offset + sizeof(LEVEL23) + uChunkPointers * sizeof(uint32_t) > uImageBytes)
+    {
+      pReport->u32Errors++;
+      continue;
+    }
+
+    pReport->au32Chunks[uLevel]++;
+    pReport->au64ChunkBytes[uLevel] += sizeof(LEVEL23) + uChunkPointers * sizeof(uint32_t);
+    pReport->aau32ChunkSizes[uLevel][SizeBucket(uChunkPointers)]++;
+
+    WalkPointers(pchImage, uImageBytes, pChunk->au32Pointers, uChunkPointers, uLevel + 1, pReport);
+  }
+}
+
+/* Walks a built or loaded image and breaks down where the memory goes */
+int LuleaTrieIntrospect(const char *pchImage, size_t uImageBytes, unsigned int uNumPrefixes, size_t uNextHopSize, PLULEAREPORT pReport)
+{
+  PLEVEL1      pLevel1         = (PLEVEL1)pchImage;
+  unsigned int uLevel1Pointers = 0;
+
+  memset(pReport, 0, sizeof(*pReport));
+
+  if (!pchImage || uImageBytes < sizeof(LEVEL1))
+  {
+    return 0;
+  }
+
+  pReport->u64ImageBytes          = uImageBytes;
+  pReport->uNumPrefixes           = uNumPrefixes;
+  pReport->u64NextHopBytes        = (uint64_t)uNumPrefixes * uNextHopSize;
+  pReport->u64Level1CodewordBytes = sizeof(LEVEL1);
+
+  uLevel1Pointers = WalkCodewords(pLevel1->codewords, 4096, 1, pReport);
+  if (sizeof(LEVEL1) + uLevel1Pointers * sizeof(uint32_t) > uImageBytes)
+  {
+    pReport->u32Errors++;
+    return 0;
+  }
+
+  pReport->au32Chunks[0]          = 1;
+  pReport->u64Level1PointerBytes  = uLevel1Pointers * sizeof(uint32_t);
+  pReport->au64ChunkBytes[0]      = pReport->u64Level1CodewordBytes + pReport->u64Level1PointerBytes;
+
+  WalkPointers(pchImage, uImageBytes, pLevel1->au32Pointers, uLevel1Pointers, 1, pReport);
+
+  return pReport->u32Errors == 0;
+}
+
+static void WriteHistogram(FILE *pFile, uint32_t *pu32Histogram, unsigned int uCount)
+{
+  unsigned int uIndex = 0;
+
+  fprintf(pFile, "[");
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    fprintf(pFile, "%s%u", uIndex ? ", " : "", pu32Histogram[uIndex]);
+  }
+  fprintf(pFile, "]");
+}
+
+void LuleaReportWriteJson(FILE *pFile, PLULEAREPORT pReport)
+{
+  unsigned int uLevel       = 0;
+  uint32_t     u32Codewords = 0;
+  uint32_t     u32Direct    = 0;
+
+  for (uLevel = 0; uLevel < 3; uLevel++)
+  {
+    u32Codewords += pReport->au32Codewords[uLevel];
+    u32Direct    += pReport->au32DirectCodewords[uLevel];
+  }
+
+  fprintf(pFile, "{\n");
+  fprintf(pFile, "  \"image_bytes\": %lu,\n", pReport->u64ImageBytes);
+  fprintf(pFile, "  \"next_hop_bytes\": %lu,\n", pReport->u64NextHopBytes);
+  fprintf(pFile, "  \"prefixes\": %u,\n", pReport->uNumPrefixes);
+  fprintf(pFile, "  \"image_bytes_per_prefix\": %.3f,\n",
+          pReport->uNumPrefixes ? (double)pReport->u64ImageBytes / pReport->uNumPrefixes : 0.0);
+  fprintf(pFile, "  \"level1_codeword_bytes\": %lu,\n", pReport->u64Level1CodewordBytes);
+  fprintf(pFile, "  \"level1_pointer_bytes\": %lu,\n", pReport->u64Level1PointerBytes);
+  fprintf(pFile, "  \"direct_codeword_fraction\": %.4f,\n", u32Codewords ? (double)u32Direct / u32Codewords : 0.0);
+  fprintf(pFile, "  \"errors\": %u,\n", pReport->u32Errors);
+  fprintf(pFile, "  \"chunk_size_buckets\": \"pointers 0, 1, 2-3, 4-7, 8-15, 16-31, 32-63, 64-127, 128-255, 256\",\n");
+  fprintf(pFile, "  \"levels\": [\n");
+
+  for (uLevel = 0; uLevel < 3; uLevel++)
+  {
+    fprintf(pFile, "    {\n");
+    fprintf(pFile, "      \"level\": %u,\n", uLevel + 1);
+    fprintf(pFile, "      \"chunks\": %u,\n", pReport->au32Chunks[uLevel]);
+    fprintf(pFile, "      \"bytes\": %lu,\n", pReport->au64ChunkBytes[uLevel]);
+    fprintf(pFile, "      \"codewords\": %u,\n", pReport->au32Codewords[uLevel]);
+    fprintf(pFile, "      \"direct_codewords\": %u,\n", pReport->au32DirectCodewords[uLevel]);
+    fprintf(pFile, "      \"direct_codeword_fraction\": %.4f,\n",
+            pReport->au32Codewords[uLevel] ? (double)pReport->au32DirectCodewords[uLevel] / pReport->au32Codewords[uLevel] : 0.0);
+    fprintf(pFile, "      \"next_hop_pointers\": %u,\n", pReport->au32NextHopPointers[uLevel]);
+    fprintf(pFile, "      \"next_level_pointers\": %u,\n", pReport->au32NextLevelPointers[uLevel]);
+    fprintf(pFile, "      \"bitmask_popcount_histogram\": ");
+    WriteHistogram(pFile, pReport->aau32BitmaskPopcount[uLevel], 17);
+    fprintf(pFile, ",\n      \"chunk_size_histogram\": ");
+    WriteHistogram(pFile, pReport->aau32ChunkSizes[uLevel], LULEA_REPORT_SIZE_BUCKETS);
+    fprintf(pFile, "\n    }%s\n", uLevel < 2 ? "," : "");
+  }
+
+  fprintf(pFile, "  ]\n}\n");
+}
@@ -0,0 +1,52 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LULEA_REPORT_H__
+#define __LULEA_REPORT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Chunk sizes are bucketed by pointer count: 0, 1, 2-3, 4-7, ... 128-255, 256 */
+#define LULEA_REPORT_SIZE_BUCKETS (10)
+
+typedef struct tagLULEAREPORT
+{
+  uint64_t     u64ImageBytes;
+  uint64_t     u64Level1CodewordBytes;
+  uint64_t     u64Level1PointerBytes;
+  unsigned int uNumPrefixes;
+  uint64_t     u64NextHopBytes;       /* Next hop array that pointers index */
+
+  /* Indexed by level - 1 */
+  uint32_t     au32Chunks[3];
+  uint64_t     au64ChunkBytes[3];
+  uint32_t     au32Codewords[3];
+  uint32_t     au32DirectCodewords[3];
+  uint32_t     au32NextHopPointers[3];
+  uint32_t     au32NextLevelPointers[3];
+  uint32_t     aau32BitmaskPopcount[3][17];                       /* Bits set in codewords that have a bitmask */
+  uint32_t     aau32ChunkSizes[3][LULEA_REPORT_SIZE_BUCKETS];     /* Level 2 and 3 only */
+
+  uint32_t     u32Errors;             /* Offsets outside the image, only for broken snapshots */
+} LULEAREPORT, *PLULEAREPORT;
+
+int  LuleaTrieIntrospect(const char *pchImage, size_t uImageBytes, unsigned int uNumPrefixes, size_t uNextHopSize, PLULEAREPORT pReport);
+void LuleaReportWriteJson(FILE *pFile, PLULEAREPORT pReport);
+
+#endif /* __LULEA_REPORT_H__ */
@@ -0,0 +1,295 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lulea_trie.h"
+#include "lulea_shm.h"
+
+/* Where the result table columns start in a data segment, the image is at offset 0 */
+typedef struct tagSHMLAYOUT
+{
+  size_t uStarts;
+  size_t uLengths;
+  size_t uNextHops;
+  size_t uBytes;
+} SHMLAYOUT;
+
+static void ShmLayout(uint64_t u64ImageBytes, uint32_t u32NumResults, SHMLAYOUT *pLayout)
+{
+  pLayout->uStarts   = (u64ImageBytes + 63) & ~63ULL;
+  pLayout->uLengths  = pLayout->uStarts + (size_t)u32NumResults * sizeof(uint32_t);
+  pLayout->uNextHops = (pLayout->uLengths + u32NumResults + 3) & ~(size_t)3;
+  pLayout->uBytes    = pLayout->uNextHops + (size_t)u32NumResults * sizeof(uint32_t);
+}
+
+/* shm_open() wants a single leading slash */
+static void ShmName(char *pszBuffer, size_t uSize, const char *pszName, uint64_t u64Generation)
+{
+  while (*pszName == '/')
+  {
+    pszName++;
+  }
+
+  if (u64Generation)
+  {
+    snprintf(pszBuffer, uSize, "/%s.%lu", pszName, u64Generation);
+  }
+  else
+  {
+    snprintf(pszBuffer, uSize, "/%s", pszName);
+  }
+}
+
+static int ShmHeaderValid(PSHMHEADER pHeader)
+{
+  return !memcmp(pHeader->achMagic, LULEA_SHM_MAGIC, sizeof(pHeader->achMagic)) &&
+         pHeader->u32Version == LULEA_SHM_VERSION;
+}
+
+/* Publishes the current luleå trie and pResults as the next generation. Readers that mapped
+   the previous one keep it until they pick up this one, its name is removed right away. */
+int LuleaShmPublish(const char *pszName, PRESULTTABLE pResults)
+{
+  char        achName[256];
+  SHMLAYOUT   layout;
+  PSHMHEADER  pHeader       = NULL;
+  char       *pchSegment    = NULL;
+  char       *pchImage      = NULL;
+  size_t      uImageBytes   = 0;
+  uint64_t    u64Generation = 1;
+  uint64_t    u64Previous   = 0;
+  int         iFd           = -1;
+
+  pchImage = LuleaTrieImage(&uImageBytes);
+  if (!pchImage || LuleaTrieHostTableBytes())
+  {
+    printf("No luleå trie to publish, or it was built without its host routes\n");
+    return 0;
+  }
+  ShmLayout(uImageBytes, pResults->uNumResults, &layout);
+
+  ShmName(achName, sizeof(achName), pszName, 0);
+  iFd = shm_open(achName, O_RDWR | O_CREAT, 0644);
+  if (iFd < 0 || ftruncate(iFd, sizeof(*pHeader)))
+  {
+    printf("Could not create shared memory %s\n", achName);
+    if (iFd >= 0)
+    {
+      close(iFd);
+    }
+    return 0;
+  }
+  pHeader = mmap(NULL, sizeof(*pHeader), PROT_READ | PROT_WRITE, MAP_SHARED, iFd, 0);
+  close(iFd);
+  if (pHeader == MAP_FAILED)
+  {
+    printf("Could not map shared memory %s\n", achName);
+    return 0;
+  }
+
+  /* A restarted publisher continues the generations, readers would not notice a reused one */
+  if (ShmHeaderValid(pHeader))
+  {
+    u64Previous   = pHeader->u64Generation;
+    u64Generation = u64Previous + 1;
+  }
+
+  ShmName(achName, sizeof(achName), pszName, u64Generation);
+  iFd = shm_open(achName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (iFd < 0 || ftruncate(iFd, layout.uBytes))
+  {
+    printf("Could not create shared memory %s\n", achName);
+    if (iFd >= 0)
+    {
+      close(iFd);
+    }
+    munmap(pHeader, sizeof(*pHeader));
+    return 0;
+  }
+  pchSegment = mmap(NULL, layout.uBytes, PROT_READ | PROT_WRITE, MAP_SHARED, iFd, 0);
+  close(iFd);
+  if (pchSegment == MAP_FAILED)
+  {
+    printf("Could not map shared memory %s\n", achName);
+    shm_unlink(achName);
+    munmap(pHeader, sizeof(*pHeader));
+    return 0;
+  }
+
+  memcpy(pchSegment, pchImage, uImageBytes);
+  memcpy(pchSegment + layout.uStarts, pResults->pu32Start, pResults->uNumResults * sizeof(*pResults->pu32Start));
+  memcpy(pchSegment + layout.uLengths, pResults->pu8Length, pResults->uNumResults * sizeof(*pResults->pu8Length));
+  memcpy(pchSegment + layout.uNextHops, pResults->pu32NextHop, pResults->uNumResults * sizeof(*pResults->pu32NextHop));
+  munmap(pchSegment, layout.uBytes);
+
+  /* Sequence lock: readers retry if the sequence is odd or changed while they copied the fields */
+  __atomic_store_n(&pHeader->u64Sequence, pHeader->u64Sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(pHeader->achMagic, LULEA_SHM_MAGIC, sizeof(pHeader->achMagic));
+  pHeader->u32Version      = LULEA_SHM_VERSION;
+  pHeader->u32NumResults   = pResults->uNumResults;
+  pHeader->u64Generation   = u64Generation;
+  pHeader->u64ImageBytes   = uImageBytes;
+  pHeader->u64SegmentBytes = layout.uBytes;
+  __atomic_store_n(&pHeader->u64Sequence, pHeader->u64Sequence + 1, __ATOMIC_RELEASE);
+
+  munmap(pHeader, sizeof(*pHeader));
+
+  if (u64Previous)
+  {
+    ShmName(achName, sizeof(achName), pszName, u64Previous);
+    shm_unlink(achName);
+  }
+
+  return 1;
+}
+
+int LuleaShmAttach(const char *pszName, PLULEASHMREADER pReader)
+{
+  int iFd = -1;
+
+  memset(pReader, 0, sizeof(*pReader));
+  ShmName(pReader->achName, sizeof(pReader->achName), pszName, 0);
+
+  iFd = shm_open(pReader->achName, O_RDONLY, 0);
+  if (iFd < 0)
+  {
+    printf("Nothing published as %s\n", pReader->achName);
+    return 0;
+  }
+  pReader->pHeader = mmap(NULL, sizeof(SHMHEADER), PROT_READ, MAP_SHARED, iFd, 0);
+  close(iFd);
+  if (pReader->pHeader == MAP_FAILED)
+  {
+    printf("Could not map shared memory %s\n", pReader->achName);
+    pReader->pHeader = NULL;
+    return 0;
+  }
+
+  if (LuleaShmPoll(pReader) <= 0)
+  {
+    printf("No table published in %s yet\n", pReader->achName);
+    LuleaShmDetach(pReader);
+    return 0;
+  }
+
+  return 1;
+}
+
+/* Makes a newly published generation the current luleå trie. Returns 1 if it switched, 0 if
+   there was nothing new (or the publisher was busy, try again later), -1 on errors. Lookups
+   may continue on the previous generation until the next switch, only the one before is
+   unmapped. Cheap enough to call between every batch of lookups. */
+int LuleaShmPoll(PLULEASHMREADER pReader)
+{
+  SHMHEADER    header;
+  SHMLAYOUT    layout;
+  struct stat  st;
+  char         achSegment[sizeof(pReader->achName) + 24];
+  char        *pchSegment  = NULL;
+  uint64_t     u64Sequence = __atomic_load_n(&pReader->pHeader->u64Sequence, __ATOMIC_ACQUIRE);
+  int          iFd         = -1;
+
+  if ((u64Sequence & 1) || u64Sequence == pReader->u64Sequence)
+  {
+    return 0;
+  }
+
+  memcpy(&header, pReader->pHeader, sizeof(header));
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if (__atomic_load_n(&pReader->pHeader->u64Sequence, __ATOMIC_RELAXED) != u64Sequence)
+  {
+    return 0;
+  }
+
+  ShmLayout(header.u64ImageBytes, header.u32NumResults, &layout);
+  if (!ShmHeaderValid(&header) || header.u64ImageBytes < sizeof(LEVEL1) || header.u64SegmentBytes != layout.uBytes)
+  {
+    printf("%s does not hold a luleå trie\n", pReader->achName);
+    return -1;
+  }
+
+  /* Gone if the publisher was faster, the header will point at the newer one */
+  snprintf(achSegment, sizeof(achSegment), "%s.%lu", pReader->achName, header.u64Generation);
+  iFd = shm_open(achSegment, O_RDONLY, 0);
+  if (iFd < 0)
+  {
+    return 0;
+  }
+  if (fstat(iFd, &st) || (size_t)st.st_size < layout.uBytes)
+  {
+    close(iFd);
+    return 0;
+  }
+  pchSegment = mmap(NULL, layout.uBytes, PROT_READ, MAP_SHARED, iFd, 0);
+  close(iFd);
+  if (pchSegment == MAP_FAILED)
+  {
+    printf("Could not map shared memory %s\n", achSegment);
+    return -1;
+  }
+
+  pReader->results.uNumResults = header.u32NumResults;
+  pReader->results.pu32Start   = (uint32_t *)(pchSegment + layout.uStarts);
+  pReader->results.pu8Length   = (uint8_t *)(pchSegment + layout.uLengths);
+  pReader->results.pu32NextHop = (uint32_t *)(pchSegment + layout.uNextHops);
+
+  /* Lookups only read the image, the mapping is read only */
+  LuleaTrieSetImage(pchSegment, header.u64ImageBytes);
+
+  if (pReader->apMappings[1])
+  {
+    munmap(pReader->apMappings[1], pReader->auMappingBytes[1]);
+  }
+  pReader->apMappings[1]     = pReader->apMappings[0];
+  pReader->auMappingBytes[1] = pReader->auMappingBytes[0];
+  pReader->apMappings[0]     = pchSegment;
+  pReader->auMappingBytes[0] = layout.uBytes;
+
+  pReader->u64Sequence   = u64Sequence;
+  pReader->u64Generation = header.u64Generation;
+
+  return 1;
+}
+
+/* The luleå trie must not be used after this if it came from the reader */
+void LuleaShmDetach(PLULEASHMREADER pReader)
+{
+  unsigned int uIndex = 0;
+
+  for (uIndex = 0; uIndex < 2; uIndex++)
+  {
+    if (pReader->apMappings[uIndex])
+    {
+      munmap(pReader->apMappings[uIndex], pReader->auMappingBytes[uIndex]);
+    }
+  }
+  if (pReader->pHeader)
+  {
+    munmap(pReader->pHeader, sizeof(SHMHEADER));
+  }
+
+  memset(pReader, 0, sizeof(*pReader));
+}
@@ -0,0 +1,62 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LULEA_SHM_H__
+#define __LULEA_SHM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "result_table.h"
+
+#define LULEA_SHM_MAGIC   "LULEASHM"
+#define LULEA_SHM_VERSION (1)
+
+/* One process builds the table and publishes it, any number of processes on the host map it
+   read only. Every publication goes into its own segment "<name>.<generation>", holding the
+   image followed by the result table columns. The image only contains offsets, so readers use
+   it wherever it is mapped. The control segment "<name>" says which generation is current. */
+typedef struct tagSHMHEADER
+{
+  char     achMagic[8];
+  uint32_t u32Version;
+  uint32_t u32NumResults;
+  uint64_t u64Sequence;    /* Odd while the publisher updates the fields below */
+  uint64_t u64Generation;
+  uint64_t u64ImageBytes;
+  uint64_t u64SegmentBytes;
+} SHMHEADER, *PSHMHEADER;
+
+typedef struct tagLULEASHMREADER
+{
+  char                 achName[256];
+  PSHMHEADER           pHeader;       /* Control segment, mapped read only */
+  uint64_t             u64Sequence;   /* Of the generation in use, 0 before the first */
+  uint64_t             u64Generation;
+
+  /* The segment in use and the one before, which lookups may still be running on */
+  void                *apMappings[2];
+  size_t               auMappingBytes[2];
+
+  RESULTTABLE          results;       /* Columns point into the current segment */
+} LULEASHMREADER, *PLULEASHMREADER;
+
+int  LuleaShmPublish(const char *pszName, PRESULTTABLE pResults);
+int  LuleaShmAttach(const char *pszName, PLULEASHMREADER pReader);
+int  LuleaShmPoll(PLULEASHMREADER pReader);
+void LuleaShmDetach(PLULEASHMREADER pReader);
+
+#endif /* __LULEA_SHM_H__ */
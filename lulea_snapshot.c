@@ -0,0 +1,124 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lulea_trie.h"
+#include "lulea_snapshot.h"
+
+/* Saves the current luleå trie image and the result table it indexes */
+int LuleaSnapshotSave(const char *pszFile, PRESULTTABLE pResults)
+{
+  SNAPSHOTHEADER  header;
+  FILE           *pFile    = NULL;
+  char           *pchImage = NULL;
+  size_t          uSize    = 0;
+
+  pchImage = LuleaTrieImage(&uSize);
+  if (!pchImage)
+  {
+    printf("No luleå trie to save\n");
+    return 0;
+  }
+  if (LuleaTrieHostTableBytes())
+  {
+    printf("Snapshots don't hold the host route table, build the trie with its /32s to save it\n");
+    return 0;
+  }
+
+  pFile = fopen(pszFile, "wb");
+  if (!pFile)
+  {
+    printf("Could not open snapshot %s for writing\n", pszFile);
+    return 0;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.achMagic, LULEA_SNAPSHOT_MAGIC, sizeof(header.achMagic));
+  header.u32Version    = LULEA_SNAPSHOT_VERSION;
+  header.u32NumResults = pResults->uNumResults;
+  header.u64ImageBytes = uSize;
+
+  fwrite(&header, sizeof(header), 1, pFile);
+  fwrite(pchImage, 1, uSize, pFile);
+  fwrite(pResults->pu32Start, sizeof(*pResults->pu32Start), pResults->uNumResults, pFile);
+  fwrite(pResults->pu8Length, sizeof(*pResults->pu8Length), pResults->uNumResults, pFile);
+  fwrite(pResults->pu32NextHop, sizeof(*pResults->pu32NextHop), pResults->uNumResults, pFile);
+
+  if (fclose(pFile))
+  {
+    printf("Could not write snapshot %s\n", pszFile);
+    return 0;
+  }
+
+  return 1;
+}
+
+/* Loads a snapshot, makes it the current luleå trie and fills in the result table */
+int LuleaSnapshotLoad(const char *pszFile, PRESULTTABLE pResults)
+{
+  SNAPSHOTHEADER  header;
+  FILE           *pFile     = NULL;
+  char           *pchImage  = NULL;
+  uint32_t        u32Count  = 0;
+
+  pFile = fopen(pszFile, "rb");
+  if (!pFile)
+  {
+    printf("Could not open snapshot %s\n", pszFile);
+    return 0;
+  }
+
+  if (fread(&header, sizeof(header), 1, pFile) != 1 ||
+      memcmp(header.achMagic, LULEA_SNAPSHOT_MAGIC, sizeof(header.achMagic)) ||
+      header.u32Version != LULEA_SNAPSHOT_VERSION ||
+      header.u64ImageBytes < sizeof(LEVEL1))
+  {
+    printf("%s is not a luleå trie snapshot\n", pszFile);
+    fclose(pFile);
+    return 0;
+  }
+
+  pchImage = malloc(header.u64ImageBytes);
+  if (!pchImage)
+  {
+    printf("Can't allocate snapshot memory\n");
+    exit(1);
+  }
+  ResultTableAlloc(pResults, header.u32NumResults);
+
+  u32Count = header.u32NumResults;
+  if (fread(pchImage, 1, header.u64ImageBytes, pFile) != header.u64ImageBytes ||
+      fread(pResults->pu32Start, sizeof(*pResults->pu32Start), u32Count, pFile) != u32Count ||
+      fread(pResults->pu8Length, sizeof(*pResults->pu8Length), u32Count, pFile) != u32Count ||
+      fread(pResults->pu32NextHop, sizeof(*pResults->pu32NextHop), u32Count, pFile) != u32Count)
+  {
+    printf("Snapshot %s is truncated\n", pszFile);
+    fclose(pFile);
+    free(pchImage);
+    ResultTableFree(pResults);
+    return 0;
+  }
+  fclose(pFile);
+
+  LuleaTrieSetImage(pchImage, header.u64ImageBytes);
+
+  return 1;
+}
@@ -0,0 +1,40 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LULEA_SNAPSHOT_H__
+#define __LULEA_SNAPSHOT_H__
+
+#include <stdint.h>
+#include "result_table.h"
+
+#define LULEA_SNAPSHOT_MAGIC   "LULEATRI"
+#define LULEA_SNAPSHOT_VERSION (2)
+
+/* File layout: header, image (u64ImageBytes), then the result table one column at a time:
+   u32NumResults starts (uint32_t), lengths (uint8_t) and next hop IDs (uint32_t) */
+typedef struct tagSNAPSHOTHEADER
+{
+  char     achMagic[8];
+  uint32_t u32Version;
+  uint32_t u32NumResults;
+  uint64_t u64ImageBytes;
+} SNAPSHOTHEADER, *PSNAPSHOTHEADER;
+
+int LuleaSnapshotSave(const char *pszFile, PRESULTTABLE pResults);
+int LuleaSnapshotLoad(const char *pszFile, PRESULTTABLE pResults);
+
+#endif /* __LULEA_SNAPSHOT_H__ */
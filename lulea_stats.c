@@ -0,0 +1,171 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "lulea_stats.h"
+#include "lulea_cache.h"
+
+__thread PLULEATHREADSTATS pLuleaThreadStats;
+
+/* Every thread that ever did a lookup. Entries are never freed, so snapshots can walk
+   the list without locking while threads come and go. */
+static PLULEATHREADSTATS pThreadStatsList;
+
+static const char *apszStatNames[LULEASTAT_MAX] =
+{
+  "l1_codeword", "l1_pointer", "l2_codeword", "l2_pointer", "l3_codeword", "l3_pointer", "not_found"
+};
+
+PLULEATHREADSTATS LuleaStatsRegisterThread(void)
+{
+  PLULEATHREADSTATS pStats = NULL;
+
+  pStats = aligned_alloc(64, sizeof(*pStats));
+  if (!pStats)
+  {
+    printf("Can't allocate lookup statistics\n");
+    exit(1);
+  }
+  memset(pStats, 0, sizeof(*pStats));
+  pStats->u32SampleCountdown = LULEA_STATS_SAMPLE_RATE;
+
+  pStats->pNext = __atomic_load_n(&pThreadStatsList, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&pThreadStatsList, &pStats->pNext, pStats, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+  {
+  }
+
+  pLuleaThreadStats = pStats;
+
+  return pStats;
+}
+
+void LuleaStatsSnapshot(PLULEASTATS pSnapshot)
+{
+  PLULEATHREADSTATS pStats = __atomic_load_n(&pThreadStatsList, __ATOMIC_ACQUIRE);
+  unsigned int      uIndex = 0;
+
+  memset(pSnapshot, 0, sizeof(*pSnapshot));
+
+  for (; pStats; pStats = pStats->pNext)
+  {
+    pSnapshot->uThreads++;
+    pSnapshot->u64Lookups += __atomic_load_n(&pStats->u64Lookups, __ATOMIC_RELAXED);
+
+    for (uIndex = 0; uIndex < LULEASTAT_MAX; uIndex++)
+    {
+      pSnapshot->au64Terminations[uIndex] += __atomic_load_n(&pStats->au64Terminations[uIndex], __ATOMIC_RELAXED);
+    }
+    for (uIndex = 0; uIndex < LULEA_STATS_GROUPS; uIndex++)
+    {
+      pSnapshot->au64Heat[uIndex] += __atomic_load_n(&pStats->au32Heat[uIndex], __ATOMIC_RELAXED);
+    }
+  }
+
+  LuleaCacheGetStats(&pSnapshot->u64CacheLookups, &pSnapshot->u64CacheHits);
+}
+
+/* Not synchronized with lookups, counters of threads doing lookups meanwhile may be off by a few */
+void LuleaStatsReset(void)
+{
+  PLULEATHREADSTATS pStats = __atomic_load_n(&pThreadStatsList, __ATOMIC_ACQUIRE);
+
+  for (; pStats; pStats = pStats->pNext)
+  {
+    __atomic_store_n(&pStats->u64Lookups, 0, __ATOMIC_RELAXED);
+    memset(pStats->au64Terminations, 0, sizeof(pStats->au64Terminations));
+    memset(pStats->au32Heat, 0, sizeof(pStats->au32Heat));
+  }
+}
+
+void LuleaStatsWriteJson(FILE *pFile, PLULEASTATS pSnapshot)
+{
+  unsigned int uIndex = 0;
+
+  fprintf(pFile, "{\n  \"threads\": %u,\n  \"lookups\": %lu,\n  \"terminations\": {", pSnapshot->uThreads, pSnapshot->u64Lookups);
+  for (uIndex = 0; uIndex < LULEASTAT_MAX; uIndex++)
+  {
+    fprintf(pFile, " \"%s\": %lu%s", apszStatNames[uIndex], pSnapshot->au64Terminations[uIndex],
+            uIndex + 1 < LULEASTAT_MAX ? "," : " },\n");
+  }
+
+  fprintf(pFile, "  \"cache_lookups\": %lu,\n  \"cache_hits\": %lu,\n  \"cache_hit_rate\": %.4f,\n",
+          pSnapshot->u64CacheLookups, pSnapshot->u64CacheHits,
+          pSnapshot->u64CacheLookups ? (double)pSnapshot->u64CacheHits / pSnapshot->u64CacheLookups : 0.0);
+  fprintf(pFile, "  \"heat_sample_rate\": %d,\n  \"group_heat\": [", LULEA_STATS_SAMPLE_RATE);
+  for (uIndex = 0; uIndex < LULEA_STATS_GROUPS; uIndex++)
+  {
+    fprintf(pFile, "%s%lu", uIndex % 32 ? ", " : (uIndex ? ",\n    " : "\n    "), pSnapshot->au64Heat[uIndex]);
+  }
+  fprintf(pFile, "\n  ]\n}\n");
+}
+
+/* 64 x 64 map, one character per level 1 bucket group (a /12), so every row covers a /6.
+   Characters are log scaled relative to the hottest group. */
+void LuleaStatsDumpHeatMap(FILE *pFile, PLULEASTATS pSnapshot)
+{
+  static const char achScale[] = " .:-=+*#%@";
+  uint64_t          u64Max     = 0;
+  unsigned int      uIndex     = 0;
+
+  for (uIndex = 0; uIndex < LULEA_STATS_GROUPS; uIndex++)
+  {
+    if (pSnapshot->au64Heat[uIndex] > u64Max)
+    {
+      u64Max = pSnapshot->au64Heat[uIndex];
+    }
+  }
+
+  fprintf(pFile, "Level 1 bucket group heat, %lu lookups, hottest group %lu samples\n", pSnapshot->u64Lookups, u64Max);
+  for (uIndex = 0; uIndex < LULEA_STATS_GROUPS; uIndex++)
+  {
+    unsigned int uLevel = 0;
+
+    if (uIndex % 64 == 0)
+    {
+      fprintf(pFile, "%3u.0.0.0 |", uIndex >> 4);
+    }
+
+    if (pSnapshot->au64Heat[uIndex])
+    {
+      uLevel = 1 + (unsigned int)(log((double)pSnapshot->au64Heat[uIndex]) / log((double)u64Max + 1) * (sizeof(achScale) - 2));
+    }
+    fputc(achScale[uLevel], pFile);
+
+    if (uIndex % 64 == 63)
+    {
+      fprintf(pFile, "|\n");
+    }
+  }
+
+  fprintf(pFile, "Terminations:");
+  for (uIndex = 0; uIndex < LULEASTAT_MAX; uIndex++)
+  {
+    fprintf(pFile, " %s %.2f%%", apszStatNames[uIndex],
+            pSnapshot->u64Lookups ? pSnapshot->au64Terminations[uIndex] * 100.0 / pSnapshot->u64Lookups : 0.0);
+  }
+  fprintf(pFile, "\n");
+  if (pSnapshot->u64CacheLookups)
+  {
+    fprintf(pFile, "Destination cache: %lu lookups, %.2f%% hits\n", pSnapshot->u64CacheLookups,
+            pSnapshot->u64CacheHits * 100.0 / pSnapshot->u64CacheLookups);
+  }
+}
@@ -0,0 +1,105 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LULEA_STATS_H__
+#define __LULEA_STATS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Where a lookup ended. Build with STATS=yes (-DLULEA_STATS) to count them,
+   without it the hooks in LuleaTrieLookup() compile to nothing. */
+typedef enum tagLULEASTAT
+{
+  LULEASTAT_L1_CODEWORD = 0, /* Next hop encoded directly in a level 1 codeword (CODEWORD_NEXTHOP) */
+  LULEASTAT_L1_POINTER,      /* Level 1 pointer to a next hop */
+  LULEASTAT_L2_CODEWORD,
+  LULEASTAT_L2_POINTER,
+  LULEASTAT_L3_CODEWORD,
+  LULEASTAT_L3_POINTER,
+  LULEASTAT_NOT_FOUND,
+  LULEASTAT_MAX
+} LULEASTAT;
+
+#define LULEA_STATS_GROUPS      (4096)
+/* Every n:th lookup of a thread is counted in the level 1 bucket group heat map */
+#define LULEA_STATS_SAMPLE_RATE (64)
+
+/* One per thread, aligned so two threads never write to the same cache line */
+typedef struct tagLULEATHREADSTATS
+{
+  uint64_t u64Lookups;
+  uint64_t au64Terminations[LULEASTAT_MAX];
+  uint32_t u32SampleCountdown;
+  uint32_t au32Heat[LULEA_STATS_GROUPS];
+
+  struct tagLULEATHREADSTATS *pNext;
+} __attribute__((aligned(64))) LULEATHREADSTATS, *PLULEATHREADSTATS;
+
+typedef struct tagLULEASTATS
+{
+  unsigned int uThreads;
+  uint64_t     u64Lookups;
+  uint64_t     au64Terminations[LULEASTAT_MAX];
+  uint64_t     au64Heat[LULEA_STATS_GROUPS];
+  uint64_t     u64CacheLookups; /* LuleaTrieLookupCached() calls, counted with or without LULEA_STATS */
+  uint64_t     u64CacheHits;
+} LULEASTATS, *PLULEASTATS;
+
+PLULEATHREADSTATS LuleaStatsRegisterThread(void);
+void              LuleaStatsSnapshot(PLULEASTATS pSnapshot);
+void              LuleaStatsReset(void);
+void              LuleaStatsWriteJson(FILE *pFile, PLULEASTATS pSnapshot);
+void              LuleaStatsDumpHeatMap(FILE *pFile, PLULEASTATS pSnapshot);
+
+#ifdef LULEA_STATS
+
+extern __thread PLULEATHREADSTATS pLuleaThreadStats;
+
+/* Only the owning thread writes its counters, the relaxed stores just keep snapshots from tearing */
+#define LULEA_STATS_INC(x) __atomic_store_n(&(x), (x) + 1, __ATOMIC_RELAXED)
+
+static inline PLULEATHREADSTATS LuleaStatsLookup(uint32_t u32IP)
+{
+  PLULEATHREADSTATS pStats = pLuleaThreadStats;
+
+  if (__builtin_expect(!pStats, 0))
+  {
+    pStats = LuleaStatsRegisterThread();
+  }
+
+  LULEA_STATS_INC(pStats->u64Lookups);
+  if (--pStats->u32SampleCountdown == 0)
+  {
+    pStats->u32SampleCountdown = LULEA_STATS_SAMPLE_RATE;
+    LULEA_STATS_INC(pStats->au32Heat[u32IP >> 20]);
+  }
+
+  return pStats;
+}
+
+#define LULEA_STAT_LOOKUP(u32IP)       PLULEATHREADSTATS pThreadStats = LuleaStatsLookup(u32IP)
+#define LULEA_STAT_END(eTermination)   LULEA_STATS_INC(pThreadStats->au64Terminations[eTermination])
+
+#else
+
+#define LULEA_STAT_LOOKUP(u32IP)       do { } while (0)
+#define LULEA_STAT_END(eTermination)   do { } while (0)
+
+#endif /* LULEA_STATS */
+
+#endif /* __LULEA_STATS_H__ */
@@ -0,0 +1,215 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "routing_table_split.h"
+#include "lulea_trie.h"
+#include "benchmark.h"
+#include "verify.h"
+#include "lookup_engine.h"
+#include "nexthop.h"
+#include "synth_table.h"
+
+/* Builds luleå tries from generated tables of growing size and reports how build time, image
+   size and lookup throughput scale, well past the size of today's full table */
+
+#define SYNTH_DEFAULT_LOOKUPS  (1000000)
+#define SYNTH_DEFAULT_NEXTHOPS (64)
+#define SYNTH_DEFAULT_PATHS    (2)
+
+static void Usage(char *pszProgram)
+{
+  printf("Usage: %s [options] <prefixes> [<prefixes> ...]\n", pszProgram);
+  printf("  -p <profile>  internet, hosts or deagg24 (default internet)\n");
+  printf("  -h <count>    next hops, one adjacency per peer (default %d)\n", SYNTH_DEFAULT_NEXTHOPS);
+  printf("  -m <count>    at most this many paths per prefix, up to %d (default %d)\n", NEXTHOP_MAX_PATHS,
+         SYNTH_DEFAULT_PATHS);
+  printf("  -n <count>    number of lookups per run (default %d)\n", SYNTH_DEFAULT_LOOKUPS);
+  printf("  -s <seed>     random seed, the same seed gives the same tables (default 1)\n");
+  printf("  -o <file>     write JSON results to file instead of stdout\n");
+  printf("  -V            verify every trie against the radix tree at every range boundary\n");
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  SYNTHCONFIG      config     = { SYNTHPROFILE_INTERNET, 0, SYNTH_DEFAULT_NEXTHOPS, SYNTH_DEFAULT_PATHS, 1 };
+  FILE            *pOutput    = stdout;
+  unsigned int     uLookups   = SYNTH_DEFAULT_LOOKUPS;
+  int              bVerify    = 0;
+  int              iOption    = 0;
+  int              iArg       = 0;
+  uint64_t         u64Failed  = 0;
+  struct timespec  sooner;
+
+  while ((iOption = getopt(argc, argv, "p:h:m:n:s:o:V")) != -1)
+  {
+    switch (iOption)
+    {
+      case 'p':
+        iArg = SynthProfileFromName(optarg);
+        if (iArg < 0)
+        {
+          Usage(argv[0]);
+        }
+        config.eProfile = iArg;
+        break;
+      case 'h':
+        config.uNumNextHops = strtoul(optarg, NULL, 0);
+        break;
+      case 'm':
+        config.uMaxPaths = strtoul(optarg, NULL, 0);
+        break;
+      case 'n':
+        uLookups = strtoul(optarg, NULL, 0);
+        break;
+      case 's':
+        config.u64Seed = strtoull(optarg, NULL, 0);
+        break;
+      case 'V':
+        bVerify = 1;
+        break;
+      case 'o':
+        pOutput = fopen(optarg, "w");
+        if (!pOutput)
+        {
+          printf("Could not open %s for writing\n", optarg);
+          exit(1);
+        }
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+
+  if (optind >= argc || !config.uNumNextHops || !config.uMaxPaths || config.uMaxPaths > NEXTHOP_MAX_PATHS ||
+      !uLookups)
+  {
+    Usage(argv[0]);
+  }
+
+  fprintf(pOutput, "{\n");
+  fprintf(pOutput, "  \"profile\": \"%s\",\n", SynthProfileName(config.eProfile));
+  fprintf(pOutput, "  \"next_hops\": %u,\n", config.uNumNextHops);
+  fprintf(pOutput, "  \"max_paths\": %u,\n", config.uMaxPaths);
+  fprintf(pOutput, "  \"seed\": %llu,\n", (unsigned long long)config.u64Seed);
+  fprintf(pOutput, "  \"tables\": [\n");
+
+  for (iArg = optind; iArg < argc; iArg++)
+  {
+    LULEABUILDSTATS  stats;
+    BENCHRESULT      aResults[2];
+    PPREFIXES        pPrefixes    = NULL;
+    PROUTEENTRY      pNextHops    = NULL;
+    unsigned int     uNumRoutes   = 0;
+    unsigned int     uGenerated   = 0;
+    unsigned int     uSet         = 0;
+    uint64_t         u64Mismatches = 0;
+    double           dGenerateMs  = 0;
+    double           dTreeMs      = 0;
+    double           dBuildMs     = 0;
+    size_t           uTreeBytes   = 0;
+    int              bBuilt       = 0;
+
+    config.uNumPrefixes = strtoul(argv[iArg], NULL, 0);
+    fprintf(stderr, "Generating %u %s prefixes\n", config.uNumPrefixes, SynthProfileName(config.eProfile));
+
+    clock_gettime(CLOCK_MONOTONIC, &sooner);
+    pPrefixes   = SynthGenerateTable(&config);
+    dGenerateMs = BenchElapsedMs(&sooner);
+    uNumRoutes  = pPrefixes->uTotalPrefixes;
+    /* The default route is stored as two halves */
+    uGenerated  = uNumRoutes - 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &sooner);
+    pNextHops  = BuildPrefixTree(pPrefixes);
+    dTreeMs    = BenchElapsedMs(&sooner);
+    uTreeBytes = PrefixTreeBytes();
+    free(pPrefixes);
+
+    fprintf(stderr, "Building luleå trie\n");
+    clock_gettime(CLOCK_MONOTONIC, &sooner);
+    bBuilt   = BuildLuleaTrie(&root, pNextHops, uNumRoutes);
+    dBuildMs = BenchElapsedMs(&sooner);
+    memset(&stats, 0, sizeof(stats));
+    memset(aResults, 0, sizeof(aResults));
+
+    if (bBuilt)
+    {
+      LuleaTrieGetBuildStats(&stats);
+
+      if (bVerify)
+      {
+        u64Mismatches = VerifyRanges(LookupEngineFind("lulea"), stderr, &root, pNextHops, VERIFY_DEFAULT_REPORT);
+        u64Failed    += u64Mismatches;
+      }
+
+      for (uSet = 0; uSet < 2; uSet++)
+      {
+        BENCHDIST     eDist   = uSet ? BENCHDIST_PREFIX : BENCHDIST_UNIFORM;
+        unsigned int  uCount  = uLookups;
+        uint32_t     *pu32IPs = BenchGenerateAddresses(eDist, &uCount, pNextHops, uNumRoutes, 0, NULL);
+
+        BenchRun("lulea", LuleaTrieLookupBatch, pu32IPs, uCount, eDist, 0, &aResults[uSet]);
+        free(pu32IPs);
+      }
+    }
+    else
+    {
+      fprintf(stderr, "Could not build a luleå trie from %u prefixes\n", uGenerated);
+      u64Failed++;
+    }
+
+    fprintf(pOutput, "    {\n");
+    fprintf(pOutput, "      \"prefixes\": %u,\n", uGenerated);
+    fprintf(pOutput, "      \"built\": %s,\n", bBuilt ? "true" : "false");
+    fprintf(pOutput, "      \"generate_ms\": %.3f,\n", dGenerateMs);
+    fprintf(pOutput, "      \"tree_ms\": %.3f,\n", dTreeMs);
+    fprintf(pOutput, "      \"tree_bytes\": %zu,\n", uTreeBytes);
+    fprintf(pOutput, "      \"build_ms\": %.3f,\n", dBuildMs);
+    fprintf(pOutput, "      \"image_bytes\": %llu,\n", (unsigned long long)stats.u64ImageBytes);
+    fprintf(pOutput, "      \"bytes_per_prefix\": %.3f,\n", uGenerated ? (double)stats.u64ImageBytes / uGenerated : 0);
+    fprintf(pOutput, "      \"level2_chunks\": %u,\n", stats.au32Chunks[1]);
+    fprintf(pOutput, "      \"level3_chunks\": %u,\n", stats.au32Chunks[2]);
+    fprintf(pOutput, "      \"mismatches\": %llu,\n", (unsigned long long)u64Mismatches);
+    fprintf(pOutput, "      \"uniform_ns_per_lookup\": %.3f,\n", aResults[0].dMeanNs);
+    fprintf(pOutput, "      \"uniform_mlookups_per_sec\": %.3f,\n", aResults[0].dMLookupsPerSec);
+    fprintf(pOutput, "      \"prefix_ns_per_lookup\": %.3f,\n", aResults[1].dMeanNs);
+    fprintf(pOutput, "      \"prefix_mlookups_per_sec\": %.3f\n", aResults[1].dMLookupsPerSec);
+    fprintf(pOutput, "    }%s\n", iArg + 1 < argc ? "," : "");
+    fflush(pOutput);
+
+    FreePrefixTree();
+    free(pNextHops);
+  }
+
+  fprintf(pOutput, "  ]\n");
+  fprintf(pOutput, "}\n");
+
+  if (pOutput != stdout)
+  {
+    fclose(pOutput);
+  }
+
+  return u64Failed ? 2 : 0;
+}
@@ -0,0 +1,163 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lulea_trace.h"
+
+int                        bLuleaTracing;
+__thread PLULEATRACERECORD pLuleaTraceRecord;
+static __thread unsigned int uTraceCountdown;
+
+/* One buffer for all threads, a sampled lookup claims the next record */
+static PLULEATRACERECORD pTraceRecords;
+static unsigned int      uTraceCapacity;
+static unsigned int      uTraceUsed;
+static unsigned int      uTraceSampleRate = 1;
+
+static const char *apszKindNames[LULEATRACE_MAX] =
+{
+  "l1_codeword", "l1_pointer", "l2_codeword", "l2_pointer", "l3_codeword", "l3_pointer", "host_route", "next_hop"
+};
+
+const char *LuleaTraceKindName(unsigned int uKind)
+{
+  return uKind < LULEATRACE_MAX ? apszKindNames[uKind] : "unknown";
+}
+
+/* Records every uSampleRate:th lookup of each thread until uMaxRecords are recorded. Starting
+   again throws away the last recording. */
+void LuleaTraceStart(unsigned int uSampleRate, unsigned int uMaxRecords)
+{
+  free(pTraceRecords);
+  pTraceRecords = calloc(uMaxRecords, sizeof(*pTraceRecords));
+  if (!pTraceRecords)
+  {
+    printf("Can't allocate %u trace records\n", uMaxRecords);
+    exit(1);
+  }
+  uTraceCapacity   = uMaxRecords;
+  uTraceUsed       = 0;
+  uTraceSampleRate = uSampleRate ? uSampleRate : 1;
+
+  __atomic_store_n(&bLuleaTracing, 1, __ATOMIC_RELEASE);
+}
+
+/* Returns how many lookups were recorded. Call once no lookups are running. */
+unsigned int LuleaTraceStop(void)
+{
+  __atomic_store_n(&bLuleaTracing, 0, __ATOMIC_RELEASE);
+
+  return uTraceUsed < uTraceCapacity ? uTraceUsed : uTraceCapacity;
+}
+
+void LuleaTraceBegin(uint32_t u32IP)
+{
+  unsigned int uRecord = 0;
+
+  if (uTraceCountdown > 1)
+  {
+    uTraceCountdown--;
+    return;
+  }
+  uTraceCountdown = uTraceSampleRate;
+
+  uRecord = __atomic_fetch_add(&uTraceUsed, 1, __ATOMIC_RELAXED);
+  if (uRecord >= uTraceCapacity)
+  {
+    /* Full, the other threads see it on their next lookup */
+    __atomic_store_n(&bLuleaTracing, 0, __ATOMIC_RELAXED);
+    return;
+  }
+
+  pLuleaTraceRecord = &pTraceRecords[uRecord];
+  pLuleaTraceRecord->u32IP = u32IP;
+}
+
+int LuleaTraceSave(const char *pszFile, uint64_t u64ImageBytes, uint32_t u32NextHopBytes)
+{
+  LULEATRACEHEADER  header;
+  FILE             *pFile = fopen(pszFile, "wb");
+
+  if (!pFile)
+  {
+    printf("Could not open trace %s for writing\n", pszFile);
+    return 0;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.achMagic, LULEA_TRACE_MAGIC, sizeof(header.achMagic));
+  header.u32Version      = LULEA_TRACE_VERSION;
+  header.u32SampleRate   = uTraceSampleRate;
+  header.u64NumRecords   = uTraceUsed < uTraceCapacity ? uTraceUsed : uTraceCapacity;
+  header.u64ImageBytes   = u64ImageBytes;
+  header.u32NextHopBytes = u32NextHopBytes;
+
+  fwrite(&header, sizeof(header), 1, pFile);
+  fwrite(pTraceRecords, sizeof(*pTraceRecords), header.u64NumRecords, pFile);
+
+  if (fclose(pFile))
+  {
+    printf("Could not write trace %s\n", pszFile);
+    return 0;
+  }
+
+  return 1;
+}
+
+/* Returns the records, NULL if the file isn't a trace */
+PLULEATRACERECORD LuleaTraceLoad(const char *pszFile, PLULEATRACEHEADER pHeader)
+{
+  PLULEATRACERECORD  pRecords = NULL;
+  FILE              *pFile    = fopen(pszFile, "rb");
+
+  if (!pFile)
+  {
+    printf("Could not open trace %s\n", pszFile);
+    return NULL;
+  }
+
+  if (fread(pHeader, sizeof(*pHeader), 1, pFile) != 1 ||
+      memcmp(pHeader->achMagic, LULEA_TRACE_MAGIC, sizeof(pHeader->achMagic)) ||
+      pHeader->u32Version != LULEA_TRACE_VERSION)
+  {
+    printf("%s is not a luleå lookup trace\n", pszFile);
+    fclose(pFile);
+    return NULL;
+  }
+
+  pRecords = malloc(pHeader->u64NumRecords * sizeof(*pRecords) + 1);
+  if (!pRecords)
+  {
+    printf("Can't allocate trace memory\n");
+    exit(1);
+  }
+
+  if (fread(pRecords, sizeof(*pRecords), pHeader->u64NumRecords, pFile) != pHeader->u64NumRecords)
+  {
+    printf("Trace %s is truncated\n", pszFile);
+    fclose(pFile);
+    free(pRecords);
+    return NULL;
+  }
+  fclose(pFile);
+
+  return pRecords;
+}
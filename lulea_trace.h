@@ -0,0 +1,109 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LULEA_TRACE_H__
+#define __LULEA_TRACE_H__
+
+#include <stdint.h>
+
+/* Memory a sample of LuleaTrieLookup() calls touches, as offsets into the table they read,
+   for lulea_cachesim to replay through a cache model. Build with TRACE=yes (-DLULEA_TRACE)
+   to record, without it the hooks compile to nothing. */
+typedef enum tagLULEATRACEKIND
+{
+  LULEATRACE_L1_CODEWORD = 0, /* Offsets into the image */
+  LULEATRACE_L1_POINTER,
+  LULEATRACE_L2_CODEWORD,
+  LULEATRACE_L2_POINTER,
+  LULEATRACE_L3_CODEWORD,
+  LULEATRACE_L3_POINTER,
+  LULEATRACE_HOST_ROUTE,      /* Offset into the host route table */
+  LULEATRACE_NEXT_HOP,        /* Result index, the next hop column entry the caller reads next */
+  LULEATRACE_MAX
+} LULEATRACEKIND;
+
+#define LULEA_TRACE_MAGIC        "LULTRACE"
+#define LULEA_TRACE_VERSION      (1)
+/* Three levels of codeword and pointer, the next hop and a short host route probe */
+#define LULEA_TRACE_MAX_ACCESSES (12)
+
+typedef struct tagLULEATRACEACCESS
+{
+  uint32_t u32Offset;
+  uint8_t  u8Kind;
+  uint8_t  u8Bytes;
+  uint16_t u16Reserved;
+} LULEATRACEACCESS, *PLULEATRACEACCESS;
+
+typedef struct tagLULEATRACERECORD
+{
+  uint32_t         u32IP;
+  uint32_t         u32NumAccesses;
+  LULEATRACEACCESS aAccesses[LULEA_TRACE_MAX_ACCESSES];
+} LULEATRACERECORD, *PLULEATRACERECORD;
+
+/* File layout: header, then u64NumRecords records in the order they were sampled */
+typedef struct tagLULEATRACEHEADER
+{
+  char     achMagic[8];
+  uint32_t u32Version;
+  uint32_t u32SampleRate;
+  uint64_t u64NumRecords;
+  uint64_t u64ImageBytes;
+  uint32_t u32NextHopBytes;   /* Size of a next hop entry, see RESULT_TABLE_NEXT_HOP_BYTES */
+  uint32_t u32Reserved;
+} LULEATRACEHEADER, *PLULEATRACEHEADER;
+
+const char        *LuleaTraceKindName(unsigned int uKind);
+void               LuleaTraceStart(unsigned int uSampleRate, unsigned int uMaxRecords);
+unsigned int       LuleaTraceStop(void);
+int                LuleaTraceSave(const char *pszFile, uint64_t u64ImageBytes, uint32_t u32NextHopBytes);
+PLULEATRACERECORD  LuleaTraceLoad(const char *pszFile, PLULEATRACEHEADER pHeader);
+
+#ifdef LULEA_TRACE
+
+extern int bLuleaTracing;
+extern __thread PLULEATRACERECORD pLuleaTraceRecord;
+
+void LuleaTraceBegin(uint32_t u32IP);
+
+static inline void LuleaTraceTouch(unsigned int uKind, uint32_t u32Offset, unsigned int uBytes)
+{
+  PLULEATRACERECORD pRecord = pLuleaTraceRecord;
+
+  if (pRecord && pRecord->u32NumAccesses < LULEA_TRACE_MAX_ACCESSES)
+  {
+    pRecord->aAccesses[pRecord->u32NumAccesses].u32Offset = u32Offset;
+    pRecord->aAccesses[pRecord->u32NumAccesses].u8Kind    = uKind;
+    pRecord->aAccesses[pRecord->u32NumAccesses].u8Bytes   = uBytes;
+    pRecord->u32NumAccesses++;
+  }
+}
+
+#define LULEA_TRACE_BEGIN(u32IP)                     do { if (__builtin_expect(bLuleaTracing, 0)) LuleaTraceBegin(u32IP); } while (0)
+#define LULEA_TRACE_TOUCH(eKind, u32Offset, uBytes)  LuleaTraceTouch((eKind), (u32Offset), (uBytes))
+#define LULEA_TRACE_END()                            (pLuleaTraceRecord = NULL)
+
+#else
+
+#define LULEA_TRACE_BEGIN(u32IP)                     do { } while (0)
+#define LULEA_TRACE_TOUCH(eKind, u32Offset, uBytes)  do { } while (0)
+#define LULEA_TRACE_END()                            do { } while (0)
+
+#endif /* LULEA_TRACE */
+
+#endif /* __LULEA_TRACE_H__ */
@@ -18,25 +18,135 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include "lulea_trie.h"
 #include "linked_list.h"
 #include "queue.h"
+#include "profile.h"
+#include "lulea_stats.h"
+#include "nexthop.h"
+#include "lulea_cache.h"
+#include "lulea_trace.h"
+#include "lulea_numa.h"
+#include "result_table.h"
 
 
 static PBUCKET      pLevel1Buckets;
-static char        *pachBucketGroupNumPrefixes;
+static uint8_t     *pau8BucketGroupNumPrefixes; /* Occupied buckets of the 16 in each group, so at most 16 */
 
-static char        *pchLuleaTrie;
+static char        *pchLuleaTrie;        /* Current image, lookups walk it through pReplicas */
+static size_t       uLuleaTrieSize;
+static char        *pchBuiltImage;       /* Last image a build allocated */
+static char        *pchRetiredImage;     /* The built image it replaced, freed by the next build */
+
+static char        *pchArena;            /* Image being built, published once complete */
+static size_t       uArenaCapacity;
+static const char  *pchCopySource;       /* Image a partial rebuild copies unchanged chunks from */
+static const uint64_t *pu64RebuildGroups; /* Level 1 bucket groups a partial rebuild recompiles */
 
 static PLEVEL1      pLevel1;
 
 static PBUILDTASK   pBuildTaskHead;
 static PBUILDTASK   pBuildTaskTail;
 
-int ProcessBucketGroups(PBUCKET pBuckets, char *pchBucketGroupNumPrefixes, unsigned int uMaxIndex, PCODEWORD pCodewords, char **ppchCurrentLocation, BUILDCALLBACK fpBuildCallback);
+static LULEABUILDSTATS buildStats;
+
+static LULEALEAF    eLeafType = LULEALEAF_PREFIX;
+static PROUTEENTRY  pBuildNextHops;
+
+/* The /32s a trie was built without. Lookups find it in the replica set next to the image
+   it goes with, so the two are always swapped together. */
+typedef struct tagHOSTTABLE
+{
+  PHOSTROUTE   pSlots;
+  uint64_t    *pu64Groups;   /* One bit per /16 holding host routes */
+  uint32_t     u32Mask;
+  unsigned int uShift;
+} HOSTTABLE, *PHOSTTABLE;
+
+static int          bSplitHostRoutes;
+static PHOSTTABLE   pHostTable;         /* Of the current image, NULL unless it was built without its /32s */
+static PHOSTTABLE   pRetiredHostTable;  /* The one it replaced, freed by the next build */
+
+#define HOSTROUTE_GROUPS              (65536)
+#define HOSTROUTE_SLOT(pHosts, u32IP) (((u32IP) * 0x9E3779B1U) >> (pHosts)->uShift)
+
+/* Bumped whenever lookups may start seeing a different table, destination caches compare it */
+static uint32_t     u32Generation;
+
+/* A lazy build publishes level 1 with the pointers to level 2 chunks aimed at a trap chunk
+   whose codewords all hold LULEA_PENDING. The arena is a reservation that never moves, so a
+   thread can append the chunks behind lookups and swap each pointer in when it is done. */
+typedef struct tagLAZYSTATE
+{
+  PTREENODE        pTree;             /* Answers lookups that hit the trap chunk */
+  PBUILDTASK       apTasks[65536];    /* Per /16, the level 2 chunk still to compile */
+  uint32_t         au32Touches[65536];
+  uint16_t         au16Hot[65536];    /* /16s lookups hit since the thread last looked */
+  unsigned int     uNumHot;
+  unsigned int     uNumPending;
+  unsigned int     uColdCursor;
+  char            *pchCurrentPos;
+  int              bDrain;            /* Compile everything left, hit or not */
+  pthread_t        thread;
+  pthread_mutex_t  mutex;
+  pthread_cond_t   cond;
+} LAZYSTATE, *PLAZYSTATE;
+
+static LULEALAZY    eLazyMode = LULEALAZY_OFF;
+static PLAZYSTATE   pLazyState;         /* Kept until the next lazy build, for lookups still in the slow path */
+static int          bLazyRunning;
+static char        *pchRetiredReservation;
+
+/* What lookups walk, published as one: the image, or one copy per NUMA node with the next hop
+   column when replicating, packed when narrower pointers fit, and the host route table of the
+   image. Lookups use the copy of their own node. */
+typedef struct tagLULEAREPLICAS
+{
+  unsigned int uNodes;
+  unsigned int uPointerBytes;  /* 2 or 3 for packed pointers, 4 as built */
+  int          bNuma;          /* From LuleaNumaCopyToNode(), otherwise the built image or one malloc()ed packed copy */
+  size_t       uImageBytes;
+  size_t       uNextHopBytes;  /* Of each copy of the next hop column, 0 if there is none */
+  char        *apchImages[LULEA_NUMA_MAX_NODES];
+  uint32_t    *apu32NextHops[LULEA_NUMA_MAX_NODES];
+  PHOSTTABLE   pHosts;         /* Not owned, retired with the image it goes with */
+} LULEAREPLICAS, *PLULEAREPLICAS;
+
+static int            bReplicate;
+static PLULEAREPLICAS pReplicas;
+static PLULEAREPLICAS pRetiredReplicas;   /* The set it replaced, freed by the next swap */
+static const uint32_t *pu32ReplicaNextHops; /* Result table next hop column, see LuleaTrieSetNextHops() */
+static unsigned int   uReplicaNextHops;
+static __thread int   iThreadNode = -1;   /* Node of the calling thread, found on its first lookup */
+static unsigned int   uPointerBits = 32;  /* Narrowest pointer width lookups may use */
+
+/* Packed pointers are 16 or 24 bits. The top bit marks a next level chunk, with its offset
+   in 8 byte units, as chunks are 8 byte aligned. The highest leaf value means no route. */
+#define PACKED_NEXTLEVEL(uBytes) (1U << (8 * (uBytes) - 1))
+#define PACKED_NO_ROUTE(uBytes)  (PACKED_NEXTLEVEL(uBytes) - 1)
+#define PACKED_ALIGN(uBytes)     (((uBytes) + 7) & ~(size_t)7)
+
+typedef struct tagPACKSIZE
+{
+  uint64_t au64Bytes[2];  /* Image size with 16 and 24 bit pointers */
+  uint32_t u32MaxLeaf;
+} PACKSIZE, *PPACKSIZE;
+
+typedef struct tagPACKER
+{
+  const char   *pchSource;
+  char         *pchImage;
+  size_t        uUsed;
+  unsigned int  uBytes;
+} PACKER, *PPACKER;
+
+int ProcessBucketGroups(PBUCKET pBuckets, uint8_t *pu8BucketGroupNumPrefixes, unsigned int uMaxIndex, unsigned int uLevel, PCODEWORD pCodewords, char **ppchCurrentLocation, BUILDCALLBACK fpBuildCallback);
 
 
-int BucketPrefix(PBUCKET pBuckets, unsigned int uBucketValue, char *pachBucketGroupPrefixes, PROUTEENTRY pRouteEntry)
+int BucketPrefix(PBUCKET pBuckets, unsigned int uBucketValue, uint8_t *pau8BucketGroupPrefixes, PROUTEENTRY pRouteEntry)
 {
   InsertIntoLinkedList(&pBuckets[uBucketValue].pPrefixes, pRouteEntry);
   pBuckets[uBucketValue].u32NumPrefixes++;
@@ -44,7 +154,7 @@ int BucketPrefix(PBUCKET pBuckets, unsigned int uBucketValue, char *pachBucketGr
   if (pBuckets[uBucketValue].u32NumPrefixes == 1)
   {
     /* Count how many of the 16 slots in the bucket group is occupied */
-    pachBucketGroupPrefixes[uBucketValue / 16]++;
+    pau8BucketGroupPrefixes[uBucketValue / 16]++;
   }
 
   return 1;
@@ -67,12 +177,38 @@ int RecurseRadixTree(PTREENODE pTreeNode)
 
     u16Level1Offset = (pTreeNode->pRoute->u32Start & 0xFFFF0000) >> 16;
 
-    BucketPrefix(pLevel1Buckets, u16Level1Offset, pachBucketGroupNumPrefixes, pTreeNode->pRoute);
+    /* A partial rebuild only buckets the groups it recompiles */
+    if (pu64RebuildGroups && !(pu64RebuildGroups[u16Level1Offset >> 10] & (1ULL << ((u16Level1Offset >> 4) & 63))))
+    {
+      return 1;
+    }
+
+    BucketPrefix(pLevel1Buckets, u16Level1Offset, pau8BucketGroupNumPrefixes, pTreeNode->pRoute);
   }
 
   return 1;
 }
 
+/* What a pointer or direct codeword stores for a route in the radix tree */
+static uint32_t LeafValueOf(uint32_t u32NextHopIndex)
+{
+  if (eLeafType == LULEALEAF_PATHLIST)
+  {
+    return pBuildNextHops[u32NextHopIndex].u32PathList;
+  }
+  if (eLeafType == LULEALEAF_GROUP)
+  {
+    return pBuildNextHops[u32NextHopIndex].u32Group;
+  }
+
+  return u32NextHopIndex;
+}
+
+static uint32_t LeafValue(PROUTEENTRY pRoute)
+{
+  return LeafValueOf(pRoute->u32NextHopIndex);
+}
+
 unsigned int FirstNextHopFromBucketGroup(PBUCKET pBuckets, unsigned int uStart)
 {
   unsigned int uIndex = 0;
@@ -82,17 +218,17 @@ unsigned int FirstNextHopFromBucketGroup(PBUCKET pBuckets, unsigned int uStart)
     PROUTEENTRY pRoute = pBuckets[uIndex].pPrefixes;
     if (pRoute)
     {
-      return pRoute->u32NextHopIndex;
+      return LeafValue(pRoute);
     }
   }
 
   return NO_NEXT_HOP;
 }
 
-int ProcessLevel23(uint32_t *pu32Pointer, PROUTEENTRY pPrefixes, char **ppchCurrentPos, unsigned int uShiftValue, BUILDCALLBACK fpBuildCallback)
+int ProcessLevel23(uint32_t *pu32Pointer, PROUTEENTRY pPrefixes, char **ppchCurrentPos, unsigned int uShiftValue, unsigned int uLevel, BUILDCALLBACK fpBuildCallback)
 {
   BUCKET       buckets[256]   = { 0 };
-  char         achBucketGroupPrefixes[16] = { 0 };
+  uint8_t      au8BucketGroupPrefixes[16] = { 0 };
   PROUTEENTRY  pProcessEntry  = NULL;
   PROUTEENTRY  pTmp           = NULL;
   unsigned int uBucketValue = 0;
@@ -100,8 +236,9 @@ int ProcessLevel23(uint32_t *pu32Pointer, PROUTEENTRY pPrefixes, char **ppchCurr
 
 
   /* Set pointer from level above to point to this chunk */
-  *pu32Pointer     = POINTERTYPE_NEXTLEVEL | (*ppchCurrentPos - pchLuleaTrie); 
+  *pu32Pointer     = POINTERTYPE_NEXTLEVEL | (*ppchCurrentPos - pchArena);
   *ppchCurrentPos += sizeof(LEVEL23);
+  buildStats.au32Chunks[uLevel - 1]++;
 
   pProcessEntry = pPrefixes;
   while (pProcessEntry)
@@ -112,28 +249,45 @@ int ProcessLevel23(uint32_t *pu32Pointer, PROUTEENTRY pPrefixes, char **ppchCurr
 
     uBucketValue = (pProcessEntry->u32Start >> uShiftValue) & 0xFF;
 
-    BucketPrefix(buckets, uBucketValue, achBucketGroupPrefixes, pProcessEntry);
+    BucketPrefix(buckets, uBucketValue, au8BucketGroupPrefixes, pProcessEntry);
 
     pProcessEntry = pTmp;
   }
 
-  return ProcessBucketGroups(buckets, achBucketGroupPrefixes, 16, pLevel23->codewords, ppchCurrentPos, fpBuildCallback);
+  return ProcessBucketGroups(buckets, au8BucketGroupPrefixes, 16, uLevel, pLevel23->codewords, ppchCurrentPos, fpBuildCallback);
 }
 
 int ProcessLevel3(uint32_t *pu32Pointer, PROUTEENTRY pPrefixes, char **ppchCurrentPos)
 {
-  return ProcessLevel23(pu32Pointer, pPrefixes, ppchCurrentPos, 0, NULL);
+  return ProcessLevel23(pu32Pointer, pPrefixes, ppchCurrentPos, 0, 3, NULL);
 }
 
 int ProcessLevel2(uint32_t *pu32Pointer, PROUTEENTRY pPrefixes, char **ppchCurrentPos)
 {
-  return ProcessLevel23(pu32Pointer, pPrefixes, ppchCurrentPos, 8, ProcessLevel3);
+  return ProcessLevel23(pu32Pointer, pPrefixes, ppchCurrentPos, 8, 2, ProcessLevel3);
+}
+
+/* All pointers need to follow continuosly after the codewords, so next level chunks are built
+   later from the task queue. The task fills in the pointer with the offset of the chunk. */
+static void QueueBuildTask(uint32_t *pu32Pointer, PROUTEENTRY pPrefixes, BUILDCALLBACK fpBuild)
+{
+  PBUILDTASK pTask = calloc(1, sizeof(*pTask));
+
+  if (!pTask)
+  {
+    printf("Can't allocate level 2/3 build task\n");
+    exit(1);
+  }
+  pTask->pPrefixes   = pPrefixes;
+  pTask->pu32Pointer = pu32Pointer;
+  pTask->fpBuild     = fpBuild;
+
+  QUEUE_ADD_FRONT(&pBuildTaskHead, &pBuildTaskTail, pTask);
 }
 
 int ProcessMultiPrefixBucket(PBUCKET pBuckets, unsigned int uStartBucket, uint16_t *pu16Bitmask, uint32_t *pu32Count, char **ppchCurrentPos, BUILDCALLBACK fpBuildCallback)
 {
   unsigned int uIndex       = 0;
-  PBUILDTASK   pLevel23Task = NULL;
 
   if (!pu16Bitmask || !pu32Count)
   {
@@ -160,23 +314,8 @@ int ProcessMultiPrefixBucket(PBUCKET pBuckets, unsigned int uStartBucket, uint16
         *pu32Pointer = POINTERTYPE_NEXTLEVEL;
         if (fpBuildCallback)
         {
-          /* All pointers need to follow continuosly after the codewords, so when we
-             need to build a next level chunk, put it as a task on the task queue.
-             That way we first make all pointers, and then continue with the next level chunks. */
-          pLevel23Task = calloc(1, sizeof(*pLevel23Task));
-          if (!pLevel23Task)
-          {
-            printf("Can't allocate level 2/3 build task\n");
-            exit(1);
-          }
-          pLevel23Task->pPrefixes = pBuckets[uIndex].pPrefixes;
-          /* Next level task will fill in the pointer with correct offset to the chunk */
-          pLevel23Task->pu32Pointer = pu32Pointer;
-          pLevel23Task->fpBuild = fpBuildCallback;
-
+          QueueBuildTask(pu32Pointer, pBuckets[uIndex].pPrefixes, fpBuildCallback);
           pBuckets[uIndex].pPrefixes = NULL;
-
-          QUEUE_ADD_FRONT(&pBuildTaskHead, &pBuildTaskTail, pLevel23Task);
         }
         else
         {
@@ -186,7 +325,7 @@ int ProcessMultiPrefixBucket(PBUCKET pBuckets, unsigned int uStartBucket, uint16
       /* If there's only one entry, the pointer will point directly to a next hop */
       else
       {
-        *pu32Pointer = POINTERTYPE_NEXTHOP | pBuckets[uIndex].pPrefixes->u32NextHopIndex;
+        *pu32Pointer = POINTERTYPE_NEXTHOP | LeafValue(pBuckets[uIndex].pPrefixes);
       }
 
       *ppchCurrentPos += sizeof(uint32_t);
@@ -198,51 +337,180 @@ int ProcessMultiPrefixBucket(PBUCKET pBuckets, unsigned int uStartBucket, uint16
   return 1;
 }
 
-int ProcessBucketGroups(PBUCKET pBuckets, char *pchBucketGroupNumPrefixes, unsigned int uMaxIndex, PCODEWORD pCodewords, char **ppchCurrentLocation, BUILDCALLBACK fpBuildCallback)
+/* Encodes codeword uIndex. Empty bucket groups take the next hop of the last single prefix
+   group to their left, kept in *puLastNextHopIndex. */
+static void ProcessBucketGroup(PBUCKET pBuckets, uint8_t *pu8BucketGroupNumPrefixes, unsigned int uIndex, unsigned int uLevel, PCODEWORD pCodewords, char **ppchCurrentLocation, BUILDCALLBACK fpBuildCallback,
+                               unsigned int *puPointerIndex, unsigned int *puLastNextHopIndex)
+{
+  unsigned int uNextHop = 0;
+
+  switch (pu8BucketGroupNumPrefixes[uIndex])
+  {
+    /* No prefixes in this bucket group, so we should encode a next hop index from the last
+        next hop found to the left, which covers this bucket group too. */
+    case 0:
+      pCodewords[uIndex].u64BitmaskOffset = CODEWORD_NEXTHOP | *puLastNextHopIndex;
+      buildStats.au32DirectCodewords[uLevel - 1]++;
+      break;
+    /* Single prefix in bucket group can be encoded directly in the codeword, no need for pointer */
+    case 1:
+      uNextHop = FirstNextHopFromBucketGroup(pBuckets, uIndex * 16);
+      pCodewords[uIndex].u64BitmaskOffset = CODEWORD_NEXTHOP | uNextHop;
+
+      *puLastNextHopIndex = uNextHop;
+      buildStats.au32DirectCodewords[uLevel - 1]++;
+      break;
+    /* More than one prefix in bucket group, now we need to set the bucket group bitmask
+        and pointer offset in the code word, and set pointers to point to the correct next hops
+        or next level chunks */
+    default:
+    {
+      uint32_t     u32FoundPrefixes = 0;
+      uint16_t     u16Bitmask = 0;
+
+      ProcessMultiPrefixBucket(pBuckets, uIndex * 16, &u16Bitmask, &u32FoundPrefixes, ppchCurrentLocation, fpBuildCallback);
+      pCodewords[uIndex].u64BitmaskOffset = (((uint64_t)u16Bitmask) << 32) | (uint64_t)*puPointerIndex;
+      *puPointerIndex += u32FoundPrefixes;
+      buildStats.au32Pointers[uLevel - 1] += u32FoundPrefixes;
+      break;
+    }
+  }
+}
+
+int ProcessBucketGroups(PBUCKET pBuckets, uint8_t *pu8BucketGroupNumPrefixes, unsigned int uMaxIndex, unsigned int uLevel, PCODEWORD pCodewords, char **ppchCurrentLocation, BUILDCALLBACK fpBuildCallback)
 {
-  unsigned int uNextHop          = 0;
   unsigned int uPointerIndex     = 0;
   unsigned int uLastNextHopIndex = 0;
   unsigned int uIndex            = 0;
 
+  buildStats.au32Codewords[uLevel - 1] += uMaxIndex;
+
   for (uIndex = 0; uIndex < uMaxIndex; uIndex++)
   {
-    switch (pchBucketGroupNumPrefixes[uIndex])
+    ProcessBucketGroup(pBuckets, pu8BucketGroupNumPrefixes, uIndex, uLevel, pCodewords, ppchCurrentLocation, fpBuildCallback,
+                       &uPointerIndex, &uLastNextHopIndex);
+  }
+
+  return 1;
+}
+
+int BuildLevel1(PROUTEENTRY pNextHops, char **ppchCurrentLocation)
+{
+  return ProcessBucketGroups(pLevel1Buckets, pau8BucketGroupNumPrefixes, 4096, 1, ((PLEVEL1)pchArena)->codewords, ppchCurrentLocation, ProcessLevel2);
+}
+
+/* Pointers after the codewords of a chunk. The last codeword with a bitmask holds the index
+   of its first pointer. */
+static unsigned int ChunkPointers(const CODEWORD *pCodewords, unsigned int uNumCodewords)
+{
+  unsigned int uIndex = uNumCodewords;
+
+  while (uIndex-- > 0)
+  {
+    uint64_t u64Codeword = pCodewords[uIndex].u64BitmaskOffset;
+
+    if (!(u64Codeword & CODEWORD_NEXTHOP))
     {
-      /* No prefixes in this bucket group, so we should encode a next hop index from the last
-          next hop found to the left, which covers this bucket group too. */
-      case 0:
-        pCodewords[uIndex].u64BitmaskOffset = CODEWORD_NEXTHOP | uLastNextHopIndex;
-        break;
-      /* Single prefix in bucket group can be encoded directly in the codeword, no need for pointer */
-      case 1:
-        uNextHop = FirstNextHopFromBucketGroup(pBuckets, uIndex * 16);
-        pCodewords[uIndex].u64BitmaskOffset = CODEWORD_NEXTHOP | uNextHop;
+      return (u64Codeword & 0xFFFFFFFF) + __builtin_popcount((u64Codeword >> 32) & 0xFFFF);
+    }
+  }
 
-        uLastNextHopIndex = uNextHop;
-        break;
-      /* More than one prefix in bucket group, now we need to set the bucket group bitmask
-          and pointer offset in the code word, and set pointers to point to the correct next hops
-          or next level chunks */
-      default:
-      {
-        uint32_t     u32FoundPrefixes = 0;
-        uint16_t     u16Bitmask = 0;
+  return 0;
+}
 
-        ProcessMultiPrefixBucket(pBuckets, uIndex * 16, &u16Bitmask, &u32FoundPrefixes, ppchCurrentLocation, fpBuildCallback);
-        pCodewords[uIndex].u64BitmaskOffset = (((uint64_t)u16Bitmask) << 32) | (uint64_t)uPointerIndex;
-        uPointerIndex += u32FoundPrefixes;
-        break;
-      }
+/* Next level pointers keep the offset of the chunk in pchCopySource until their copy task
+   moves it over */
+static void CopyPointers(const uint32_t *pu32Source, unsigned int uNumPointers, uint32_t *pu32Destination, BUILDCALLBACK fpCopyNext)
+{
+  unsigned int uIndex = 0;
+
+  for (uIndex = 0; uIndex < uNumPointers; uIndex++)
+  {
+    pu32Destination[uIndex] = pu32Source[uIndex];
+    if ((pu32Source[uIndex] & POINTERTYPE_NEXTLEVEL) && fpCopyNext)
+    {
+      QueueBuildTask(&pu32Destination[uIndex], NULL, fpCopyNext);
     }
   }
+}
+
+static int CopyLevel23(uint32_t *pu32Pointer, char **ppchCurrentPos, unsigned int uLevel, BUILDCALLBACK fpCopyNext)
+{
+  const LEVEL23 *pSource      = (const LEVEL23 *)(pchCopySource + (*pu32Pointer & ~POINTERTYPE_NEXTLEVEL));
+  PLEVEL23       pChunk       = (PLEVEL23)(*ppchCurrentPos);
+  unsigned int   uNumPointers = ChunkPointers(pSource->codewords, 16);
+  unsigned int   uIndex       = 0;
+
+  *pu32Pointer     = POINTERTYPE_NEXTLEVEL | (*ppchCurrentPos - pchArena);
+  *ppchCurrentPos += sizeof(LEVEL23) + uNumPointers * sizeof(uint32_t);
+
+  memcpy(pChunk->codewords, pSource->codewords, sizeof(pChunk->codewords));
+  CopyPointers(pSource->au32Pointers, uNumPointers, pChunk->au32Pointers, fpCopyNext);
+
+  buildStats.au32Chunks[uLevel - 1]++;
+  buildStats.au32Codewords[uLevel - 1] += 16;
+  buildStats.au32Pointers[uLevel - 1]  += uNumPointers;
+  for (uIndex = 0; uIndex < 16; uIndex++)
+  {
+    buildStats.au32DirectCodewords[uLevel - 1] += (pSource->codewords[uIndex].u64BitmaskOffset & CODEWORD_NEXTHOP) != 0;
+  }
+  buildStats.u32ChunksCopied++;
 
   return 1;
 }
 
-int BuildLevel1(PROUTEENTRY pNextHops, char **ppchCurrentLocation)
+static int CopyLevel3(uint32_t *pu32Pointer, PROUTEENTRY pPrefixes, char **ppchCurrentPos)
+{
+  return CopyLevel23(pu32Pointer, ppchCurrentPos, 3, NULL);
+}
+
+static int CopyLevel2(uint32_t *pu32Pointer, PROUTEENTRY pPrefixes, char **ppchCurrentPos)
+{
+  return CopyLevel23(pu32Pointer, ppchCurrentPos, 2, CopyLevel3);
+}
+
+/* Level 1 of a partial rebuild: the groups in pu64RebuildGroups come from the buckets, the
+   others keep their codeword and pointers from pchCopySource, and their chunks get queued
+   for copying */
+static void RebuildLevel1(char **ppchCurrentLocation)
 {
-  return ProcessBucketGroups(pLevel1Buckets, pachBucketGroupNumPrefixes, 4096, pLevel1->codewords, ppchCurrentLocation, ProcessLevel2);
+  const LEVEL1 *pSource           = (const LEVEL1 *)pchCopySource;
+  PLEVEL1       pArenaLevel1      = (PLEVEL1)pchArena;
+  unsigned int  uPointerIndex     = 0;
+  unsigned int  uLastNextHopIndex = 0;
+  unsigned int  uIndex            = 0;
+
+  buildStats.au32Codewords[0] += 4096;
+
+  for (uIndex = 0; uIndex < 4096; uIndex++)
+  {
+    uint64_t     u64Codeword  = pSource->codewords[uIndex].u64BitmaskOffset;
+    unsigned int uNumPointers = 0;
+
+    if (pu64RebuildGroups[uIndex / 64] & (1ULL << (uIndex % 64)))
+    {
+      ProcessBucketGroup(pLevel1Buckets, pau8BucketGroupNumPrefixes, uIndex, 1, pArenaLevel1->codewords, ppchCurrentLocation,
+                         ProcessLevel2, &uPointerIndex, &uLastNextHopIndex);
+      buildStats.u32GroupsRebuilt++;
+      continue;
+    }
+
+    if (u64Codeword & CODEWORD_NEXTHOP)
+    {
+      pArenaLevel1->codewords[uIndex].u64BitmaskOffset = u64Codeword;
+      uLastNextHopIndex = u64Codeword & 0xFFFFFFFF;
+      buildStats.au32DirectCodewords[0]++;
+      continue;
+    }
+
+    uNumPointers = __builtin_popcount((u64Codeword >> 32) & 0xFFFF);
+    pArenaLevel1->codewords[uIndex].u64BitmaskOffset = (u64Codeword & 0xFFFF00000000ULL) | uPointerIndex;
+    CopyPointers(&pSource->au32Pointers[u64Codeword & 0xFFFFFFFF], uNumPointers, (uint32_t *)(*ppchCurrentLocation), CopyLevel2);
+
+    *ppchCurrentLocation         += uNumPointers * sizeof(uint32_t);
+    uPointerIndex                += uNumPointers;
+    buildStats.au32Pointers[0]   += uNumPointers;
+  }
 }
 
 #ifdef DEBUG
@@ -277,134 +545,1268 @@ int DebugBuckets(void)
 }
 #endif
 
-int BuildLuleaTrie(PTREENODE pTreeRoot, PROUTEENTRY pNextHops, unsigned int uNumPrefixes)
+/* Puts every /32 of pNextHops into a new host route table. At least half the slots stay
+   empty, so probes are short. */
+static PHOSTTABLE BuildHostRoutes(PROUTEENTRY pNextHops, unsigned int uNumPrefixes)
 {
-  char        *pchCurrentPos = NULL;
+  PHOSTTABLE   pHosts  = NULL;
+  PHOSTROUTE   pSlots  = NULL;
+  unsigned int uIndex  = 0;
+  unsigned int uHosts  = 0;
+  unsigned int uBits   = 4;
 
-  pLevel1Buckets = calloc(65536, sizeof(BUCKET));
-  pachBucketGroupNumPrefixes = calloc(65536 / 16, sizeof(char));
+  for (uIndex = 0; uIndex < uNumPrefixes; uIndex++)
+  {
+    uHosts += pNextHops[uIndex].u32Size == 1;
+  }
+  while ((1U << uBits) < uHosts * 2)
+  {
+    uBits++;
+  }
 
-  if (!pLevel1Buckets || !pachBucketGroupNumPrefixes)
+  pHosts = calloc(1, sizeof(*pHosts));
+  pSlots = aligned_alloc(64, sizeof(*pSlots) << uBits);
+  if (!pHosts || !pSlots)
   {
-    printf("Can't allocate level 1 buckets\n");
+    printf("Can't allocate host route table\n");
     exit(1);
   }
+  pHosts->pSlots     = pSlots;
+  pHosts->pu64Groups = calloc(HOSTROUTE_GROUPS / 64, sizeof(*pHosts->pu64Groups));
+  if (!pHosts->pu64Groups)
+  {
+    printf("Can't allocate host route table\n");
+    exit(1);
+  }
+  pHosts->u32Mask = (1U << uBits) - 1;
+  pHosts->uShift  = 32 - uBits;
 
-  RecurseRadixTree(pTreeRoot);
+  for (uIndex = 0; uIndex <= pHosts->u32Mask; uIndex++)
+  {
+    pSlots[uIndex].u32Address = 0;
+    pSlots[uIndex].u32Value   = HOSTROUTE_EMPTY;
+  }
 
-  /* 16 MB should be enough for everyone?
-     A full BGP dump as of 2020 takes ~8MB */
-  pchLuleaTrie = calloc(1, 1024 * 1024 * 16);
-  if (!pchLuleaTrie)
+  for (uIndex = 0; uIndex < uNumPrefixes; uIndex++)
   {
-    printf("Can't allocate luleå trie memory block!\n");
-    exit(1);
+    ROUTEENTRY route = pNextHops[uIndex];
+    uint32_t   u32Slot = 0;
+
+    if (route.u32Size != 1)
+    {
+      continue;
+    }
+
+    /* Like the radix tree, the first copy of a duplicate prefix wins */
+    u32Slot = HOSTROUTE_SLOT(pHosts, route.u32Start);
+    while (pSlots[u32Slot].u32Value != HOSTROUTE_EMPTY && pSlots[u32Slot].u32Address != route.u32Start)
+    {
+      u32Slot = (u32Slot + 1) & pHosts->u32Mask;
+    }
+    if (pSlots[u32Slot].u32Value != HOSTROUTE_EMPTY)
+    {
+      continue;
+    }
+
+    route.u32NextHopIndex      = uIndex;
+    pSlots[u32Slot].u32Address = route.u32Start;
+    pSlots[u32Slot].u32Value   = LeafValue(&route);
+    pHosts->pu64Groups[route.u32Start >> 22] |= 1ULL << ((route.u32Start >> 16) & 63);
+    buildStats.u32HostRoutes++;
   }
-  pLevel1 = (PLEVEL1)pchLuleaTrie;
 
-  pchCurrentPos = pchLuleaTrie + sizeof(LEVEL1);
+  buildStats.u64HostTableBytes = (sizeof(*pSlots) << uBits) + HOSTROUTE_GROUPS / 8;
 
-  BuildLevel1(pNextHops, &pchCurrentPos);
+  return pHosts;
+}
 
-  while (pBuildTaskTail)
+static void FreeHostRoutes(PHOSTTABLE pHosts)
+{
+  if (pHosts)
   {
-    PBUILDTASK pTask = NULL;
+    free(pHosts->pSlots);
+    free(pHosts->pu64Groups);
+    free(pHosts);
+  }
+}
 
-    QUEUE_REMOVE_TAIL(&pBuildTaskHead, &pBuildTaskTail, pTask);
+/* Makes pHosts the table of the image about to be swapped in. The one it replaces is kept
+   until the next build, for lookups still on the old image, like the built image. */
+static void RetireHostRoutes(PHOSTTABLE pHosts)
+{
+  FreeHostRoutes(pRetiredHostTable);
+  pRetiredHostTable = pHostTable;
+  pHostTable        = pHosts;
+}
 
-    pTask->fpBuild(pTask->pu32Pointer, pTask->pPrefixes, &pchCurrentPos);
+/* Makes room for uBytes more at *ppchCurrentPos, growing the arena if needed. The image only
+   holds offsets, so it can move, but the build has pointers into it: the current position,
+   the queued tasks and pTask, the one being run. */
+static void ReserveArena(char **ppchCurrentPos, size_t uBytes, PBUILDTASK pTask)
+{
+  size_t     uUsed     = *ppchCurrentPos - pchArena;
+  size_t     uCapacity = uArenaCapacity;
+  char      *pchGrown  = NULL;
+  PBUILDTASK pIterate  = NULL;
 
-    free(pTask);
+  if (uUsed + uBytes <= uArenaCapacity)
+  {
+    return;
   }
 
-#ifdef DEBUG
-  printf("Structure is %ld bytes\n", pchCurrentPos - pchLuleaTrie);
-  DebugBuckets();
-#endif
+  while (uUsed + uBytes > uCapacity)
+  {
+    uCapacity *= 2;
+  }
+  /* Chunk offsets share the pointer with POINTERTYPE_NEXTLEVEL, so they only have 31 bits */
+  if (uCapacity > POINTERTYPE_NEXTLEVEL)
+  {
+    uCapacity = POINTERTYPE_NEXTLEVEL;
+    if (uUsed + uBytes > uCapacity)
+    {
+      printf("Luleå trie needs more than 2 GB, chunk offsets only have 31 bits\n");
+      exit(1);
+    }
+  }
 
-  free(pLevel1Buckets);
-  free(pachBucketGroupNumPrefixes);
+  /* Park the pointers as offsets while the arena moves */
+  for (pIterate = pBuildTaskHead; pIterate; pIterate = pIterate->pNext)
+  {
+    pIterate->pu32Pointer = (uint32_t *)((char *)pIterate->pu32Pointer - pchArena);
+  }
+  if (pTask)
+  {
+    pTask->pu32Pointer = (uint32_t *)((char *)pTask->pu32Pointer - pchArena);
+  }
 
-  return 1;
+  pchGrown = realloc(pchArena, uCapacity);
+  if (!pchGrown)
+  {
+    printf("Can't grow luleå trie memory block to %zu bytes!\n", uCapacity);
+    exit(1);
+  }
+  memset(pchGrown + uArenaCapacity, 0, uCapacity - uArenaCapacity);
+
+  for (pIterate = pBuildTaskHead; pIterate; pIterate = pIterate->pNext)
+  {
+    pIterate->pu32Pointer = (uint32_t *)(pchGrown + (uintptr_t)pIterate->pu32Pointer);
+  }
+  if (pTask)
+  {
+    pTask->pu32Pointer = (uint32_t *)(pchGrown + (uintptr_t)pTask->pu32Pointer);
+  }
+
+  *ppchCurrentPos = pchGrown + uUsed;
+  pchArena        = pchGrown;
+  uArenaCapacity  = uCapacity;
 }
 
-PROUTEENTRY LuleaTrieLookup(uint32_t u32IP, PROUTEENTRY pNextHops)
+/* The reservation of the last lazy build, lookups left it when its compacted copy was published */
+static void ReleaseReservation(void)
 {
-  unsigned int uLow            = 0;
-  unsigned int uPointer        = 0;
-  unsigned int uShiftedBitmask = 0;
-  unsigned int uPopcount       = 0;
-  uint32_t     u32Offset       = 0;
-  PCODEWORD    pCodeWord       = &pLevel1->codewords[u32IP >> 20];
-  PLEVEL23     pLevel2         = NULL;
-  PLEVEL23     pLevel3         = NULL;
+  if (pchRetiredReservation)
+  {
+    munmap(pchRetiredReservation, POINTERTYPE_NEXTLEVEL);
+    pchRetiredReservation = NULL;
+  }
+}
 
-  /* Next hop encoded directly into codeword? */
-  if (pCodeWord->u64BitmaskOffset & CODEWORD_NEXTHOP)
+/* Returns where the pointers after level 1 start */
+static char *StartArena(size_t uCapacity)
+{
+  uArenaCapacity = uCapacity;
+  pchArena       = calloc(1, uArenaCapacity);
+  if (!pchArena)
   {
-    return pNextHops + (pCodeWord->u64BitmaskOffset & 0xFFFFFFFF);
+    printf("Can't allocate luleå trie memory block!\n");
+    exit(1);
   }
 
-  /* Continue to find correct pointer, either to next hop or next level chunk */
-  u32Offset = pCodeWord->u64BitmaskOffset & 0xFFFFFFFF;
-  uLow = (u32IP & 0x000F0000) >> 16;
+  return pchArena + sizeof(LEVEL1);
+}
 
-  uShiftedBitmask = pCodeWord->u64BitmaskOffset >> (32 + (16 - (uLow + 1)));
-  uPopcount = __builtin_popcount(uShiftedBitmask);
-  uPopcount -= (uPopcount > 0);
-  uPointer = uPopcount + u32Offset;
+/* Address space for the largest image chunk offsets can reach, pages only get memory once
+   written. Level 2 chunks can then be appended while lookups walk the image. */
+static char *StartLazyArena(void)
+{
+  ReleaseReservation();
 
-  /* Next hop! */
-  if (!(pLevel1->au32Pointers[uPointer] & POINTERTYPE_NEXTLEVEL))
+  uArenaCapacity = POINTERTYPE_NEXTLEVEL;
+  pchArena       = mmap(NULL, uArenaCapacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (pchArena == MAP_FAILED)
   {
-    return pNextHops + pLevel1->au32Pointers[uPointer];
+    printf("Can't reserve luleå trie address space!\n");
+    exit(1);
   }
 
-  /* Continue with next level */
-  pLevel2   = (PLEVEL23) (pchLuleaTrie + (pLevel1->au32Pointers[uPointer] & ~POINTERTYPE_NEXTLEVEL));
-  pCodeWord = &pLevel2->codewords[(u32IP >> 12) & 0xF];
+  return pchArena + sizeof(LEVEL1);
+}
 
-  //printf ("Looking at level 2\n");
-  if (pCodeWord->u64BitmaskOffset & CODEWORD_NEXTHOP)
+static void RunBuildTasks(char **ppchCurrentPos)
+{
+  while (pBuildTaskTail)
+  {
+    PBUILDTASK pTask = NULL;
+
+    QUEUE_REMOVE_TAIL(&pBuildTaskHead, &pBuildTaskTail, pTask);
+
+    /* A chunk has at most 256 pointers */
+    ReserveArena(ppchCurrentPos, sizeof(LEVEL23) + 256 * sizeof(uint32_t), pTask);
+    pTask->fpBuild(pTask->pu32Pointer, pTask->pPrefixes, ppchCurrentPos);
+
+    free(pTask);
+  }
+}
+
+/* Sizing pass: adds what the chunk and every chunk below it take with packed pointers */
+static void SizeChunk(const char *pchImage, const CODEWORD *pCodewords, unsigned int uNumCodewords, const uint32_t *pu32Pointers,
+                      unsigned int uLevel, PPACKSIZE pSize)
+{
+  unsigned int uNumPointers = ChunkPointers(pCodewords, uNumCodewords);
+  unsigned int uIndex       = 0;
+
+  pSize->au64Bytes[0] += uNumCodewords * sizeof(CODEWORD) + PACKED_ALIGN(uNumPointers * 2);
+  pSize->au64Bytes[1] += uNumCodewords * sizeof(CODEWORD) + PACKED_ALIGN(uNumPointers * 3);
+
+  for (uIndex = 0; uIndex < uNumPointers; uIndex++)
   {
-    return pNextHops + (pCodeWord->u64BitmaskOffset & 0xFFFFFFFF);
+    uint32_t u32Pointer = pu32Pointers[uIndex];
+
+    if (!(u32Pointer & POINTERTYPE_NEXTLEVEL))
+    {
+      pSize->u32MaxLeaf = u32Pointer > pSize->u32MaxLeaf ? u32Pointer : pSize->u32MaxLeaf;
+    }
+    else if (uLevel < 3)
+    {
+      const LEVEL23 *pChild = (const LEVEL23 *)(pchImage + (u32Pointer & ~POINTERTYPE_NEXTLEVEL));
+
+      SizeChunk(pchImage, pChild->codewords, 16, pChild->au32Pointers, uLevel + 1, pSize);
+    }
   }
+}
 
-  u32Offset = pCodeWord->u64BitmaskOffset & 0xFFFFFFFF;
-  uLow = (u32IP & 0x00000F00) >> 8;
+/* Appends the chunk with packed pointers, then the chunks below it depth first, so level 3
+   chunks sit close to their level 2 chunk. Returns its offset. */
+static size_t PackChunk(PPACKER pPacker, const CODEWORD *pCodewords, unsigned int uNumCodewords, const uint32_t *pu32Pointers,
+                        unsigned int uLevel)
+{
+  size_t        uOffset      = pPacker->uUsed;
+  unsigned int  uNumPointers = ChunkPointers(pCodewords, uNumCodewords);
+  unsigned int  uIndex       = 0;
+  char         *pchPointers  = pPacker->pchImage + uOffset + uNumCodewords * sizeof(CODEWORD);
 
-  uShiftedBitmask = pCodeWord->u64BitmaskOffset >> (32 + (16 - (uLow + 1)));
-  uPopcount = __builtin_popcount(uShiftedBitmask);
-  uPopcount -= (uPopcount > 0);
-  uPointer = uPopcount + u32Offset;
+  memcpy(pPacker->pchImage + uOffset, pCodewords, uNumCodewords * sizeof(CODEWORD));
+  pPacker->uUsed += uNumCodewords * sizeof(CODEWORD) + PACKED_ALIGN(uNumPointers * pPacker->uBytes);
 
-  if (!(pLevel2->au32Pointers[uPointer] & POINTERTYPE_NEXTLEVEL))
+  for (uIndex = 0; uIndex < uNumPointers; uIndex++)
   {
-    return pNextHops + pLevel2->au32Pointers[uPointer];
+    uint32_t u32Pointer = pu32Pointers[uIndex];
+    uint32_t u32Packed  = PACKED_NO_ROUTE(pPacker->uBytes);
+
+    if (!(u32Pointer & POINTERTYPE_NEXTLEVEL))
+    {
+      u32Packed = u32Pointer;
+    }
+    else if (uLevel < 3)
+    {
+      const LEVEL23 *pChild = (const LEVEL23 *)(pPacker->pchSource + (u32Pointer & ~POINTERTYPE_NEXTLEVEL));
+
+      u32Packed = PACKED_NEXTLEVEL(pPacker->uBytes) | (PackChunk(pPacker, pChild->codewords, 16, pChild->au32Pointers, uLevel + 1) / 8);
+    }
+
+    /* x86 is little endian, the low bytes are the packed pointer */
+    memcpy(pchPointers + uIndex * pPacker->uBytes, &u32Packed, pPacker->uBytes);
   }
 
-  pLevel3 = (PLEVEL23) (pchLuleaTrie + (pLevel2->au32Pointers[uPointer] & ~POINTERTYPE_NEXTLEVEL));
-  pCodeWord = &pLevel3->codewords[(u32IP >> 4) & 0xF];
+  return uOffset;
+}
 
-  //printf ("Looking at level 3\n");
+/* Sizes a complete image for 16 and 24 bit pointers, and packs it with the narrowest width
+   of at least uPointerBits that holds every leaf and chunk offset. Returns NULL if that is
+   32 bits, the image as built. */
+static char *PackImage(const char *pchImage, size_t uSize, size_t *puPackedSize, unsigned int *puBytes)
+{
+  const LEVEL1 *pSource = (const LEVEL1 *)pchImage;
+  PACKSIZE      size;
+  PACKER        packer;
+  unsigned int  uBytes  = 0;
+
+  memset(&size, 0, sizeof(size));
+  SizeChunk(pchImage, pSource->codewords, 4096, pSource->au32Pointers, 1, &size);
+
+  *puBytes = 4;
+  buildStats.au64PackedBytes[2] = uSize;
+  buildStats.abPackedFits[2]    = 1;
+  for (uBytes = 3; uBytes >= 2; uBytes--)
+  {
+    int bFits = size.u32MaxLeaf < PACKED_NO_ROUTE(uBytes) && size.au64Bytes[uBytes - 2] / 8 <= PACKED_NEXTLEVEL(uBytes);
 
-  if (pCodeWord->u64BitmaskOffset & CODEWORD_NEXTHOP)
+    buildStats.au64PackedBytes[uBytes - 2] = size.au64Bytes[uBytes - 2];
+    buildStats.abPackedFits[uBytes - 2]    = bFits;
+    if (bFits && uBytes * 8 >= uPointerBits)
+    {
+      *puBytes = uBytes;
+    }
+  }
+  if (*puBytes == 4)
   {
-    return pNextHops + (pCodeWord->u64BitmaskOffset & 0xFFFFFFFF);
+    return NULL;
   }
 
-  u32Offset = pCodeWord->u64BitmaskOffset & 0xFFFFFFFF;
-  uLow = (u32IP & 0x0000000F);
+  /* A 24 bit pointer is read with a 32 bit load, which can run past the last one */
+  packer.pchSource = pchImage;
+  packer.uBytes    = *puBytes;
+  packer.uUsed     = 0;
+  packer.pchImage  = calloc(1, size.au64Bytes[*puBytes - 2] + 8);
+  if (!packer.pchImage)
+  {
+    printf("Can't allocate packed luleå trie\n");
+    exit(1);
+  }
+  PackChunk(&packer, pSource->codewords, 4096, pSource->au32Pointers, 1);
+  *puPackedSize = packer.uUsed + 8;
 
-  uShiftedBitmask = pCodeWord->u64BitmaskOffset >> (32 + (16 - (uLow + 1)));
-  uPopcount = __builtin_popcount(uShiftedBitmask);
-  uPopcount -= (uPopcount > 0);
-  uPointer = uPopcount + u32Offset;
+  return packer.pchImage;
+}
 
-  if (!(pLevel3->au32Pointers[uPointer] & POINTERTYPE_NEXTLEVEL))
+static void FreeReplicas(PLULEAREPLICAS pSet)
+{
+  unsigned int uNode = 0;
+
+  if (!pSet)
+  {
+    return;
+  }
+  /* Without NUMA the set only owns a packed copy, the built image is freed with the builds */
+  if (!pSet->bNuma && pSet->uPointerBytes < 4)
+  {
+    free(pSet->apchImages[0]);
+  }
+  for (uNode = 0; pSet->bNuma && uNode < pSet->uNodes; uNode++)
   {
-    return pNextHops + pLevel3->au32Pointers[uPointer];
+    LuleaNumaFree(pSet->apchImages[uNode], pSet->uImageBytes);
+    LuleaNumaFree(pSet->apu32NextHops[uNode], pSet->uNextHopBytes);
   }
+  free(pSet);
+}
 
-  return NULL;
+/* The set lookups walk pchImage through, with the current host route table. A complete image
+   is packed if narrower pointers are allowed and fit, and copied with the next hop column to
+   every node when replicating. Otherwise lookups walk pchImage itself. */
+static PLULEAREPLICAS CopyReplicas(char *pchImage, size_t uSize, int bComplete)
+{
+  PLULEAREPLICAS pSet        = NULL;
+  unsigned int   uNode       = 0;
+  unsigned int   uBytes      = 4;
+  size_t         uPackedSize = 0;
+  char          *pchPacked   = bComplete && uPointerBits < 32 ? PackImage(pchImage, uSize, &uPackedSize, &uBytes) : NULL;
+
+  pSet = calloc(1, sizeof(*pSet));
+  if (!pSet)
+  {
+    printf("Can't allocate luleå trie replicas\n");
+    exit(1);
+  }
+  pSet->uPointerBytes = uBytes;
+  pSet->uImageBytes   = pchPacked ? uPackedSize : uSize;
+  pSet->pHosts        = pHostTable;
+
+  if (!bComplete || !bReplicate)
+  {
+    pSet->uNodes        = 1;
+    pSet->apchImages[0] = pchPacked ? pchPacked : pchImage;
+    return pSet;
+  }
+
+  pSet->bNuma         = 1;
+  pSet->uNodes        = LuleaNumaNodes();
+  pSet->uNextHopBytes = pu32ReplicaNextHops ? (size_t)uReplicaNextHops * sizeof(*pu32ReplicaNextHops) : 0;
+
+  for (uNode = 0; uNode < pSet->uNodes; uNode++)
+  {
+    pSet->apchImages[uNode] = LuleaNumaCopyToNode(pchPacked ? pchPacked : pchImage, pSet->uImageBytes, uNode);
+    if (pSet->uNextHopBytes)
+    {
+      pSet->apu32NextHops[uNode] = LuleaNumaCopyToNode(pu32ReplicaNextHops, pSet->uNextHopBytes, uNode);
+    }
+  }
+  free(pchPacked);
+
+  return pSet;
+}
+
+/* Publishes a new replica set. The one it replaces is kept until the next swap, for lookups
+   that were still walking it, the same as built images. */
+static void SwapReplicas(PLULEAREPLICAS pSet)
+{
+  FreeReplicas(pRetiredReplicas);
+  pRetiredReplicas = __atomic_exchange_n(&pReplicas, pSet, __ATOMIC_ACQ_REL);
+
+  buildStats.u32Replicas     = pSet->bNuma ? pSet->uNodes : 0;
+  buildStats.u64ReplicaBytes = pSet->bNuma ? (uint64_t)pSet->uNodes * (pSet->uImageBytes + pSet->uNextHopBytes) : 0;
+  buildStats.u32PointerBits  = pSet->uPointerBytes * 8;
+}
+
+/* Lookups running meanwhile finish on the old image. bComplete is 0 for the image of a lazy
+   build, which is patched in place and can't be replicated until it is finished. Lookups only
+   reach the image through the replica set, so they always pair it with its host routes. */
+static void SwapImage(char *pchImage, size_t uSize, int bComplete)
+{
+  SwapReplicas(CopyReplicas(pchImage, uSize, bComplete));
+
+  pLevel1        = (PLEVEL1)pchImage;
+  uLuleaTrieSize = uSize;
+  __atomic_store_n(&pchLuleaTrie, pchImage, __ATOMIC_RELEASE);
+
+  __atomic_add_fetch(&u32Generation, 1, __ATOMIC_RELEASE);
+}
+
+/* Trims the arena and makes it the image lookups use. The built image it replaces is kept
+   until the next build, for lookups that were still walking it. */
+static void PublishArena(char *pchCurrentPos)
+{
+  size_t  uSize     = pchCurrentPos - pchArena;
+  char   *pchShrunk = realloc(pchArena, uSize);
+
+  if (pchShrunk)
+  {
+    pchArena = pchShrunk;
+  }
+  buildStats.u64ImageBytes = uSize;
+
+  ReleaseReservation();
+  free(pchRetiredImage);
+  pchRetiredImage = pchBuiltImage;
+  pchBuiltImage   = pchArena;
+  pchArena        = NULL;
+
+  SwapImage(pchBuiltImage, uSize, 1);
+}
+
+/* Compiles a level 2 chunk and its level 3 chunks at the end of the reservation, then swaps
+   the level 1 pointer from the trap chunk to it. Stores on x86 are seen in order, so a lookup
+   that reads the new pointer also sees the chunk. */
+static void CompileLazyTask(PLAZYSTATE pLazy, PBUILDTASK pTask)
+{
+  uint32_t u32Pointer = 0;
+
+  ProcessLevel2(&u32Pointer, pTask->pPrefixes, &pLazy->pchCurrentPos);
+  RunBuildTasks(&pLazy->pchCurrentPos);
+  __atomic_store_n(pTask->pu32Pointer, u32Pointer, __ATOMIC_RELEASE);
+
+  free(pTask);
+}
+
+/* Hit chunks first, the most hit one first, then the rest in address order unless only hit
+   chunks are wanted. Called with the mutex held, NULL once there is nothing to do. */
+static PBUILDTASK NextLazyTask(PLAZYSTATE pLazy)
+{
+  PBUILDTASK   pTask = NULL;
+  unsigned int uBest = 0;
+  unsigned int uHot  = 0;
+
+  while (pLazy->uNumHot)
+  {
+    for (uHot = 1, uBest = 0; uHot < pLazy->uNumHot; uHot++)
+    {
+      if (pLazy->au32Touches[pLazy->au16Hot[uHot]] > pLazy->au32Touches[pLazy->au16Hot[uBest]])
+      {
+        uBest = uHot;
+      }
+    }
+
+    pTask = pLazy->apTasks[pLazy->au16Hot[uBest]];
+    pLazy->apTasks[pLazy->au16Hot[uBest]] = NULL;
+    pLazy->au16Hot[uBest] = pLazy->au16Hot[--pLazy->uNumHot];
+
+    /* The address order sweep may have got there first */
+    if (pTask)
+    {
+      buildStats.u32LazyTouched++;
+      return pTask;
+    }
+  }
+
+  if (eLazyMode != LULEALAZY_BACKGROUND && !pLazy->bDrain)
+  {
+    return NULL;
+  }
+
+  for (; pLazy->uColdCursor < 65536; pLazy->uColdCursor++)
+  {
+    pTask = pLazy->apTasks[pLazy->uColdCursor];
+    if (pTask)
+    {
+      pLazy->apTasks[pLazy->uColdCursor] = NULL;
+      return pTask;
+    }
+  }
+
+  return NULL;
+}
+
+/* Publishes a compacted copy once every chunk is in, which also drops the reservation */
+static void FinishLazyBuild(PLAZYSTATE pLazy)
+{
+  size_t  uSize  = pLazy->pchCurrentPos - pchArena;
+  char   *pchCopy = malloc(uSize);
+
+  if (!pchCopy)
+  {
+    printf("Can't allocate luleå trie memory block!\n");
+    exit(1);
+  }
+  memcpy(pchCopy, pchArena, uSize);
+  buildStats.u64ImageBytes = uSize;
+
+  free(pchRetiredImage);
+  pchRetiredImage       = NULL;
+  pchBuiltImage         = pchCopy;
+  pchRetiredReservation = pchArena;
+  pchArena              = NULL;
+
+  SwapImage(pchCopy, uSize, 1);
+}
+
+static void *LazyThread(void *pArg)
+{
+  PLAZYSTATE pLazy = pArg;
+  PBUILDTASK pTask = NULL;
+
+  pthread_mutex_lock(&pLazy->mutex);
+  while (pLazy->uNumPending)
+  {
+    pTask = NextLazyTask(pLazy);
+    if (!pTask)
+    {
+      pthread_cond_wait(&pLazy->cond, &pLazy->mutex);
+      continue;
+    }
+    pLazy->uNumPending--;
+    pthread_mutex_unlock(&pLazy->mutex);
+
+    CompileLazyTask(pLazy, pTask);
+
+    pthread_mutex_lock(&pLazy->mutex);
+  }
+  pthread_mutex_unlock(&pLazy->mutex);
+
+  FinishLazyBuild(pLazy);
+
+  return NULL;
+}
+
+/* Slow path for addresses under the trap chunk. The first hit on a /16 asks the thread for
+   its chunk. */
+static uint32_t LazyLookup(uint32_t u32IP)
+{
+  PLAZYSTATE pLazy    = pLazyState;
+  uint32_t   u32Index = LookupInTreeIndexAt(pLazy->pTree, u32IP);
+
+  __atomic_add_fetch(&buildStats.u64LazySlowLookups, 1, __ATOMIC_RELAXED);
+  if (!__atomic_fetch_add(&pLazy->au32Touches[u32IP >> 16], 1, __ATOMIC_RELAXED))
+  {
+    pthread_mutex_lock(&pLazy->mutex);
+    pLazy->au16Hot[pLazy->uNumHot++] = u32IP >> 16;
+    pthread_cond_signal(&pLazy->cond);
+    pthread_mutex_unlock(&pLazy->mutex);
+  }
+
+  return u32Index == NO_NEXT_HOP ? NO_NEXT_HOP : LeafValueOf(u32Index);
+}
+
+/* Level 1 is complete and its pointers are in the arena, with the level 2 chunks queued.
+   Aims those pointers at the trap chunk, publishes the image and leaves the chunks to the
+   thread. */
+static void StartLazyBuild(PTREENODE pTreeRoot, char *pchCurrentPos)
+{
+  PLAZYSTATE   pLazy    = NULL;
+  PLEVEL23     pTrap    = (PLEVEL23)pchCurrentPos;
+  uint32_t     u32Trap  = POINTERTYPE_NEXTLEVEL | (pchCurrentPos - pchArena);
+  unsigned int uIndex   = 0;
+
+  for (uIndex = 0; uIndex < 16; uIndex++)
+  {
+    pTrap->codewords[uIndex].u64BitmaskOffset = CODEWORD_NEXTHOP | LULEA_PENDING;
+  }
+  pchCurrentPos += sizeof(LEVEL23);
+
+  free(pLazyState);
+  pLazy = pLazyState = calloc(1, sizeof(*pLazyState));
+  if (!pLazy)
+  {
+    printf("Can't allocate lazy build state\n");
+    exit(1);
+  }
+  pLazy->pTree         = pTreeRoot;
+  pLazy->pchCurrentPos = pchCurrentPos;
+  pthread_mutex_init(&pLazy->mutex, NULL);
+  pthread_cond_init(&pLazy->cond, NULL);
+
+  while (pBuildTaskTail)
+  {
+    PBUILDTASK pTask = NULL;
+
+    QUEUE_REMOVE_TAIL(&pBuildTaskHead, &pBuildTaskTail, pTask);
+    *pTask->pu32Pointer = u32Trap;
+    pLazy->apTasks[pTask->pPrefixes->u32Start >> 16] = pTask;
+    pLazy->uNumPending++;
+  }
+  buildStats.u32LazyChunks = pLazy->uNumPending;
+
+  free(pchRetiredImage);
+  pchRetiredImage = pchBuiltImage;
+  pchBuiltImage   = NULL;
+  SwapImage(pchArena, pchCurrentPos - pchArena, 0);
+
+  if (pthread_create(&pLazy->thread, NULL, LazyThread, pLazy))
+  {
+    printf("Can't start lazy build thread\n");
+    exit(1);
+  }
+  bLazyRunning = 1;
+}
+
+/* Compiles whatever a lazy build left and returns once the complete image is published.
+   The tree the build was given must stay until then. */
+void LuleaTrieWaitMaterialized(void)
+{
+  if (!bLazyRunning)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&pLazyState->mutex);
+  pLazyState->bDrain = 1;
+  pthread_cond_signal(&pLazyState->cond);
+  pthread_mutex_unlock(&pLazyState->mutex);
+
+  pthread_join(pLazyState->thread, NULL);
+  bLazyRunning = 0;
+}
+
+int BuildLuleaTrie(PTREENODE pTreeRoot, PROUTEENTRY pNextHops, unsigned int uNumPrefixes)
+{
+  char        *pchCurrentPos = NULL;
+  TREENODE     withoutHosts  = { 0 };
+  int          bLazy         = 0;
+  PHOSTTABLE   pHosts        = NULL;
+
+  /* Leaves share the pointer with POINTERTYPE_NEXTLEVEL too */
+  if (uNumPrefixes >= POINTERTYPE_NEXTLEVEL)
+  {
+    printf("Luleå trie can't hold %u prefixes, leaves only have 31 bits\n", uNumPrefixes);
+    return 0;
+  }
+
+  pLevel1Buckets = calloc(65536, sizeof(BUCKET));
+  pau8BucketGroupNumPrefixes = calloc(65536 / 16, sizeof(uint8_t));
+
+  if (!pLevel1Buckets || !pau8BucketGroupNumPrefixes)
+  {
+    printf("Can't allocate level 1 buckets\n");
+    exit(1);
+  }
+
+  LuleaTrieWaitMaterialized();
+  memset(&buildStats, 0, sizeof(buildStats));
+  buildStats.au32Chunks[0] = 1;
+  pBuildNextHops = pNextHops;
+
+  ProfileBegin(PROFILE_RECURSE_RADIX_TREE);
+  if (bSplitHostRoutes)
+  {
+    /* The covering prefixes have to fill the space of the /32s again, so bucket a copy of
+       the tree built without them. Lookups keep the old image and table until the swap. */
+    pHosts = BuildHostRoutes(pNextHops, uNumPrefixes);
+    BuildPrefixTreeFrom(&withoutHosts, pNextHops, uNumPrefixes, 2);
+    pTreeRoot = &withoutHosts;
+  }
+  RecurseRadixTree(pTreeRoot);
+  ProfileEnd(PROFILE_RECURSE_RADIX_TREE);
+
+  /* A full BGP dump as of 2020 takes ~8MB, the arena grows when a chunk doesn't fit anymore.
+     Level 1 with all its pointers always fits. A lazy build can't move the image once
+     published, and the slow path needs the tree it was given. */
+  bLazy = eLazyMode != LULEALAZY_OFF && !bSplitHostRoutes;
+  pchCurrentPos = bLazy ? StartLazyArena() : StartArena(1024 * 1024 * 16);
+
+  ProfileBegin(PROFILE_BUILD_LEVEL1);
+  BuildLevel1(pNextHops, &pchCurrentPos);
+  ProfileEnd(PROFILE_BUILD_LEVEL1);
+
+  if (bLazy)
+  {
+    RetireHostRoutes(NULL);
+    StartLazyBuild(pTreeRoot, pchCurrentPos);
+  }
+  else
+  {
+    ProfileBegin(PROFILE_BUILD_LEVEL23);
+    RunBuildTasks(&pchCurrentPos);
+    ProfileEnd(PROFILE_BUILD_LEVEL23);
+
+    RetireHostRoutes(pHosts);
+    PublishArena(pchCurrentPos);
+  }
+
+#ifdef DEBUG
+  printf("Structure is %zu bytes\n", uLuleaTrieSize);
+  DebugBuckets();
+#endif
+
+  free(pLevel1Buckets);
+  free(pau8BucketGroupNumPrefixes);
+  FreePrefixTreeAt(&withoutHosts);
+
+  return 1;
+}
+
+/* Recompiles the level 1 bucket groups set in pu64Groups, one bit per /12, into a fresh image
+   and copies the chunks of all other groups from the current one. pTreeRoot needs every route
+   of those groups, with routes wider than /12 cut down to the groups they cover, so a group
+   never depends on the groups left of it. Returns 0 if there is no image to start from. */
+int LuleaTrieRebuildGroups(PTREENODE pTreeRoot, PROUTEENTRY pNextHops, unsigned int uNumPrefixes, const uint64_t *pu64Groups)
+{
+  char   *pchCurrentPos = NULL;
+  size_t  uCapacity     = 1024 * 1024 * 16;
+
+  LuleaTrieWaitMaterialized();
+  if (!pchLuleaTrie || bSplitHostRoutes || pHostTable)
+  {
+    printf("Partial rebuilds need a built luleå trie without a host route table\n");
+    return 0;
+  }
+  if (uNumPrefixes >= POINTERTYPE_NEXTLEVEL)
+  {
+    printf("Luleå trie can't hold %u prefixes, leaves only have 31 bits\n", uNumPrefixes);
+    return 0;
+  }
+
+  pLevel1Buckets = calloc(65536, sizeof(BUCKET));
+  pau8BucketGroupNumPrefixes = calloc(65536 / 16, sizeof(uint8_t));
+  if (!pLevel1Buckets || !pau8BucketGroupNumPrefixes)
+  {
+    printf("Can't allocate level 1 buckets\n");
+    exit(1);
+  }
+
+  memset(&buildStats, 0, sizeof(buildStats));
+  buildStats.au32Chunks[0] = 1;
+  pBuildNextHops    = pNextHops;
+  pu64RebuildGroups = pu64Groups;
+  pchCopySource     = pchLuleaTrie;
+
+  ProfileBegin(PROFILE_RECURSE_RADIX_TREE);
+  RecurseRadixTree(pTreeRoot);
+  ProfileEnd(PROFILE_RECURSE_RADIX_TREE);
+
+  /* Mostly a copy, so start out the size of the current image */
+  while (uCapacity < uLuleaTrieSize + uLuleaTrieSize / 4 && uCapacity < POINTERTYPE_NEXTLEVEL)
+  {
+    uCapacity *= 2;
+  }
+  pchCurrentPos = StartArena(uCapacity);
+
+  ProfileBegin(PROFILE_BUILD_LEVEL1);
+  RebuildLevel1(&pchCurrentPos);
+  ProfileEnd(PROFILE_BUILD_LEVEL1);
+
+  ProfileBegin(PROFILE_BUILD_LEVEL23);
+  RunBuildTasks(&pchCurrentPos);
+  ProfileEnd(PROFILE_BUILD_LEVEL23);
+
+  PublishArena(pchCurrentPos);
+
+  free(pLevel1Buckets);
+  free(pau8BucketGroupNumPrefixes);
+  pu64RebuildGroups = NULL;
+  pchCopySource     = NULL;
+
+  return 1;
+}
+
+/* The image only contains offsets relative to its start, so it can be saved and loaded anywhere */
+char *LuleaTrieImage(size_t *puSize)
+{
+  LuleaTrieWaitMaterialized();
+  *puSize = uLuleaTrieSize;
+  return pchLuleaTrie;
+}
+
+/* Lookups running meanwhile finish on the old image, the caller keeps it around until they have */
+void LuleaTrieSetImage(char *pchImage, size_t uSize)
+{
+  LuleaTrieWaitMaterialized();
+
+  /* Images never include a host route table */
+  RetireHostRoutes(NULL);
+  SwapImage(pchImage, uSize, 1);
+}
+
+uint32_t LuleaTrieGeneration(void)
+{
+  return __atomic_load_n(&u32Generation, __ATOMIC_ACQUIRE);
+}
+
+void LuleaTrieGetBuildStats(PLULEABUILDSTATS pStats)
+{
+  *pStats = buildStats;
+}
+
+/* A lazy build still running reads the leaf type for the chunks it has left and for lookups
+   that reach them, so it is finished first */
+void LuleaTrieSetLeafType(LULEALEAF eLeaf)
+{
+  LuleaTrieWaitMaterialized();
+  eLeafType = eLeaf;
+}
+
+/* Applies to the next BuildLuleaTrie() */
+void LuleaTrieSetHostRoutes(int bSplit)
+{
+  bSplitHostRoutes = bSplit;
+}
+
+/* Applies to the next BuildLuleaTrie(). Builds with host routes split out are never lazy.
+   The lazy thread picks its tasks by the mode, so one that is still running is finished first. */
+void LuleaTrieSetLazy(LULEALAZY eLazy)
+{
+  LuleaTrieWaitMaterialized();
+  eLazyMode = eLazy;
+}
+
+/* Keeps a copy of the image and next hop column on every NUMA node from now on, starting
+   with the current image, and lookups walk the copy of the node their thread runs on.
+   Returns the number of replicas published, 0 when turned off or nothing is built yet. */
+unsigned int LuleaTrieSetReplication(int bEnable)
+{
+  LuleaTrieWaitMaterialized();
+  bReplicate = bEnable;
+  if (pchLuleaTrie)
+  {
+    SwapReplicas(CopyReplicas(pchLuleaTrie, uLuleaTrieSize, 1));
+  }
+
+  return buildStats.u32Replicas;
+}
+
+/* Lets lookups use pointers of uBits (16, 24 or 32) or wider, the narrowest that fits the
+   table. A sizing pass after every build picks it and packs a copy of the image for lookups,
+   the built image stays for partial rebuilds, snapshots and reports. 32, the default, walks
+   the built image. Applies to the current image right away, returns the width it got. */
+unsigned int LuleaTrieSetPointerWidth(unsigned int uBits)
+{
+  LuleaTrieWaitMaterialized();
+  uPointerBits = uBits;
+  if (pchLuleaTrie)
+  {
+    SwapReplicas(CopyReplicas(pchLuleaTrie, uLuleaTrieSize, 1));
+  }
+
+  return buildStats.u32PointerBits;
+}
+
+/* Image a lookup from this thread walks, the width of its pointers and its host routes, all
+   from one read of the set, so a lookup stays on one image while a swap goes on. A thread is
+   assumed to stay on the node it ran its first lookup on, forwarding threads are pinned. */
+static inline char *LocalImage(unsigned int *puPointerBytes, const HOSTTABLE **ppHosts)
+{
+  PLULEAREPLICAS pSet  = __atomic_load_n(&pReplicas, __ATOMIC_ACQUIRE);
+  unsigned int   uNode = 0;
+
+  if (__builtin_expect(pSet->bNuma, 0))
+  {
+    if (__builtin_expect(iThreadNode < 0, 0))
+    {
+      iThreadNode = LuleaNumaCurrentNode();
+    }
+    uNode = (unsigned int)iThreadNode < pSet->uNodes ? iThreadNode : 0;
+  }
+
+  *puPointerBytes = pSet->uPointerBytes;
+  *ppHosts        = pSet->pHosts;
+  return pSet->apchImages[uNode];
+}
+
+/* Registers the next hop column of the result table lookups index (RESULTTABLE pu32NextHop),
+   so replication copies it to every node along with the image. Copies are taken at every
+   swap, changes in between only show up in them after the next one. */
+void LuleaTrieSetNextHops(const uint32_t *pu32NextHops, unsigned int uNumResults)
+{
+  pu32ReplicaNextHops = pu32NextHops;
+  uReplicaNextHops    = uNumResults;
+}
+
+/* The column LuleaTrieSetNextHops() registered, in memory of the calling thread's node when
+   replicated. Good until the next swap, like the image, so fetch it once per batch. */
+const uint32_t *LuleaTrieLocalNextHops(void)
+{
+  PLULEAREPLICAS pSet = __atomic_load_n(&pReplicas, __ATOMIC_ACQUIRE);
+
+  if (pSet && pSet->uNextHopBytes)
+  {
+    if (iThreadNode < 0)
+    {
+      iThreadNode = LuleaNumaCurrentNode();
+    }
+    return pSet->apu32NextHops[(unsigned int)iThreadNode < pSet->uNodes ? iThreadNode : 0];
+  }
+
+  return pu32ReplicaNextHops;
+}
+
+size_t LuleaTrieHostTableBytes(void)
+{
+  return pHostTable ? (size_t)(pHostTable->u32Mask + 1) * sizeof(*pHostTable->pSlots) + HOSTROUTE_GROUPS / 8 : 0;
+}
+
+static inline uint32_t LuleaTrieWalk(char *pchImage, uint32_t u32IP)
+{
+  PLEVEL1      pImageLevel1    = (PLEVEL1)pchImage;
+  unsigned int uLow            = 0;
+  unsigned int uPointer        = 0;
+  unsigned int uShiftedBitmask = 0;
+  unsigned int uPopcount       = 0;
+  uint32_t     u32Offset       = 0;
+  PCODEWORD    pCodeWord       = &pImageLevel1->codewords[u32IP >> 20];
+  PLEVEL23     pLevel2         = NULL;
+  PLEVEL23     pLevel3         = NULL;
+
+  LULEA_STAT_LOOKUP(u32IP);
+  LULEA_TRACE_TOUCH(LULEATRACE_L1_CODEWORD, (char *)pCodeWord - pchImage, sizeof(*pCodeWord));
+
+  /* Next hop encoded directly into codeword? */
+  if (pCodeWord->u64BitmaskOffset & CODEWORD_NEXTHOP)
+  {
+    LULEA_STAT_END(LULEASTAT_L1_CODEWORD);
+    return pCodeWord->u64BitmaskOffset & 0xFFFFFFFF;
+  }
+
+  /* Continue to find correct pointer, either to next hop or next level chunk */
+  u32Offset = pCodeWord->u64BitmaskOffset & 0xFFFFFFFF;
+  uLow = (u32IP & 0x000F0000) >> 16;
+
+  uShiftedBitmask = pCodeWord->u64BitmaskOffset >> (32 + (16 - (uLow + 1)));
+  uPopcount = __builtin_popcount(uShiftedBitmask);
+  uPopcount -= (uPopcount > 0);
+  uPointer = uPopcount + u32Offset;
+  LULEA_TRACE_TOUCH(LULEATRACE_L1_POINTER, (char *)&pImageLevel1->au32Pointers[uPointer] - pchImage, sizeof(uint32_t));
+
+  /* Next hop! */
+  if (!(pImageLevel1->au32Pointers[uPointer] & POINTERTYPE_NEXTLEVEL))
+  {
+    LULEA_STAT_END(LULEASTAT_L1_POINTER);
+    return pImageLevel1->au32Pointers[uPointer];
+  }
+
+  /* Continue with next level */
+  pLevel2   = (PLEVEL23) (pchImage + (pImageLevel1->au32Pointers[uPointer] & ~POINTERTYPE_NEXTLEVEL));
+  pCodeWord = &pLevel2->codewords[(u32IP >> 12) & 0xF];
+  LULEA_TRACE_TOUCH(LULEATRACE_L2_CODEWORD, (char *)pCodeWord - pchImage, sizeof(*pCodeWord));
+
+  //printf ("Looking at level 2\n");
+  if (pCodeWord->u64BitmaskOffset & CODEWORD_NEXTHOP)
+  {
+    LULEA_STAT_END(LULEASTAT_L2_CODEWORD);
+    return pCodeWord->u64BitmaskOffset & 0xFFFFFFFF;
+  }
+
+  u32Offset = pCodeWord->u64BitmaskOffset & 0xFFFFFFFF;
+  uLow = (u32IP & 0x00000F00) >> 8;
+
+  uShiftedBitmask = pCodeWord->u64BitmaskOffset >> (32 + (16 - (uLow + 1)));
+  uPopcount = __builtin_popcount(uShiftedBitmask);
+  uPopcount -= (uPopcount > 0);
+  uPointer = uPopcount + u32Offset;
+  LULEA_TRACE_TOUCH(LULEATRACE_L2_POINTER, (char *)&pLevel2->au32Pointers[uPointer] - pchImage, sizeof(uint32_t));
+
+  if (!(pLevel2->au32Pointers[uPointer] & POINTERTYPE_NEXTLEVEL))
+  {
+    LULEA_STAT_END(LULEASTAT_L2_POINTER);
+    return pLevel2->au32Pointers[uPointer];
+  }
+
+  pLevel3 = (PLEVEL23) (pchImage + (pLevel2->au32Pointers[uPointer] & ~POINTERTYPE_NEXTLEVEL));
+  pCodeWord = &pLevel3->codewords[(u32IP >> 4) & 0xF];
+  LULEA_TRACE_TOUCH(LULEATRACE_L3_CODEWORD, (char *)pCodeWord - pchImage, sizeof(*pCodeWord));
+
+  //printf ("Looking at level 3\n");
+
+  if (pCodeWord->u64BitmaskOffset & CODEWORD_NEXTHOP)
+  {
+    LULEA_STAT_END(LULEASTAT_L3_CODEWORD);
+    return pCodeWord->u64BitmaskOffset & 0xFFFFFFFF;
+  }
+
+  u32Offset = pCodeWord->u64BitmaskOffset & 0xFFFFFFFF;
+  uLow = (u32IP & 0x0000000F);
+
+  uShiftedBitmask = pCodeWord->u64BitmaskOffset >> (32 + (16 - (uLow + 1)));
+  uPopcount = __builtin_popcount(uShiftedBitmask);
+  uPopcount -= (uPopcount > 0);
+  uPointer = uPopcount + u32Offset;
+  LULEA_TRACE_TOUCH(LULEATRACE_L3_POINTER, (char *)&pLevel3->au32Pointers[uPointer] - pchImage, sizeof(uint32_t));
+
+  if (!(pLevel3->au32Pointers[uPointer] & POINTERTYPE_NEXTLEVEL))
+  {
+    LULEA_STAT_END(LULEASTAT_L3_POINTER);
+    return pLevel3->au32Pointers[uPointer];
+  }
+
+  LULEA_STAT_END(LULEASTAT_NOT_FOUND);
+  return NO_NEXT_HOP;
+}
+
+/* LuleaTrieWalk() for an image with uBytes wide packed pointers. Always inlined with a
+   constant width, so every width gets its own loop. */
+static inline __attribute__((always_inline)) uint32_t PackedWalk(const char *pchImage, uint32_t u32IP, unsigned int uBytes)
+{
+  const CODEWORD *pCodewords  = ((const LEVEL1 *)pchImage)->codewords;
+  const char     *pchPointers = pchImage + sizeof(LEVEL1);
+  unsigned int    uCodeword   = u32IP >> 20;
+  unsigned int    uShift      = 16;
+  unsigned int    uLevel      = 0;
+
+  LULEA_STAT_LOOKUP(u32IP);
+
+  for (uLevel = 0; uLevel < 3; uLevel++, uShift -= 8)
+  {
+    uint64_t     u64Codeword = pCodewords[uCodeword].u64BitmaskOffset;
+    unsigned int uLow        = (u32IP >> uShift) & 0xF;
+    unsigned int uPopcount   = 0;
+    unsigned int uPointer    = 0;
+    uint32_t     u32Packed   = 0;
+    const char  *pchChunk    = NULL;
+
+    LULEA_TRACE_TOUCH(LULEATRACE_L1_CODEWORD + 2 * uLevel, (const char *)&pCodewords[uCodeword] - pchImage, sizeof(CODEWORD));
+    if (u64Codeword & CODEWORD_NEXTHOP)
+    {
+      LULEA_STAT_END(LULEASTAT_L1_CODEWORD + 2 * uLevel);
+      return u64Codeword & 0xFFFFFFFF;
+    }
+
+    uPopcount  = __builtin_popcount(u64Codeword >> (32 + (16 - (uLow + 1))));
+    uPopcount -= (uPopcount > 0);
+    uPointer   = uPopcount + (u64Codeword & 0xFFFFFFFF);
+    LULEA_TRACE_TOUCH(LULEATRACE_L1_POINTER + 2 * uLevel, pchPointers + uPointer * uBytes - pchImage, uBytes);
+
+    memcpy(&u32Packed, pchPointers + uPointer * uBytes, uBytes == 2 ? 2 : 4);
+    u32Packed &= PACKED_NEXTLEVEL(uBytes) | PACKED_NO_ROUTE(uBytes);
+
+    if (!(u32Packed & PACKED_NEXTLEVEL(uBytes)))
+    {
+      LULEA_STAT_END(LULEASTAT_L1_POINTER + 2 * uLevel);
+      return u32Packed == PACKED_NO_ROUTE(uBytes) ? NO_NEXT_HOP : u32Packed;
+    }
+    if (uLevel == 2)
+    {
+      break;
+    }
+
+    pchChunk    = pchImage + (size_t)(u32Packed & PACKED_NO_ROUTE(uBytes)) * 8;
+    pCodewords  = ((const LEVEL23 *)pchChunk)->codewords;
+    pchPointers = pchChunk + sizeof(LEVEL23);
+    uCodeword   = (u32IP >> (uShift - 4)) & 0xF;
+  }
+
+  LULEA_STAT_END(LULEASTAT_NOT_FOUND);
+  return NO_NEXT_HOP;
+}
+
+static inline uint32_t LookupInImage(char *pchImage, unsigned int uPointerBytes, const HOSTTABLE *pHosts, uint32_t u32IP)
+{
+  PHOSTROUTE pSlot     = NULL;
+  uint32_t   u32Result = 0;
+
+  LULEA_TRACE_BEGIN(u32IP);
+
+  /* Only addresses in a /16 with host routes probe the table, and the probe's cache miss
+     overlaps with the trie walk */
+  if (__builtin_expect(pHosts != NULL, 0) &&
+      (pHosts->pu64Groups[u32IP >> 22] & (1ULL << ((u32IP >> 16) & 63))))
+  {
+    pSlot = &pHosts->pSlots[HOSTROUTE_SLOT(pHosts, u32IP)];
+    __builtin_prefetch(pSlot);
+  }
+
+  switch (uPointerBytes)
+  {
+    case 2:
+      u32Result = PackedWalk(pchImage, u32IP, 2);
+      break;
+    case 3:
+      u32Result = PackedWalk(pchImage, u32IP, 3);
+      break;
+    default:
+      u32Result = LuleaTrieWalk(pchImage, u32IP);
+      break;
+  }
+  if (__builtin_expect(u32Result == LULEA_PENDING, 0))
+  {
+    LULEA_TRACE_END();
+    return LazyLookup(u32IP);
+  }
+
+  if (pSlot)
+  {
+    LULEA_TRACE_TOUCH(LULEATRACE_HOST_ROUTE, (pSlot - pHosts->pSlots) * sizeof(*pSlot), sizeof(*pSlot));
+    while (pSlot->u32Value != HOSTROUTE_EMPTY)
+    {
+      if (pSlot->u32Address == u32IP)
+      {
+        u32Result = pSlot->u32Value;
+        break;
+      }
+      pSlot = &pHosts->pSlots[(pSlot - pHosts->pSlots + 1) & pHosts->u32Mask];
+      LULEA_TRACE_TOUCH(LULEATRACE_HOST_ROUTE, (pSlot - pHosts->pSlots) * sizeof(*pSlot), sizeof(*pSlot));
+    }
+  }
+
+  if (u32Result != NO_NEXT_HOP)
+  {
+    LULEA_TRACE_TOUCH(LULEATRACE_NEXT_HOP, u32Result, RESULT_TABLE_NEXT_HOP_BYTES);
+  }
+  LULEA_TRACE_END();
+
+  return u32Result;
+}
+
+/* Returns the value stored in the trie for u32IP: the result index of the prefix (also its
+   index in pNextHops), or a path list or group ID, depending on the leaf type the trie was
+   built with. NO_NEXT_HOP if there is none. */
+uint32_t LuleaTrieLookup(uint32_t u32IP)
+{
+  unsigned int     uPointerBytes = 4;
+  const HOSTTABLE *pHosts        = NULL;
+  char            *pchImage      = LocalImage(&uPointerBytes, &pHosts);
+
+  return LookupInImage(pchImage, uPointerBytes, pHosts, u32IP);
+}
+
+/* LuleaTrieLookup() on the replica of uNode whichever node the caller runs on, to measure
+   remote lookups. Without replicas it is the same as LuleaTrieLookup(). */
+uint32_t LuleaTrieLookupOnNode(unsigned int uNode, uint32_t u32IP)
+{
+  PLULEAREPLICAS pSet = __atomic_load_n(&pReplicas, __ATOMIC_ACQUIRE);
+
+  return LookupInImage(pSet->apchImages[uNode < pSet->uNodes ? uNode : 0], pSet->uPointerBytes, pSet->pHosts, u32IP);
+}
+
+
+/* How many lookups ahead to prefetch the level 1 codeword */
+#define LOOKUP_PREFETCH_DISTANCE (8)
+
+void LuleaTrieLookupBatch(const uint32_t *pu32IPs, uint32_t *pu32Results, unsigned int uCount)
+{
+  unsigned int     uIndex        = 0;
+  unsigned int     uPointerBytes = 4;
+  const HOSTTABLE *pHosts        = NULL;
+  char            *pchImage      = LocalImage(&uPointerBytes, &pHosts);
+  PLEVEL1          pLocal        = (PLEVEL1)pchImage;
+
+  /* The whole batch goes to one image, a swap meanwhile is picked up by the next batch */
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    if (uIndex + LOOKUP_PREFETCH_DISTANCE < uCount)
+    {
+      __builtin_prefetch(&pLocal->codewords[pu32IPs[uIndex + LOOKUP_PREFETCH_DISTANCE] >> 20]);
+    }
+
+    pu32Results[uIndex] = LookupInImage(pchImage, uPointerBytes, pHosts, pu32IPs[uIndex]);
+  }
+}
+
+/* LuleaTrieLookup() behind the calling thread's destination cache. A cache filled before the
+   trie was rebuilt or swapped is flushed on the next lookup. Pays off once traffic is skewed
+   enough to hit, with uniform traffic it only adds the probe, see lulea_bench. */
+uint32_t LuleaTrieLookupCached(uint32_t u32IP)
+{
+  PLULEACACHE    pCache     = pLuleaThreadCache;
+  PLULEACACHESET pSet       = NULL;
+  uint32_t       u32Result  = 0;
+  uint32_t       u32Current = 0;
+
+  if (__builtin_expect(!pCache, 0))
+  {
+    pCache = LuleaCacheRegisterThread();
+  }
+
+  /* Acquire pairs with the bump after a build or swap, so once the new generation is seen
+     the lookups below walk the new table */
+  u32Current = __atomic_load_n(&u32Generation, __ATOMIC_ACQUIRE);
+  if (__builtin_expect(pCache->u32Generation != u32Current, 0))
+  {
+    LuleaCacheFlush(pCache, u32Current);
+  }
+
+  __atomic_store_n(&pCache->u64Lookups, pCache->u64Lookups + 1, __ATOMIC_RELAXED);
+  pSet = &pCache->aSets[LULEA_CACHE_SET(u32IP)];
+
+  if (pSet->au32Keys[0] == u32IP && pSet->au32Results[0] != LULEA_CACHE_EMPTY)
+  {
+    __atomic_store_n(&pCache->u64Hits, pCache->u64Hits + 1, __ATOMIC_RELAXED);
+    return pSet->au32Results[0];
+  }
+
+  if (pSet->au32Keys[1] == u32IP && pSet->au32Results[1] != LULEA_CACHE_EMPTY)
+  {
+    __atomic_store_n(&pCache->u64Hits, pCache->u64Hits + 1, __ATOMIC_RELAXED);
+    u32Result = pSet->au32Results[1];
+  }
+  else
+  {
+    u32Result = LuleaTrieLookup(u32IP);
+  }
+
+  /* Move to the front, a miss evicts way 1 */
+  pSet->au32Keys[1]    = pSet->au32Keys[0];
+  pSet->au32Results[1] = pSet->au32Results[0];
+  pSet->au32Keys[0]    = u32IP;
+  pSet->au32Results[0] = u32Result;
+
+  return u32Result;
+}
+
+void LuleaTrieLookupCachedBatch(const uint32_t *pu32IPs, uint32_t *pu32Results, unsigned int uCount)
+{
+  unsigned int uIndex = 0;
+
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    pu32Results[uIndex] = LuleaTrieLookupCached(pu32IPs[uIndex]);
+  }
+}
+
+/* For a trie built with LULEALEAF_GROUP leaves: the adjacency the flow hash picks from the
+   ECMP group of the matching prefix, or NO_ADJACENCY */
+uint32_t LuleaTrieLookupFlow(uint32_t u32IP, uint32_t u32FlowHash)
+{
+  uint32_t u32Group = LuleaTrieLookup(u32IP);
+
+  return u32Group == NO_NEXT_HOP ? NO_ADJACENCY : NextHopGroupMember(u32Group, u32FlowHash);
+}
+
+void LuleaTrieLookupFlowBatch(const uint32_t *pu32IPs, const uint32_t *pu32FlowHashes, uint32_t *pu32Adjacencies,
+                              unsigned int uCount)
+{
+  unsigned int     uIndex        = 0;
+  unsigned int     uPointerBytes = 4;
+  const HOSTTABLE *pHosts        = NULL;
+  char            *pchImage      = LocalImage(&uPointerBytes, &pHosts);
+  PLEVEL1          pLocal        = (PLEVEL1)pchImage;
+
+  /* One image for the whole batch, the one the prefetches go to, like LuleaTrieLookupBatch() */
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    uint32_t u32Group = 0;
+
+    if (uIndex + LOOKUP_PREFETCH_DISTANCE < uCount)
+    {
+      __builtin_prefetch(&pLocal->codewords[pu32IPs[uIndex + LOOKUP_PREFETCH_DISTANCE] >> 20]);
+    }
+
+    u32Group = LookupInImage(pchImage, uPointerBytes, pHosts, pu32IPs[uIndex]);
+    pu32Adjacencies[uIndex] = u32Group == NO_NEXT_HOP ? NO_ADJACENCY : NextHopGroupMember(u32Group, pu32FlowHashes[uIndex]);
+  }
 }
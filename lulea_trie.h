@@ -19,6 +19,7 @@
 #define __LULEA_TRIE_H__
 
 #include <stdint.h>
+#include <stddef.h>
 #include "routing_table_split.h"
 
 typedef struct tagBUCKET
@@ -66,7 +67,80 @@ typedef struct tagBUILDTASK
 
 } BUILDTASK, *PBUILDTASK;
 
+typedef struct tagLULEABUILDSTATS
+{
+  /* Indexed by level - 1 */
+  uint32_t au32Chunks[3];
+  uint32_t au32Pointers[3];
+  uint32_t au32Codewords[3];
+  uint32_t au32DirectCodewords[3]; /* Codewords with CODEWORD_NEXTHOP set, no pointers needed */
+  uint64_t u64ImageBytes;
+  uint32_t u32HostRoutes;      /* /32 prefixes kept in the host route table instead of the trie */
+  uint64_t u64HostTableBytes;  /* Host route slots and the /16 bitmap, not part of the image */
+  uint32_t u32GroupsRebuilt;   /* Level 1 bucket groups a partial rebuild recompiled */
+  uint32_t u32ChunksCopied;    /* Level 2 and 3 chunks it copied from the previous image */
+  uint32_t u32LazyChunks;      /* Level 2 chunks a lazy build left for later, with their level 3 chunks */
+  uint32_t u32LazyTouched;     /* Of those, compiled early because lookups hit them */
+  uint64_t u64LazySlowLookups; /* Lookups answered from the radix tree meanwhile */
+  uint32_t u32Replicas;        /* NUMA nodes holding a copy of the image, 0 unless replicated */
+  uint64_t u64ReplicaBytes;    /* All copies of the image and next hop column together */
+  uint32_t u32PointerBits;     /* Pointer width lookups use, see LuleaTrieSetPointerWidth() */
+  uint64_t au64PackedBytes[3]; /* Image size with 16, 24 and 32 bit pointers, only sized when narrower
+                                  pointers are allowed */
+  int      abPackedFits[3];    /* Whether the table fits each width, its size means nothing where it doesn't */
+} LULEABUILDSTATS, *PLULEABUILDSTATS;
+
+typedef enum tagLULEALEAF
+{
+  LULEALEAF_PREFIX = 0,  /* Leaves index the pNextHops array */
+  LULEALEAF_PATHLIST,    /* Leaves hold the path list ID of the prefix, see nexthop.h */
+  LULEALEAF_GROUP        /* Leaves hold the ECMP group ID of the prefix */
+} LULEALEAF;
+
+typedef enum tagLULEALAZY
+{
+  LULEALAZY_OFF = 0,     /* Every chunk is compiled before BuildLuleaTrie() returns */
+  LULEALAZY_BACKGROUND,  /* Level 1 only, a thread compiles the rest, hottest first */
+  LULEALAZY_TOUCH        /* Level 1 only, the thread only compiles chunks lookups hit */
+} LULEALAZY;
+
+/* Walk result for addresses under a level 2 chunk that isn't compiled yet. Leaves have 31
+   bits, so it can't be a real one. */
+#define LULEA_PENDING (0xFFFFFFFEU)
+
+/* Host routes split out of the trie by LuleaTrieSetHostRoutes(1), found by open addressing
+   with linear probing. A bit per /16 tells lookups which addresses can have one. */
+typedef struct tagHOSTROUTE
+{
+  uint32_t u32Address;
+  uint32_t u32Value;   /* Leaf value, same as the trie would have stored */
+} HOSTROUTE, *PHOSTROUTE;
+
+/* Trie values never have the next level pointer bit set, except NO_NEXT_HOP, so it marks empty slots */
+#define HOSTROUTE_EMPTY (POINTERTYPE_NEXTLEVEL)
+
+void LuleaTrieSetLeafType(LULEALEAF eLeaf);
+void LuleaTrieSetHostRoutes(int bSplit);
+size_t LuleaTrieHostTableBytes(void);
+void LuleaTrieSetLazy(LULEALAZY eLazy);
+void LuleaTrieWaitMaterialized(void);
+unsigned int LuleaTrieSetReplication(int bEnable);
+unsigned int LuleaTrieSetPointerWidth(unsigned int uBits);
+void LuleaTrieSetNextHops(const uint32_t *pu32NextHops, unsigned int uNumResults);
+const uint32_t *LuleaTrieLocalNextHops(void);
 int BuildLuleaTrie(PTREENODE pTreeRoot, PROUTEENTRY pNextHops, unsigned int uNumPrefixes);
-PROUTEENTRY LuleaTrieLookup(uint32_t u32IP, PROUTEENTRY pNextHops);
+int LuleaTrieRebuildGroups(PTREENODE pTreeRoot, PROUTEENTRY pNextHops, unsigned int uNumPrefixes, const uint64_t *pu64Groups);
+uint32_t LuleaTrieLookup(uint32_t u32IP);
+uint32_t LuleaTrieLookupOnNode(unsigned int uNode, uint32_t u32IP);
+void LuleaTrieLookupBatch(const uint32_t *pu32IPs, uint32_t *pu32Results, unsigned int uCount);
+uint32_t LuleaTrieLookupCached(uint32_t u32IP);
+void LuleaTrieLookupCachedBatch(const uint32_t *pu32IPs, uint32_t *pu32Results, unsigned int uCount);
+uint32_t LuleaTrieLookupFlow(uint32_t u32IP, uint32_t u32FlowHash);
+void LuleaTrieLookupFlowBatch(const uint32_t *pu32IPs, const uint32_t *pu32FlowHashes, uint32_t *pu32Adjacencies,
+                              unsigned int uCount);
+void LuleaTrieGetBuildStats(PLULEABUILDSTATS pStats);
+char *LuleaTrieImage(size_t *puSize);
+void LuleaTrieSetImage(char *pchImage, size_t uSize);
+uint32_t LuleaTrieGeneration(void);
 
 #endif /* __LULEA_TRIE_H__ */
\ No newline at end of file
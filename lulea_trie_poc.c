@@ -0,0 +1,384 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "routing_table_split.h"
+#include "read_bgp.h"
+#include "lulea_trie.h"
+#include "benchmark.h"
+#include "profile.h"
+#include "lulea_stats.h"
+#include "result_table.h"
+#include "lulea_snapshot.h"
+#include "lulea_report.h"
+#include "verify.h"
+#include "lulea_shm.h"
+
+static PROUTEENTRY  pNextHops;   /* Next hop array */
+static RESULTTABLE  results;     /* What lookups index, without the build time fields */
+
+void QueryTree(PRESULTTABLE pResults)
+{
+  char achBuffer[256];
+  struct in_addr ipAddr;
+  uint32_t u32IP;
+  uint32_t u32Result;
+
+
+  printf("Enter IPv4 to query for route:\n");
+
+  while (1)
+  {
+    fgets(achBuffer, sizeof(achBuffer), stdin);
+    achBuffer[255] = '\0';
+
+    if (!strcmp(achBuffer, "quit"))
+    {
+      exit(EXIT_SUCCESS);
+    }
+
+    inet_aton(achBuffer, &ipAddr);
+    u32IP = ntohl(ipAddr.s_addr);
+
+#ifdef DEBUG
+    PROUTEENTRY pRoute = LookupInTree(u32IP);
+    if (pRoute)
+    {
+      printf ("Tree: Found route of size %u!\n", pRoute->u32Size);
+      PrintIP(pRoute->u32Start);
+    }
+    else
+    {
+      printf("Tree: Did not find route!\n");
+    }
+#endif
+
+    u32Result = LuleaTrieLookup(u32IP);
+    if (u32Result != NO_NEXT_HOP)
+    {
+      printf ("Luleå: Found route /%u!\n", pResults->pu8Length[u32Result]);
+      PrintIP(pResults->pu32Start[u32Result]);
+    }
+    else
+    {
+      printf("Luleå: Did not find route!\n");
+    }
+
+  }
+}
+
+#define BENCHMARK_IPS (100000)
+void Benchmark(void)
+{
+  struct       timespec  sooner;
+  struct       timespec  later;
+  struct       timespec  diff;
+  uint32_t    *pu32IPs = NULL;
+  unsigned int uIndex  = 0;
+  unsigned int uCount  = BENCHMARK_IPS;
+
+
+  /* rand() only gives 31 bits, so use the benchmark generator to cover the whole address space.
+     See lulea_bench for the full benchmark suite. */
+  pu32IPs = BenchGenerateAddresses(BENCHDIST_UNIFORM, &uCount, NULL, 0, 0, NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  for (uIndex = 0; uIndex < BENCHMARK_IPS; uIndex++)
+  {
+    LookupInTree(pu32IPs[uIndex]);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &later);
+  timediff(&sooner, &later, &diff);
+  printf("Benchmark: %d Lookups in radix trie took %ld sec %ld nanosec\n", BENCHMARK_IPS, diff.tv_sec, diff.tv_nsec);
+
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  for (uIndex = 0; uIndex < BENCHMARK_IPS; uIndex++)
+  {
+    LuleaTrieLookup(pu32IPs[uIndex]);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &later);
+  timediff(&sooner, &later, &diff);
+  printf("Benchmark: %d Lookups in luleå trie took %ld sec %ld nanosec\n", BENCHMARK_IPS, diff.tv_sec, diff.tv_nsec);
+
+  free(pu32IPs);
+}
+
+void ProfileBuildCounters(void)
+{
+  LULEABUILDSTATS stats;
+
+  LuleaTrieGetBuildStats(&stats);
+
+  ProfileCounter("level1_pointers", stats.au32Pointers[0]);
+  ProfileCounter("level1_direct_codewords", stats.au32DirectCodewords[0]);
+  ProfileCounter("level2_chunks", stats.au32Chunks[1]);
+  ProfileCounter("level2_pointers", stats.au32Pointers[1]);
+  ProfileCounter("level2_direct_codewords", stats.au32DirectCodewords[1]);
+  ProfileCounter("level3_chunks", stats.au32Chunks[2]);
+  ProfileCounter("level3_pointers", stats.au32Pointers[2]);
+  ProfileCounter("level3_direct_codewords", stats.au32DirectCodewords[2]);
+  ProfileCounter("image_bytes", stats.u64ImageBytes);
+}
+
+int main(int argc, char **argv)
+{
+  PPREFIXES pPrefixes = NULL;
+  uint32_t  u32Index  = 0;
+  char     *pszProfile = NULL;
+  char     *pszReport  = NULL;
+  char     *pszSnapshot = NULL;
+  char     *pszVerify  = NULL;
+  char     *pszShm     = NULL;
+  char     *pszLazy    = NULL;
+  unsigned int uPointerBits = 32;
+  int       iOption    = 0;
+  struct    timespec  sooner;
+  struct    timespec  later;
+  struct    timespec  diff;
+  struct    timespec  buildStart;
+
+  while ((iOption = getopt(argc, argv, "L:M:P:R:S:V:W:")) != -1)
+  {
+    switch (iOption)
+    {
+      case 'L':
+        pszLazy = optarg;
+        break;
+      case 'M':
+        pszShm = optarg;
+        break;
+      case 'P':
+        pszProfile = optarg;
+        break;
+      case 'R':
+        pszReport = optarg;
+        break;
+      case 'S':
+        pszSnapshot = optarg;
+        break;
+      case 'V':
+        pszVerify = optarg;
+        break;
+      case 'W':
+        uPointerBits = strtoul(optarg, NULL, 0);
+        break;
+      default:
+        optind = argc;
+        break;
+    }
+  }
+
+#ifdef DEBUG
+  /* Debug builds always check the trie against the radix tree */
+  if (!pszVerify)
+  {
+    pszVerify = "ranges";
+  }
+#endif
+
+  if (pszVerify && strcmp(pszVerify, "ranges") && strcmp(pszVerify, "full"))
+  {
+    optind = argc;
+  }
+  if (pszLazy && strcmp(pszLazy, "background") && strcmp(pszLazy, "touch"))
+  {
+    optind = argc;
+  }
+  if (uPointerBits != 16 && uPointerBits != 24 && uPointerBits != 32)
+  {
+    optind = argc;
+  }
+
+  if (optind >= argc)
+  {
+    printf("Usage: %s [-L background|touch] [-M <name>] [-P <profile.json>] [-R <report.json>] [-S <snapshot>] [-V ranges|full] [-W 16|24|32] <bgp dump file>\n", argv[0]);
+    printf("  -L background  publish level 1 first, a thread compiles level 2 and 3, chunks lookups hit first\n");
+    printf("  -L touch       publish level 1 first, only compile the chunks lookups hit until the end\n");
+    printf("  -M <name>  publish the luleå trie in POSIX shared memory, lulea_inspect -M reads it\n");
+    printf("  -P <file>  write build phase profile as JSON, compare runs with lulea_profile\n");
+    printf("  -R <file>  write memory breakdown of the luleå trie as JSON\n");
+    printf("  -S <file>  save the luleå trie, lulea_inspect reports on saved snapshots\n");
+    printf("  -V ranges  verify the luleå trie against the radix tree at every range boundary\n");
+    printf("  -V full    verify all 2^32 addresses, using one thread per core\n");
+    printf("  -W <bits>  let lookups use the narrowest pointers of at least 16 or 24 bits that fit (default 32)\n");
+    exit(1);
+  }
+
+  printf("Reading BGP from file\n");
+  pPrefixes = ReadFromBgpDump(argv[optind]);
+  printf("done..\n");
+
+  for (u32Index = 32; u32Index != UINT32_MAX; u32Index--)
+  {
+    printf("%u prefixes at level %u\n", pPrefixes->uNumPrefixes[u32Index], u32Index);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  /* Insert routes from linked lists into radix tree. */
+  pNextHops = BuildPrefixTree(pPrefixes);
+  clock_gettime(CLOCK_MONOTONIC, &later);
+  timediff(&sooner, &later, &diff);
+  printf("Building radix took %ld sec %ld nanosec\n", diff.tv_sec, diff.tv_nsec);
+
+  ResultTableBuild(&results, pNextHops, pPrefixes->uTotalPrefixes);
+  printf("Result table is %zu bytes, next hop array %zu bytes\n", ResultTableBytes(&results),
+         (size_t)pPrefixes->uTotalPrefixes * sizeof(*pNextHops));
+
+  LuleaTrieSetPointerWidth(uPointerBits);
+  if (pszLazy)
+  {
+    LuleaTrieSetLazy(!strcmp(pszLazy, "touch") ? LULEALAZY_TOUCH : LULEALAZY_BACKGROUND);
+  }
+
+  printf("Building luleå trie now..\n");
+  clock_gettime(CLOCK_MONOTONIC, &sooner);
+  buildStart = sooner;
+  BuildLuleaTrie(&root, pNextHops, pPrefixes->uTotalPrefixes);
+  clock_gettime(CLOCK_MONOTONIC, &later);
+  printf("done.\n");
+  timediff(&sooner, &later, &diff);
+  printf("Building luleå trie took %ld sec %ld nanosec\n", diff.tv_sec, diff.tv_nsec);
+
+  if (uPointerBits < 32 && !pszLazy)
+  {
+    LULEABUILDSTATS stats;
+    unsigned int    uWidth = 0;
+
+    LuleaTrieGetBuildStats(&stats);
+    printf("Lookups use %u bit pointers. Image bytes by pointer width:", stats.u32PointerBits);
+    for (uWidth = 0; uWidth < 3; uWidth++)
+    {
+      if (stats.abPackedFits[uWidth])
+      {
+        printf(" %u bits %llu", 16 + uWidth * 8, (unsigned long long)stats.au64PackedBytes[uWidth]);
+      }
+      else
+      {
+        printf(" %u bits doesn't fit", 16 + uWidth * 8);
+      }
+      printf("%s", uWidth < 2 ? "," : "");
+    }
+    printf("\n");
+  }
+
+  if (pszReport)
+  {
+    LULEAREPORT  report;
+    FILE        *pFile       = fopen(pszReport, "w");
+    char        *pchImage    = NULL;
+    size_t       uImageBytes = 0;
+
+    if (!pFile)
+    {
+      printf("Could not open %s for writing\n", pszReport);
+      exit(1);
+    }
+    pchImage = LuleaTrieImage(&uImageBytes);
+    LuleaTrieIntrospect(pchImage, uImageBytes, results.uNumResults, RESULT_TABLE_ENTRY_BYTES, &report);
+    LuleaReportWriteJson(pFile, &report);
+    fclose(pFile);
+  }
+
+  if (pszSnapshot && !LuleaSnapshotSave(pszSnapshot, &results))
+  {
+    exit(1);
+  }
+
+  if (pszShm && !LuleaShmPublish(pszShm, &results))
+  {
+    exit(1);
+  }
+
+  Benchmark();
+#ifdef LULEA_STATS
+  {
+    LULEASTATS stats;
+
+    LuleaStatsSnapshot(&stats);
+    LuleaStatsDumpHeatMap(stdout, &stats);
+  }
+#endif
+
+  if (pszVerify)
+  {
+    uint64_t u64Mismatches = 0;
+
+    printf("Starting luleå trie verification now..\n");
+    if (!strcmp(pszVerify, "full"))
+    {
+      u64Mismatches = VerifyExhaustive(LookupEngineFind("lulea"), stdout, &root, pNextHops, 0, VERIFY_DEFAULT_REPORT);
+    }
+    else
+    {
+      u64Mismatches = VerifyRanges(LookupEngineFind("lulea"), stdout, &root, pNextHops, VERIFY_DEFAULT_REPORT);
+    }
+
+    if (u64Mismatches)
+    {
+      exit(2);
+    }
+  }
+
+  if (pszLazy)
+  {
+    LULEABUILDSTATS stats;
+
+    /* Lookups so far may have gone through the radix tree, check the compiled image too */
+    LuleaTrieWaitMaterialized();
+    clock_gettime(CLOCK_MONOTONIC, &later);
+    timediff(&buildStart, &later, &diff);
+    LuleaTrieGetBuildStats(&stats);
+    printf("All %u level 2 chunks compiled after %ld sec %ld nanosec, %u of them because lookups hit them first,"
+           " %llu lookups answered by the radix tree\n", stats.u32LazyChunks, diff.tv_sec, diff.tv_nsec,
+           stats.u32LazyTouched, (unsigned long long)stats.u64LazySlowLookups);
+
+    if (pszVerify && VerifyRanges(LookupEngineFind("lulea"), stdout, &root, pNextHops, VERIFY_DEFAULT_REPORT))
+    {
+      exit(2);
+    }
+  }
+
+#ifndef DEBUG
+  FreePrefixTree();
+#endif
+
+  if (pszProfile)
+  {
+    FILE *pFile = fopen(pszProfile, "w");
+
+    if (!pFile)
+    {
+      printf("Could not open %s for writing\n", pszProfile);
+      exit(1);
+    }
+    ProfileBuildCounters();
+    ProfileWriteJson(pFile);
+    fclose(pFile);
+  }
+
+  QueryTree(&results);
+}
\ No newline at end of file
@@ -0,0 +1,349 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nexthop.h"
+
+#define NEXTHOP_MAX_PEERS (65536)   /* Peer index in TABLE_DUMP_V2 is 16 bits */
+
+static PADJACENCY    pAdjacencies     = NULL;
+static unsigned int  uNumAdjacencies  = 0;
+static unsigned int  uMaxAdjacencies  = 0;
+static PPATHLIST     pPathLists       = NULL;
+static unsigned int  uNumPathLists    = 0;
+static unsigned int  uMaxPathLists    = 0;
+static uint32_t     *pu32PeerFirst    = NULL;   /* First adjacency of every peer */
+PECMPGROUP           pEcmpGroups      = NULL;
+static unsigned int  uNumGroups       = 0;
+static unsigned int  uMaxGroups       = 0;
+
+/* Open addressing hash tables of adjacency and path list indexes, only used while adding */
+static uint32_t     *pu32AdjacencyHash = NULL;
+static unsigned int  uAdjacencyHashSize = 0;
+static uint32_t     *pu32PathListHash  = NULL;
+static unsigned int  uPathListHashSize = 0;
+static uint32_t     *pu32GroupHash     = NULL;
+static unsigned int  uGroupHashSize    = 0;
+
+static uint32_t HashWords(const uint32_t *pu32Words, unsigned int uCount)
+{
+  uint64_t     u64Hash = 0x9E3779B97F4A7C15ULL;
+  unsigned int uIndex  = 0;
+
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    u64Hash = (u64Hash ^ pu32Words[uIndex]) * 0xBF58476D1CE4E5B9ULL;
+    u64Hash ^= u64Hash >> 31;
+  }
+
+  return (uint32_t)u64Hash;
+}
+
+static void *Grow(void *pArray, unsigned int *puMax, size_t uElementSize)
+{
+  *puMax = *puMax ? *puMax * 2 : 1024;
+  pArray = realloc(pArray, *puMax * uElementSize);
+  if (!pArray)
+  {
+    printf("Can't allocate next hop tables\n");
+    exit(1);
+  }
+
+  return pArray;
+}
+
+static uint32_t AdjacencyHash(uint32_t u32Peer, uint32_t u32Gateway)
+{
+  uint32_t au32Key[2] = { u32Peer, u32Gateway };
+
+  return HashWords(au32Key, 2);
+}
+
+static uint32_t HashAdjacency(unsigned int uIndex)
+{
+  return AdjacencyHash(pAdjacencies[uIndex].u32Peer, pAdjacencies[uIndex].u32Gateway);
+}
+
+static uint32_t HashPathList(unsigned int uIndex)
+{
+  return HashWords(pPathLists[uIndex].au32Adjacencies, pPathLists[uIndex].u32NumPaths);
+}
+
+static uint32_t HashGroup(unsigned int uIndex)
+{
+  uint32_t     au32Members[ECMP_MAX_MEMBERS];
+  unsigned int uMember = 0;
+
+  for (uMember = 0; uMember < pEcmpGroups[uIndex].u16NumMembers; uMember++)
+  {
+    au32Members[uMember] = pEcmpGroups[uIndex].au16Members[uMember];
+  }
+
+  return HashWords(au32Members, pEcmpGroups[uIndex].u16NumMembers);
+}
+
+/* Rebuilds a hash table with twice the size when it gets half full */
+static void Rehash(uint32_t **ppu32Hash, unsigned int *puSize, unsigned int uEntries, uint32_t (*fpHash)(unsigned int))
+{
+  unsigned int uIndex = 0;
+
+  if (*ppu32Hash && uEntries * 2 < *puSize)
+  {
+    return;
+  }
+
+  free(*ppu32Hash);
+  *puSize    = *puSize ? *puSize * 2 : 4096;
+  *ppu32Hash = malloc(*puSize * sizeof(**ppu32Hash));
+  if (!*ppu32Hash)
+  {
+    printf("Can't allocate next hop hash table\n");
+    exit(1);
+  }
+  memset(*ppu32Hash, 0xFF, *puSize * sizeof(**ppu32Hash));
+
+  for (uIndex = 0; uIndex < uEntries; uIndex++)
+  {
+    uint32_t u32Slot = fpHash(uIndex) & (*puSize - 1);
+
+    while ((*ppu32Hash)[u32Slot] != UINT32_MAX)
+    {
+      u32Slot = (u32Slot + 1) & (*puSize - 1);
+    }
+    (*ppu32Hash)[u32Slot] = uIndex;
+  }
+}
+
+uint32_t NextHopAddAdjacency(uint32_t u32Peer, uint32_t u32Gateway)
+{
+  uint32_t u32Slot = 0;
+
+  if (u32Peer >= NEXTHOP_MAX_PEERS)
+  {
+    printf("Peer index %u out of range\n", u32Peer);
+    exit(1);
+  }
+
+  if (!pu32PeerFirst)
+  {
+    pu32PeerFirst = malloc(NEXTHOP_MAX_PEERS * sizeof(*pu32PeerFirst));
+    if (!pu32PeerFirst)
+    {
+      printf("Can't allocate peer table\n");
+      exit(1);
+    }
+    memset(pu32PeerFirst, 0xFF, NEXTHOP_MAX_PEERS * sizeof(*pu32PeerFirst));
+  }
+
+  Rehash(&pu32AdjacencyHash, &uAdjacencyHashSize, uNumAdjacencies, HashAdjacency);
+
+  u32Slot = AdjacencyHash(u32Peer, u32Gateway) & (uAdjacencyHashSize - 1);
+  while (pu32AdjacencyHash[u32Slot] != UINT32_MAX)
+  {
+    PADJACENCY pAdjacency = &pAdjacencies[pu32AdjacencyHash[u32Slot]];
+
+    if (pAdjacency->u32Peer == u32Peer && pAdjacency->u32Gateway == u32Gateway)
+    {
+      return pu32AdjacencyHash[u32Slot];
+    }
+    u32Slot = (u32Slot + 1) & (uAdjacencyHashSize - 1);
+  }
+
+  if (uNumAdjacencies == uMaxAdjacencies)
+  {
+    pAdjacencies = Grow(pAdjacencies, &uMaxAdjacencies, sizeof(*pAdjacencies));
+  }
+
+  pAdjacencies[uNumAdjacencies].u32Gateway    = u32Gateway;
+  pAdjacencies[uNumAdjacencies].u32Peer       = u32Peer;
+  pAdjacencies[uNumAdjacencies].u32Up         = 1;
+  pAdjacencies[uNumAdjacencies].u32NextOfPeer = pu32PeerFirst[u32Peer];
+  pu32PeerFirst[u32Peer]      = uNumAdjacencies;
+  pu32AdjacencyHash[u32Slot]  = uNumAdjacencies;
+
+  return uNumAdjacencies++;
+}
+
+/* Returns the ID of the path list with these adjacencies, in this order, adding it if it is new.
+   A prefix without usable paths still gets a (empty) path list, which resolves to no adjacency. */
+uint32_t NextHopAddPathList(const uint32_t *pu32Adjacencies, unsigned int uNumPaths)
+{
+  PATHLIST pathList = { 0 };
+  uint32_t u32Slot  = 0;
+
+  pathList.u32NumPaths = uNumPaths < NEXTHOP_MAX_PATHS ? uNumPaths : NEXTHOP_MAX_PATHS;
+  memcpy(pathList.au32Adjacencies, pu32Adjacencies, pathList.u32NumPaths * sizeof(*pu32Adjacencies));
+
+  Rehash(&pu32PathListHash, &uPathListHashSize, uNumPathLists, HashPathList);
+
+  u32Slot = HashWords(pathList.au32Adjacencies, pathList.u32NumPaths) & (uPathListHashSize - 1);
+  while (pu32PathListHash[u32Slot] != UINT32_MAX)
+  {
+    if (!memcmp(&pPathLists[pu32PathListHash[u32Slot]], &pathList, sizeof(pathList)))
+    {
+      return pu32PathListHash[u32Slot];
+    }
+    u32Slot = (u32Slot + 1) & (uPathListHashSize - 1);
+  }
+
+  if (uNumPathLists == uMaxPathLists)
+  {
+    pPathLists = Grow(pPathLists, &uMaxPathLists, sizeof(*pPathLists));
+  }
+
+  pPathLists[uNumPathLists]  = pathList;
+  pu32PathListHash[u32Slot]  = uNumPathLists;
+
+  return uNumPathLists++;
+}
+
+/* Forwarding path: the most preferred adjacency that is up */
+uint32_t NextHopResolve(uint32_t u32PathList)
+{
+  PPATHLIST    pPathList = NULL;
+  unsigned int uPath     = 0;
+
+  if (u32PathList == NO_PATH_LIST)
+  {
+    return NO_ADJACENCY;
+  }
+
+  pPathList = &pPathLists[u32PathList];
+  for (uPath = 0; uPath < pPathList->u32NumPaths; uPath++)
+  {
+    uint32_t u32Adjacency = pPathList->au32Adjacencies[uPath];
+
+    if (__atomic_load_n(&pAdjacencies[u32Adjacency].u32Up, __ATOMIC_RELAXED))
+    {
+      return u32Adjacency;
+    }
+  }
+
+  return NO_ADJACENCY;
+}
+
+/* Fails over or restores everything learned from a peer with one store per adjacency of the peer,
+   no matter how many prefixes use it. Returns the number of adjacencies changed. */
+unsigned int NextHopSetPeerState(uint32_t u32Peer, int bUp)
+{
+  uint32_t     u32Adjacency = pu32PeerFirst && u32Peer < NEXTHOP_MAX_PEERS ? pu32PeerFirst[u32Peer] : NO_ADJACENCY;
+  unsigned int uChanged     = 0;
+
+  while (u32Adjacency != NO_ADJACENCY)
+  {
+    __atomic_store_n(&pAdjacencies[u32Adjacency].u32Up, bUp ? 1 : 0, __ATOMIC_RELEASE);
+    u32Adjacency = pAdjacencies[u32Adjacency].u32NextOfPeer;
+    uChanged++;
+  }
+
+  return uChanged;
+}
+
+static int CompareAdjacency(const void *pA, const void *pB)
+{
+  const uint32_t *pu32A = pA;
+  const uint32_t *pu32B = pB;
+
+  return (*pu32A > *pu32B) - (*pu32A < *pu32B);
+}
+
+/* Returns the ID of the group with these members, in any order, adding it if it is new.
+   Members beyond ECMP_MAX_MEMBERS are dropped. */
+uint32_t NextHopAddGroup(const uint32_t *pu32Adjacencies, unsigned int uNumMembers)
+{
+  uint32_t     au32Members[ECMP_MAX_MEMBERS];
+  ECMPGROUP    group   = { 0 };
+  uint32_t     u32Slot = 0;
+  unsigned int uMember = 0;
+
+  uNumMembers = uNumMembers < ECMP_MAX_MEMBERS ? uNumMembers : ECMP_MAX_MEMBERS;
+  memcpy(au32Members, pu32Adjacencies, uNumMembers * sizeof(*pu32Adjacencies));
+  qsort(au32Members, uNumMembers, sizeof(*au32Members), CompareAdjacency);
+
+  group.u16NumMembers = uNumMembers;
+  for (uMember = 0; uMember < uNumMembers; uMember++)
+  {
+    if (au32Members[uMember] > UINT16_MAX)
+    {
+      printf("Too many adjacencies for ECMP groups\n");
+      exit(1);
+    }
+    group.au16Members[uMember] = au32Members[uMember];
+  }
+
+  Rehash(&pu32GroupHash, &uGroupHashSize, uNumGroups, HashGroup);
+
+  u32Slot = HashWords(au32Members, uNumMembers) & (uGroupHashSize - 1);
+  while (pu32GroupHash[u32Slot] != UINT32_MAX)
+  {
+    if (!memcmp(&pEcmpGroups[pu32GroupHash[u32Slot]], &group, sizeof(group)))
+    {
+      return pu32GroupHash[u32Slot];
+    }
+    u32Slot = (u32Slot + 1) & (uGroupHashSize - 1);
+  }
+
+  /* realloc() doesn't keep the cache line alignment */
+  if (uNumGroups == uMaxGroups)
+  {
+    PECMPGROUP pGroups = NULL;
+
+    uMaxGroups = uMaxGroups ? uMaxGroups * 2 : 1024;
+    if (posix_memalign((void **)&pGroups, 64, uMaxGroups * sizeof(*pGroups)))
+    {
+      printf("Can't allocate ECMP group table\n");
+      exit(1);
+    }
+    memcpy(pGroups, pEcmpGroups, uNumGroups * sizeof(*pGroups));
+    free(pEcmpGroups);
+    pEcmpGroups = pGroups;
+  }
+
+  pEcmpGroups[uNumGroups] = group;
+  pu32GroupHash[u32Slot]  = uNumGroups;
+
+  return uNumGroups++;
+}
+
+PADJACENCY NextHopAdjacency(uint32_t u32Adjacency)
+{
+  return u32Adjacency < uNumAdjacencies ? &pAdjacencies[u32Adjacency] : NULL;
+}
+
+PPATHLIST NextHopPathList(uint32_t u32PathList)
+{
+  return u32PathList < uNumPathLists ? &pPathLists[u32PathList] : NULL;
+}
+
+unsigned int NextHopNumAdjacencies(void)
+{
+  return uNumAdjacencies;
+}
+
+unsigned int NextHopNumPathLists(void)
+{
+  return uNumPathLists;
+}
+
+unsigned int NextHopNumGroups(void)
+{
+  return uNumGroups;
+}
@@ -0,0 +1,83 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __NEXTHOP_H__
+#define __NEXTHOP_H__
+
+#include <stdint.h>
+
+/* Two level forwarding result: a prefix maps to a path list, the path list to adjacencies in
+   order of preference. All prefixes learned over the same paths share one path list, so when a
+   peer goes down only its adjacencies change and every prefix moves to its backup path at once. */
+#define NEXTHOP_MAX_PATHS (4)
+#define NO_ADJACENCY      (UINT32_MAX)
+#define NO_PATH_LIST      (UINT32_MAX)
+
+/* Equal cost paths are kept in a separate group table, one cache line per group, so picking a
+   member by flow hash touches a single line. Members are adjacency IDs. */
+#define ECMP_MAX_MEMBERS  (16)
+#define NO_ECMP_GROUP     (UINT32_MAX)
+
+typedef struct tagADJACENCY
+{
+  uint32_t u32Gateway;    /* Forwarding next hop address, host order */
+  uint32_t u32Peer;       /* BGP peer the paths were learned from */
+  uint32_t u32Up;         /* Cleared while the peer is down, read by the forwarding path */
+  uint32_t u32NextOfPeer; /* Next adjacency of the same peer */
+} ADJACENCY, *PADJACENCY;
+
+typedef struct tagPATHLIST
+{
+  uint32_t u32NumPaths;
+  uint32_t au32Adjacencies[NEXTHOP_MAX_PATHS]; /* Most preferred first */
+} PATHLIST, *PPATHLIST;
+
+typedef struct tagECMPGROUP
+{
+  uint16_t u16NumMembers;
+  uint16_t au16Members[ECMP_MAX_MEMBERS];
+} __attribute__((aligned(64))) ECMPGROUP, *PECMPGROUP;
+
+/* Contiguous group table, indexed by group ID */
+extern PECMPGROUP pEcmpGroups;
+
+/* Spreads the flow hash over the members without a division */
+static inline uint32_t NextHopGroupMember(uint32_t u32Group, uint32_t u32FlowHash)
+{
+  PECMPGROUP pGroup = &pEcmpGroups[u32Group];
+
+  if (!pGroup->u16NumMembers)
+  {
+    return NO_ADJACENCY;
+  }
+
+  return pGroup->au16Members[((uint64_t)u32FlowHash * pGroup->u16NumMembers) >> 32];
+}
+
+uint32_t     NextHopAddAdjacency(uint32_t u32Peer, uint32_t u32Gateway);
+uint32_t     NextHopAddPathList(const uint32_t *pu32Adjacencies, unsigned int uNumPaths);
+uint32_t     NextHopResolve(uint32_t u32PathList);
+unsigned int NextHopSetPeerState(uint32_t u32Peer, int bUp);
+uint32_t     NextHopAddGroup(const uint32_t *pu32Adjacencies, unsigned int uNumMembers);
+
+PADJACENCY   NextHopAdjacency(uint32_t u32Adjacency);
+PPATHLIST    NextHopPathList(uint32_t u32PathList);
+unsigned int NextHopNumAdjacencies(void);
+unsigned int NextHopNumPathLists(void);
+unsigned int NextHopNumGroups(void);
+
+#endif /* __NEXTHOP_H__ */
@@ -0,0 +1,206 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pcap_file.h"
+
+static uint32_t Swap32(uint32_t u32Value, int bSwapped)
+{
+  return bSwapped ? __builtin_bswap32(u32Value) : u32Value;
+}
+
+/* Maps the capture read only and indexes its packets. Returns 1 on success. */
+int PcapFileOpen(const char *pszFile, PPCAPFILE pPcap)
+{
+  PCAPGLOBALHEADER  header;
+  PCAPRECORDHEADER  record;
+  struct stat       fileStat;
+  uint64_t          u64Offset   = sizeof(header);
+  unsigned int      uCapacity   = 0;
+  int               bSwapped    = 0;
+  int               iFd         = -1;
+  void             *pMap        = NULL;
+
+  memset(pPcap, 0, sizeof(*pPcap));
+
+  iFd = open(pszFile, O_RDONLY);
+  if (iFd < 0 || fstat(iFd, &fileStat) || (size_t)fileStat.st_size < sizeof(header))
+  {
+    printf("Could not open capture %s\n", pszFile);
+    if (iFd >= 0)
+    {
+      close(iFd);
+    }
+    return 0;
+  }
+
+  pMap = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, iFd, 0);
+  close(iFd);
+  if (pMap == MAP_FAILED)
+  {
+    printf("Could not map capture %s\n", pszFile);
+    return 0;
+  }
+  pPcap->pu8Map    = pMap;
+  pPcap->uMapBytes = fileStat.st_size;
+
+  memcpy(&header, pPcap->pu8Map, sizeof(header));
+  if (header.u32Magic == __builtin_bswap32(PCAP_MAGIC) || header.u32Magic == __builtin_bswap32(PCAP_MAGIC_NSEC))
+  {
+    bSwapped = 1;
+  }
+  else if (header.u32Magic != PCAP_MAGIC && header.u32Magic != PCAP_MAGIC_NSEC)
+  {
+    printf("%s is not a pcap file (pcapng is not supported)\n", pszFile);
+    PcapFileClose(pPcap);
+    return 0;
+  }
+  pPcap->u32LinkType = Swap32(header.u32LinkType, bSwapped);
+
+  while (u64Offset + sizeof(record) <= pPcap->uMapBytes)
+  {
+    memcpy(&record, pPcap->pu8Map + u64Offset, sizeof(record));
+    record.u32CapLen = Swap32(record.u32CapLen, bSwapped);
+    u64Offset       += sizeof(record);
+    if (u64Offset + record.u32CapLen > pPcap->uMapBytes)
+    {
+      printf("Capture %s is truncated after %u packets\n", pszFile, pPcap->uNumPackets);
+      break;
+    }
+
+    if (pPcap->uNumPackets == uCapacity)
+    {
+      PPCAPPACKET pGrown = NULL;
+
+      uCapacity = uCapacity ? uCapacity * 2 : 65536;
+      pGrown    = realloc(pPcap->pPackets, uCapacity * sizeof(*pGrown));
+      if (!pGrown)
+      {
+        printf("Can't allocate packet index\n");
+        exit(1);
+      }
+      pPcap->pPackets = pGrown;
+    }
+
+    pPcap->pPackets[pPcap->uNumPackets].u64Offset = u64Offset;
+    pPcap->pPackets[pPcap->uNumPackets].u32CapLen = record.u32CapLen;
+    pPcap->uNumPackets++;
+    u64Offset += record.u32CapLen;
+  }
+
+  if (!pPcap->uNumPackets)
+  {
+    printf("No packets in capture %s\n", pszFile);
+    PcapFileClose(pPcap);
+    return 0;
+  }
+
+  return 1;
+}
+
+void PcapFileClose(PPCAPFILE pPcap)
+{
+  if (pPcap->pu8Map)
+  {
+    munmap((void *)pPcap->pu8Map, pPcap->uMapBytes);
+  }
+  free(pPcap->pPackets);
+  memset(pPcap, 0, sizeof(*pPcap));
+}
+
+/* 60 byte frames, the Ethernet minimum without the FCS */
+#define SYNTHETIC_FRAME_BYTES (60)
+
+static void WriteFrame(uint8_t *pu8Frame, uint32_t u32Destination, unsigned int uIndex, int bIPv6)
+{
+  uint8_t *pu8IP = pu8Frame + 14;
+
+  memset(pu8Frame, 0, SYNTHETIC_FRAME_BYTES);
+  /* Locally administered MAC addresses */
+  pu8Frame[0]  = 0x02;
+  pu8Frame[5]  = 0x01;
+  pu8Frame[6]  = 0x02;
+  pu8Frame[11] = 0x02;
+
+  if (bIPv6)
+  {
+    pu8Frame[12] = 0x86;
+    pu8Frame[13] = 0xDD;
+    pu8IP[0]     = 0x60;
+    return;
+  }
+
+  pu8Frame[12] = 0x08;
+  pu8IP[0]     = 0x45;
+  pu8IP[3]     = 46;                /* Total length, IP and UDP headers plus 18 bytes of payload */
+  pu8IP[8]     = 64;                /* TTL */
+  pu8IP[9]     = 17;                /* UDP */
+  pu8IP[12]    = 192;               /* Source 192.0.2.x, TEST-NET-1 */
+  pu8IP[14]    = 2;
+  pu8IP[15]    = uIndex & 0xFF;
+  pu8IP[16]    = u32Destination >> 24;
+  pu8IP[17]    = u32Destination >> 16;
+  pu8IP[18]    = u32Destination >> 8;
+  pu8IP[19]    = u32Destination;
+  pu8IP[21]    = 9;                 /* Source and destination port 9, discard */
+  pu8IP[23]    = 9;
+  pu8IP[25]    = 26;                /* UDP length */
+}
+
+int PcapFileWriteSynthetic(const char *pszFile, const uint32_t *pu32IPs, unsigned int uCount, unsigned int uOtherEvery)
+{
+  PCAPGLOBALHEADER  header = { PCAP_MAGIC, 2, 4, 0, 0, 65535, PCAP_LINK_ETHERNET };
+  PCAPRECORDHEADER  record = { 0 };
+  uint8_t           au8Frame[SYNTHETIC_FRAME_BYTES];
+  FILE             *pFile  = fopen(pszFile, "wb");
+  unsigned int      uIndex = 0;
+
+  if (!pFile)
+  {
+    printf("Could not open %s for writing\n", pszFile);
+    return 0;
+  }
+
+  fwrite(&header, sizeof(header), 1, pFile);
+  record.u32CapLen  = SYNTHETIC_FRAME_BYTES;
+  record.u32OrigLen = SYNTHETIC_FRAME_BYTES;
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    /* One packet per microsecond */
+    record.u32Seconds  = uIndex / 1000000;
+    record.u32Fraction = uIndex % 1000000;
+    WriteFrame(au8Frame, pu32IPs[uIndex], uIndex, uOtherEvery && uIndex % uOtherEvery == uOtherEvery - 1);
+    fwrite(&record, sizeof(record), 1, pFile);
+    fwrite(au8Frame, sizeof(au8Frame), 1, pFile);
+  }
+
+  if (fclose(pFile))
+  {
+    printf("Could not write %s\n", pszFile);
+    return 0;
+  }
+
+  return 1;
+}
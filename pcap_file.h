@@ -0,0 +1,128 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PCAP_FILE_H__
+#define __PCAP_FILE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+/* Classic libpcap capture files, read through mmap() so packets are never copied */
+#define PCAP_MAGIC         (0xA1B2C3D4U)
+#define PCAP_MAGIC_NSEC    (0xA1B23C4DU)
+
+#define PCAP_LINK_ETHERNET (1)
+#define PCAP_LINK_RAW      (101)  /* Bare IP packets */
+#define PCAP_LINK_SLL      (113)  /* Linux "any" device cooked header */
+#define PCAP_LINK_IPV4     (228)
+
+typedef struct tagPCAPGLOBALHEADER
+{
+  uint32_t u32Magic;
+  uint16_t u16VersionMajor;
+  uint16_t u16VersionMinor;
+  int32_t  i32ThisZone;
+  uint32_t u32SigFigs;
+  uint32_t u32SnapLen;
+  uint32_t u32LinkType;
+} PCAPGLOBALHEADER, *PPCAPGLOBALHEADER;
+
+typedef struct tagPCAPRECORDHEADER
+{
+  uint32_t u32Seconds;
+  uint32_t u32Fraction;  /* Micro or nanoseconds, depending on the magic */
+  uint32_t u32CapLen;
+  uint32_t u32OrigLen;
+} PCAPRECORDHEADER, *PPCAPRECORDHEADER;
+
+/* Where each captured packet starts in the mapping, found once when the file is opened */
+typedef struct tagPCAPPACKET
+{
+  uint64_t u64Offset;
+  uint32_t u32CapLen;
+} PCAPPACKET, *PPCAPPACKET;
+
+typedef struct tagPCAPFILE
+{
+  const uint8_t *pu8Map;
+  size_t         uMapBytes;
+  uint32_t       u32LinkType;
+  unsigned int   uNumPackets;
+  PPCAPPACKET    pPackets;
+} PCAPFILE, *PPCAPFILE;
+
+int  PcapFileOpen(const char *pszFile, PPCAPFILE pPcap);
+void PcapFileClose(PPCAPFILE pPcap);
+
+/* Writes one minimum size Ethernet frame per address, UDP to pu32IPs[i] in host order. Every
+   uOtherEvery'th frame is IPv6 instead (0 for none), to exercise the parser's slow path. */
+int  PcapFileWriteSynthetic(const char *pszFile, const uint32_t *pu32IPs, unsigned int uCount, unsigned int uOtherEvery);
+
+/* Destination address of an IPv4 packet in host order. Returns 0 for anything that isn't IPv4
+   or is cut short by the snap length. Handles up to two VLAN tags. */
+static inline int PcapFileDestination(const uint8_t *pu8Packet, uint32_t u32CapLen, uint32_t u32LinkType,
+                                      uint32_t *pu32Destination)
+{
+  uint32_t u32Offset = 0;
+  uint16_t u16Type   = 0x0800;
+  uint32_t u32Wire   = 0;
+
+  switch (u32LinkType)
+  {
+    case PCAP_LINK_ETHERNET:
+      u32Offset = 14;
+      if (u32CapLen < u32Offset)
+      {
+        return 0;
+      }
+      u16Type = (uint16_t)(pu8Packet[12] << 8 | pu8Packet[13]);
+      while ((u16Type == 0x8100 || u16Type == 0x88A8) && u32CapLen >= u32Offset + 4 && u32Offset < 22)
+      {
+        u16Type    = (uint16_t)(pu8Packet[u32Offset + 2] << 8 | pu8Packet[u32Offset + 3]);
+        u32Offset += 4;
+      }
+      break;
+    case PCAP_LINK_SLL:
+      u32Offset = 16;
+      if (u32CapLen < u32Offset)
+      {
+        return 0;
+      }
+      u16Type = (uint16_t)(pu8Packet[14] << 8 | pu8Packet[15]);
+      break;
+    case PCAP_LINK_RAW:
+    case PCAP_LINK_IPV4:
+      break;
+    default:
+      return 0;
+  }
+
+  if (u16Type != 0x0800 || u32CapLen < u32Offset + 20 || (pu8Packet[u32Offset] >> 4) != 4)
+  {
+    return 0;
+  }
+
+  /* Network order on the wire, the trie wants host order */
+  memcpy(&u32Wire, pu8Packet + u32Offset + 16, sizeof(u32Wire));
+  *pu32Destination = ntohl(u32Wire);
+
+  return 1;
+}
+
+#endif /* __PCAP_FILE_H__ */
@@ -0,0 +1,338 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "routing_table_split.h"
+#include "poptrie.h"
+
+typedef struct tagPOPTRIERANGE
+{
+  uint32_t u32Start;
+  uint32_t u32Last;
+  uint32_t u32NextHopIndex;  /* NO_NEXT_HOP for addresses without a route */
+} POPTRIERANGE, *PPOPTRIERANGE;
+
+static uint32_t     *pu32Top       = NULL;
+static PPOPTRIENODE  pNodes        = NULL;
+static unsigned int  uNumNodes     = 0;
+static unsigned int  uMaxNodes     = 0;
+static uint32_t     *pu32Leaves    = NULL;
+static unsigned int  uNumLeaves    = 0;
+static unsigned int  uMaxLeaves    = 0;
+
+/* Build input: the whole address space as sorted ranges, gaps included */
+static PPOPTRIERANGE pRanges       = NULL;
+static unsigned int  uNumRanges    = 0;
+static unsigned int  uMaxRanges    = 0;
+
+static void AppendRange(uint32_t u32Start, uint32_t u32Last, uint32_t u32NextHopIndex)
+{
+  /* Neighbouring fragments of the same prefix make one range */
+  if (uNumRanges && pRanges[uNumRanges - 1].u32NextHopIndex == u32NextHopIndex &&
+      pRanges[uNumRanges - 1].u32Last + 1 == u32Start)
+  {
+    pRanges[uNumRanges - 1].u32Last = u32Last;
+    return;
+  }
+
+  if (uNumRanges == uMaxRanges)
+  {
+    uMaxRanges = uMaxRanges ? uMaxRanges * 2 : 65536;
+    pRanges    = realloc(pRanges, uMaxRanges * sizeof(*pRanges));
+    if (!pRanges)
+    {
+      printf("Can't allocate poptrie ranges\n");
+      exit(1);
+    }
+  }
+
+  pRanges[uNumRanges].u32Start        = u32Start;
+  pRanges[uNumRanges].u32Last         = u32Last;
+  pRanges[uNumRanges].u32NextHopIndex = u32NextHopIndex;
+  uNumRanges++;
+}
+
+static int CollectRange(uint32_t u32Start, uint32_t u32Size, uint32_t u32NextHopIndex, void *pContext)
+{
+  uint64_t *pu64Next = pContext;
+
+  if (*pu64Next < u32Start)
+  {
+    AppendRange((uint32_t)*pu64Next, u32Start - 1, NO_NEXT_HOP);
+  }
+  AppendRange(u32Start, u32Start + (u32Size - 1), u32NextHopIndex);
+  *pu64Next = (uint64_t)u32Start + u32Size;
+
+  return 1;
+}
+
+/* Index of the range holding u32IP */
+static unsigned int FindRange(uint32_t u32IP)
+{
+  unsigned int uLow  = 0;
+  unsigned int uHigh = uNumRanges - 1;
+
+  while (uLow < uHigh)
+  {
+    unsigned int uMid = uLow + (uHigh - uLow) / 2;
+
+    if (pRanges[uMid].u32Last < u32IP)
+    {
+      uLow = uMid + 1;
+    }
+    else
+    {
+      uHigh = uMid;
+    }
+  }
+
+  return uLow;
+}
+
+/* Returns 1 and the next hop if the whole span has the same next hop */
+static int SpanIsLeaf(uint32_t u32Start, uint64_t u64Size, uint32_t *pu32NextHopIndex)
+{
+  unsigned int uRange = FindRange(u32Start);
+
+  *pu32NextHopIndex = pRanges[uRange].u32NextHopIndex;
+  return pRanges[uRange].u32Last >= u32Start + (u64Size - 1);
+}
+
+static unsigned int AllocNodes(unsigned int uCount)
+{
+  unsigned int uFirst = uNumNodes;
+
+  while (uNumNodes + uCount > uMaxNodes)
+  {
+    uMaxNodes = uMaxNodes ? uMaxNodes * 2 : 4096;
+    pNodes    = realloc(pNodes, uMaxNodes * sizeof(*pNodes));
+    if (!pNodes)
+    {
+      printf("Can't allocate poptrie nodes\n");
+      exit(1);
+    }
+  }
+  uNumNodes += uCount;
+
+  return uFirst;
+}
+
+static unsigned int AllocLeaves(unsigned int uCount)
+{
+  unsigned int uFirst = uNumLeaves;
+
+  while (uNumLeaves + uCount > uMaxLeaves)
+  {
+    uMaxLeaves = uMaxLeaves ? uMaxLeaves * 2 : 4096;
+    pu32Leaves = realloc(pu32Leaves, uMaxLeaves * sizeof(*pu32Leaves));
+    if (!pu32Leaves)
+    {
+      printf("Can't allocate poptrie leaves\n");
+      exit(1);
+    }
+  }
+  uNumLeaves += uCount;
+
+  return uFirst;
+}
+
+/* Fills in node uNode covering the addresses from u32Prefix that share the first uOffset bits.
+   Below 32 bits the last stride is shorter, the chunk value is then padded with zero bits. */
+static void BuildNode(unsigned int uNode, uint32_t u32Prefix, unsigned int uOffset)
+{
+  unsigned int uBitsLeft = 32 - uOffset;
+  unsigned int uStride   = uBitsLeft < POPTRIE_STRIDE ? uBitsLeft : POPTRIE_STRIDE;
+  uint64_t     u64Span   = 1ULL << (uBitsLeft - uStride);
+  uint32_t     au32Leaf[1 << POPTRIE_STRIDE];
+  uint64_t     u64Vector  = 0;
+  uint64_t     u64Leafvec = 0;
+  uint32_t     u32Last    = NO_NEXT_HOP;
+  int          bHaveLeaf  = 0;
+  unsigned int uChunk     = 0;
+  unsigned int uNodeBase  = 0;
+  unsigned int uLeafBase  = 0;
+  unsigned int uCount     = 0;
+
+  for (uChunk = 0; uChunk < (1 << POPTRIE_STRIDE); uChunk++)
+  {
+    uint32_t u32Start = u32Prefix + (uint32_t)((uChunk >> (POPTRIE_STRIDE - uStride)) * u64Span);
+
+    if (!SpanIsLeaf(u32Start, u64Span, &au32Leaf[uChunk]))
+    {
+      u64Vector |= 1ULL << uChunk;
+    }
+    else if (!bHaveLeaf || au32Leaf[uChunk] != u32Last)
+    {
+      u64Leafvec |= 1ULL << uChunk;
+      u32Last     = au32Leaf[uChunk];
+      bHaveLeaf   = 1;
+    }
+  }
+
+  /* Children and leaves of a node are contiguous, so they are indexed by popcount */
+  uNodeBase = AllocNodes(__builtin_popcountll(u64Vector));
+  uLeafBase = AllocLeaves(__builtin_popcountll(u64Leafvec));
+
+  pNodes[uNode].u64Vector   = u64Vector;
+  pNodes[uNode].u64Leafvec  = u64Leafvec;
+  pNodes[uNode].u32NodeBase = uNodeBase;
+  pNodes[uNode].u32LeafBase = uLeafBase;
+
+  for (uChunk = 0, uCount = 0; uChunk < (1 << POPTRIE_STRIDE); uChunk++)
+  {
+    if (u64Leafvec & (1ULL << uChunk))
+    {
+      pu32Leaves[uLeafBase + uCount++] = au32Leaf[uChunk];
+    }
+  }
+
+  for (uChunk = 0, uCount = 0; uChunk < (1 << POPTRIE_STRIDE); uChunk++)
+  {
+    if (u64Vector & (1ULL << uChunk))
+    {
+      BuildNode(uNodeBase + uCount++, u32Prefix + (uint32_t)(uChunk * u64Span), uOffset + uStride);
+    }
+  }
+}
+
+int BuildPoptrie(PTREENODE pTreeRoot, PROUTEENTRY pNextHops, unsigned int uNumPrefixes)
+{
+  uint64_t     u64Next = 0;
+  unsigned int uIndex  = 0;
+
+  if (uNumPrefixes >= POPTRIE_NO_ROUTE)
+  {
+    printf("Too many prefixes for poptrie\n");
+    return 0;
+  }
+
+  FreePoptrie();
+
+  WalkPrefixTree(pTreeRoot, CollectRange, &u64Next);
+  if (u64Next <= UINT32_MAX)
+  {
+    AppendRange((uint32_t)u64Next, UINT32_MAX, NO_NEXT_HOP);
+  }
+
+  pu32Top = malloc((1U << POPTRIE_TOP_BITS) * sizeof(*pu32Top));
+  if (!pu32Top)
+  {
+    printf("Can't allocate poptrie top level\n");
+    exit(1);
+  }
+
+  for (uIndex = 0; uIndex < (1U << POPTRIE_TOP_BITS); uIndex++)
+  {
+    uint32_t u32Prefix       = uIndex << (32 - POPTRIE_TOP_BITS);
+    uint32_t u32NextHopIndex = 0;
+
+    if (SpanIsLeaf(u32Prefix, 1ULL << (32 - POPTRIE_TOP_BITS), &u32NextHopIndex))
+    {
+      pu32Top[uIndex] = POPTRIE_LEAF | (u32NextHopIndex == NO_NEXT_HOP ? POPTRIE_NO_ROUTE : u32NextHopIndex);
+    }
+    else
+    {
+      pu32Top[uIndex] = AllocNodes(1);
+      BuildNode(pu32Top[uIndex], u32Prefix, POPTRIE_TOP_BITS);
+    }
+  }
+
+  /* Only needed while building */
+  free(pRanges);
+  pRanges    = NULL;
+  uNumRanges = 0;
+  uMaxRanges = 0;
+
+  return 1;
+}
+
+uint32_t PoptrieLookup(uint32_t u32IP)
+{
+  uint32_t     u32Entry = pu32Top[u32IP >> (32 - POPTRIE_TOP_BITS)];
+  uint64_t     u64Key   = (uint64_t)u32IP << 32;
+  unsigned int uOffset  = POPTRIE_TOP_BITS;
+  PPOPTRIENODE pNode    = NULL;
+
+  if (u32Entry & POPTRIE_LEAF)
+  {
+    u32Entry &= ~POPTRIE_LEAF;
+    return u32Entry == POPTRIE_NO_ROUTE ? NO_NEXT_HOP : u32Entry;
+  }
+
+  pNode = &pNodes[u32Entry];
+  while (1)
+  {
+    /* Six bits following the offset, shifted in from the zero padding past bit 32 */
+    unsigned int uChunk = (u64Key >> (64 - POPTRIE_STRIDE - uOffset)) & ((1 << POPTRIE_STRIDE) - 1);
+    uint64_t     u64Mask = (2ULL << uChunk) - 1;
+
+    if (!(pNode->u64Vector & (1ULL << uChunk)))
+    {
+      return pu32Leaves[pNode->u32LeafBase + __builtin_popcountll(pNode->u64Leafvec & u64Mask) - 1];
+    }
+
+    pNode    = &pNodes[pNode->u32NodeBase + __builtin_popcountll(pNode->u64Vector & u64Mask) - 1];
+    uOffset += POPTRIE_STRIDE;
+  }
+}
+
+/* How many lookups ahead to prefetch the top level entry, same as the other engines */
+#define POPTRIE_PREFETCH_DISTANCE (8)
+
+void PoptrieLookupBatch(const uint32_t *pu32IPs, uint32_t *pu32Results, unsigned int uCount)
+{
+  unsigned int uIndex = 0;
+
+  for (uIndex = 0; uIndex < uCount; uIndex++)
+  {
+    if (uIndex + POPTRIE_PREFETCH_DISTANCE < uCount)
+    {
+      __builtin_prefetch(&pu32Top[pu32IPs[uIndex + POPTRIE_PREFETCH_DISTANCE] >> (32 - POPTRIE_TOP_BITS)]);
+    }
+
+    pu32Results[uIndex] = PoptrieLookup(pu32IPs[uIndex]);
+  }
+}
+
+size_t PoptrieBytes(void)
+{
+  if (!pu32Top)
+  {
+    return 0;
+  }
+
+  return (1U << POPTRIE_TOP_BITS) * sizeof(*pu32Top) + (size_t)uNumNodes * sizeof(*pNodes) +
+         (size_t)uNumLeaves * sizeof(*pu32Leaves);
+}
+
+void FreePoptrie(void)
+{
+  free(pu32Top);
+  free(pNodes);
+  free(pu32Leaves);
+  pu32Top    = NULL;
+  pNodes     = NULL;
+  pu32Leaves = NULL;
+  uNumNodes  = 0;
+  uMaxNodes  = 0;
+  uNumLeaves = 0;
+  uMaxLeaves = 0;
+}
@@ -0,0 +1,46 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __POPTRIE_H__
+#define __POPTRIE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "routing_table_split.h"
+
+/* Poptrie: a direct pointing top level for the first POPTRIE_TOP_BITS bits, then 64-ary nodes
+   that use popcount over a node bitmap and a leaf bitmap to index their children and leaves. */
+#define POPTRIE_TOP_BITS (16)
+#define POPTRIE_STRIDE   (6)
+#define POPTRIE_LEAF     (1U << 31)         /* Top level entry is a next hop index, not a node */
+#define POPTRIE_NO_ROUTE (POPTRIE_LEAF - 1)
+
+typedef struct tagPOPTRIENODE
+{
+  uint64_t u64Vector;    /* Bit set for every chunk value that continues in a child node */
+  uint64_t u64Leafvec;   /* Bit set where a run of equal leaves starts */
+  uint32_t u32LeafBase;  /* Index of the first leaf in the leaf array */
+  uint32_t u32NodeBase;  /* Index of the first child in the node array */
+} POPTRIENODE, *PPOPTRIENODE;
+
+int         BuildPoptrie(PTREENODE pTreeRoot, PROUTEENTRY pNextHops, unsigned int uNumPrefixes);
+uint32_t    PoptrieLookup(uint32_t u32IP);
+void        PoptrieLookupBatch(const uint32_t *pu32IPs, uint32_t *pu32Results, unsigned int uCount);
+size_t      PoptrieBytes(void);
+void        FreePoptrie(void);
+
+#endif /* __POPTRIE_H__ */
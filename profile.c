@@ -0,0 +1,443 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "profile.h"
+
+/* Programs linking this file are linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+   so every allocation made by our code and the statically linked libbgpdump is counted. */
+void *__real_malloc(size_t uSize);
+void *__real_calloc(size_t uNum, size_t uSize);
+void *__real_realloc(void *pPtr, size_t uSize);
+void  __real_free(void *pPtr);
+
+static uint64_t       u64Allocations;
+static uint64_t       u64Frees;
+
+static PROFILESAMPLE  aSamples[PROFILE_MAX];
+
+static const char    *apszPhaseNames[PROFILE_MAX] =
+{
+  "ReadFromBgpDump",
+  "LinkedListToTree",
+  "RecurseRadixTree",
+  "BuildLevel1",
+  "BuildLevel23",
+  "FreePrefixTree",
+};
+
+static const char    *apszCounterNames[PROFILE_MAX_COUNTERS];
+static uint64_t       au64CounterValues[PROFILE_MAX_COUNTERS];
+static unsigned int   uNumCounters;
+
+typedef struct tagPROFILEMETRIC
+{
+  char   achName[256];
+  double dValue;
+} PROFILEMETRIC, *PPROFILEMETRIC;
+
+#define PROFILE_MAX_METRICS (256)
+
+/* Metrics where a bigger value is not a cost */
+static const char    *apszNotCostSuffixes[] = { ".calls", ".frees", "_direct_codewords" };
+
+void *__wrap_malloc(size_t uSize)
+{
+  __atomic_fetch_add(&u64Allocations, 1, __ATOMIC_RELAXED);
+  return __real_malloc(uSize);
+}
+
+void *__wrap_calloc(size_t uNum, size_t uSize)
+{
+  __atomic_fetch_add(&u64Allocations, 1, __ATOMIC_RELAXED);
+  return __real_calloc(uNum, uSize);
+}
+
+void *__wrap_realloc(void *pPtr, size_t uSize)
+{
+  __atomic_fetch_add(&u64Allocations, 1, __ATOMIC_RELAXED);
+  return __real_realloc(pPtr, uSize);
+}
+
+void __wrap_free(void *pPtr)
+{
+  if (pPtr)
+  {
+    __atomic_fetch_add(&u64Frees, 1, __ATOMIC_RELAXED);
+  }
+  __real_free(pPtr);
+}
+
+static uint64_t ClockNs(clockid_t clockId)
+{
+  struct timespec now;
+
+  clock_gettime(clockId, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* Reads VmHWM and VmRSS from /proc/self/status */
+static void ReadRss(uint64_t *pu64PeakKb, uint64_t *pu64CurrentKb)
+{
+  FILE         *pFile = fopen("/proc/self/status", "r");
+  char          achLine[256];
+  unsigned long ulValue = 0;
+
+  *pu64PeakKb    = 0;
+  *pu64CurrentKb = 0;
+
+  if (!pFile)
+  {
+    return;
+  }
+
+  while (fgets(achLine, sizeof(achLine), pFile))
+  {
+    if (sscanf(achLine, "VmHWM: %lu kB", &ulValue) == 1)
+    {
+      *pu64PeakKb = ulValue;
+    }
+    else if (sscanf(achLine, "VmRSS: %lu kB", &ulValue) == 1)
+    {
+      *pu64CurrentKb = ulValue;
+    }
+  }
+  fclose(pFile);
+}
+
+/* Writing 5 to clear_refs resets VmHWM to the current RSS, so the peak read at
+   ProfileEnd() belongs to this phase. Older kernels ignore it and we report the process peak. */
+static void ResetPeakRss(void)
+{
+  FILE *pFile = fopen("/proc/self/clear_refs", "w");
+
+  if (pFile)
+  {
+    fputs("5", pFile);
+    fclose(pFile);
+  }
+}
+
+void ProfileBegin(PROFILEPHASE ePhase)
+{
+  PPROFILESAMPLE pSample = &aSamples[ePhase];
+
+  ResetPeakRss();
+
+  pSample->u64StartAllocations = __atomic_load_n(&u64Allocations, __ATOMIC_RELAXED);
+  pSample->u64StartFrees       = __atomic_load_n(&u64Frees, __ATOMIC_RELAXED);
+  pSample->u64StartCpuNs       = ClockNs(CLOCK_PROCESS_CPUTIME_ID);
+  pSample->u64StartWallNs      = ClockNs(CLOCK_MONOTONIC);
+}
+
+void ProfileEnd(PROFILEPHASE ePhase)
+{
+  PPROFILESAMPLE pSample   = &aSamples[ePhase];
+  uint64_t       u64Wall   = ClockNs(CLOCK_MONOTONIC);
+  uint64_t       u64Cpu    = ClockNs(CLOCK_PROCESS_CPUTIME_ID);
+  uint64_t       u64PeakKb = 0;
+  uint64_t       u64RssKb  = 0;
+
+  pSample->uCalls++;
+  pSample->u64WallNs      += u64Wall - pSample->u64StartWallNs;
+  pSample->u64CpuNs       += u64Cpu - pSample->u64StartCpuNs;
+  pSample->u64Allocations += __atomic_load_n(&u64Allocations, __ATOMIC_RELAXED) - pSample->u64StartAllocations;
+  pSample->u64Frees       += __atomic_load_n(&u64Frees, __ATOMIC_RELAXED) - pSample->u64StartFrees;
+
+  ReadRss(&u64PeakKb, &u64RssKb);
+  if (u64PeakKb > pSample->u64PeakRssKb)
+  {
+    pSample->u64PeakRssKb = u64PeakKb;
+  }
+  pSample->u64RssKb = u64RssKb;
+}
+
+/* Structure counters, the name must stay valid until the profile is written */
+void ProfileCounter(const char *pszName, uint64_t u64Value)
+{
+  unsigned int uIndex = 0;
+
+  for (uIndex = 0; uIndex < uNumCounters; uIndex++)
+  {
+    if (!strcmp(apszCounterNames[uIndex], pszName))
+    {
+      au64CounterValues[uIndex] = u64Value;
+      return;
+    }
+  }
+
+  if (uNumCounters < PROFILE_MAX_COUNTERS)
+  {
+    apszCounterNames[uNumCounters]  = pszName;
+    au64CounterValues[uNumCounters] = u64Value;
+    uNumCounters++;
+  }
+}
+
+void ProfileWriteJson(FILE *pFile)
+{
+  unsigned int uIndex = 0;
+
+  fprintf(pFile, "{\n  \"phases\": {\n");
+  for (uIndex = 0; uIndex < PROFILE_MAX; uIndex++)
+  {
+    PPROFILESAMPLE pSample = &aSamples[uIndex];
+
+    fprintf(pFile, "    \"%s\": { \"calls\": %u, \"wall_ns\": %lu, \"cpu_ns\": %lu, \"allocations\": %lu, "
+                   "\"frees\": %lu, \"peak_rss_kb\": %lu, \"rss_kb\": %lu }%s\n",
+            apszPhaseNames[uIndex], pSample->uCalls, pSample->u64WallNs, pSample->u64CpuNs,
+            pSample->u64Allocations, pSample->u64Frees, pSample->u64PeakRssKb, pSample->u64RssKb,
+            uIndex + 1 < PROFILE_MAX ? "," : "");
+  }
+  fprintf(pFile, "  },\n  \"counters\": {\n");
+  for (uIndex = 0; uIndex < uNumCounters; uIndex++)
+  {
+    fprintf(pFile, "    \"%s\": %lu%s\n", apszCounterNames[uIndex], au64CounterValues[uIndex],
+            uIndex + 1 < uNumCounters ? "," : "");
+  }
+  fprintf(pFile, "  }\n}\n");
+}
+
+static const char *SkipSpace(const char *pch)
+{
+  while (*pch == ' ' || *pch == '\t' || *pch == '\n' || *pch == '\r')
+  {
+    pch++;
+  }
+  return pch;
+}
+
+static const char *ParseString(const char *pch, char *pchOut, size_t uOutSize)
+{
+  size_t uLength = 0;
+
+  if (*pch != '"')
+  {
+    return NULL;
+  }
+  pch++;
+
+  while (*pch && *pch != '"')
+  {
+    if (*pch == '\\' && pch[1])
+    {
+      pch++;
+    }
+    if (pchOut && uLength + 1 < uOutSize)
+    {
+      pchOut[uLength++] = *pch;
+    }
+    pch++;
+  }
+  if (pchOut)
+  {
+    pchOut[uLength] = '\0';
+  }
+
+  return *pch == '"' ? pch + 1 : NULL;
+}
+
+/* Flattens nested objects of numbers into "object.key" metrics. Only handles what ProfileWriteJson() emits
+   (plus strings, booleans and null, which are skipped). */
+static const char *ParseObject(const char *pch, const char *pszPrefix, PPROFILEMETRIC pMetrics, unsigned int *puCount)
+{
+  char achKey[96];
+  char achName[256];
+
+  pch = SkipSpace(pch);
+  if (*pch != '{')
+  {
+    return NULL;
+  }
+  pch = SkipSpace(pch + 1);
+
+  while (*pch && *pch != '}')
+  {
+    pch = ParseString(pch, achKey, sizeof(achKey));
+    if (!pch)
+    {
+      return NULL;
+    }
+    pch = SkipSpace(pch);
+    if (*pch != ':')
+    {
+      return NULL;
+    }
+    pch = SkipSpace(pch + 1);
+
+    snprintf(achName, sizeof(achName), "%s%s%s", pszPrefix, *pszPrefix ? "." : "", achKey);
+
+    if (*pch == '{')
+    {
+      pch = ParseObject(pch, achName, pMetrics, puCount);
+    }
+    else if (*pch == '"')
+    {
+      pch = ParseString(pch, NULL, 0);
+    }
+    else if (!strncmp(pch, "null", 4) || !strncmp(pch, "true", 4))
+    {
+      pch += 4;
+    }
+    else if (!strncmp(pch, "false", 5))
+    {
+      pch += 5;
+    }
+    else
+    {
+      char  *pchEnd = NULL;
+      double dValue = strtod(pch, &pchEnd);
+
+      if (pchEnd == pch)
+      {
+        return NULL;
+      }
+      if (*puCount < PROFILE_MAX_METRICS)
+      {
+        snprintf(pMetrics[*puCount].achName, sizeof(pMetrics[*puCount].achName), "%s", achName);
+        pMetrics[*puCount].dValue = dValue;
+        (*puCount)++;
+      }
+      pch = pchEnd;
+    }
+
+    if (!pch)
+    {
+      return NULL;
+    }
+    pch = SkipSpace(pch);
+    if (*pch == ',')
+    {
+      pch = SkipSpace(pch + 1);
+    }
+  }
+
+  return *pch == '}' ? pch + 1 : NULL;
+}
+
+static PPROFILEMETRIC LoadProfile(const char *pszFile, unsigned int *puCount)
+{
+  FILE          *pFile    = fopen(pszFile, "r");
+  char          *pchData  = NULL;
+  PPROFILEMETRIC pMetrics = NULL;
+  long           lSize    = 0;
+
+  if (!pFile)
+  {
+    printf("Could not open profile %s\n", pszFile);
+    exit(1);
+  }
+
+  fseek(pFile, 0, SEEK_END);
+  lSize = ftell(pFile);
+  fseek(pFile, 0, SEEK_SET);
+
+  pchData  = calloc(1, lSize + 1);
+  pMetrics = calloc(PROFILE_MAX_METRICS, sizeof(*pMetrics));
+  if (!pchData || !pMetrics)
+  {
+    printf("Can't allocate profile\n");
+    exit(1);
+  }
+
+  if (fread(pchData, 1, lSize, pFile) != (size_t)lSize || !ParseObject(pchData, "", pMetrics, puCount))
+  {
+    printf("Could not parse profile %s\n", pszFile);
+    exit(1);
+  }
+
+  fclose(pFile);
+  free(pchData);
+
+  return pMetrics;
+}
+
+/* Prints every metric of both runs and flags those that grew more than dThresholdPercent.
+   Returns the number of regressions. */
+int ProfileCompare(const char *pszBaseline, const char *pszCandidate, double dThresholdPercent)
+{
+  PPROFILEMETRIC pBaseline    = NULL;
+  PPROFILEMETRIC pCandidate   = NULL;
+  unsigned int   uNumBaseline = 0;
+  unsigned int   uNumCandidate = 0;
+  unsigned int   uIndex       = 0;
+  unsigned int   uBase        = 0;
+  int            iRegressions = 0;
+
+  pBaseline  = LoadProfile(pszBaseline, &uNumBaseline);
+  pCandidate = LoadProfile(pszCandidate, &uNumCandidate);
+
+  printf("%-44s %16s %16s %9s\n", "metric", "baseline", "candidate", "change");
+
+  for (uIndex = 0; uIndex < uNumCandidate; uIndex++)
+  {
+    PPROFILEMETRIC pNew    = &pCandidate[uIndex];
+    double         dChange = 0;
+    size_t         uLength = strlen(pNew->achName);
+    int            bCost   = 1;
+    unsigned int   uSuffix = 0;
+
+    for (uSuffix = 0; uSuffix < sizeof(apszNotCostSuffixes) / sizeof(apszNotCostSuffixes[0]); uSuffix++)
+    {
+      size_t uSuffixLength = strlen(apszNotCostSuffixes[uSuffix]);
+
+      if (uLength > uSuffixLength && !strcmp(pNew->achName + uLength - uSuffixLength, apszNotCostSuffixes[uSuffix]))
+      {
+        bCost = 0;
+      }
+    }
+
+    for (uBase = 0; uBase < uNumBaseline; uBase++)
+    {
+      if (!strcmp(pBaseline[uBase].achName, pNew->achName))
+      {
+        break;
+      }
+    }
+    if (uBase == uNumBaseline)
+    {
+      printf("%-44s %16s %16.0f %9s\n", pNew->achName, "-", pNew->dValue, "new");
+      continue;
+    }
+
+    if (pBaseline[uBase].dValue > 0)
+    {
+      dChange = (pNew->dValue - pBaseline[uBase].dValue) * 100.0 / pBaseline[uBase].dValue;
+    }
+    else if (pNew->dValue > 0)
+    {
+      dChange = 100.0;
+    }
+
+    printf("%-44s %16.0f %16.0f %8.1f%%%s\n", pNew->achName, pBaseline[uBase].dValue, pNew->dValue, dChange,
+           bCost && dChange > dThresholdPercent ? "  REGRESSION" : "");
+    if (bCost && dChange > dThresholdPercent)
+    {
+      iRegressions++;
+    }
+  }
+
+  free(pBaseline);
+  free(pCandidate);
+
+  return iRegressions;
+}
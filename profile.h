@@ -0,0 +1,60 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum tagPROFILEPHASE
+{
+  PROFILE_READ_BGP_DUMP = 0,   /* ReadFromBgpDump */
+  PROFILE_LINKED_LIST_TO_TREE, /* LinkedListToTree, once per prefix length */
+  PROFILE_RECURSE_RADIX_TREE,  /* RecurseRadixTree */
+  PROFILE_BUILD_LEVEL1,        /* BuildLevel1 */
+  PROFILE_BUILD_LEVEL23,       /* Draining the level 2/3 build task queue */
+  PROFILE_FREE_PREFIX_TREE,    /* FreePrefixTree */
+  PROFILE_MAX
+} PROFILEPHASE;
+
+typedef struct tagPROFILESAMPLE
+{
+  unsigned int uCalls;
+  uint64_t     u64WallNs;
+  uint64_t     u64CpuNs;
+  uint64_t     u64Allocations;  /* malloc/calloc/realloc calls during the phase */
+  uint64_t     u64Frees;
+  uint64_t     u64PeakRssKb;    /* Highest VmHWM seen at the end of the phase */
+  uint64_t     u64RssKb;        /* VmRSS at the end of the phase */
+
+  /* Values at ProfileBegin() */
+  uint64_t     u64StartWallNs;
+  uint64_t     u64StartCpuNs;
+  uint64_t     u64StartAllocations;
+  uint64_t     u64StartFrees;
+} PROFILESAMPLE, *PPROFILESAMPLE;
+
+#define PROFILE_MAX_COUNTERS (64)
+
+void ProfileBegin(PROFILEPHASE ePhase);
+void ProfileEnd(PROFILEPHASE ePhase);
+void ProfileCounter(const char *pszName, uint64_t u64Value);
+void ProfileWriteJson(FILE *pFile);
+int  ProfileCompare(const char *pszBaseline, const char *pszCandidate, double dThresholdPercent);
+
+#endif /* __PROFILE_H__ */
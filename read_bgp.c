@@ -17,20 +17,135 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include "bgpdump_lib.h"
 #include "routing_table_split.h"
 #include "linked_list.h"
 #include "read_bgp.h"
+#include "profile.h"
+#include "nexthop.h"
 
 static PREFIXES prefixes;
 
+/* Orders the paths of a prefix like a simple best path selection would, shortest AS path first
+   and then lowest peer, and returns the path list of their adjacencies. */
+static uint32_t PathListFromEntries(BGPDUMP_TABLE_DUMP_V2_PREFIX *prefix_entry)
+{
+	BGPDUMP_TABLE_DUMP_V2_ROUTE_ENTRY *apEntries[NEXTHOP_MAX_PATHS];
+	uint32_t     au32Adjacencies[NEXTHOP_MAX_PATHS];
+	unsigned int uNumEntries = 0;
+	unsigned int uNumPaths   = 0;
+	unsigned int uIndex      = 0;
+	unsigned int uPath       = 0;
+
+	for (uIndex = 0; uIndex < prefix_entry->entry_count; uIndex++)
+	{
+		BGPDUMP_TABLE_DUMP_V2_ROUTE_ENTRY *pEntry = &prefix_entry->entries[uIndex];
+		int iLength = pEntry->attr && pEntry->attr->aspath ? pEntry->attr->aspath->count : 0;
+		unsigned int uInsert = uNumEntries;
+
+		if (!pEntry->attr)
+		{
+			continue;
+		}
+
+		/* Insertion sort, keeping only the best NEXTHOP_MAX_PATHS paths */
+		while (uInsert > 0)
+		{
+			BGPDUMP_TABLE_DUMP_V2_ROUTE_ENTRY *pOther = apEntries[uInsert - 1];
+			int iOtherLength = pOther->attr->aspath ? pOther->attr->aspath->count : 0;
+
+			if (iOtherLength < iLength || (iOtherLength == iLength && pOther->peer_index <= pEntry->peer_index))
+			{
+				break;
+			}
+			if (uInsert < NEXTHOP_MAX_PATHS)
+			{
+				apEntries[uInsert] = pOther;
+			}
+			uInsert--;
+		}
+
+		if (uInsert < NEXTHOP_MAX_PATHS)
+		{
+			apEntries[uInsert] = pEntry;
+			if (uNumEntries < NEXTHOP_MAX_PATHS)
+			{
+				uNumEntries++;
+			}
+		}
+	}
+
+	for (uIndex = 0; uIndex < uNumEntries; uIndex++)
+	{
+		uint32_t u32Adjacency = NextHopAddAdjacency(apEntries[uIndex]->peer_index,
+		                                            ntohl(apEntries[uIndex]->attr->nexthop.s_addr));
+
+		/* The same peer and next hop can show up more than once, keep the best */
+		for (uPath = 0; uPath < uNumPaths && au32Adjacencies[uPath] != u32Adjacency; uPath++)
+		{
+		}
+		if (uPath == uNumPaths)
+		{
+			au32Adjacencies[uNumPaths++] = u32Adjacency;
+		}
+	}
+
+	return NextHopAddPathList(au32Adjacencies, uNumPaths);
+}
+
+/* Multipath: every path tied for the shortest AS path goes into the prefix's ECMP group */
+static uint32_t GroupFromEntries(BGPDUMP_TABLE_DUMP_V2_PREFIX *prefix_entry)
+{
+	uint32_t     au32Members[ECMP_MAX_MEMBERS];
+	unsigned int uNumMembers = 0;
+	unsigned int uIndex      = 0;
+	unsigned int uMember     = 0;
+	int          iBest       = -1;
+
+	for (uIndex = 0; uIndex < prefix_entry->entry_count; uIndex++)
+	{
+		struct attr *pAttr = prefix_entry->entries[uIndex].attr;
+		int iLength = pAttr && pAttr->aspath ? pAttr->aspath->count : 0;
+
+		if (pAttr && (iBest < 0 || iLength < iBest))
+		{
+			iBest = iLength;
+		}
+	}
+
+	for (uIndex = 0; uIndex < prefix_entry->entry_count && uNumMembers < ECMP_MAX_MEMBERS; uIndex++)
+	{
+		BGPDUMP_TABLE_DUMP_V2_ROUTE_ENTRY *pEntry = &prefix_entry->entries[uIndex];
+		uint32_t u32Adjacency = 0;
+
+		if (!pEntry->attr || (pEntry->attr->aspath ? pEntry->attr->aspath->count : 0) != iBest)
+		{
+			continue;
+		}
+
+		u32Adjacency = NextHopAddAdjacency(pEntry->peer_index, ntohl(pEntry->attr->nexthop.s_addr));
+		for (uMember = 0; uMember < uNumMembers && au32Members[uMember] != u32Adjacency; uMember++)
+		{
+		}
+		if (uMember == uNumMembers)
+		{
+			au32Members[uNumMembers++] = u32Adjacency;
+		}
+	}
+
+	return NextHopAddGroup(au32Members, uNumMembers);
+}
+
 PPREFIXES ReadFromBgpDump(char *filename)
 {
 	BGPDUMP       *dumpfile = NULL;
 	BGPDUMP_ENTRY *entry    = NULL;
 
+	ProfileBegin(PROFILE_READ_BGP_DUMP);
+
 	dumpfile = bgpdump_open_dump(filename);
 	if (!dumpfile)
 	{
@@ -64,10 +179,14 @@ PPREFIXES ReadFromBgpDump(char *filename)
 
 					pNewEntry->u32Start = ntohl(prefix_entry->prefix.v4_addr.s_addr);
 					pNewEntry->u32NextHopIndex = NO_NEXT_HOP;
+					pNewEntry->u32PathList = PathListFromEntries(prefix_entry);
+					pNewEntry->u32Group = GroupFromEntries(prefix_entry);
 					if (prefix_entry->prefix_length == 0)
 					{
 						uint32_t u32IP = pNewEntry->u32Start;
 						uint32_t u32Size = 1 << (32 - 1);
+						uint32_t u32PathList = pNewEntry->u32PathList;
+						uint32_t u32Group = pNewEntry->u32Group;
 
 						pNewEntry->u32Size = u32Size;
 						InsertIntoLinkedList(&prefixes.pPrefixes[prefix_entry->prefix_length], pNewEntry);
@@ -84,6 +203,8 @@ PPREFIXES ReadFromBgpDump(char *filename)
 						pNewEntry->u32Size = u32Size;
 						pNewEntry->u32Start = u32IP + u32Size;
 						pNewEntry->u32NextHopIndex = NO_NEXT_HOP;
+						pNewEntry->u32PathList = u32PathList;
+						pNewEntry->u32Group = u32Group;
 
 					}
 					else
@@ -105,5 +226,202 @@ PPREFIXES ReadFromBgpDump(char *filename)
 
 	bgpdump_close_dump(dumpfile);
 
+	ProfileEnd(PROFILE_READ_BGP_DUMP);
+
 	return &prefixes;
 }
+
+/* UPDATE records name the peer by address, RIB entries by their index in the peer index table.
+   Peers seen in the RIB keep their index, other peers get one from BGP_UPDATE_PEER_BASE up. */
+#define BGP_PEER_SLOTS       (4096)
+#define BGP_UPDATE_PEER_BASE (0x8000)
+
+static uint64_t     au64PeerKeys[BGP_PEER_SLOTS];   /* Address + 1, 0 is an empty slot */
+static uint32_t     au32PeerIndexes[BGP_PEER_SLOTS];
+static unsigned int uNumUpdatePeers;
+
+static uint32_t PeerAddressKey(BGPDUMP_IP_ADDRESS *pAddress, int iAfi)
+{
+	uint32_t     u32Key = 0;
+	unsigned int uIndex = 0;
+
+	if (iAfi == AFI_IP)
+	{
+		return ntohl(pAddress->v4_addr.s_addr);
+	}
+
+	for (uIndex = 0; uIndex < 16; uIndex += 4)
+	{
+		uint32_t u32Word = 0;
+
+		memcpy(&u32Word, &pAddress->v6_addr.s6_addr[uIndex], sizeof(u32Word));
+		u32Key ^= u32Word;
+	}
+	return u32Key;
+}
+
+/* Returns the peer index of u32Key, giving it u32Index (or the next update peer index if that
+   is UINT32_MAX) when it is new */
+static uint32_t PeerIndex(uint32_t u32Key, uint32_t u32Index)
+{
+	unsigned int uSlot = (u32Key * 0x9E3779B1U) >> 20;
+
+	while (au64PeerKeys[uSlot] && au64PeerKeys[uSlot] != (uint64_t)u32Key + 1)
+	{
+		uSlot = (uSlot + 1) % BGP_PEER_SLOTS;
+	}
+
+	if (!au64PeerKeys[uSlot])
+	{
+		if (u32Index == UINT32_MAX)
+		{
+			u32Index = BGP_UPDATE_PEER_BASE + uNumUpdatePeers++;
+		}
+		au64PeerKeys[uSlot]    = (uint64_t)u32Key + 1;
+		au32PeerIndexes[uSlot] = u32Index;
+	}
+
+	return au32PeerIndexes[uSlot];
+}
+
+static void PrefixEvents(struct prefix *pPrefixes, unsigned int uCount, BGPEVENT *pEvent, BGPEVENTCALLBACK fpCallback,
+                         void *pContext, unsigned long *pulEvents)
+{
+	unsigned int uIndex = 0;
+
+	for (uIndex = 0; uIndex < uCount; uIndex++)
+	{
+		pEvent->u32Prefix = ntohl(pPrefixes[uIndex].address.v4_addr.s_addr);
+		pEvent->uLength   = pPrefixes[uIndex].len;
+		fpCallback(pEvent, pContext);
+		(*pulEvents)++;
+	}
+}
+
+/* IPv4 unicast prefixes can come in the UPDATE itself or in MP_REACH_NLRI / MP_UNREACH_NLRI,
+   with the next hop of MP_REACH_NLRI */
+static void UpdateEvents(BGPDUMP_ENTRY *entry, BGPEVENT *pEvent, BGPEVENTCALLBACK fpCallback, void *pContext,
+                         unsigned long *pulEvents)
+{
+	BGPDUMP_ZEBRA_MESSAGE *message = &entry->body.zebra_message;
+	struct mp_info *mp_info = entry->attr ? entry->attr->mp_info : NULL;
+	struct mp_nlri *mp_nlri = NULL;
+
+	if (message->type != BGP_MSG_UPDATE)
+	{
+		return;
+	}
+
+	pEvent->u32Peer = PeerIndex(PeerAddressKey(&message->source_ip, message->address_family), UINT32_MAX);
+
+	pEvent->bWithdraw = 1;
+	PrefixEvents(message->withdraw, message->withdraw_count, pEvent, fpCallback, pContext, pulEvents);
+	mp_nlri = mp_info ? mp_info->withdraw[AFI_IP][SAFI_UNICAST] : NULL;
+	if (mp_nlri)
+	{
+		PrefixEvents(mp_nlri->nlri, mp_nlri->prefix_count, pEvent, fpCallback, pContext, pulEvents);
+	}
+
+	if (!entry->attr)
+	{
+		return;
+	}
+	pEvent->bWithdraw   = 0;
+	pEvent->u32Gateway  = ntohl(entry->attr->nexthop.s_addr);
+	pEvent->uPathLength = entry->attr->aspath ? entry->attr->aspath->count : 0;
+	PrefixEvents(message->announce, message->announce_count, pEvent, fpCallback, pContext, pulEvents);
+	mp_nlri = mp_info ? mp_info->announce[AFI_IP][SAFI_UNICAST] : NULL;
+	if (mp_nlri)
+	{
+		pEvent->u32Gateway = ntohl(mp_nlri->nexthop.v4_addr.s_addr);
+		PrefixEvents(mp_nlri->nlri, mp_nlri->prefix_count, pEvent, fpCallback, pContext, pulEvents);
+	}
+}
+
+/* A session that leaves Established takes every path the peer announced with it */
+static void StateChangeEvent(BGPDUMP_ENTRY *entry, BGPEVENT *pEvent, BGPEVENTCALLBACK fpCallback, void *pContext,
+                             unsigned long *pulEvents)
+{
+	BGPDUMP_ZEBRA_STATE_CHANGE *state_change = &entry->body.zebra_state_change;
+
+	if (state_change->old_state != BGP_STATE_ESTABLISHED || state_change->new_state == BGP_STATE_ESTABLISHED)
+	{
+		return;
+	}
+
+	pEvent->u32Peer   = PeerIndex(PeerAddressKey(&state_change->source_ip, state_change->address_family), UINT32_MAX);
+	pEvent->bWithdraw = 1;
+	pEvent->bPeerDown = 1;
+	fpCallback(pEvent, pContext);
+	(*pulEvents)++;
+}
+
+/* Streams a RIB dump or an updates file as events, one per IPv4 RIB path, one per IPv4 prefix an
+   UPDATE announces or withdraws and one per session that goes down. Returns the number of events. */
+unsigned long ReadBgpEvents(char *filename, BGPEVENTCALLBACK fpCallback, void *pContext)
+{
+	BGPDUMP       *dumpfile = NULL;
+	BGPDUMP_ENTRY *entry    = NULL;
+	unsigned long  ulEvents = 0;
+
+	dumpfile = bgpdump_open_dump(filename);
+	if (!dumpfile)
+	{
+		printf("Could not open file %s\n", filename);
+		exit(1);
+	}
+
+	do
+	{
+		entry = bgpdump_read_next(dumpfile);
+		if (entry)
+		{
+			BGPEVENT event = { 0 };
+
+			event.u64TimeMs = (uint64_t)entry->time * 1000 + entry->ms;
+
+			if (entry->type == BGPDUMP_TYPE_TABLE_DUMP_V2 && entry->body.mrtd_table_dump_v2_prefix.afi == AFI_IP)
+			{
+				BGPDUMP_TABLE_DUMP_V2_PREFIX *prefix_entry = &entry->body.mrtd_table_dump_v2_prefix;
+				unsigned int uIndex = 0;
+
+				event.u32Prefix = ntohl(prefix_entry->prefix.v4_addr.s_addr);
+				event.uLength   = prefix_entry->prefix_length;
+				for (uIndex = 0; uIndex < prefix_entry->entry_count; uIndex++)
+				{
+					BGPDUMP_TABLE_DUMP_V2_ROUTE_ENTRY *pEntry = &prefix_entry->entries[uIndex];
+
+					if (!pEntry->attr)
+					{
+						continue;
+					}
+					event.u32Peer = pEntry->peer_index;
+					if (pEntry->peer)
+					{
+						PeerIndex(PeerAddressKey(&pEntry->peer->peer_ip, pEntry->peer->afi), pEntry->peer_index);
+					}
+					event.u32Gateway  = ntohl(pEntry->attr->nexthop.s_addr);
+					event.uPathLength = pEntry->attr->aspath ? pEntry->attr->aspath->count : 0;
+					fpCallback(&event, pContext);
+					ulEvents++;
+				}
+			}
+			else if (entry->type == BGPDUMP_TYPE_ZEBRA_BGP &&
+			         (entry->subtype == BGPDUMP_SUBTYPE_ZEBRA_BGP_MESSAGE || entry->subtype == BGPDUMP_SUBTYPE_ZEBRA_BGP_MESSAGE_AS4 ||
+			          entry->subtype == BGPDUMP_SUBTYPE_ZEBRA_BGP_MESSAGE_LOCAL || entry->subtype == BGPDUMP_SUBTYPE_ZEBRA_BGP_MESSAGE_AS4_LOCAL))
+			{
+				UpdateEvents(entry, &event, fpCallback, pContext, &ulEvents);
+			}
+			else if (entry->type == BGPDUMP_TYPE_ZEBRA_BGP &&
+			         (entry->subtype == BGPDUMP_SUBTYPE_ZEBRA_BGP_STATE_CHANGE || entry->subtype == BGPDUMP_SUBTYPE_ZEBRA_BGP_STATE_CHANGE_AS4))
+			{
+				StateChangeEvent(entry, &event, fpCallback, pContext, &ulEvents);
+			}
+			bgpdump_free_mem(entry);
+		}
+	} while (!dumpfile->eof);
+
+	bgpdump_close_dump(dumpfile);
+
+	return ulEvents;
+}
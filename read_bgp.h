@@ -18,6 +18,8 @@
 #ifndef __READ_BGP_H__
 #define __READ_BGP_H__
 
+#include <stdint.h>
+
 struct tagROUTEENTRY;
 
 typedef struct tagPREFIXES {
@@ -28,4 +30,21 @@ typedef struct tagPREFIXES {
 
 PPREFIXES ReadFromBgpDump(char *filename);
 
+/* One path of a TABLE_DUMP_V2 RIB entry, one IPv4 prefix of a BGP4MP UPDATE, or a BGP4MP
+   session leaving Established, which withdraws every path of the peer */
+typedef struct tagBGPEVENT {
+  uint64_t     u64TimeMs;     /* Unix time of the record in milliseconds */
+  uint32_t     u32Prefix;     /* Host order */
+  unsigned int uLength;
+  int          bWithdraw;
+  int          bPeerDown;     /* No prefix, bWithdraw is set too */
+  uint32_t     u32Peer;       /* RIB peer index, UPDATE peers are matched to it by address */
+  uint32_t     u32Gateway;    /* Host order, announcements only */
+  unsigned int uPathLength;   /* AS path length, announcements only */
+} BGPEVENT, *PBGPEVENT;
+
+typedef void (*BGPEVENTCALLBACK)(const BGPEVENT *pEvent, void *pContext);
+
+unsigned long ReadBgpEvents(char *filename, BGPEVENTCALLBACK fpCallback, void *pContext);
+
 #endif /* __READ_BGP_H__ */
\ No newline at end of file
@@ -0,0 +1,72 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "routing_table_split.h"
+#include "result_table.h"
+
+void ResultTableAlloc(PRESULTTABLE pTable, unsigned int uNumResults)
+{
+  /* Allocate at least one entry, so an empty table still has valid arrays */
+  size_t uAlloc = uNumResults ? uNumResults : 1;
+
+  pTable->uNumResults = uNumResults;
+  pTable->pu32Start   = malloc(uAlloc * sizeof(*pTable->pu32Start));
+  pTable->pu8Length   = malloc(uAlloc * sizeof(*pTable->pu8Length));
+  pTable->pu32NextHop = malloc(uAlloc * sizeof(*pTable->pu32NextHop));
+
+  if (!pTable->pu32Start || !pTable->pu8Length || !pTable->pu32NextHop)
+  {
+    printf("Can't allocate result table\n");
+    exit(1);
+  }
+}
+
+/* Copies what forwarding needs out of the next hop array, leaving the list links behind */
+void ResultTableBuild(PRESULTTABLE pTable, PROUTEENTRY pNextHops, unsigned int uNumPrefixes)
+{
+  unsigned int uIndex = 0;
+
+  ResultTableAlloc(pTable, uNumPrefixes);
+
+  for (uIndex = 0; uIndex < uNumPrefixes; uIndex++)
+  {
+    pTable->pu32Start[uIndex]   = pNextHops[uIndex].u32Start;
+    pTable->pu8Length[uIndex]   = 32 - __builtin_ctzll(pNextHops[uIndex].u32Size ? pNextHops[uIndex].u32Size : (1ULL << 32));
+    pTable->pu32NextHop[uIndex] = pNextHops[uIndex].u32PathList;
+  }
+}
+
+size_t ResultTableBytes(PRESULTTABLE pTable)
+{
+  return (size_t)pTable->uNumResults * RESULT_TABLE_ENTRY_BYTES;
+}
+
+void ResultTableFree(PRESULTTABLE pTable)
+{
+  free(pTable->pu32Start);
+  free(pTable->pu8Length);
+  free(pTable->pu32NextHop);
+
+  pTable->pu32Start   = NULL;
+  pTable->pu8Length   = NULL;
+  pTable->pu32NextHop = NULL;
+  pTable->uNumResults = 0;
+}
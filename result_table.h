@@ -0,0 +1,43 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RESULT_TABLE_H__
+#define __RESULT_TABLE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "routing_table_split.h"
+
+/* Forwarding data of every prefix, indexed by the result index lookups return. One array per
+   field, so a caller that only wants the next hop only touches that array. */
+typedef struct tagRESULTTABLE
+{
+  unsigned int uNumResults;
+  uint32_t    *pu32Start;    /* First address of the prefix */
+  uint8_t     *pu8Length;    /* Prefix length */
+  uint32_t    *pu32NextHop;  /* Next hop ID, the path list of the prefix (see nexthop.h) */
+} RESULTTABLE, *PRESULTTABLE;
+
+#define RESULT_TABLE_ENTRY_BYTES    (sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint32_t))
+#define RESULT_TABLE_NEXT_HOP_BYTES (sizeof(uint32_t))   /* All that forwarding reads, pu32NextHop */
+
+void   ResultTableAlloc(PRESULTTABLE pTable, unsigned int uNumResults);
+void   ResultTableBuild(PRESULTTABLE pTable, PROUTEENTRY pNextHops, unsigned int uNumPrefixes);
+size_t ResultTableBytes(PRESULTTABLE pTable);
+void   ResultTableFree(PRESULTTABLE pTable);
+
+#endif /* __RESULT_TABLE_H__ */
@@ -29,11 +29,13 @@
 #include "read_bgp.h"
 #include "linked_list.h"
 #include "lulea_trie.h"
+#include "profile.h"
 
 TREENODE root;
 
 static PROUTEENTRY  pNextHops;   /* Next hop array */
 static unsigned int uNextHopIndex = 0;
+static size_t       uTreeBytes    = 0;   /* Nodes and leaf routes currently allocated */
 
 void PrintIP(uint32_t u32IP)
 {
@@ -70,6 +72,7 @@ int InsertIntoPrefixTreeRecurse(PTREENODE pTreeStart, unsigned int uLevel, unsig
              the 3 nodes will (almost) fit within a 64 byte cache line,
              making it faster to traverse down the tree. */
           pIterate->pRight = calloc(1, sizeof(TREENODE) * 3);
+          uTreeBytes += sizeof(TREENODE) * 3;
         }
         else
         {
@@ -88,6 +91,7 @@ int InsertIntoPrefixTreeRecurse(PTREENODE pTreeStart, unsigned int uLevel, unsig
         if ((uLevel % 2) == 0)
         {
           pIterate->pLeft = calloc(1, sizeof(TREENODE) * 3);
+          uTreeBytes += sizeof(TREENODE) * 3;
         }
         else
         {
@@ -132,6 +136,7 @@ int InsertIntoPrefixTreeRecurse(PTREENODE pTreeStart, unsigned int uLevel, unsig
       printf("Couldn't allocate route\n");
       exit(1);
     }
+    uTreeBytes += sizeof(*pIterate->pRoute);
     pIterate->pRoute->u32Start = pRoute->u32Start;
     pIterate->pRoute->u32Size = pRoute->u32Size;
     pIterate->pRoute->u32NextHopIndex = pRouteEntry->u32NextHopIndex;
@@ -151,21 +156,46 @@ void FreePrefixTreeRecurse(PTREENODE pTreeNode, unsigned int uLevel)
     FreePrefixTreeRecurse(pTreeNode->pRight, uLevel + 1);
   }
 
-  free(pTreeNode->pRoute);
+  if (pTreeNode->pRoute)
+  {
+    free(pTreeNode->pRoute);
+    uTreeBytes -= sizeof(*pTreeNode->pRoute);
+  }
 
   if (uLevel % 2 == 1)
   {
     free(pTreeNode);
+    uTreeBytes -= sizeof(TREENODE) * 3;
   }
 }
 
+void FreePrefixTreeAt(PTREENODE pTreeRoot)
+{
+  if (pTreeRoot->pLeft)
+  {
+    FreePrefixTreeRecurse(pTreeRoot->pLeft, 1);
+  }
+  if (pTreeRoot->pRight)
+  {
+    FreePrefixTreeRecurse(pTreeRoot->pRight, 1);
+  }
+
+  pTreeRoot->pLeft  = NULL;
+  pTreeRoot->pRight = NULL;
+}
+
 void FreePrefixTree(void)
 {
-  FreePrefixTreeRecurse(root.pLeft, 1);
-  FreePrefixTreeRecurse(root.pRight, 1);
+  ProfileBegin(PROFILE_FREE_PREFIX_TREE);
 
-  root.pLeft  = NULL;
-  root.pRight = NULL;
+  FreePrefixTreeAt(&root);
+
+  ProfileEnd(PROFILE_FREE_PREFIX_TREE);
+}
+
+size_t PrefixTreeBytes(void)
+{
+  return uTreeBytes;
 }
 
 int InsertIntoPrefixTree(PROUTEENTRY pRoute)
@@ -173,9 +203,21 @@ int InsertIntoPrefixTree(PROUTEENTRY pRoute)
   return InsertIntoPrefixTreeRecurse(&root, 0, 0x80000000, pRoute, pRoute);
 }
 
-PROUTEENTRY LookupInTree(uint32_t u32IP)
+/* Same as InsertIntoPrefixTree() for a tree other than root. Insert narrowest routes first. */
+int InsertIntoPrefixTreeAt(PTREENODE pTreeRoot, PROUTEENTRY pRoute)
 {
-  PTREENODE    pIterate     = &root;
+  return InsertIntoPrefixTreeRecurse(pTreeRoot, 0, 0x80000000, pRoute, pRoute);
+}
+
+/* Returns the pNextHops index of the prefix matching u32IP, NO_NEXT_HOP if none */
+uint32_t LookupInTreeIndex(uint32_t u32IP)
+{
+  return LookupInTreeIndexAt(&root, u32IP);
+}
+
+uint32_t LookupInTreeIndexAt(PTREENODE pTreeRoot, uint32_t u32IP)
+{
+  PTREENODE    pIterate     = pTreeRoot;
   unsigned int uMask        = 0x80000000;
 
 
@@ -183,8 +225,7 @@ PROUTEENTRY LookupInTree(uint32_t u32IP)
   {
     if (pIterate->pRoute)
     {
-      //return pIterate->pRoute;
-      return &pNextHops[pIterate->pRoute->u32NextHopIndex];
+      return pIterate->pRoute->u32NextHopIndex;
     }
 
     if (u32IP & uMask)
@@ -199,7 +240,36 @@ PROUTEENTRY LookupInTree(uint32_t u32IP)
     uMask >>= 1;
   }
 
-  return NULL;
+  return NO_NEXT_HOP;
+}
+
+PROUTEENTRY LookupInTree(uint32_t u32IP)
+{
+  uint32_t u32Index = LookupInTreeIndex(u32IP);
+
+  return u32Index == NO_NEXT_HOP ? NULL : &pNextHops[u32Index];
+}
+
+/* In order walk, so ranges come out sorted by address. Returns 0 if the callback stopped the walk. */
+int WalkPrefixTree(PTREENODE pTreeNode, RANGECALLBACK fpCallback, void *pContext)
+{
+  if (pTreeNode->pLeft && !WalkPrefixTree(pTreeNode->pLeft, fpCallback, pContext))
+  {
+    return 0;
+  }
+
+  if (pTreeNode->pRoute &&
+      !fpCallback(pTreeNode->pRoute->u32Start, pTreeNode->pRoute->u32Size, pTreeNode->pRoute->u32NextHopIndex, pContext))
+  {
+    return 0;
+  }
+
+  if (pTreeNode->pRight && !WalkPrefixTree(pTreeNode->pRight, fpCallback, pContext))
+  {
+    return 0;
+  }
+
+  return 1;
 }
 
 #ifdef DEBUG
@@ -220,6 +290,8 @@ void LinkedListToTree(PROUTEENTRY pHead)
 {
   PROUTEENTRY pTmp = NULL;
 
+  ProfileBegin(PROFILE_LINKED_LIST_TO_TREE);
+
   while (pHead)
   {
     pNextHops[uNextHopIndex] = *pHead;
@@ -235,83 +307,54 @@ void LinkedListToTree(PROUTEENTRY pHead)
     free(pHead);
     pHead = pTmp;
   }
+
+  ProfileEnd(PROFILE_LINKED_LIST_TO_TREE);
 }
 
-void QueryTree(PROUTEENTRY pNextHops)
+/* Inserts all routes into the radix tree and returns the next hop array.
+   Start with the narrowest routes and continue with wider routes, so that
+   wider routes will be split and the parts covering narrower routes removed. */
+PROUTEENTRY BuildPrefixTree(PPREFIXES pPrefixes)
 {
-  char achBuffer[256];
-  struct in_addr ipAddr;
-  uint32_t u32IP;
-  PROUTEENTRY pRoute = NULL;
+  uint32_t u32Index = 0;
 
-
-  printf("Enter IPv4 to query for route:\n");
-
-  while (1)
+  uNextHopIndex = 0;
+  pNextHops = malloc(sizeof(*pNextHops) * pPrefixes->uTotalPrefixes);
+  if (!pNextHops)
   {
-    fgets(achBuffer, sizeof(achBuffer), stdin);
-    achBuffer[255] = '\0';
-
-    if (!strcmp(achBuffer, "quit"))
-    {
-      exit(EXIT_SUCCESS);
-    }
-
-    inet_aton(achBuffer, &ipAddr);
-    u32IP = ntohl(ipAddr.s_addr);
-
-#ifdef DEBUG
-    pRoute = LookupInTree(u32IP);
-    if (pRoute)
-    {
-      printf ("Tree: Found route of size %u!\n", pRoute->u32Size);
-      PrintIP(pRoute->u32Start);
-    }
-    else
-    {
-      printf("Tree: Did not find route!\n");
-    }
-#endif
-
-    pRoute = LuleaTrieLookup(u32IP, pNextHops);
-    if (pRoute)
-    {
-      printf ("Luleå: Found route of size %u!\n", pRoute->u32Size);
-      PrintIP(pRoute->u32Start);
-    }
-    else
-    {
-      printf("Luleå: Did not find route!\n");
-    }
+    printf("Can't allocate nexthop array\n");
+    exit(1);
+  }
 
+  for (u32Index = 32; u32Index != UINT32_MAX; u32Index--)
+  {
+    LinkedListToTree(pPrefixes->pPrefixes[u32Index]);
+    pPrefixes->pPrefixes[u32Index] = NULL;
   }
+
+  return pNextHops;
 }
 
-#ifdef DEBUG
-int VerifyLulea(PROUTEENTRY pNextHops)
+/* Builds a second radix tree under pTreeRoot from an array BuildPrefixTree() returned, leaving
+   out prefixes smaller than u32MinSize addresses. The array is ordered narrowest first, so wider
+   routes are split around the narrower ones the same way. Free it with FreePrefixTreeAt(). */
+void BuildPrefixTreeFrom(PTREENODE pTreeRoot, PROUTEENTRY pNextHops, unsigned int uNumPrefixes, uint32_t u32MinSize)
 {
-  uint32_t u32IP = 0;
+  unsigned int uIndex = 0;
 
-  printf ("Starting luleå trie verification now..\n");
-
-  for (u32IP = 0; u32IP < UINT32_MAX; u32IP++)
+  for (uIndex = 0; uIndex < uNumPrefixes; uIndex++)
   {
-    PROUTEENTRY pRouteTree  = NULL;
-    PROUTEENTRY pRouteLulea = NULL;
-
-    pRouteTree = LookupInTree(u32IP);
-    pRouteLulea = LuleaTrieLookup(u32IP, pNextHops);
+    ROUTEENTRY route = pNextHops[uIndex];
 
-    if (pRouteTree != pRouteLulea)
+    if (route.u32Size < u32MinSize)
     {
-      printf("Mismatch!\n");
-      PrintIP(u32IP);
+      continue;
     }
-  }
 
-  printf("done..\n");
+    route.u32NextHopIndex = uIndex;
+    InsertIntoPrefixTreeRecurse(pTreeRoot, 0, 0x80000000, &route, &route);
+  }
 }
-#endif
 
 void timediff(struct timespec *sooner, struct timespec *later, struct timespec *result)
 {       
@@ -330,105 +373,3 @@ void timediff(struct timespec *sooner, struct timespec *later, struct timespec *
   result->tv_sec = later->tv_sec - carry - sooner->tv_sec;
 }       
 
-#define BENCHMARK_IPS (100000)
-void Benchmark(void)
-{
-  struct       timespec  sooner;
-  struct       timespec  later;
-  struct       timespec  diff;
-  uint32_t    *pu32IPs = NULL;
-  unsigned int uIndex  = 0;
-
-
-  pu32IPs = calloc(BENCHMARK_IPS, sizeof(*pu32IPs));
-  if (!pu32IPs)
-  {
-    printf("Can't allocate benchmark IP list\n");
-    exit(1);
-  }
-
-  /* Always use the same seed so that benchmark is reproducible. */
-  srand(100);
-  for (uIndex = 0; uIndex < BENCHMARK_IPS; uIndex++)
-  {
-    pu32IPs[uIndex] = rand();
-  }
-
-  clock_gettime(CLOCK_MONOTONIC, &sooner);
-  for (uIndex = 0; uIndex < BENCHMARK_IPS; uIndex++)
-  {
-    LookupInTree(pu32IPs[uIndex]);
-  }
-  clock_gettime(CLOCK_MONOTONIC, &later);
-  timediff(&sooner, &later, &diff);
-  printf("Benchmark: %d Lookups in radix trie took %ld sec %ld nanosec\n", BENCHMARK_IPS, diff.tv_sec, diff.tv_nsec);
-
-  clock_gettime(CLOCK_MONOTONIC, &sooner);
-  for (uIndex = 0; uIndex < BENCHMARK_IPS; uIndex++)
-  {
-    LuleaTrieLookup(pu32IPs[uIndex], pNextHops);
-  }
-  clock_gettime(CLOCK_MONOTONIC, &later);
-  timediff(&sooner, &later, &diff);
-  printf("Benchmark: %d Lookups in luleå trie took %ld sec %ld nanosec\n", BENCHMARK_IPS, diff.tv_sec, diff.tv_nsec);
-
-  free(pu32IPs);
-}
-
-int main(int argc, char **argv)
-{
-  PPREFIXES pPrefixes = NULL;
-  uint32_t  u32Index  = 0;
-  struct    timespec  sooner;
-  struct    timespec  later;
-  struct    timespec  diff;
-
-  if (argc < 2)
-  {
-    printf("Usage: %s <bgp dump file>\n", argv[0]);
-    exit(1);
-  }
-
-  printf("Reading BGP from file\n");
-  pPrefixes = ReadFromBgpDump(argv[1]);
-  printf("done..\n");
-
-  pNextHops = malloc(sizeof(*pNextHops) * pPrefixes->uTotalPrefixes);
-  if (!pNextHops)
-  {
-    printf("Can't allocate nexthop array\n");
-    exit(1);
-  }
-
-  clock_gettime(CLOCK_MONOTONIC, &sooner);
-  /* Insert routes from linked lists into radix tree.
-     Start with the narrowest routes and continue with wider routes, so that
-     wider routes will be split and the parts covering narrower routes removed. */
-  for (u32Index = 32; u32Index != UINT32_MAX; u32Index--)
-  {
-    printf("%u prefixes at level %u\n", pPrefixes->uNumPrefixes[u32Index], u32Index);
-    LinkedListToTree(pPrefixes->pPrefixes[u32Index]);    
-  }
-  clock_gettime(CLOCK_MONOTONIC, &later);
-  timediff(&sooner, &later, &diff);
-  printf("Building radix took %ld sec %ld nanosec\n", diff.tv_sec, diff.tv_nsec);
-
-  printf("Building luleå trie now..\n");
-  clock_gettime(CLOCK_MONOTONIC, &sooner);
-  BuildLuleaTrie(&root, pNextHops, pPrefixes->uTotalPrefixes);
-  clock_gettime(CLOCK_MONOTONIC, &later);
-  printf("done.\n");
-  timediff(&sooner, &later, &diff);
-  printf("Building luleå trie took %ld sec %ld nanosec\n", diff.tv_sec, diff.tv_nsec);
-
-  Benchmark();
-#ifdef DEBUG
-  VerifyLulea(pNextHops);
-#endif
-
-#ifndef DEBUG
-  FreePrefixTree();
-#endif
-
-  QueryTree(pNextHops);
-}
\ No newline at end of file
@@ -19,6 +19,9 @@
 #define __ROUTING_TABLE_SPLIT_H__
 
 #include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "read_bgp.h"
 
 typedef struct tagROUTEENTRY
 {
@@ -26,6 +29,8 @@ typedef struct tagROUTEENTRY
     uint32_t u32Size;
 
     uint32_t u32NextHopIndex;
+    uint32_t u32PathList;  /* Paths the prefix was learned over, see nexthop.h */
+    uint32_t u32Group;     /* ECMP group of its equally good paths */
 
     struct tagROUTEENTRY *pNext, *pPrev;
 } ROUTEENTRY, *PROUTEENTRY;
@@ -41,6 +46,22 @@ typedef struct tagTREENODE
 
 } TREENODE, *PTREENODE;
 
-void PrintIP(uint32_t u32IP);
+/* Called for every disjoint range in the radix tree, in address order */
+typedef int (*RANGECALLBACK)(uint32_t u32Start, uint32_t u32Size, uint32_t u32NextHopIndex, void *pContext);
+
+extern TREENODE root;
+
+void        PrintIP(uint32_t u32IP);
+PROUTEENTRY BuildPrefixTree(PPREFIXES pPrefixes);
+PROUTEENTRY LookupInTree(uint32_t u32IP);
+uint32_t    LookupInTreeIndex(uint32_t u32IP);
+uint32_t    LookupInTreeIndexAt(PTREENODE pTreeRoot, uint32_t u32IP);
+int         InsertIntoPrefixTreeAt(PTREENODE pTreeRoot, PROUTEENTRY pRoute);
+void        BuildPrefixTreeFrom(PTREENODE pTreeRoot, PROUTEENTRY pNextHops, unsigned int uNumPrefixes, uint32_t u32MinSize);
+void        FreePrefixTree(void);
+void        FreePrefixTreeAt(PTREENODE pTreeRoot);
+size_t      PrefixTreeBytes(void);
+int         WalkPrefixTree(PTREENODE pTreeNode, RANGECALLBACK fpCallback, void *pContext);
+void        timediff(struct timespec *sooner, struct timespec *later, struct timespec *result);
 
 #endif /* __ROUTING_TABLE_SPLIT_H__ */
\ No newline at end of file
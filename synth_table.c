@@ -0,0 +1,242 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "routing_table_split.h"
+#include "linked_list.h"
+#include "benchmark.h"
+#include "nexthop.h"
+#include "synth_table.h"
+
+static const char *apszProfileNames[SYNTHPROFILE_MAX] = { "internet", "hosts", "deagg24" };
+
+/* Share of each prefix length in the IPv4 DFZ, in hundredths of a percent. Roughly the RIS
+   tables of the early 2020s: two thirds /24s, then /22, /23, /21 and /20. */
+static const unsigned int auInternetWeights[33] =
+{
+  0, 0, 0, 0, 0, 0, 0, 0,
+  2, 2, 4, 8, 15, 30, 50, 60,             /* /8 - /15 */
+  140, 80, 120, 240, 380, 460, 1050, 860, /* /16 - /23 */
+  6450, 5, 5, 5, 5, 5, 5, 2,              /* /24 - /31 */
+  30                                      /* /32 */
+};
+
+/* Unicast space the prefixes are spread over, 1.0.0.0 up to multicast */
+#define SYNTH_FIRST_ADDRESS (0x01000000U)
+#define SYNTH_LAST_ADDRESS  (0xDFFFFFFFU)
+
+const char *SynthProfileName(SYNTHPROFILE eProfile)
+{
+  return eProfile < SYNTHPROFILE_MAX ? apszProfileNames[eProfile] : "unknown";
+}
+
+int SynthProfileFromName(const char *pszName)
+{
+  int iIndex = 0;
+
+  for (iIndex = 0; iIndex < SYNTHPROFILE_MAX; iIndex++)
+  {
+    if (!strcmp(pszName, apszProfileNames[iIndex]))
+    {
+      return iIndex;
+    }
+  }
+
+  return -1;
+}
+
+static unsigned int RandomLength(SYNTHPROFILE eProfile, uint64_t *pu64State)
+{
+  unsigned int uTotal  = 0;
+  unsigned int uPick   = 0;
+  unsigned int uLength = 0;
+
+  if (eProfile == SYNTHPROFILE_DEAGG24)
+  {
+    return 24;
+  }
+  if (eProfile == SYNTHPROFILE_HOSTS && (BenchRandom(pu64State) & 1))
+  {
+    return 32;
+  }
+
+  for (uLength = 0; uLength <= 32; uLength++)
+  {
+    uTotal += auInternetWeights[uLength];
+  }
+  uPick = BenchRandom(pu64State) % uTotal;
+  for (uLength = 0; uPick >= auInternetWeights[uLength]; uLength++)
+  {
+    uPick -= auInternetWeights[uLength];
+  }
+
+  return uLength;
+}
+
+/* Open addressing set of start and length, so every generated prefix is distinct */
+static int AddUnique(uint64_t *pu64Set, uint64_t u64Mask, uint32_t u32Start, unsigned int uLength)
+{
+  uint64_t u64Key  = ((uint64_t)uLength << 32 | u32Start) + 1;
+  uint64_t u64Slot = (u64Key * 0x9E3779B97F4A7C15ULL) & u64Mask;
+
+  while (pu64Set[u64Slot])
+  {
+    if (pu64Set[u64Slot] == u64Key)
+    {
+      return 0;
+    }
+    u64Slot = (u64Slot + 1) & u64Mask;
+  }
+  pu64Set[u64Slot] = u64Key;
+
+  return 1;
+}
+
+static void AddPrefix(PPREFIXES pPrefixes, uint32_t u32Start, uint32_t u32Size, unsigned int uLength,
+                      uint32_t u32PathList, uint32_t u32Group)
+{
+  PROUTEENTRY pEntry = calloc(1, sizeof(*pEntry));
+
+  if (!pEntry)
+  {
+    printf("Out of memory!\n");
+    exit(1);
+  }
+
+  pEntry->u32Start        = u32Start;
+  pEntry->u32Size         = u32Size;
+  pEntry->u32NextHopIndex = NO_NEXT_HOP;
+  pEntry->u32PathList     = u32PathList;
+  pEntry->u32Group        = u32Group;
+
+  InsertIntoLinkedList(&pPrefixes->pPrefixes[uLength], pEntry);
+  pPrefixes->uNumPrefixes[uLength]++;
+  pPrefixes->uTotalPrefixes++;
+}
+
+/* Paths over distinct random peers, best first. The best path ties with the second one a
+   quarter of the time, those prefixes get a two member ECMP group. */
+static void RandomPaths(const SYNTHCONFIG *pConfig, const uint32_t *pu32Adjacencies, uint64_t *pu64State,
+                        uint32_t *pu32PathList, uint32_t *pu32Group)
+{
+  uint32_t     au32Paths[NEXTHOP_MAX_PATHS];
+  unsigned int uNumPaths = 1 + BenchRandom(pu64State) % pConfig->uMaxPaths;
+  unsigned int uPath     = 0;
+
+  if (uNumPaths > pConfig->uNumNextHops)
+  {
+    uNumPaths = pConfig->uNumNextHops;
+  }
+
+  for (uPath = 0; uPath < uNumPaths; uPath++)
+  {
+    unsigned int uOther = 0;
+
+    au32Paths[uPath] = pu32Adjacencies[BenchRandom(pu64State) % pConfig->uNumNextHops];
+    for (uOther = 0; uOther < uPath; uOther++)
+    {
+      if (au32Paths[uOther] == au32Paths[uPath])
+      {
+        /* Retry this path */
+        uPath--;
+        break;
+      }
+    }
+  }
+
+  *pu32PathList = NextHopAddPathList(au32Paths, uNumPaths);
+  *pu32Group    = NextHopAddGroup(au32Paths, uNumPaths > 1 && (BenchRandom(pu64State) & 3) == 0 ? 2 : 1);
+}
+
+PPREFIXES SynthGenerateTable(const SYNTHCONFIG *pConfig)
+{
+  PPREFIXES     pPrefixes        = calloc(1, sizeof(*pPrefixes));
+  uint32_t     *pu32Adjacencies  = calloc(pConfig->uNumNextHops, sizeof(*pu32Adjacencies));
+  uint64_t     *pu64Set          = NULL;
+  uint64_t      u64Mask          = 1;
+  uint64_t      u64State         = pConfig->u64Seed;
+  uint64_t      u64Attempts      = 0;
+  unsigned int  uIndex           = 0;
+  unsigned int  uGenerated       = 0;
+  uint32_t      u32PathList      = 0;
+  uint32_t      u32Group         = 0;
+
+  if (!pPrefixes || !pu32Adjacencies || !pConfig->uNumNextHops || !pConfig->uMaxPaths ||
+      pConfig->uMaxPaths > NEXTHOP_MAX_PATHS)
+  {
+    printf("Can't generate a table with %u next hops and %u paths\n", pConfig->uNumNextHops, pConfig->uMaxPaths);
+    exit(1);
+  }
+
+  while (u64Mask < (uint64_t)pConfig->uNumPrefixes * 2)
+  {
+    u64Mask <<= 1;
+  }
+  pu64Set = calloc(u64Mask, sizeof(*pu64Set));
+  if (!pu64Set)
+  {
+    printf("Can't allocate prefix set\n");
+    exit(1);
+  }
+  u64Mask--;
+
+  for (uIndex = 0; uIndex < pConfig->uNumNextHops; uIndex++)
+  {
+    /* Peer i is reached over 10.x.y.z, where x.y.z is i + 1 */
+    pu32Adjacencies[uIndex] = NextHopAddAdjacency(uIndex, 0x0A000000U + uIndex + 1);
+  }
+
+  /* The trie needs the whole address space covered, so there is always a default route,
+     stored as two /1 halves like ReadFromBgpDump() does */
+  RandomPaths(pConfig, pu32Adjacencies, &u64State, &u32PathList, &u32Group);
+  AddPrefix(pPrefixes, 0, 0x80000000U, 0, u32PathList, u32Group);
+  AddPrefix(pPrefixes, 0x80000000U, 0x80000000U, 0, u32PathList, u32Group);
+  uGenerated = 1;
+
+  /* Give up on tables that can't exist, like more /24s than the unicast space has */
+  while (uGenerated < pConfig->uNumPrefixes && u64Attempts++ < (uint64_t)pConfig->uNumPrefixes * 8)
+  {
+    unsigned int uLength  = RandomLength(pConfig->eProfile, &u64State);
+    uint32_t     u32Mask  = 0xFFFFFFFFU << (32 - uLength);
+    uint32_t     u32Start = SYNTH_FIRST_ADDRESS +
+                            BenchRandom(&u64State) % (SYNTH_LAST_ADDRESS - SYNTH_FIRST_ADDRESS + 1);
+
+    u32Start &= u32Mask;
+    if (u32Start < SYNTH_FIRST_ADDRESS || !AddUnique(pu64Set, u64Mask, u32Start, uLength))
+    {
+      continue;
+    }
+
+    RandomPaths(pConfig, pu32Adjacencies, &u64State, &u32PathList, &u32Group);
+    AddPrefix(pPrefixes, u32Start, ~u32Mask + 1, uLength, u32PathList, u32Group);
+    uGenerated++;
+  }
+
+  if (uGenerated < pConfig->uNumPrefixes)
+  {
+    printf("Only found room for %u distinct %s prefixes\n", uGenerated, SynthProfileName(pConfig->eProfile));
+  }
+
+  free(pu64Set);
+  free(pu32Adjacencies);
+
+  return pPrefixes;
+}
@@ -0,0 +1,49 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SYNTH_TABLE_H__
+#define __SYNTH_TABLE_H__
+
+#include <stdint.h>
+#include "read_bgp.h"
+
+/* Shape of a generated table */
+typedef enum tagSYNTHPROFILE
+{
+  SYNTHPROFILE_INTERNET = 0, /* Prefix lengths distributed like the IPv4 DFZ */
+  SYNTHPROFILE_HOSTS,        /* Half of the prefixes are /32 host routes, the rest like the DFZ */
+  SYNTHPROFILE_DEAGG24,      /* Fully deaggregated, every prefix a /24 */
+  SYNTHPROFILE_MAX
+} SYNTHPROFILE;
+
+typedef struct tagSYNTHCONFIG
+{
+  SYNTHPROFILE eProfile;
+  unsigned int uNumPrefixes;   /* Including the default route */
+  unsigned int uNumNextHops;   /* Distinct adjacencies, one per peer */
+  unsigned int uMaxPaths;      /* Paths per prefix, 1 to NEXTHOP_MAX_PATHS */
+  uint64_t     u64Seed;
+} SYNTHCONFIG, *PSYNTHCONFIG;
+
+const char *SynthProfileName(SYNTHPROFILE eProfile);
+int         SynthProfileFromName(const char *pszName);
+
+/* Same result as ReadFromBgpDump(), ready for BuildPrefixTree(). Free the returned struct after
+   building, the prefixes themselves are freed by BuildPrefixTree(). */
+PPREFIXES   SynthGenerateTable(const SYNTHCONFIG *pConfig);
+
+#endif /* __SYNTH_TABLE_H__ */
@@ -0,0 +1,387 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "routing_table_split.h"
+#include "lookup_engine.h"
+#include "verify.h"
+
+#define VERIFY_BATCH (256)
+
+typedef struct tagRANGELIST
+{
+  PVERIFYRANGE pRanges;
+  unsigned int uNumRanges;
+  unsigned int uCapacity;
+} RANGELIST, *PRANGELIST;
+
+typedef struct tagVERIFYTHREAD
+{
+  pthread_t           thread;
+  uint64_t            u64Begin;        /* First address */
+  uint64_t            u64End;          /* One past the last address */
+  PRANGELIST          pRangeList;
+  const LOOKUPENGINE *pEngine;
+  FILE               *pLog;
+  unsigned int        uMaxReport;
+
+  uint64_t            u64Checked;
+  uint64_t            u64Mismatches;
+  unsigned int        uNumReported;
+  PVERIFYMISMATCH     pMismatches;
+} VERIFYTHREAD, *PVERIFYTHREAD;
+
+static int CollectRange(uint32_t u32Start, uint32_t u32Size, uint32_t u32NextHopIndex, void *pContext)
+{
+  PRANGELIST pRangeList = pContext;
+
+  if (pRangeList->uNumRanges == pRangeList->uCapacity)
+  {
+    pRangeList->uCapacity = pRangeList->uCapacity ? pRangeList->uCapacity * 2 : 65536;
+    pRangeList->pRanges   = realloc(pRangeList->pRanges, pRangeList->uCapacity * sizeof(*pRangeList->pRanges));
+    if (!pRangeList->pRanges)
+    {
+      printf("Can't allocate verification ranges\n");
+      exit(1);
+    }
+  }
+
+  pRangeList->pRanges[pRangeList->uNumRanges].u32Start        = u32Start;
+  pRangeList->pRanges[pRangeList->uNumRanges].u32Last         = u32Start + (u32Size - 1);
+  pRangeList->pRanges[pRangeList->uNumRanges].u32NextHopIndex = u32NextHopIndex;
+  pRangeList->uNumRanges++;
+
+  return 1;
+}
+
+static void BuildRangeList(PTREENODE pTreeRoot, PRANGELIST pRangeList)
+{
+  memset(pRangeList, 0, sizeof(*pRangeList));
+  WalkPrefixTree(pTreeRoot, CollectRange, pRangeList);
+}
+
+/* Index of the first range ending at or after u32IP */
+static unsigned int FindRange(PRANGELIST pRangeList, uint32_t u32IP)
+{
+  unsigned int uLow  = 0;
+  unsigned int uHigh = pRangeList->uNumRanges;
+
+  while (uLow < uHigh)
+  {
+    unsigned int uMid = uLow + (uHigh - uLow) / 2;
+
+    if (pRangeList->pRanges[uMid].u32Last < u32IP)
+    {
+      uLow = uMid + 1;
+    }
+    else
+    {
+      uHigh = uMid;
+    }
+  }
+
+  return uLow;
+}
+
+static uint32_t ExpectedNextHop(PRANGELIST pRangeList, unsigned int uRange, uint32_t u32IP)
+{
+  if (uRange < pRangeList->uNumRanges && pRangeList->pRanges[uRange].u32Start <= u32IP)
+  {
+    return pRangeList->pRanges[uRange].u32NextHopIndex;
+  }
+
+  /* Not covered by any route */
+  return NO_NEXT_HOP;
+}
+
+#define IP_FORMAT      "%u.%u.%u.%u"
+#define IP_ARGS(u32IP) (u32IP) >> 24, ((u32IP) >> 16) & 0xFF, ((u32IP) >> 8) & 0xFF, (u32IP) & 0xFF
+
+static void PrintPrefix(FILE *pLog, const char *pszWhat, uint32_t u32Start, uint32_t u32Size)
+{
+  fprintf(pLog, "  %s " IP_FORMAT "/%d\n", pszWhat, IP_ARGS(u32Start), 32 - __builtin_ctzll(u32Size ? u32Size : (1ULL << 32)));
+}
+
+static void PrintMismatch(FILE *pLog, PVERIFYMISMATCH pMismatch, PRANGELIST pRangeList, PROUTEENTRY pNextHops,
+                          const char *pszEngine)
+{
+  unsigned int uRange = FindRange(pRangeList, pMismatch->u32IP);
+
+  fprintf(pLog, "Mismatch for " IP_FORMAT "\n", IP_ARGS(pMismatch->u32IP));
+
+  if (pMismatch->u32Expected != NO_NEXT_HOP)
+  {
+    fprintf(pLog, "  radix tree range " IP_FORMAT " - " IP_FORMAT "\n", IP_ARGS(pRangeList->pRanges[uRange].u32Start),
+            IP_ARGS(pRangeList->pRanges[uRange].u32Last));
+    PrintPrefix(pLog, "expected prefix ", pNextHops[pMismatch->u32Expected].u32Start, pNextHops[pMismatch->u32Expected].u32Size);
+  }
+  else
+  {
+    fprintf(pLog, "  expected no route\n");
+  }
+
+  if (pMismatch->u32Got != NO_NEXT_HOP)
+  {
+    char achWhat[64];
+
+    snprintf(achWhat, sizeof(achWhat), "%s found", pszEngine);
+    PrintPrefix(pLog, achWhat, pNextHops[pMismatch->u32Got].u32Start, pNextHops[pMismatch->u32Got].u32Size);
+  }
+  else
+  {
+    fprintf(pLog, "  %s found no route\n", pszEngine);
+  }
+}
+
+static int CompareMismatch(const void *pA, const void *pB)
+{
+  const VERIFYMISMATCH *pMismatchA = pA;
+  const VERIFYMISMATCH *pMismatchB = pB;
+
+  return (pMismatchA->u32IP > pMismatchB->u32IP) - (pMismatchA->u32IP < pMismatchB->u32IP);
+}
+
+static void CheckAddress(PVERIFYTHREAD pThread, uint32_t u32IP, uint32_t u32Expected, uint32_t u32Got)
+{
+  pThread->u64Checked++;
+  if (u32Got == u32Expected)
+  {
+    return;
+  }
+
+  pThread->u64Mismatches++;
+  if (pThread->uNumReported < pThread->uMaxReport)
+  {
+    pThread->pMismatches[pThread->uNumReported].u32IP       = u32IP;
+    pThread->pMismatches[pThread->uNumReported].u32Expected = u32Expected;
+    pThread->pMismatches[pThread->uNumReported].u32Got      = u32Got;
+    pThread->uNumReported++;
+  }
+}
+
+static void CheckLookup(PVERIFYTHREAD pThread, uint32_t u32IP)
+{
+  unsigned int uRange = FindRange(pThread->pRangeList, u32IP);
+
+  CheckAddress(pThread, u32IP, ExpectedNextHop(pThread->pRangeList, uRange, u32IP),
+               pThread->pEngine->fpLookup(u32IP));
+}
+
+static void *VerifyThread(void *pArg)
+{
+  PVERIFYTHREAD pThread  = pArg;
+  PRANGELIST    pRanges  = pThread->pRangeList;
+  uint32_t      au32IPs[VERIFY_BATCH];
+  uint32_t      au32Results[VERIFY_BATCH];
+  uint64_t      u64IP    = 0;
+  unsigned int  uRange   = FindRange(pRanges, (uint32_t)pThread->u64Begin);
+
+  for (u64IP = pThread->u64Begin; u64IP < pThread->u64End; u64IP += VERIFY_BATCH)
+  {
+    unsigned int uCount = pThread->u64End - u64IP < VERIFY_BATCH ? pThread->u64End - u64IP : VERIFY_BATCH;
+    unsigned int uIndex = 0;
+
+    for (uIndex = 0; uIndex < uCount; uIndex++)
+    {
+      au32IPs[uIndex] = (uint32_t)(u64IP + uIndex);
+    }
+
+    pThread->pEngine->fpLookupBatch(au32IPs, au32Results, uCount);
+
+    /* Addresses are increasing, so the expected range only ever moves forward */
+    for (uIndex = 0; uIndex < uCount; uIndex++)
+    {
+      while (uRange < pRanges->uNumRanges && pRanges->pRanges[uRange].u32Last < au32IPs[uIndex])
+      {
+        uRange++;
+      }
+      CheckAddress(pThread, au32IPs[uIndex], ExpectedNextHop(pRanges, uRange, au32IPs[uIndex]), au32Results[uIndex]);
+    }
+  }
+
+  return NULL;
+}
+
+static uint64_t ReportResult(PVERIFYTHREAD pThreads, unsigned int uThreads, PRANGELIST pRangeList, PROUTEENTRY pNextHops,
+                             unsigned int uMaxReport)
+{
+  VERIFYMISMATCH *pAll        = NULL;
+  unsigned int    uNumAll     = 0;
+  unsigned int    uIndex      = 0;
+  uint64_t        u64Checked  = 0;
+  uint64_t        u64Mismatch = 0;
+
+  pAll = calloc((size_t)uThreads * uMaxReport + 1, sizeof(*pAll));
+  if (!pAll)
+  {
+    printf("Can't allocate mismatch report\n");
+    exit(1);
+  }
+
+  for (uIndex = 0; uIndex < uThreads; uIndex++)
+  {
+    u64Checked  += pThreads[uIndex].u64Checked;
+    u64Mismatch += pThreads[uIndex].u64Mismatches;
+    memcpy(pAll + uNumAll, pThreads[uIndex].pMismatches, pThreads[uIndex].uNumReported * sizeof(*pAll));
+    uNumAll += pThreads[uIndex].uNumReported;
+  }
+
+  /* Threads each kept their first mismatches, print the lowest addresses overall */
+  qsort(pAll, uNumAll, sizeof(*pAll), CompareMismatch);
+  for (uIndex = 0; uIndex < uNumAll && uIndex < uMaxReport; uIndex++)
+  {
+    PrintMismatch(pThreads[0].pLog, &pAll[uIndex], pRangeList, pNextHops, pThreads[0].pEngine->pszName);
+  }
+
+  fprintf(pThreads[0].pLog, "Verified %s on %lu addresses over %u ranges: %lu mismatches\n", pThreads[0].pEngine->pszName, u64Checked,
+          pRangeList->uNumRanges, u64Mismatch);
+
+  free(pAll);
+  return u64Mismatch;
+}
+
+static void InitThread(PVERIFYTHREAD pThread, const LOOKUPENGINE *pEngine, FILE *pLog, PRANGELIST pRangeList,
+                       unsigned int uMaxReport)
+{
+  memset(pThread, 0, sizeof(*pThread));
+  pThread->pEngine     = pEngine;
+  pThread->pLog        = pLog;
+  pThread->pRangeList  = pRangeList;
+  pThread->uMaxReport  = uMaxReport;
+  pThread->pMismatches = calloc(uMaxReport + 1, sizeof(*pThread->pMismatches));
+  if (!pThread->pMismatches)
+  {
+    printf("Can't allocate mismatch report\n");
+    exit(1);
+  }
+}
+
+/* Fast check: both ends of every disjoint range in the radix tree, the gaps between them and
+   the start of every level 1 bucket (/16) that a range covers. Returns the number of mismatches. */
+uint64_t VerifyRanges(const LOOKUPENGINE *pEngine, FILE *pLog, PTREENODE pTreeRoot, PROUTEENTRY pNextHops, unsigned int uMaxReport)
+{
+  RANGELIST    rangeList;
+  VERIFYTHREAD thread;
+  uint64_t     u64Mismatches = 0;
+  uint64_t     u64Next       = 0;  /* First address after the previous range */
+  unsigned int uIndex        = 0;
+
+  BuildRangeList(pTreeRoot, &rangeList);
+  InitThread(&thread, pEngine, pLog, &rangeList, uMaxReport);
+
+  for (uIndex = 0; uIndex < rangeList.uNumRanges; uIndex++)
+  {
+    PVERIFYRANGE pRange   = &rangeList.pRanges[uIndex];
+    uint64_t     u64Bucket = 0;
+
+    if (u64Next < pRange->u32Start)
+    {
+      CheckLookup(&thread, (uint32_t)u64Next);
+      CheckLookup(&thread, pRange->u32Start - 1);
+    }
+
+    CheckLookup(&thread, pRange->u32Start);
+    for (u64Bucket = ((uint64_t)pRange->u32Start + 0x10000) & ~0xFFFFULL; u64Bucket <= pRange->u32Last; u64Bucket += 0x10000)
+    {
+      CheckLookup(&thread, (uint32_t)u64Bucket);
+    }
+    if (pRange->u32Last != pRange->u32Start)
+    {
+      CheckLookup(&thread, pRange->u32Last);
+    }
+
+    u64Next = (uint64_t)pRange->u32Last + 1;
+  }
+
+  if (u64Next <= UINT32_MAX)
+  {
+    CheckLookup(&thread, (uint32_t)u64Next);
+    CheckLookup(&thread, UINT32_MAX);
+  }
+
+  u64Mismatches = ReportResult(&thread, 1, &rangeList, pNextHops, uMaxReport);
+
+  free(thread.pMismatches);
+  free(rangeList.pRanges);
+
+  return u64Mismatches;
+}
+
+/* Every address from 0.0.0.0 to 255.255.255.255 through the batch lookup path, split over
+   uThreads threads (0 for one per online core). Returns the number of mismatches. */
+uint64_t VerifyExhaustive(const LOOKUPENGINE *pEngine, FILE *pLog, PTREENODE pTreeRoot, PROUTEENTRY pNextHops,
+                          unsigned int uThreads, unsigned int uMaxReport)
+{
+  RANGELIST     rangeList;
+  PVERIFYTHREAD pThreads      = NULL;
+  uint64_t      u64Mismatches = 0;
+  uint64_t      u64Slice      = 0;
+  unsigned int  uIndex        = 0;
+
+  if (!uThreads)
+  {
+    long lCores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    uThreads = lCores > 0 ? (unsigned int)lCores : 1;
+  }
+
+  BuildRangeList(pTreeRoot, &rangeList);
+
+  pThreads = calloc(uThreads, sizeof(*pThreads));
+  if (!pThreads)
+  {
+    printf("Can't allocate verification threads\n");
+    exit(1);
+  }
+
+  u64Slice = ((1ULL << 32) + uThreads - 1) / uThreads;
+  for (uIndex = 0; uIndex < uThreads; uIndex++)
+  {
+    InitThread(&pThreads[uIndex], pEngine, pLog, &rangeList, uMaxReport);
+    pThreads[uIndex].u64Begin = uIndex * u64Slice;
+    pThreads[uIndex].u64End   = (uIndex + 1) * u64Slice < (1ULL << 32) ? (uIndex + 1) * u64Slice : (1ULL << 32);
+
+    if (pthread_create(&pThreads[uIndex].thread, NULL, VerifyThread, &pThreads[uIndex]))
+    {
+      printf("Can't start verification thread\n");
+      exit(1);
+    }
+  }
+
+  for (uIndex = 0; uIndex < uThreads; uIndex++)
+  {
+    pthread_join(pThreads[uIndex].thread, NULL);
+  }
+
+  fprintf(pLog, "Exhaustive verification on %u threads\n", uThreads);
+  u64Mismatches = ReportResult(pThreads, uThreads, &rangeList, pNextHops, uMaxReport);
+
+  for (uIndex = 0; uIndex < uThreads; uIndex++)
+  {
+    free(pThreads[uIndex].pMismatches);
+  }
+  free(pThreads);
+  free(rangeList.pRanges);
+
+  return u64Mismatches;
+}
@@ -0,0 +1,47 @@
+/* An implementation of the Luleå algorithm, slightly modified.
+ * Copyright (C) 2020 Kristoffer Brånemyr
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VERIFY_H__
+#define __VERIFY_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include "routing_table_split.h"
+#include "lookup_engine.h"
+
+#define VERIFY_DEFAULT_REPORT (20)
+
+typedef struct tagVERIFYRANGE
+{
+  uint32_t u32Start;
+  uint32_t u32Last;         /* Inclusive, so the range can end at 255.255.255.255 */
+  uint32_t u32NextHopIndex;
+} VERIFYRANGE, *PVERIFYRANGE;
+
+typedef struct tagVERIFYMISMATCH
+{
+  uint32_t u32IP;
+  uint32_t u32Expected;     /* Next hop index from the radix tree, NO_NEXT_HOP if not covered */
+  uint32_t u32Got;          /* Next hop index from the engine under test */
+} VERIFYMISMATCH, *PVERIFYMISMATCH;
+
+/* Both check pEngine against the radix tree, print mismatches to pLog and return how many there were */
+uint64_t VerifyRanges(const LOOKUPENGINE *pEngine, FILE *pLog, PTREENODE pTreeRoot, PROUTEENTRY pNextHops, unsigned int uMaxReport);
+uint64_t VerifyExhaustive(const LOOKUPENGINE *pEngine, FILE *pLog, PTREENODE pTreeRoot, PROUTEENTRY pNextHops,
+                          unsigned int uThreads, unsigned int uMaxReport);
+
+#endif /* __VERIFY_H__ */